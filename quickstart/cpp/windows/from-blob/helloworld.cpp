@@ -7,19 +7,41 @@
 #include <iostream>
 #include <strstream>
 #include <Windows.h>
-#include <locale>
-#include <codecvt>
 #include <string>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <thread>
+#include <vector>
 
 #include <cpprest/http_client.h>
+#include <cpprest/http_listener.h>
 #include <cpprest/filestream.h>
 #include <nlohmann/json.hpp>
 
+// Webhook signatures are computed with the HMAC-SHA256 of the CNG library.
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+
 using namespace std;
 using namespace utility;                    // Common utilities like string conversions
 using namespace web;                        // Common features like URIs.
 using namespace web::http;                  // Common HTTP functionality
 using namespace web::http::client;          // HTTP client features
+using namespace web::http::experimental::listener;  // HTTP server features
 using namespace concurrency::streams;       // Asynchronous streams
 using json = nlohmann::json;
 
@@ -28,7 +50,15 @@ const string_t subscriptionKey = U("YourSubscriptionKey");
 const string name = "Simple transcription";
 const string description = "Simple transcription description";
 const string myLocale = "en-US";
-const string recordingsBlobUri = "YourFileUrl";
+// Add more file URLs to transcribe them as a batch.
+const vector<string> recordingsBlobUris = { "YourFileUrl" };
+// Or replace with the URL of a storage container, with a SAS that allows listing and reading, to transcribe all of it.
+const string recordingsContainerSasUrl = "YourContainerSasUrl";
+// Replace with the public URL that forwards to the local listener, e.g. through a reverse proxy, to be notified
+// when transcriptions complete instead of polling them. The secret signs the notifications.
+const string_t webhookUrl = U("YourWebhookUrl");
+const string_t webhookListenerUrl = U("http://localhost:8080/callback");
+const string webhookSecret = "YourWebhookSecret";
 
 class TranscriptionDefinition {
 private:
@@ -52,6 +82,7 @@ public:
     string Locale;
     std::list<string> Models;
     std::map<string, string> properties;
+    std::list<string> ContentUrls;          // of a transcription of many files, submitted through the v3 API.
 
     static TranscriptionDefinition Create(string name, string description, string locale, string recordingsUrl) {
         return TranscriptionDefinition(name, description, locale, recordingsUrl, std::list<string>());
@@ -60,9 +91,23 @@ public:
         std::list<string> models) {
         return TranscriptionDefinition(name, description, locale, recordingsUrl, models);
     }
+    static TranscriptionDefinition CreateForFiles(string name, string description, string locale, std::list<string> contentUrls) {
+        auto definition = TranscriptionDefinition(name, description, locale, "", std::list<string>());
+        definition.ContentUrls = contentUrls;
+        return definition;
+    }
 };
 
 void to_json(nlohmann::json& j, const TranscriptionDefinition& t) {
+    if (!t.ContentUrls.empty()) {
+        j = nlohmann::json{
+                { "contentUrls", t.ContentUrls },
+                { "description", t.Description },
+                { "displayName", t.Name },
+                { "locale", t.Locale }
+        };
+        return;
+    }
     j = nlohmann::json{
             { "description", t.Description },
             { "locale", t.Locale },
@@ -93,6 +138,7 @@ public:
     string lastActionDateTime;
     string status;
     string statusMessage;
+    string filesUrl;                        // of a transcription of the v3 API, which lists its results there.
 };
 
 void to_json(nlohmann::json& j, const Transcription& t) {
@@ -110,6 +156,17 @@ void to_json(nlohmann::json& j, const Transcription& t) {
 };
 
 void from_json(const nlohmann::json& j, Transcription& t) {
+    if (j.contains("links")) {
+        t.name = j.value("displayName", "");
+        t.description = j.value("description", "");
+        t.locale = j.value("locale", "");
+        t.createdDateTime = j.value("createdDateTime", "");
+        j.at("status").get_to(t.status);
+        t.filesUrl = j.at("links").value("files", "");
+        auto properties = j.value("properties", nlohmann::json::object());
+        t.statusMessage = properties.contains("error") ? properties["error"].value("message", "") : "";
+        return;
+    }
     j.at("description").get_to(t.description);
     j.at("locale").get_to(t.locale);
     j.at("createdDateTime").get_to(t.createdDateTime);
@@ -151,152 +208,1795 @@ class SegmentResult
 {
 public:
     string RecognitionStatus;
-    ULONG Offset;
-    ULONG Duration;
+    uint64_t Offset;        // in ticks of 100 nanoseconds, 32 bits overflow after about 7 minutes.
+    uint64_t Duration;
     std::list<NBest> NBest;
 };
 void from_json(const nlohmann::json& j, SegmentResult& sr) {
+    // A recognized phrase of the v3 API.
+    if (j.contains("recognitionStatus")) {
+        j.at("recognitionStatus").get_to(sr.RecognitionStatus);
+        sr.Offset = j.at("offsetInTicks").get<uint64_t>();
+        sr.Duration = j.at("durationInTicks").get<uint64_t>();
+        sr.NBest.clear();
+        for (const auto& alternative : j.at("nBest")) {
+            NBest nb;
+            nb.Confidence = alternative.value("confidence", 0.0);
+            nb.Lexical = alternative.value("lexical", "");
+            nb.ITN = alternative.value("itn", "");
+            nb.MaskedITN = alternative.value("maskedITN", "");
+            nb.Display = alternative.value("display", "");
+            sr.NBest.push_back(nb);
+        }
+        return;
+    }
     j.at("RecognitionStatus").get_to(sr.RecognitionStatus);
     j.at("Offset").get_to(sr.Offset);
     j.at("Duration").get_to(sr.Duration);
     sr.NBest = j.at("NBest").get<list<NBest>>();
 }
 
-class AudioFileResult
+// Reads a results document as it arrives, and hands each segment to a callback as soon as it has been read,
+// instead of parsing the whole document into memory. Only the segment being read is kept, as a small json value.
+// Both the documents of the v2 API and those of the v3 API, one per file with its recognized phrases, are read.
+// The member functions are the ones nlohmann::json::sax_parse calls, std:: is spelled out because string() hides std::string.
+class SegmentResultStreamParser
 {
 public:
-    string AudioFileName;
-    std::list<SegmentResult> SegmentResults;
-    std::list<Result> CombinedResults;
+    using number_integer_t = nlohmann::json::number_integer_t;
+    using number_unsigned_t = nlohmann::json::number_unsigned_t;
+    using number_float_t = nlohmann::json::number_float_t;
+    using string_t = nlohmann::json::string_t;
+
+    using SegmentCallback = std::function<void(const std::string& audioFileName, const SegmentResult& segment)>;
+
+    SegmentResultStreamParser(SegmentCallback onSegment) : m_onSegment(onSegment)
+    {
+    }
+
+    // Parses a results document from 'in', and returns the number of segments read.
+    size_t Parse(std::istream& in)
+    {
+        if (!nlohmann::json::sax_parse(in, this))
+        {
+            throw std::runtime_error("Failed to parse the results: " + m_error);
+        }
+        return m_segmentCount;
+    }
+
+    bool null() { return AddValue(nullptr); }
+    bool boolean(bool value) { return AddValue(value); }
+    bool number_integer(number_integer_t value) { return AddValue(value); }
+    bool number_unsigned(number_unsigned_t value) { return AddValue(value); }
+    bool number_float(number_float_t value, const string_t&) { return AddValue(value); }
+
+    bool string(string_t& value)
+    {
+        // The name of the audio file comes before its segments.
+        if (m_captured.empty() && ((IsAudioFileLevel() && m_key == "AudioFileName") || (m_frames.size() == 1 && m_key == "source")))
+        {
+            m_audioFileName = value;
+            return true;
+        }
+        return AddValue(value);
+    }
+
+    // Binary values only come from the binary formats, never from a results document.
+    template<typename BinaryType>
+    bool binary(BinaryType&)
+    {
+        return true;
+    }
+
+    bool key(string_t& value)
+    {
+        m_key = value;
+        return true;
+    }
+
+    bool start_object(std::size_t)
+    {
+        if (!m_captured.empty())
+        {
+            m_captured.push_back(Add(nlohmann::json::object()));
+        }
+        else if (IsSegmentLevel())
+        {
+            m_segment = nlohmann::json::object();
+            m_captured.push_back(&m_segment);
+        }
+        else
+        {
+            PushFrame(false);
+        }
+        return true;
+    }
+
+    bool end_object()
+    {
+        if (m_captured.empty())
+        {
+            m_frames.pop_back();
+            return true;
+        }
+
+        m_captured.pop_back();
+        if (m_captured.empty())
+        {
+            SegmentResult segment = m_segment;
+            m_segment = nullptr;
+            m_segmentCount++;
+            m_onSegment(m_audioFileName, segment);
+        }
+        return true;
+    }
+
+    bool start_array(std::size_t)
+    {
+        if (!m_captured.empty())
+        {
+            m_captured.push_back(Add(nlohmann::json::array()));
+        }
+        else
+        {
+            PushFrame(true);
+        }
+        return true;
+    }
+
+    bool end_array()
+    {
+        if (!m_captured.empty())
+        {
+            m_captured.pop_back();
+        }
+        else
+        {
+            m_frames.pop_back();
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e)
+    {
+        m_error = e.what();
+        return false;
+    }
+
+private:
+    // A container outside of the segments, with the key it is the value of.
+    struct Frame
+    {
+        bool IsArray;
+        std::string Key;
+    };
+
+    void PushFrame(bool isArray)
+    {
+        auto inArray = !m_frames.empty() && m_frames.back().IsArray;
+        m_frames.push_back(Frame{ isArray, inArray ? "" : m_key });
+    }
+
+    // Checks whether the parser is in an element of AudioFileResults.
+    bool IsAudioFileLevel() const
+    {
+        return m_frames.size() == 3 && m_frames[1].Key == "AudioFileResults";
+    }
+
+    // Checks whether the parser is in the SegmentResults array of an element of AudioFileResults,
+    // or in the recognizedPhrases array of a v3 document.
+    bool IsSegmentLevel() const
+    {
+        return (m_frames.size() == 4 && m_frames[1].Key == "AudioFileResults" && m_frames[3].Key == "SegmentResults")
+            || (m_frames.size() == 2 && m_frames[1].Key == "recognizedPhrases");
+    }
+
+    // Adds a value to the segment being read, values outside of the segments are skipped.
+    bool AddValue(nlohmann::json value)
+    {
+        if (!m_captured.empty())
+        {
+            Add(std::move(value));
+        }
+        return true;
+    }
+
+    nlohmann::json* Add(nlohmann::json value)
+    {
+        auto parent = m_captured.back();
+        if (parent->is_object())
+        {
+            auto& slot = (*parent)[m_key];
+            slot = std::move(value);
+            return &slot;
+        }
+        parent->push_back(std::move(value));
+        return &parent->back();
+    }
+
+    SegmentCallback m_onSegment;
+    std::vector<Frame> m_frames;
+    std::vector<nlohmann::json*> m_captured;
+    nlohmann::json m_segment;
+    std::string m_key;
+    std::string m_audioFileName;
+    std::string m_error;
+    size_t m_segmentCount = 0;
 };
-void from_json(const nlohmann::json& j, AudioFileResult& arf) {
-    j.at("AudioFileName").get_to(arf.AudioFileName);
-    arf.SegmentResults = j.at("SegmentResults").get<list<SegmentResult>>();
-    arf.CombinedResults = j.at("CombinedResults").get<list<Result>>();
-}
 
-class RootObject {
+// Exposes the body of an http response as a std::streambuf, reading it in chunks as it arrives.
+class HttpBodyStreamBuffer : public std::streambuf
+{
 public:
-    std::list<AudioFileResult> AudioFileResults;
+    HttpBodyStreamBuffer(concurrency::streams::istream body, size_t chunkSize = 64 * 1024)
+        : m_body(body), m_chunk(chunkSize)
+    {
+    }
+
+protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr())
+        {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        auto size = m_body.streambuf().getn((uint8_t*)m_chunk.data(), m_chunk.size()).get();
+        if (size == 0)
+        {
+            return traits_type::eof();
+        }
+        setg(m_chunk.data(), m_chunk.data(), m_chunk.data() + size);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    concurrency::streams::istream m_body;
+    std::vector<char> m_chunk;
 };
-void from_json(const nlohmann::json& j, RootObject& r) {
-    r.AudioFileResults = j.at("AudioFileResults").get<list<AudioFileResult>>();
-}
 
+// Keeps each distinct string once, in one contiguous buffer, and refers to it by a 32-bit id.
+class StringArena
+{
+public:
+    // Gets the id of 'text', adding it if it isn't there yet.
+    uint32_t Intern(const string& text)
+    {
+        auto hash = std::hash<string>()(text);
+        auto range = m_index.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            auto& entry = m_entries[it->second];
+            if (entry.Length == text.size() && m_data.compare(entry.Offset, entry.Length, text) == 0)
+            {
+                return it->second;
+            }
+        }
 
-void recognizeSpeech()
+        auto id = (uint32_t)m_entries.size();
+        m_entries.push_back(Entry{ m_data.size(), (uint32_t)text.size() });
+        m_data.append(text);
+        m_index.emplace(hash, id);
+        return id;
+    }
+
+    // Gets the string of an id, valid until the next Intern().
+    const char* Data(uint32_t id) const { return m_data.data() + m_entries[id].Offset; }
+    uint32_t Length(uint32_t id) const { return m_entries[id].Length; }
+    string Get(uint32_t id) const { return m_data.substr(m_entries[id].Offset, m_entries[id].Length); }
+
+    // Gets the number of bytes used by the strings and their index.
+    size_t MemoryBytes() const
+    {
+        return m_data.capacity() + m_entries.capacity() * sizeof(Entry) + m_index.size() * (sizeof(size_t) + sizeof(uint32_t) + 2 * sizeof(void*));
+    }
+
+private:
+    struct Entry
+    {
+        size_t Offset;
+        uint32_t Length;
+    };
+
+    string m_data;
+    vector<Entry> m_entries;
+    unordered_multimap<size_t, uint32_t> m_index;
+};
+
+// Keeps batch transcription segments in columns: one contiguous vector per field, with the texts interned in a string arena.
+// Only the best alternative of each segment is kept. Aggregations over millions of segments only touch the columns they need.
+class ColumnarResultStore
 {
-    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t >> converter;
+public:
+    void Add(const string& audioFileName, const SegmentResult& segment)
+    {
+        m_files.push_back(m_strings.Intern(audioFileName));
+        m_statuses.push_back(m_strings.Intern(segment.RecognitionStatus));
+        m_offsets.push_back(segment.Offset);
+        m_durations.push_back(segment.Duration);
+
+        if (segment.NBest.empty())
+        {
+            m_confidences.push_back(0);
+            m_displays.push_back(m_strings.Intern(""));
+            m_itns.push_back(m_strings.Intern(""));
+            m_lexicals.push_back(m_strings.Intern(""));
+        }
+        else
+        {
+            auto& best = segment.NBest.front();
+            m_confidences.push_back((float)best.Confidence);
+            m_displays.push_back(m_strings.Intern(best.Display));
+            m_itns.push_back(m_strings.Intern(best.ITN));
+            m_lexicals.push_back(m_strings.Intern(best.Lexical));
+        }
+    }
 
-    utility::string_t service_url = U("https://") + region + U(".cris.ai/api/speechtotext/v2.0/Transcriptions/");
-    uri u(service_url);
+    size_t Size() const { return m_offsets.size(); }
 
-    http_client c(u);
-    http_request msg(methods::POST);
-    msg.headers().add(U("Content-Type"), U("application/json"));
-    msg.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
+    // Gets the columns, each with Size() entries. Offsets and durations are in ticks of 100 nanoseconds.
+    const vector<uint64_t>& Offsets() const { return m_offsets; }
+    const vector<uint64_t>& Durations() const { return m_durations; }
+    const vector<float>& Confidences() const { return m_confidences; }
+    const vector<uint32_t>& AudioFiles() const { return m_files; }
+    const vector<uint32_t>& Statuses() const { return m_statuses; }
+    const vector<uint32_t>& Displays() const { return m_displays; }
+    const vector<uint32_t>& ITNs() const { return m_itns; }
+    const vector<uint32_t>& Lexicals() const { return m_lexicals; }
 
-    auto transportdef = TranscriptionDefinition::Create(name, description, myLocale, recordingsBlobUri);
+    // Gets the arena the ids of the text columns refer to.
+    const StringArena& Strings() const { return m_strings; }
 
-    nlohmann::json transportdefJSON = transportdef;
+    // Counts the words of the lexical form of all the segments.
+    size_t CountWords() const
+    {
+        size_t words = 0;
+        for (auto id : m_lexicals)
+        {
+            auto text = m_strings.Data(id);
+            auto length = m_strings.Length(id);
+            bool inWord = false;
+            for (uint32_t i = 0; i < length; i++)
+            {
+                bool space = text[i] == ' ';
+                words += !space && !inWord;
+                inWord = !space;
+            }
+        }
+        return words;
+    }
 
-    msg.set_body(transportdefJSON.dump());
+    // Counts the segments whose confidence is below 'threshold'.
+    size_t CountBelowConfidence(float threshold) const
+    {
+        size_t count = 0;
+        for (auto confidence : m_confidences)
+        {
+            count += confidence < threshold;
+        }
+        return count;
+    }
 
-    auto response = c.request(msg).get();
-    auto statusCode = response.status_code();
+    // Gets the total duration of the segments in ticks.
+    uint64_t TotalDuration() const
+    {
+        uint64_t total = 0;
+        for (auto duration : m_durations)
+        {
+            total += duration;
+        }
+        return total;
+    }
 
-    if (statusCode != status_codes::Accepted)
+    // Gets the number of bytes used by the columns and the strings.
+    size_t MemoryBytes() const
     {
-        cout << "Unexpected status code " << statusCode << endl;
-        return;
+        return (m_offsets.capacity() + m_durations.capacity()) * sizeof(uint64_t) + m_confidences.capacity() * sizeof(float)
+            + (m_files.capacity() + m_statuses.capacity() + m_displays.capacity() + m_itns.capacity() + m_lexicals.capacity()) * sizeof(uint32_t)
+            + m_strings.MemoryBytes();
     }
 
-    string_t transcriptionLocation = response.headers()[U("location")];
+private:
+    StringArena m_strings;
+    vector<uint64_t> m_offsets;
+    vector<uint64_t> m_durations;
+    vector<float> m_confidences;
+    vector<uint32_t> m_files;
+    vector<uint32_t> m_statuses;
+    vector<uint32_t> m_displays;
+    vector<uint32_t> m_itns;
+    vector<uint32_t> m_lexicals;
+};
 
-    cout << "Transcription status is located at " << converter.to_bytes(transcriptionLocation) << endl;
+// Runs tasks after a delay, all on one thread. Tasks are expected to only start asynchronous work.
+class DelayScheduler
+{
+public:
+    DelayScheduler() : m_thread([this]() { Run(); })
+    {
+    }
 
-    http_client statusCheckClient(transcriptionLocation);
-    http_request statusCheckMessage(methods::GET);
-    statusCheckMessage.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
+    ~DelayScheduler()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_one();
+        m_thread.join();
+    }
 
-    bool completed = false;
+    void Schedule(chrono::milliseconds delay, function<void()> task)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_tasks.emplace(chrono::steady_clock::now() + delay, move(task));
+        }
+        m_changed.notify_one();
+    }
 
-    while (!completed)
+private:
+    void Run()
     {
-        auto statusResponse = statusCheckClient.request(statusCheckMessage).get();
-        auto statusResponseCode = statusResponse.status_code();
+        unique_lock<mutex> lock(m_mutex);
+        while (!m_stopping)
+        {
+            if (m_tasks.empty())
+            {
+                m_changed.wait(lock);
+            }
+            else if (chrono::steady_clock::now() < m_tasks.begin()->first)
+            {
+                m_changed.wait_until(lock, m_tasks.begin()->first);
+            }
+            else
+            {
+                auto task = move(m_tasks.begin()->second);
+                m_tasks.erase(m_tasks.begin());
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+    }
+
+    mutex m_mutex;
+    condition_variable m_changed;
+    multimap<chrono::steady_clock::time_point, function<void()>> m_tasks;
+    bool m_stopping = false;
+    thread m_thread;
+};
+
+// The outcome of one transcription of a batch.
+class TranscriptionOutcome {
+public:
+    string RecordingsUrl;
+    string_t Location;
+    bool Succeeded = false;
+    string ErrorDetails;
+    Transcription Status;
+    int Polls = 0;
+};
 
-        if (statusResponseCode != status_codes::OK)
+// Keeps many batch transcriptions in flight without blocking a thread on any of them.
+// Requests are chained with continuations, and status polls are scheduled with exponential backoff and jitter,
+// honoring Retry-After. The number in flight adapts to the service like AdaptiveConcurrencyLimiter of the console
+// samples: it is halved when a submission is throttled, and grows back by one per limit's worth of accepted ones.
+// One http_client is reused for each host. The callback is called as each transcription finishes, on a cpprestsdk
+// thread. With notifications enabled, e.g. by a webhook, a transcription is polled as soon as it is notified of,
+// and otherwise only once in a while, in case a notification is lost.
+class BatchTranscriptionClient
+{
+public:
+    using CompletionCallback = function<void(const TranscriptionOutcome&)>;
+    using SubmittedCallback = function<void(const TranscriptionDefinition&, const string_t& location)>;
+
+    BatchTranscriptionClient(const string_t& region, const string_t& subscriptionKey, size_t maxInFlight, CompletionCallback onCompleted)
+        : m_serviceUri(U("https://") + region + U(".cris.ai")), m_apiV3Uri(U("https://") + region + U(".api.cognitive.microsoft.com")),
+          m_subscriptionKey(subscriptionKey),
+          m_maxInFlight(maxInFlight), m_onCompleted(onCompleted), m_limit(maxInFlight), m_random(random_device()())
+    {
+        if (maxInFlight == 0 || !onCompleted)
         {
-            cout << "Fetching the transcription returned unexpected http code " << statusResponseCode << endl;
-            return;
+            throw invalid_argument("A positive in-flight limit and a completion callback are required");
         }
+    }
 
-        auto body = statusResponse.extract_string().get();
-        auto statusJSON = nlohmann::json::parse(body);
-        Transcription transcriptionStatus = statusJSON;
+    // Waits for the outstanding transcriptions, the continuations must not outlive the client.
+    ~BatchTranscriptionClient()
+    {
+        WaitAll();
+    }
 
-        if (!_stricmp(transcriptionStatus.status.c_str(), "Failed"))
+    // Queues a transcription, which is submitted as soon as fewer than the in-flight limit are running.
+    // A definition of many files is submitted through the v3 API, and the results of all its files are listed.
+    void Submit(const TranscriptionDefinition& definition)
+    {
+        auto job = make_shared<Job>(definition);
+        job->Outcome.RecordingsUrl = definition.ContentUrls.empty() ? definition.RecordingsUrl
+            : definition.ContentUrls.front() + (definition.ContentUrls.size() > 1 ? " and " + to_string(definition.ContentUrls.size() - 1) + " more" : "");
         {
-            completed = true;
-            cout << "Transcription has failed " << transcriptionStatus.statusMessage << endl;
+            lock_guard<mutex> lock(m_mutex);
+            m_pending.push_back(job);
+            m_outstanding++;
         }
-        else if (!_stricmp(transcriptionStatus.status.c_str(), "Succeeded"))
+        StartPending();
+    }
+
+    // Follows a transcription submitted before, e.g. by an earlier run, until it completes. It is queued with the
+    // submissions, and counts against the in-flight limit once it is followed.
+    void Resume(const string_t& location)
+    {
+        auto job = make_shared<Job>(TranscriptionDefinition::Create(name, description, myLocale, ""));
+        job->Outcome.RecordingsUrl = utility::conversions::to_utf8string(location);
+        job->Location = location;
         {
-            completed = true;
-            cout << "Success!" << endl;
-            string result = transcriptionStatus.resultsUrls["channel_0"];
-            cout << "Transcription has completed. Results are at " << result << endl;
-            cout << "Fetching results" << endl;
+            lock_guard<mutex> lock(m_mutex);
+            m_pending.push_back(job);
+            m_outstanding++;
+        }
+        StartPending();
+    }
+
+    // Sets a callback called as each transcription is accepted by the service, before it is polled, e.g. to record it.
+    // Set it before submitting.
+    void SetSubmittedCallback(SubmittedCallback onSubmitted)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_onSubmitted = onSubmitted;
+    }
 
-            http_client result_client(converter.from_bytes(result));
-            http_request resultMessage(methods::GET);
-            resultMessage.headers().add(U("Ocp-Apim-Subscription-Key"), subscriptionKey);
+    // Gets the current in-flight limit, at most the one the client was created with, and how many submissions were throttled.
+    size_t GetConcurrencyLimit(size_t& throttled)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        throttled = m_throttled;
+        return m_limit;
+    }
 
-            auto resultResponse = result_client.request(resultMessage).get();
+    // Blocks until all the submitted transcriptions have finished.
+    void WaitAll()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_outstanding == 0; });
+    }
 
-            auto responseCode = resultResponse.status_code();
+    // Registers a webhook that the service calls back when a transcription of the subscription completes, and returns
+    // its URL. The listener at 'webUrl' must be open already, as the service checks it with a challenge.
+    pplx::task<string_t> RegisterWebhookAsync(const string_t& webUrl, const string& secret)
+    {
+        auto request = CreateRequest(methods::POST, uri(U("/speechtotext/v3.0/webhooks")));
+        request.headers().add(U("Content-Type"), U("application/json"));
+        nlohmann::json webhookJSON = {
+            { "displayName", name },
+            { "webUrl", utility::conversions::to_utf8string(webUrl) },
+            { "events", { { "transcriptionCompletion", true } } },
+            { "properties", { { "secret", secret } } }
+        };
+        request.set_body(webhookJSON.dump());
 
-            if (responseCode != status_codes::OK)
+        return GetClient(m_apiV3Uri)->request(request).then([](http_response response)
+        {
+            if (response.status_code() != status_codes::Created)
             {
-                cout << "Fetching the transcription returned unexpected http code " << responseCode << endl;
-                return;
+                throw runtime_error("Registering the webhook returned unexpected http code " + to_string(response.status_code()));
             }
+            auto created = nlohmann::json::parse(response.extract_utf8string(true).get());
+            return utility::conversions::to_string_t(created.at("self").get<string>());
+        });
+    }
 
-            auto resultBody = resultResponse.extract_string().get();
+    // Deletes a webhook registered by RegisterWebhookAsync().
+    pplx::task<void> DeleteWebhookAsync(const string_t& location)
+    {
+        uri u(location);
+        return GetClient(u)->request(CreateRequest(methods::DEL, u.resource())).then([](http_response) {});
+    }
 
-            nlohmann::json resultJSON = nlohmann::json::parse(resultBody);
-            RootObject root = resultJSON;
+    // Polls the transcriptions only every 'fallbackPollDelay', relying on Notify() to learn when they complete.
+    void EnableNotifications(chrono::milliseconds fallbackPollDelay)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_fallbackPollDelay = fallbackPollDelay;
+    }
 
-            for (AudioFileResult af : root.AudioFileResults)
+    // Polls a transcription now, as it has been notified of, e.g. as completed. Transcriptions that are not this
+    // client's are ignored. Safe to call from any thread.
+    void Notify(const string& transcriptionId)
+    {
+        auto id = ToLower(transcriptionId);
+        shared_ptr<Job> job;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            auto found = m_waiting.find(id);
+            if (found == m_waiting.end())
             {
-                cout << "There were " << af.SegmentResults.size() << " results in " << af.AudioFileName << endl;
-
-                for (SegmentResult segResult : af.SegmentResults)
+                // It may be one whose submission has not been answered yet.
+                if (m_active > m_waiting.size())
                 {
-                    cout << "Status: " << segResult.RecognitionStatus << endl;
-
-                    if (!_stricmp(segResult.RecognitionStatus.c_str(), "success") && segResult.NBest.size() > 0)
-                    {
-                        cout << "Best text result was: '" << segResult.NBest.front().Display << "'" << endl;
-                    }
+                    m_earlyNotifications.insert(id);
                 }
+                return;
+            }
+            job = found->second;
+            if (job->PollInFlight)
+            {
+                // Polled again as soon as the poll in flight answers, in case it was sent before the completion.
+                job->Notified = true;
+                return;
             }
         }
-        else if (!_stricmp(transcriptionStatus.status.c_str(), "Running"))
+        SchedulePoll(job, chrono::milliseconds(0));
+    }
+
+    // Gets a results URL, using the client of its host. The task completes once the headers have arrived,
+    // the body can be read from the response as it is received.
+    pplx::task<http_response> GetAsync(const string& url)
+    {
+        uri u(utility::conversions::to_string_t(url));
+        return GetClient(u)->request(CreateRequest(methods::GET, u.resource()));
+    }
+
+private:
+    // Defines the delay before the first status poll, and the bounds of the backoff between polls.
+    const chrono::milliseconds firstPollDelay = chrono::milliseconds(5000);
+    const chrono::milliseconds maxPollDelay = chrono::milliseconds(60000);
+
+    // Defines how many times a throttled or failed submission is retried.
+    const int maxSubmitAttempts = 5;
+
+    // Defines the time after a decrease of the limit during which throttling does not decrease it again,
+    // as it comes from the same overload.
+    const chrono::milliseconds throttleCooldown = chrono::milliseconds(2000);
+
+    struct Job
+    {
+        Job(const TranscriptionDefinition& definition) : Definition(definition) {}
+
+        TranscriptionDefinition Definition;
+        string_t Location;                  // set before it is started for a resumed transcription, which is not posted.
+        string Id;
+        int Attempt = 0;
+        TranscriptionOutcome Outcome;
+
+        // Whether the limit was reached when it was started; only then does its acceptance show the limit can grow.
+        bool Saturated = false;
+
+        // Guarded by the client's mutex: a poll scheduled before the last call to SchedulePoll() is dropped.
+        uint64_t PollGeneration = 0;
+        bool PollInFlight = false;
+        bool Notified = false;
+    };
+
+    static string ToLower(string text)
+    {
+        for (auto& c : text)
         {
-            cout << "Transcription is running." << endl;
+            c = (char)tolower((unsigned char)c);
         }
-        else if (!_stricmp(transcriptionStatus.status.c_str(), "NotStarted"))
+        return text;
+    }
+
+    static bool IsTransient(status_code code)
+    {
+        return code == status_codes::TooManyRequests || code >= 500;
+    }
+
+    http_request CreateRequest(const method& requestMethod, const uri& resource)
+    {
+        http_request request(requestMethod);
+        request.set_request_uri(resource);
+        request.headers().add(U("Ocp-Apim-Subscription-Key"), m_subscriptionKey);
+        return request;
+    }
+
+    shared_ptr<http_client> GetClient(const uri& u)
+    {
+        auto authority = u.authority().to_string();
+        lock_guard<mutex> lock(m_mutex);
+        auto& client = m_clients[authority];
+        if (client == nullptr)
         {
-            cout << "Transcription has not started." << endl;
+            // Asks for gzip compressed bodies, which are decompressed as they are read.
+            // The client keeps its HTTP/1.1 connections alive, so they are reused by all the requests to the host.
+            http_client_config config;
+            config.set_request_compressed_response(true);
+            client = make_shared<http_client>(u.authority(), config);
         }
+        return client;
+    }
 
-        if (!completed) {
-            Sleep(5000);
+    // Gets the delay of the given attempt: doubled for each attempt up to the maximum, then randomized
+    // between half and all of it so that thousands of jobs don't poll in lockstep.
+    chrono::milliseconds Backoff(int attempt)
+    {
+        // Windows.h defines min and max as macros, the bounds are applied by hand.
+        auto delay = firstPollDelay.count() << (attempt < 16 ? attempt : 16);
+        if (delay > maxPollDelay.count())
+        {
+            delay = maxPollDelay.count();
         }
+        lock_guard<mutex> lock(m_mutex);
+        uniform_int_distribution<chrono::milliseconds::rep> jitter(delay / 2, delay);
+        return chrono::milliseconds(jitter(m_random));
+    }
 
+    // Gets the delay asked for by a Retry-After header in seconds, or 'otherwise' without one.
+    chrono::milliseconds RetryAfterOr(const http_response& response, chrono::milliseconds otherwise)
+    {
+        auto header = response.headers().find(U("Retry-After"));
+        if (header != response.headers().end())
+        {
+            try
+            {
+                return chrono::seconds(stoi(header->second));
+            }
+            catch (const exception&)
+            {
+                // An HTTP date instead of seconds, falls back to the backoff.
+            }
+        }
+        return otherwise;
     }
+
+    // Schedules a poll of a job, dropping the ones scheduled before, so that a notification replaces the poll that was due.
+    void SchedulePoll(shared_ptr<Job> job, chrono::milliseconds delay)
+    {
+        uint64_t generation;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            generation = ++job->PollGeneration;
+        }
+        m_scheduler.Schedule(delay, [this, job, generation]()
+        {
+            {
+                lock_guard<mutex> lock(m_mutex);
+                if (job->PollGeneration != generation || job->PollInFlight)
+                {
+                    return;
+                }
+                job->PollInFlight = true;
+                job->Notified = false;
+            }
+            Poll(job);
+        });
+    }
+
+    // Schedules the next poll of a job that is still running, at once if it was notified of meanwhile.
+    void PollAgain(shared_ptr<Job> job, const http_response& response, bool transient)
+    {
+        chrono::milliseconds fallbackPollDelay;
+        bool notified;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            job->PollInFlight = false;
+            notified = job->Notified;
+            fallbackPollDelay = m_fallbackPollDelay;
+        }
+
+        auto delay = notified ? chrono::milliseconds(0)
+            : fallbackPollDelay.count() > 0 && !transient ? fallbackPollDelay
+            : RetryAfterOr(response, Backoff(job->Attempt++));
+        SchedulePoll(job, delay);
+    }
+
+    void StartPending()
+    {
+        vector<shared_ptr<Job>> jobs;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            while (m_active < m_limit && !m_pending.empty())
+            {
+                jobs.push_back(m_pending.front());
+                m_pending.pop_front();
+                m_active++;
+                jobs.back()->Saturated = m_active >= m_limit;
+            }
+        }
+        for (auto& job : jobs)
+        {
+            if (job->Location.empty())
+            {
+                Post(job);
+            }
+            else
+            {
+                Track(job, job->Location, chrono::milliseconds(0));
+            }
+        }
+    }
+
+    // Starts polling a job accepted by the service.
+    void Track(shared_ptr<Job> job, const string_t& location, chrono::milliseconds delay)
+    {
+        job->Location = location;
+        job->Outcome.Location = location;
+        job->Id = ToLower(utility::conversions::to_utf8string(uri(location).path()));
+        job->Id = job->Id.substr(job->Id.find_last_of('/') + 1);
+        job->Attempt = 0;
+
+        // The first poll is due at once if the transcription completed before it was known to be this client's.
+        bool notified;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_waiting[job->Id] = job;
+            notified = m_earlyNotifications.erase(job->Id) > 0;
+        }
+        SchedulePoll(job, notified ? chrono::milliseconds(0) : delay);
+    }
+
+    // Grows the limit by one for each limit's worth of submissions accepted while it was reached.
+    void OnAccepted(const Job& job)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (job.Saturated && m_limit < m_maxInFlight)
+        {
+            m_credit += 1.0 / m_limit;
+            if (m_credit >= 1)
+            {
+                m_credit = 0;
+                m_limit++;
+            }
+        }
+    }
+
+    // Halves the limit when the service throttles a submission, once per cooldown.
+    void OnThrottled()
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_throttled++;
+        auto now = chrono::steady_clock::now();
+        if (m_limit > 1 && now - m_lastDecrease >= throttleCooldown)
+        {
+            m_limit /= 2;
+            m_credit = 0;
+            m_lastDecrease = now;
+        }
+    }
+
+    void Post(shared_ptr<Job> job)
+    {
+        auto isV3 = !job->Definition.ContentUrls.empty();
+        auto request = CreateRequest(methods::POST, uri(isV3 ? U("/speechtotext/v3.0/transcriptions") : U("/api/speechtotext/v2.0/Transcriptions/")));
+        request.headers().add(U("Content-Type"), U("application/json"));
+        nlohmann::json definitionJSON = job->Definition;
+        request.set_body(definitionJSON.dump());
+
+        GetClient(isV3 ? m_apiV3Uri : m_serviceUri)->request(request).then([this, job](pplx::task<http_response> task)
+        {
+            try
+            {
+                auto response = task.get();
+                auto statusCode = response.status_code();
+                if (statusCode == status_codes::Accepted || statusCode == status_codes::Created)
+                {
+                    OnAccepted(*job);
+                    auto location = response.headers()[U("location")];
+                    SubmittedCallback onSubmitted;
+                    {
+                        lock_guard<mutex> lock(m_mutex);
+                        onSubmitted = m_onSubmitted;
+                    }
+                    if (onSubmitted)
+                    {
+                        onSubmitted(job->Definition, location);
+                    }
+                    Track(job, location, RetryAfterOr(response, firstPollDelay));
+                }
+                else
+                {
+                    if (statusCode == status_codes::TooManyRequests || statusCode == status_codes::ServiceUnavailable)
+                    {
+                        OnThrottled();
+                    }
+                    if (IsTransient(statusCode) && ++job->Attempt < maxSubmitAttempts)
+                    {
+                        m_scheduler.Schedule(RetryAfterOr(response, Backoff(job->Attempt)), [this, job]() { Post(job); });
+                    }
+                    else
+                    {
+                        Complete(job, "Unexpected status code " + to_string(statusCode));
+                    }
+                }
+            }
+            catch (const exception& e)
+            {
+                Complete(job, e.what());
+            }
+        });
+    }
+
+    void Poll(shared_ptr<Job> job)
+    {
+        uri location(job->Location);
+        GetClient(location)->request(CreateRequest(methods::GET, location.resource())).then([this, job](pplx::task<http_response> task)
+        {
+            try
+            {
+                auto response = task.get();
+                auto statusCode = response.status_code();
+                job->Outcome.Polls++;
+                if (statusCode == status_codes::OK)
+                {
+                    auto statusJSON = nlohmann::json::parse(response.extract_utf8string(true).get());
+                    job->Outcome.Status = statusJSON;
+
+                    auto& status = job->Outcome.Status.status;
+                    if (!_stricmp(status.c_str(), "Succeeded"))
+                    {
+                        if (!job->Outcome.Status.filesUrl.empty())
+                        {
+                            ListResultFiles(job, job->Outcome.Status.filesUrl);
+                            return;
+                        }
+                        job->Outcome.Succeeded = true;
+                        Complete(job, "");
+                        return;
+                    }
+                    if (!_stricmp(status.c_str(), "Failed"))
+                    {
+                        Complete(job, "Transcription has failed " + job->Outcome.Status.statusMessage);
+                        return;
+                    }
+                }
+                else if (!IsTransient(statusCode))
+                {
+                    Complete(job, "Fetching the transcription returned unexpected http code " + to_string(statusCode));
+                    return;
+                }
+
+                // Still running, or a transient error.
+                PollAgain(job, response, statusCode != status_codes::OK);
+            }
+            catch (const exception& e)
+            {
+                Complete(job, e.what());
+            }
+        });
+    }
+
+    // Gets the results URLs of a v3 transcription from its files, a page at a time, then completes it.
+    void ListResultFiles(shared_ptr<Job> job, const string& filesUrl)
+    {
+        GetAsync(filesUrl).then([this, job](pplx::task<http_response> task)
+        {
+            try
+            {
+                auto response = task.get();
+                if (response.status_code() != status_codes::OK)
+                {
+                    Complete(job, "Listing the result files returned unexpected http code " + to_string(response.status_code()));
+                    return;
+                }
+
+                auto files = nlohmann::json::parse(response.extract_utf8string(true).get());
+                for (const auto& file : files.at("values"))
+                {
+                    if (file.value("kind", "") == "Transcription")
+                    {
+                        job->Outcome.Status.resultsUrls[file.value("name", "")] = file.at("links").at("contentUrl").get<string>();
+                    }
+                }
+
+                auto nextLink = files.value("@nextLink", "");
+                if (!nextLink.empty())
+                {
+                    ListResultFiles(job, nextLink);
+                    return;
+                }
+                job->Outcome.Succeeded = true;
+                Complete(job, "");
+            }
+            catch (const exception& e)
+            {
+                Complete(job, e.what());
+            }
+        });
+    }
+
+    void Complete(shared_ptr<Job> job, const string& errorDetails)
+    {
+        job->Outcome.ErrorDetails = errorDetails;
+        try
+        {
+            m_onCompleted(job->Outcome);
+        }
+        catch (...)
+        {
+        }
+
+        vector<shared_ptr<Job>> next;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_waiting.erase(job->Id);
+            m_active--;
+            m_outstanding--;
+            if (m_active == 0)
+            {
+                m_earlyNotifications.clear();
+            }
+            if (m_outstanding == 0)
+            {
+                // Notified under the lock, the client may be destroyed as soon as it is released.
+                m_idle.notify_all();
+                return;
+            }
+        }
+        StartPending();
+    }
+
+    const uri m_serviceUri;
+    const uri m_apiV3Uri;
+    const string_t m_subscriptionKey;
+    const size_t m_maxInFlight;
+    CompletionCallback m_onCompleted;
+
+    mutex m_mutex;
+    condition_variable m_idle;
+    deque<shared_ptr<Job>> m_pending;
+    size_t m_active = 0;
+    size_t m_limit;
+    double m_credit = 0;
+    size_t m_throttled = 0;
+    chrono::steady_clock::time_point m_lastDecrease;
+    size_t m_outstanding = 0;
+    map<string_t, shared_ptr<http_client>> m_clients;
+    mt19937 m_random;
+
+    // The jobs submitted and not completed yet, by transcription id, and the ids notified of before their job was known.
+    map<string, shared_ptr<Job>> m_waiting;
+    set<string> m_earlyNotifications;
+    chrono::milliseconds m_fallbackPollDelay = chrono::milliseconds(0);
+    SubmittedCallback m_onSubmitted;
+
+    // Declared last, so that its thread is joined before the members its tasks use are destroyed.
+    DelayScheduler m_scheduler;
+};
+
+// Submits all the recordings of a storage container, listed through a SAS URL of the container, as transcriptions of
+// up to 'filesPerTranscription' files each, which the client posts concurrently as the listing goes on. Each accepted
+// transcription is appended to a ledger with the blobs it covers, each completed one once its results are downloaded,
+// and each failed one, so that after a restart the blobs submitted before are skipped and the transcriptions that
+// neither completed nor failed are resumed.
+// A transcription accepted just as the process stops, before it is written, is submitted again: intake is at least once.
+// The ledger holds blob URLs without their SAS.
+class ContainerBatchSubmitter
+{
+public:
+    // Defines the most files the service takes in one transcription.
+    static const size_t maxFilesPerTranscription = 1000;
+
+    ContainerBatchSubmitter(BatchTranscriptionClient& client, const string& ledgerFileName, size_t filesPerTranscription = maxFilesPerTranscription)
+        : m_client(client), m_filesPerTranscription(filesPerTranscription)
+    {
+        if (filesPerTranscription == 0 || filesPerTranscription > maxFilesPerTranscription)
+        {
+            throw invalid_argument("Files per transcription must be between 1 and " + to_string(maxFilesPerTranscription));
+        }
+
+        LoadLedger(ledgerFileName);
+        m_ledger.open(ledgerFileName, ios::app);
+        if (!m_ledger)
+        {
+            throw runtime_error("Failed to open the ledger " + ledgerFileName);
+        }
+        m_client.SetSubmittedCallback([this](const TranscriptionDefinition& definition, const string_t& location)
+        {
+            Record(definition, location);
+        });
+    }
+
+    // Resumes the transcriptions of the ledger that were submitted and have not completed. Returns how many.
+    size_t ResumeOpenTranscriptions()
+    {
+        vector<string_t> locations;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            locations.assign(m_open.begin(), m_open.end());
+        }
+        for (const auto& location : locations)
+        {
+            m_client.Resume(location);
+        }
+        return locations.size();
+    }
+
+    // Lists the container, and submits the recordings that are not in the ledger. Returns how many were submitted.
+    // 'containerSasUrl' is the URL of the container with a SAS that allows listing and reading as its query.
+    size_t SubmitContainer(const string& containerSasUrl, const string& locale)
+    {
+        uri container(utility::conversions::to_string_t(containerSasUrl));
+        auto containerUrl = containerSasUrl.substr(0, containerSasUrl.find('?'));
+        auto sas = utility::conversions::to_utf8string(container.query());
+        http_client storage(container.authority());
+
+        size_t submitted = 0;
+        size_t batches = 0;
+        std::list<string> contentUrls;
+        auto submitBatch = [&]()
+        {
+            if (!contentUrls.empty())
+            {
+                m_client.Submit(TranscriptionDefinition::CreateForFiles(name + " " + to_string(++batches), description, locale, contentUrls));
+                submitted += contentUrls.size();
+                contentUrls.clear();
+            }
+        };
+
+        // Submits a transcription as soon as it is full, while the next pages are listed.
+        string marker;
+        do
+        {
+            auto listing = container.path() + U("?restype=container&comp=list&maxresults=5000&") + container.query();
+            if (!marker.empty())
+            {
+                listing += U("&marker=") + uri::encode_data_string(utility::conversions::to_string_t(marker));
+            }
+            auto response = storage.request(methods::GET, listing).get();
+            if (response.status_code() != status_codes::OK)
+            {
+                throw runtime_error("Listing the container returned unexpected http code " + to_string(response.status_code()));
+            }
+
+            auto page = response.extract_utf8string(true).get();
+            for (const auto& blobName : ElementTexts(page, "Name"))
+            {
+                auto blobUrl = containerUrl + "/" + utility::conversions::to_utf8string(uri::encode_uri(utility::conversions::to_string_t(blobName), uri::components::path));
+                if (!IsRecording(blobName) || IsSubmitted(blobUrl))
+                {
+                    continue;
+                }
+                contentUrls.push_back(blobUrl + "?" + sas);
+                if (contentUrls.size() == m_filesPerTranscription)
+                {
+                    submitBatch();
+                }
+            }
+            auto markers = ElementTexts(page, "NextMarker");
+            marker = markers.empty() ? "" : markers.front();
+        } while (!marker.empty());
+
+        submitBatch();
+        return submitted;
+    }
+
+    // Records that a transcription has completed and its results have been downloaded, so that it is not resumed.
+    void MarkCompleted(const string_t& location)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_open.erase(location) > 0)
+        {
+            m_ledger << "D\t" << utility::conversions::to_utf8string(location) << "\n" << flush;
+        }
+    }
+
+    // Records that a transcription has failed, so that it is not resumed either. Its recordings are not submitted again.
+    void MarkFailed(const string_t& location, const string& errorDetails)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_open.erase(location) > 0)
+        {
+            // The details are kept on one line and one field.
+            auto details = errorDetails;
+            replace_if(details.begin(), details.end(), [](char c) { return c == '\t' || c == '\r' || c == '\n'; }, ' ');
+            m_ledger << "F\t" << utility::conversions::to_utf8string(location) << "\t" << details << "\n" << flush;
+        }
+    }
+
+private:
+    // The ledger has a line per event, with tab separated fields:
+    //   S, the location of a transcription accepted, then the URLs of its blobs.
+    //   D, the location of a transcription completed.
+    //   F, the location of a transcription failed, then why.
+    void LoadLedger(const string& ledgerFileName)
+    {
+        ifstream ledger(ledgerFileName);
+        string line;
+        while (getline(ledger, line))
+        {
+            vector<string> fields;
+            size_t start = 0;
+            for (auto tab = line.find('\t'); tab != string::npos; start = tab + 1, tab = line.find('\t', start))
+            {
+                fields.push_back(line.substr(start, tab - start));
+            }
+            fields.push_back(line.substr(start));
+
+            // A line cut short by a crash is ignored, its transcription is submitted again.
+            if (fields.size() >= 3 && fields[0] == "S")
+            {
+                m_open.insert(utility::conversions::to_string_t(fields[1]));
+                m_submitted.insert(fields.begin() + 2, fields.end());
+            }
+            else if ((fields.size() == 2 && fields[0] == "D") || (fields.size() == 3 && fields[0] == "F"))
+            {
+                m_open.erase(utility::conversions::to_string_t(fields[1]));
+            }
+        }
+    }
+
+    void Record(const TranscriptionDefinition& definition, const string_t& location)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_ledger << "S\t" << utility::conversions::to_utf8string(location);
+        for (const auto& url : definition.ContentUrls.empty() ? std::list<string>{ definition.RecordingsUrl } : definition.ContentUrls)
+        {
+            auto blobUrl = url.substr(0, url.find('?'));
+            m_ledger << "\t" << blobUrl;
+            m_submitted.insert(blobUrl);
+        }
+        m_ledger << "\n" << flush;
+        m_open.insert(location);
+    }
+
+    bool IsSubmitted(const string& blobUrl)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        return m_submitted.count(blobUrl) > 0;
+    }
+
+    // Checks whether a blob is a recording, by the extension of its name.
+    static bool IsRecording(const string& blobName)
+    {
+        static const char* const extensions[] = { ".wav", ".mp3", ".ogg", ".opus", ".flac" };
+        auto dot = blobName.find_last_of('.');
+        if (dot == string::npos)
+        {
+            return false;
+        }
+        auto extension = blobName.substr(dot);
+        for (auto& c : extension)
+        {
+            c = (char)tolower((unsigned char)c);
+        }
+        for (auto known : extensions)
+        {
+            if (extension == known)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Gets the texts of the elements named 'tag' of a listing, unescaped. The listing is simple enough that it needs
+    // no XML parser: the elements hold text only, and are never nested in themselves.
+    static vector<string> ElementTexts(const string& xml, const string& tag)
+    {
+        vector<string> texts;
+        auto open = "<" + tag + ">";
+        auto close = "</" + tag + ">";
+        for (auto start = xml.find(open); start != string::npos; start = xml.find(open, start))
+        {
+            start += open.size();
+            auto end = xml.find(close, start);
+            if (end == string::npos)
+            {
+                break;
+            }
+            texts.push_back(Unescape(xml.substr(start, end - start)));
+            start = end + close.size();
+        }
+        return texts;
+    }
+
+    static string Unescape(const string& text)
+    {
+        static const pair<const char*, char> entities[] = { { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' } };
+        string unescaped;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            bool replaced = false;
+            if (text[i] == '&')
+            {
+                for (const auto& entity : entities)
+                {
+                    if (text.compare(i, strlen(entity.first), entity.first) == 0)
+                    {
+                        unescaped += entity.second;
+                        i += strlen(entity.first) - 1;
+                        replaced = true;
+                        break;
+                    }
+                }
+            }
+            if (!replaced)
+            {
+                unescaped += text[i];
+            }
+        }
+        return unescaped;
+    }
+
+    BatchTranscriptionClient& m_client;
+    const size_t m_filesPerTranscription;
+
+    mutex m_mutex;
+    ofstream m_ledger;
+    set<string> m_submitted;
+    set<string_t> m_open;
+};
+
+// The outcome of downloading one results URL.
+class ResultDownload {
+public:
+    string Url;
+    size_t Segments = 0;
+    bool Succeeded = false;
+    string ErrorDetails;
+};
+
+// Downloads many results URLs at once, on up to 'maxConcurrency' threads, and streams each body into its own parser.
+// The wall time is bounded by the slowest download rather than by the sum of them. The callback is called for the
+// segments of all the downloads, one at a time. URLs can be added while others are downloaded, e.g. as each
+// transcription completes, so that its results are read right away instead of after the whole batch.
+class ConcurrentResultFetcher
+{
+public:
+    using SegmentCallback = function<void(const string& url, const string& audioFileName, const SegmentResult& segment)>;
+    using DownloadCallback = function<void(const ResultDownload& download)>;
+
+    ConcurrentResultFetcher(BatchTranscriptionClient& client, size_t maxConcurrency)
+        : m_client(client), m_maxConcurrency(maxConcurrency)
+    {
+        if (maxConcurrency == 0)
+        {
+            throw invalid_argument("A positive concurrency is required");
+        }
+    }
+
+    // Stops the downloads that have not started.
+    ~ConcurrentResultFetcher()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_queue.clear();
+        }
+        Finish();
+    }
+
+    // Starts the download threads, which download the URLs given to Enqueue() as they are given.
+    void Start(SegmentCallback onSegment)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_threads.empty())
+        {
+            throw logic_error("The fetcher is started already");
+        }
+        m_onSegment = onSegment;
+        m_finishing = false;
+        m_downloads.clear();
+        for (size_t i = 0; i < m_maxConcurrency; i++)
+        {
+            m_threads.emplace_back([this]() { Work(); });
+        }
+    }
+
+    // Adds a URL to download, and a callback called with its outcome once it is downloaded, if any. Safe to call from any thread.
+    void Enqueue(const string& url, DownloadCallback onDownloaded = nullptr)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_downloads.emplace_back();
+            m_downloads.back().Url = url;
+            m_queue.emplace_back(&m_downloads.back(), onDownloaded);
+        }
+        m_changed.notify_one();
+    }
+
+    // Waits for the URLs added to be downloaded, and returns their outcomes in the order they were added.
+    vector<ResultDownload> Finish()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_finishing = true;
+        }
+        m_changed.notify_all();
+        for (auto& t : m_threads)
+        {
+            t.join();
+        }
+        m_threads.clear();
+        return vector<ResultDownload>(m_downloads.begin(), m_downloads.end());
+    }
+
+    // Downloads all the URLs, and returns their outcomes in the order of the input.
+    vector<ResultDownload> FetchAll(const vector<string>& urls, SegmentCallback onSegment)
+    {
+        Start(onSegment);
+        for (const auto& url : urls)
+        {
+            Enqueue(url);
+        }
+        return Finish();
+    }
+
+private:
+    void Fetch(ResultDownload& download, SegmentResultStreamParser::SegmentCallback onSegment)
+    {
+        try
+        {
+            auto response = m_client.GetAsync(download.Url).get();
+            if (response.status_code() != status_codes::OK)
+            {
+                download.ErrorDetails = "Fetching the results returned unexpected http code " + to_string(response.status_code());
+                return;
+            }
+
+            // Parses the body while it is downloaded, without holding the whole document.
+            HttpBodyStreamBuffer body(response.body());
+            istream bodyStream(&body);
+            SegmentResultStreamParser parser(onSegment);
+            download.Segments = parser.Parse(bodyStream);
+            download.Succeeded = true;
+        }
+        catch (const exception& e)
+        {
+            download.ErrorDetails = e.what();
+        }
+    }
+
+    void Work()
+    {
+        while (true)
+        {
+            ResultDownload* download;
+            DownloadCallback onDownloaded;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_changed.wait(lock, [this]() { return !m_queue.empty() || m_finishing; });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                download = m_queue.front().first;
+                onDownloaded = move(m_queue.front().second);
+                m_queue.pop_front();
+            }
+
+            auto url = download->Url;
+            Fetch(*download, [this, &url](const string& audioFileName, const SegmentResult& segment)
+            {
+                lock_guard<mutex> lock(m_callbackMutex);
+                m_onSegment(url, audioFileName, segment);
+            });
+            if (onDownloaded)
+            {
+                onDownloaded(*download);
+            }
+        }
+    }
+
+    BatchTranscriptionClient& m_client;
+    const size_t m_maxConcurrency;
+    SegmentCallback m_onSegment;
+
+    // The downloads are kept in a deque, so that the threads can fill them in while more are added.
+    mutex m_mutex;
+    condition_variable m_changed;
+    deque<ResultDownload> m_downloads;
+    deque<pair<ResultDownload*, DownloadCallback>> m_queue;
+    bool m_finishing = false;
+    vector<thread> m_threads;
+    mutex m_callbackMutex;
+};
+
+// Gets the base64 of the HMAC-SHA256 of 'payload' with 'secret', the signature of a webhook notification.
+string_t ComputeWebhookSignature(const string& secret, const string& payload)
+{
+    BCRYPT_ALG_HANDLE algorithm = nullptr;
+    BCRYPT_HASH_HANDLE hash = nullptr;
+    vector<unsigned char> signature(32);
+    bool succeeded = BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&algorithm, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG))
+        && BCRYPT_SUCCESS(BCryptCreateHash(algorithm, &hash, nullptr, 0, (PUCHAR)secret.data(), (ULONG)secret.size(), 0))
+        && BCRYPT_SUCCESS(BCryptHashData(hash, (PUCHAR)payload.data(), (ULONG)payload.size(), 0))
+        && BCRYPT_SUCCESS(BCryptFinishHash(hash, signature.data(), (ULONG)signature.size(), 0));
+    if (hash != nullptr)
+    {
+        BCryptDestroyHash(hash);
+    }
+    if (algorithm != nullptr)
+    {
+        BCryptCloseAlgorithmProvider(algorithm, 0);
+    }
+    if (!succeeded)
+    {
+        throw runtime_error("Failed to compute the webhook signature");
+    }
+    return utility::conversions::to_base64(signature);
+}
+
+// Receives the webhook notifications of the service on an embedded http listener, and hands the id of each completed
+// transcription to a callback. Notifications are checked against the secret of the webhook: the body, or the
+// validation token of a challenge, must have its HMAC-SHA256 as signature. Each notification is answered at once, and
+// handed on once even if the service retries it.
+class WebhookListener
+{
+public:
+    using CompletionCallback = function<void(const string& transcriptionId)>;
+
+    WebhookListener(const string_t& listenerUrl, const string& secret, CompletionCallback onCompleted)
+        : m_listener(listenerUrl), m_secret(secret), m_onCompleted(onCompleted)
+    {
+        if (secret.empty() || !onCompleted)
+        {
+            throw invalid_argument("A webhook secret and a completion callback are required");
+        }
+        m_listener.support(methods::POST, [this](http_request request) { Handle(request); });
+        m_listener.open().wait();
+    }
+
+    ~WebhookListener()
+    {
+        try
+        {
+            m_listener.close().wait();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    // Gets the number of notifications rejected for a missing or wrong signature.
+    size_t GetRejected() const
+    {
+        return m_rejected;
+    }
+
+private:
+    // Defines how many invocation ids are remembered to drop the notifications the service sends again.
+    const size_t maxRememberedInvocations = 4096;
+
+    void Handle(http_request request)
+    {
+        auto eventKind = request.headers().find(U("X-MicrosoftSpeechServices-Event"));
+        auto signature = request.headers().find(U("X-MicrosoftSpeechServices-Signature"));
+        if (eventKind == request.headers().end() || signature == request.headers().end())
+        {
+            Reject(request);
+            return;
+        }
+
+        if (eventKind->second == U("Challenge"))
+        {
+            auto query = uri::split_query(request.relative_uri().query());
+            auto token = query.find(U("validationToken"));
+            if (token == query.end() || !IsSigned(utility::conversions::to_utf8string(uri::decode(token->second)), signature->second))
+            {
+                Reject(request);
+                return;
+            }
+            request.reply(status_codes::OK, uri::decode(token->second));
+            return;
+        }
+
+        auto body = request.extract_utf8string(true).get();
+        if (!IsSigned(body, signature->second))
+        {
+            Reject(request);
+            return;
+        }
+        request.reply(status_codes::OK);
+
+        if (eventKind->second != U("TranscriptionCompletion"))
+        {
+            return;
+        }
+        try
+        {
+            auto notification = nlohmann::json::parse(body);
+            if (!Remember(notification.value("invocationId", "")))
+            {
+                return;
+            }
+
+            // The transcription is referred to by its URL, which ends with its id.
+            auto self = notification.at("self").get<string>();
+            m_onCompleted(self.substr(self.find_last_of('/') + 1));
+        }
+        catch (const exception&)
+        {
+            // A malformed notification; the transcription is still found by the fallback polls.
+        }
+    }
+
+    // Compares the signatures in constant time, so that the time taken does not tell how much of one matched.
+    bool IsSigned(const string& payload, const string_t& signature) const
+    {
+        auto expected = ComputeWebhookSignature(m_secret, payload);
+        if (expected.size() != signature.size())
+        {
+            return false;
+        }
+        unsigned int difference = 0;
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            difference |= (unsigned int)(expected[i] ^ signature[i]);
+        }
+        return difference == 0;
+    }
+
+    void Reject(http_request request)
+    {
+        m_rejected++;
+        request.reply(status_codes::BadRequest);
+    }
+
+    // Remembers an invocation id, returns false if it was already, as the notification is a retry.
+    bool Remember(const string& invocationId)
+    {
+        if (invocationId.empty())
+        {
+            return true;
+        }
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_invocations.insert(invocationId).second)
+        {
+            return false;
+        }
+        m_invocationOrder.push_back(invocationId);
+        if (m_invocationOrder.size() > maxRememberedInvocations)
+        {
+            m_invocations.erase(m_invocationOrder.front());
+            m_invocationOrder.pop_front();
+        }
+        return true;
+    }
+
+    http_listener m_listener;
+    const string m_secret;
+    CompletionCallback m_onCompleted;
+    atomic<size_t> m_rejected{ 0 };
+
+    mutex m_mutex;
+    set<string> m_invocations;
+    deque<string> m_invocationOrder;
+};
+
+void recognizeSpeech()
+{
+    // Defines how often transcriptions are polled while webhook notifications are expected, in case one is lost.
+    const chrono::milliseconds fallbackPollDelay = chrono::minutes(5);
+
+    mutex outputMutex;
+    ColumnarResultStore store;
+    ConcurrentResultFetcher* fetcher = nullptr;
+    ContainerBatchSubmitter* submitter = nullptr;
+
+    // Keeps up to 100 transcriptions in flight, and starts downloading the results of each one as it finishes.
+    BatchTranscriptionClient client(region, subscriptionKey, 100, [&](const TranscriptionOutcome& outcome)
+    {
+        lock_guard<mutex> lock(outputMutex);
+        if (outcome.Succeeded)
+        {
+            cout << "Transcription of " << outcome.RecordingsUrl << " has completed after " << outcome.Polls << " polls." << endl;
+
+            // There is a result for each channel of each recording. The transcription is completed in the ledger once
+            // all of them are downloaded, so that if one fails, the next run resumes it and downloads them again.
+            auto remaining = make_shared<atomic<size_t>>(outcome.Status.resultsUrls.size());
+            auto failed = make_shared<atomic<bool>>(false);
+            auto location = outcome.Location;
+            for (const auto& result : outcome.Status.resultsUrls)
+            {
+                cout << "Results of " << result.first << " are at " << result.second << endl;
+                fetcher->Enqueue(result.second, [&submitter, remaining, failed, location](const ResultDownload& download)
+                {
+                    if (!download.Succeeded)
+                    {
+                        *failed = true;
+                    }
+                    if (--*remaining == 0 && !*failed && submitter != nullptr)
+                    {
+                        submitter->MarkCompleted(location);
+                    }
+                });
+            }
+            if (outcome.Status.resultsUrls.empty() && submitter != nullptr)
+            {
+                submitter->MarkCompleted(outcome.Location);
+            }
+        }
+        else
+        {
+            cout << "Transcription of " << outcome.RecordingsUrl << " has failed: " << outcome.ErrorDetails << endl;
+            if (submitter != nullptr && !outcome.Location.empty())
+            {
+                submitter->MarkFailed(outcome.Location, outcome.ErrorDetails);
+            }
+        }
+    });
+
+    ConcurrentResultFetcher resultFetcher(client, 8);
+    fetcher = &resultFetcher;
+    resultFetcher.Start([&](const string& url, const string& audioFileName, const SegmentResult& segResult)
+    {
+        lock_guard<mutex> lock(outputMutex);
+        store.Add(audioFileName, segResult);
+        cout << "Status: " << segResult.RecognitionStatus << endl;
+
+        if (!_stricmp(segResult.RecognitionStatus.c_str(), "success") && segResult.NBest.size() > 0)
+        {
+            cout << "Best text result was: '" << segResult.NBest.front().Display << "'" << endl;
+        }
+    });
+
+    // Listens for completions where a webhook URL is set up, and polls with backoff otherwise, or if that fails.
+    unique_ptr<WebhookListener> listener;
+    string_t webhookLocation;
+    if (webhookUrl != U("YourWebhookUrl"))
+    {
+        try
+        {
+            listener = make_unique<WebhookListener>(webhookListenerUrl, webhookSecret, [&client](const string& transcriptionId)
+            {
+                client.Notify(transcriptionId);
+            });
+            webhookLocation = client.RegisterWebhookAsync(webhookUrl, webhookSecret).get();
+            client.EnableNotifications(fallbackPollDelay);
+            cout << "Listening for transcription completions at " << utility::conversions::to_utf8string(webhookUrl) << endl;
+        }
+        catch (const exception& e)
+        {
+            cout << "Polling for transcription completions, the webhook is not available: " << e.what() << endl;
+            listener.reset();
+        }
+    }
+
+    // Submits a whole container where one is set up, resuming from the ledger of the runs before, or the files otherwise.
+    unique_ptr<ContainerBatchSubmitter> containerSubmitter;
+    if (recordingsContainerSasUrl != "YourContainerSasUrl")
+    {
+        containerSubmitter = make_unique<ContainerBatchSubmitter>(client, "submissions.ledger");
+        submitter = containerSubmitter.get();
+        cout << "Resumed " << containerSubmitter->ResumeOpenTranscriptions() << " transcriptions of an earlier run." << endl;
+        try
+        {
+            cout << "Submitted " << containerSubmitter->SubmitContainer(recordingsContainerSasUrl, myLocale) << " recordings of the container." << endl;
+        }
+        catch (const exception& e)
+        {
+            // The transcriptions submitted so far are still waited for, the next run submits the rest.
+            cout << "Listing the container has failed: " << e.what() << endl;
+        }
+    }
+    else
+    {
+        for (const auto& recordingsBlobUri : recordingsBlobUris)
+        {
+            client.Submit(TranscriptionDefinition::Create(name, description, myLocale, recordingsBlobUri));
+        }
+    }
+    client.WaitAll();
+
+    size_t throttled = 0;
+    auto limit = client.GetConcurrencyLimit(throttled);
+    cout << "Submissions throttled: " << throttled << ", in-flight limit at the end: " << limit << endl;
+
+    if (!webhookLocation.empty())
+    {
+        client.DeleteWebhookAsync(webhookLocation).wait();
+        cout << "Notifications rejected for their signature: " << listener->GetRejected() << endl;
+    }
+    listener.reset();
+
+    cout << "Waiting for the results" << endl;
+    auto downloads = resultFetcher.Finish();
+
+    for (const auto& download : downloads)
+    {
+        if (download.Succeeded)
+        {
+            cout << "There were " << download.Segments << " results in " << download.Url << endl;
+        }
+        else
+        {
+            cout << "Fetching " << download.Url << " has failed: " << download.ErrorDetails << endl;
+        }
+    }
+
+    cout << "Segments: " << store.Size() << ", words: " << store.CountWords()
+         << ", below 0.5 confidence: " << store.CountBelowConfidence(0.5f)
+         << ", audio: " << store.TotalDuration() / 10000000 << "s, memory: " << store.MemoryBytes() << " bytes" << endl;
 }
 
 int wmain()
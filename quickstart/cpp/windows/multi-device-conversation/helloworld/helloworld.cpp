@@ -3,8 +3,18 @@
 // Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 #include <speechapi_cxx.h>
 
 using namespace std::chrono_literals;
@@ -199,6 +209,269 @@ void JoinExistingConversation(const std::string& conversationId)
     conversationTranslator->LeaveConversationAsync().get();
 }
 
+// Reads the audio data of a wav file, which must be 16 kHz, 16-bit, mono PCM like the push streams below.
+std::vector<uint8_t> ReadWavAudioData(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    char riff[12];
+    if (!file.read(riff, sizeof(riff)) || std::string(riff, 4) != "RIFF" || std::string(riff + 8, 4) != "WAVE")
+    {
+        throw std::runtime_error("Not a wav file: " + fileName);
+    }
+
+    // Walks the chunks up to the data chunk.
+    char chunkHeader[8];
+    while (file.read(chunkHeader, sizeof(chunkHeader)))
+    {
+        uint32_t chunkSize = (uint8_t)chunkHeader[4] | ((uint8_t)chunkHeader[5] << 8) | ((uint8_t)chunkHeader[6] << 16) | ((uint32_t)(uint8_t)chunkHeader[7] << 24);
+        if (std::string(chunkHeader, 4) == "data")
+        {
+            std::vector<uint8_t> data(chunkSize);
+            file.read((char*)data.data(), chunkSize);
+            data.resize((size_t)file.gcount());
+            return data;
+        }
+        file.seekg(chunkSize + (chunkSize & 1), std::ios::cur);
+    }
+    throw std::runtime_error("No audio data in " + fileName);
+}
+
+// Latencies in milliseconds, summarized by percentiles.
+struct LatencySamples
+{
+    std::vector<double> Milliseconds;
+
+    void Add(std::chrono::steady_clock::duration latency)
+    {
+        Milliseconds.push_back(std::chrono::duration<double, std::milli>(latency).count());
+    }
+
+    void Print(const std::string& name)
+    {
+        if (Milliseconds.empty())
+        {
+            std::cout << name << ": no samples" << std::endl;
+            return;
+        }
+        std::sort(Milliseconds.begin(), Milliseconds.end());
+        auto percentile = [this](double p) { return Milliseconds[(size_t)(p * (Milliseconds.size() - 1))]; };
+        std::cout << name << ": count=" << Milliseconds.size() << " p50=" << percentile(0.5) << "ms p95=" << percentile(0.95)
+            << "ms p99=" << percentile(0.99) << "ms max=" << Milliseconds.back() << "ms" << std::endl;
+    }
+};
+
+// What the participants of a load test receive, shared by the event handlers of all the translators.
+struct LoadTestState
+{
+    std::mutex Mutex;
+    std::map<std::string, std::chrono::steady_clock::time_point> SentMessages;
+    std::map<std::string, std::chrono::steady_clock::time_point> FirstTranscribed;
+    LatencySamples MessageLatency;      // from the host sending a text message to each participant receiving it.
+    LatencySamples TranscribedSpread;   // from the first participant receiving a transcription to each other one receiving it.
+    size_t TranscribedCount = 0;
+    size_t CanceledCount = 0;
+};
+
+// A joining participant of a load test, with the push stream its recorded audio goes to.
+struct LoadTestParticipant
+{
+    std::shared_ptr<PushAudioInputStream> PushStream;
+    std::shared_ptr<ConversationTranslator> Translator;
+};
+
+// Creates a translator reading from a push stream, with the handlers that measure the fan-out to it.
+LoadTestParticipant CreateLoadTestParticipant(std::shared_ptr<LoadTestState> state)
+{
+    LoadTestParticipant participant;
+    participant.PushStream = AudioInputStream::CreatePushStream(AudioStreamFormat::GetWaveFormatPCM(16000, 16, 1));
+    participant.Translator = ConversationTranslator::FromConfig(AudioConfig::FromStreamInput(participant.PushStream));
+
+    participant.Translator->TextMessageReceived += [state](const ConversationTranslationEventArgs& args)
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        auto sent = state->SentMessages.find(args.Result->Text);
+        if (sent != state->SentMessages.end())
+        {
+            state->MessageLatency.Add(now - sent->second);
+        }
+    };
+    participant.Translator->Transcribed += [state](const ConversationTranslationEventArgs& args)
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        state->TranscribedCount++;
+
+        // The same utterance reaches every participant, it is identified by its speaker and its text.
+        auto first = state->FirstTranscribed.insert({ args.Result->ParticipantId + "\n" + args.Result->Text, now });
+        if (!first.second)
+        {
+            state->TranscribedSpread.Add(now - first.first->second);
+        }
+    };
+    participant.Translator->Canceled += [state](const ConversationTranslationCanceledEventArgs& args)
+    {
+        if (args.Reason == CancellationReason::Error)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            state->CanceledCount++;
+            std::cout << "CANCELED: ErrorCode=" << (long)args.ErrorCode << " ErrorDetails=" << args.ErrorDetails << std::endl;
+        }
+    };
+    return participant;
+}
+
+// Starts a conversation and joins 'participantCount' translators to it in this process. The first 'speakerCount'
+// participants send the recorded audio of 'audioFile' in real time, and the host sends text messages, to measure
+// how long the Transcribed and TextMessageReceived events take to reach all the participants. Then a participant joins
+// and leaves 'churnCycles' times, to measure the cost of churn while the conversation is busy.
+void RunConversationLoadTest(size_t participantCount, const std::string& audioFile, size_t speakerCount, size_t churnCycles)
+{
+    // Replace with your own subscription key and service region (e.g., "westus").
+    std::string subscriptionKey("YourSubscriptionKey");
+    std::string region("YourServiceRegion");
+    std::string speechLanguage("en-US");
+
+    auto audio = ReadWavAudioData(audioFile);
+    auto state = std::make_shared<LoadTestState>();
+
+    auto speechConfig = SpeechConfig::FromSubscription(subscriptionKey, region);
+    speechConfig->SetSpeechRecognitionLanguage(speechLanguage);
+    auto conversation = Conversation::CreateConversationAsync(speechConfig).get();
+    conversation->StartConversationAsync().get();
+    auto conversationId = conversation->GetConversationId();
+    std::cout << "CONVERSATION: Created a new conversation with ID " << conversationId << std::endl;
+
+    // The host only sends text messages, its push stream stays silent.
+    auto host = CreateLoadTestParticipant(state);
+    host.Translator->JoinConversationAsync(conversation, "Load Test Host").get();
+
+    // Starts all the joins before waiting for any of them.
+    std::vector<LoadTestParticipant> participants;
+    std::vector<std::future<void>> joins;
+    std::vector<std::chrono::steady_clock::time_point> joinStarts;
+    for (size_t i = 0; i < participantCount; i++)
+    {
+        participants.push_back(CreateLoadTestParticipant(state));
+        joinStarts.push_back(std::chrono::steady_clock::now());
+        joins.push_back(participants.back().Translator->JoinConversationAsync(conversationId, "participant" + std::to_string(i), speechLanguage));
+    }
+
+    LatencySamples joinLatency;
+    size_t failedJoins = 0;
+    for (size_t i = 0; i < joins.size(); i++)
+    {
+        try
+        {
+            joins[i].get();
+            joinLatency.Add(std::chrono::steady_clock::now() - joinStarts[i]);
+        }
+        catch (const std::exception& e)
+        {
+            failedJoins++;
+            std::cout << "JOIN FAILED: participant" << i << ": " << e.what() << std::endl;
+        }
+    }
+
+    std::vector<std::future<void>> starts;
+    for (auto& participant : participants)
+    {
+        starts.push_back(participant.Translator->StartTranscribingAsync());
+    }
+    for (auto& start : starts)
+    {
+        start.get();
+    }
+
+    // The speakers send the recording in real time, 100 ms at a time.
+    std::vector<std::thread> speakers;
+    for (size_t i = 0; i < speakerCount && i < participants.size(); i++)
+    {
+        auto pushStream = participants[i].PushStream;
+        speakers.emplace_back([pushStream, &audio]()
+        {
+            const size_t chunkSize = 3200;
+            auto next = std::chrono::steady_clock::now();
+            for (size_t offset = 0; offset < audio.size(); offset += chunkSize)
+            {
+                auto size = audio.size() - offset < chunkSize ? audio.size() - offset : chunkSize;
+                pushStream->Write(const_cast<uint8_t*>(audio.data() + offset), (uint32_t)size);
+                next += std::chrono::milliseconds(100);
+                std::this_thread::sleep_until(next);
+            }
+        });
+    }
+
+    // Meanwhile, the host sends a text message every second.
+    for (int i = 0; i < 10; i++)
+    {
+        auto text = "Load test message " + std::to_string(i);
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            state->SentMessages[text] = std::chrono::steady_clock::now();
+        }
+        host.Translator->SendTextMessageAsync(text).get();
+        std::this_thread::sleep_for(1s);
+    }
+
+    for (auto& speaker : speakers)
+    {
+        speaker.join();
+    }
+
+    // Waits for the last transcriptions to reach everyone.
+    std::this_thread::sleep_for(5s);
+
+    // Joins and leaves with one more participant, while the others are still in the conversation.
+    LatencySamples churnJoinLatency;
+    LatencySamples churnLeaveLatency;
+    for (size_t i = 0; i < churnCycles; i++)
+    {
+        auto churner = CreateLoadTestParticipant(state);
+        auto joinStart = std::chrono::steady_clock::now();
+        churner.Translator->JoinConversationAsync(conversationId, "churn" + std::to_string(i), speechLanguage).get();
+        auto leaveStart = std::chrono::steady_clock::now();
+        churnJoinLatency.Add(leaveStart - joinStart);
+        churner.Translator->LeaveConversationAsync().get();
+        churnLeaveLatency.Add(std::chrono::steady_clock::now() - leaveStart);
+    }
+
+    // Stops and leaves all at once.
+    std::vector<std::future<void>> stops;
+    for (auto& participant : participants)
+    {
+        stops.push_back(participant.Translator->StopTranscribingAsync());
+    }
+    for (auto& stop : stops)
+    {
+        stop.get();
+    }
+    std::vector<std::future<void>> leaves;
+    for (auto& participant : participants)
+    {
+        participant.PushStream->Close();
+        leaves.push_back(participant.Translator->LeaveConversationAsync());
+    }
+    for (auto& leave : leaves)
+    {
+        leave.get();
+    }
+    host.PushStream->Close();
+    host.Translator->LeaveConversationAsync().get();
+    conversation->EndConversationAsync().get();
+    conversation->DeleteConversationAsync().get();
+
+    std::lock_guard<std::mutex> lock(state->Mutex);
+    std::cout << "Participants: " << participantCount << ", failed joins: " << failedJoins << ", speakers: " << speakerCount
+        << ", transcribed events: " << state->TranscribedCount << ", utterances: " << state->FirstTranscribed.size()
+        << ", canceled: " << state->CanceledCount << std::endl;
+    joinLatency.Print("Join latency");
+    state->MessageLatency.Print("Text message fan-out latency");
+    state->TranscribedSpread.Print("Transcribed fan-out spread");
+    churnJoinLatency.Print("Churn join latency");
+    churnLeaveLatency.Print("Churn leave latency");
+}
+
 int main()
 {
     StartNewConversation();
@@ -206,4 +479,8 @@ int main()
     // Comment out the previous line, and uncomment the next line to join an existing conversation.
     // Remember to replace YourConversationId with the ID of the conversation you want to join
     //JoinExistingConversation("YourConversationId");
+
+    // Or uncomment the next line to measure a conversation with 100 participants, three of them speaking
+    // the audio of a 16 kHz, 16-bit, mono wav file.
+    //RunConversationLoadTest(100, "YourAudioFile.wav", 3, 10);
 }
@@ -0,0 +1,148 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "buffered_audio_file_reader.h"
+
+// The audio format of a file as found from its first bytes.
+struct SniffedAudioFormat
+{
+    // Defines how the audio is handed to the recognizer.
+    enum class Path
+    {
+        Unknown,
+        Compressed,     // a compressed pull stream in 'Container' format.
+        Pcm             // a PCM pull stream in the format given by the wav header.
+    };
+
+    Path InputPath = Path::Unknown;
+    Microsoft::CognitiveServices::Speech::Audio::AudioStreamContainerFormat Container =
+        Microsoft::CognitiveServices::Speech::Audio::AudioStreamContainerFormat::ANY;
+    uint32_t SamplesPerSecond = 0;
+    uint8_t BitsPerSample = 0;
+    uint8_t Channels = 0;
+
+    // Number of header bytes in front of the audio data, which are not passed to the recognizer.
+    uint32_t HeaderSize = 0;
+
+    // Creates the stream format for the pull stream.
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> CreateStreamFormat() const
+    {
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+        return InputPath == Path::Pcm
+            ? AudioStreamFormat::GetWaveFormatPCM(SamplesPerSecond, BitsPerSample, Channels)
+            : AudioStreamFormat::GetCompressedFormat(Container);
+    }
+};
+
+namespace AudioFormatSniffer
+{
+    // Defines how many bytes are peeked at, enough for a wav header with a few extra chunks in front of the data.
+    constexpr uint32_t peekSize = 4096;
+
+    inline uint32_t ReadLittleEndian32(const uint8_t* data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    inline uint16_t ReadLittleEndian16(const uint8_t* data)
+    {
+        return (uint16_t)(data[0] | (data[1] << 8));
+    }
+
+    // Parses a RIFF/WAVE header. PCM is passed on as PCM, A-law and mu-law are passed on as compressed audio.
+    inline bool SniffWav(const uint8_t* data, uint32_t size, SniffedAudioFormat& format)
+    {
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        constexpr uint16_t pcmTag = 0x0001;
+        constexpr uint16_t alawTag = 0x0006;
+        constexpr uint16_t mulawTag = 0x0007;
+        constexpr uint16_t extensibleTag = 0xFFFE;
+
+        bool haveFormat = false;
+        uint64_t offset = 12;
+        while (offset + 8 <= size)
+        {
+            auto chunkSize = ReadLittleEndian32(data + offset + 4);
+            if (memcmp(data + offset, "fmt ", 4) == 0 && chunkSize >= 16 && offset + 8 + 16 <= size)
+            {
+                auto body = data + offset + 8;
+                auto tag = ReadLittleEndian16(body);
+                format.Channels = (uint8_t)ReadLittleEndian16(body + 2);
+                format.SamplesPerSecond = ReadLittleEndian32(body + 4);
+                format.BitsPerSample = (uint8_t)ReadLittleEndian16(body + 14);
+                if (tag == pcmTag || tag == extensibleTag)
+                {
+                    format.InputPath = SniffedAudioFormat::Path::Pcm;
+                }
+                else if (tag == alawTag || tag == mulawTag)
+                {
+                    format.InputPath = SniffedAudioFormat::Path::Compressed;
+                    format.Container = tag == alawTag ? AudioStreamContainerFormat::ALAW : AudioStreamContainerFormat::MULAW;
+                }
+                else
+                {
+                    return false;
+                }
+                haveFormat = true;
+            }
+            else if (memcmp(data + offset, "data", 4) == 0)
+            {
+                format.HeaderSize = (uint32_t)offset + 8;
+                return haveFormat;
+            }
+
+            // Chunks are padded to an even size.
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
+        return false;
+    }
+}
+
+// Looks at the first bytes of a file to choose between the compressed and the PCM path.
+// The bytes are only peeked at, the reader still starts at the beginning of the file afterward.
+// A-law and mu-law files without a header can't be told apart from their content, they are left Unknown.
+inline SniffedAudioFormat SniffAudioFormat(BufferedAudioFileReader& reader)
+{
+    using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+    SniffedAudioFormat format;
+    const uint8_t* data = nullptr;
+    auto size = reader.Peek(&data, AudioFormatSniffer::peekSize);
+
+    if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0)
+    {
+        if (!AudioFormatSniffer::SniffWav(data, size, format))
+        {
+            format = SniffedAudioFormat();
+        }
+    }
+    else if (size >= 4 && memcmp(data, "OggS", 4) == 0)
+    {
+        // Only Opus is supported in an Ogg container, its identification header starts the first page.
+        if (size >= 36 && memcmp(data + 28, "OpusHead", 8) == 0)
+        {
+            format.InputPath = SniffedAudioFormat::Path::Compressed;
+            format.Container = AudioStreamContainerFormat::OGG_OPUS;
+        }
+    }
+    else if (size >= 4 && memcmp(data, "fLaC", 4) == 0)
+    {
+        format.InputPath = SniffedAudioFormat::Path::Compressed;
+        format.Container = AudioStreamContainerFormat::FLAC;
+    }
+    else if ((size >= 3 && memcmp(data, "ID3", 3) == 0) || (size >= 2 && data[0] == 0xFF && (data[1] & 0xE0) == 0xE0))
+    {
+        // An ID3v2 tag, or the frame sync of an MPEG audio frame.
+        format.InputPath = SniffedAudioFormat::Path::Compressed;
+        format.Container = AudioStreamContainerFormat::MP3;
+    }
+    return format;
+}
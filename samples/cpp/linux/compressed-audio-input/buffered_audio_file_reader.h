@@ -0,0 +1,257 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reads a compressed audio file (MP3, OGG_OPUS, FLAC, ALAW, MULAW) for a pull stream.
+// The SDK asks for small blocks at a time. Instead of one read per request, the reader fills a large read-ahead
+// buffer with a single read() and serves the requests from it, which matters on network file systems.
+// Alternatively, the whole file is memory-mapped and requests are served from the mapped region.
+class BufferedAudioFileReader final
+{
+public:
+    // Defines how the file is read.
+    enum class Mode
+    {
+        Buffered,   // read() into a read-ahead buffer.
+        Mapped      // mmap() of the whole file.
+    };
+
+    // Defines the default size of the read-ahead buffer.
+    static constexpr size_t defaultBufferSize = 1024 * 1024;
+
+    // Constructor that opens the file. It throws if the file can't be opened or mapped.
+    // With 'adviseSequential', the kernel is told that the file is read sequentially, so that it reads ahead eagerly.
+    BufferedAudioFileReader(const std::string& fileName, Mode mode = Mode::Buffered, size_t bufferSize = defaultBufferSize, bool adviseSequential = true)
+        : m_mode(mode)
+    {
+        if (bufferSize == 0)
+        {
+            throw std::invalid_argument("Buffer size must be positive");
+        }
+
+        m_fd = open(fileName.c_str(), O_RDONLY);
+        if (m_fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + fileName + ": " + strerror(errno));
+        }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (adviseSequential)
+        {
+            // Only a hint, failures are ignored.
+            (void)posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+#endif
+
+        if (m_mode == Mode::Mapped)
+        {
+            struct stat fileStat;
+            if (fstat(m_fd, &fileStat) != 0)
+            {
+                auto error = errno;
+                Close();
+                throw std::runtime_error("Failed to get the size of " + fileName + ": " + strerror(error));
+            }
+
+            // An empty file can't be mapped, it is simply at its end.
+            m_mappedSize = (size_t)fileStat.st_size;
+            if (m_mappedSize > 0)
+            {
+                auto address = mmap(nullptr, m_mappedSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+                if (address == MAP_FAILED)
+                {
+                    auto error = errno;
+                    Close();
+                    throw std::runtime_error("Failed to map " + fileName + ": " + strerror(error));
+                }
+                m_mapped = (const uint8_t*)address;
+                if (adviseSequential)
+                {
+                    (void)madvise(address, m_mappedSize, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        else
+        {
+            m_buffer.resize(bufferSize);
+        }
+    }
+
+    ~BufferedAudioFileReader()
+    {
+        Close();
+    }
+
+    BufferedAudioFileReader(const BufferedAudioFileReader&) = delete;
+    BufferedAudioFileReader& operator=(const BufferedAudioFileReader&) = delete;
+
+    // Copies no more than 'size' bytes to 'data'.
+    // It returns the number of bytes copied, and 0 at the end of the file or after an error.
+    int Read(uint8_t* data, uint32_t size)
+    {
+        if (m_mode == Mode::Mapped)
+        {
+            auto available = m_mappedSize - m_position;
+            auto count = size < available ? size : available;
+            if (count > 0)
+            {
+                memcpy(data, m_mapped + m_position, count);
+                m_position += count;
+            }
+            return (int)count;
+        }
+
+        uint32_t copied = 0;
+        while (copied < size)
+        {
+            if (m_bufferEnd == m_bufferStart && !Fill(0))
+            {
+                break;
+            }
+            auto available = m_bufferEnd - m_bufferStart;
+            auto count = size - copied < available ? size - copied : available;
+            memcpy(data + copied, m_buffer.data() + m_bufferStart, count);
+            m_bufferStart += count;
+            copied += (uint32_t)count;
+        }
+        return (int)copied;
+    }
+
+    // Returns in 'data' a pointer to the next bytes of the file without consuming them, so that the format of the
+    // file can be sniffed without a second open or a seek. At most the buffer size can be peeked in buffered mode.
+    // It returns the number of bytes available, which is less than 'size' only at the end of the file.
+    uint32_t Peek(const uint8_t** data, uint32_t size)
+    {
+        if (m_mode == Mode::Mapped)
+        {
+            auto available = m_mappedSize - m_position;
+            *data = m_mapped + m_position;
+            return (uint32_t)(size < available ? size : available);
+        }
+
+        if (size > m_buffer.size())
+        {
+            size = (uint32_t)m_buffer.size();
+        }
+        if (m_bufferEnd - m_bufferStart < size)
+        {
+            // Moves what is left to the front of the buffer, and reads more behind it.
+            memmove(m_buffer.data(), m_buffer.data() + m_bufferStart, m_bufferEnd - m_bufferStart);
+            m_bufferEnd -= m_bufferStart;
+            m_bufferStart = 0;
+            while (m_bufferEnd < size && Fill(m_bufferEnd))
+            {
+            }
+        }
+        *data = m_buffer.data() + m_bufferStart;
+        auto available = m_bufferEnd - m_bufferStart;
+        return (uint32_t)(size < available ? size : available);
+    }
+
+    // Consumes up to 'size' bytes without copying them, e.g. a file header found by Peek().
+    // It returns the number of bytes skipped.
+    uint32_t Skip(uint32_t size)
+    {
+        if (m_mode == Mode::Mapped)
+        {
+            auto available = m_mappedSize - m_position;
+            auto count = size < available ? size : available;
+            m_position += count;
+            return (uint32_t)count;
+        }
+
+        uint32_t skipped = 0;
+        while (skipped < size)
+        {
+            if (m_bufferEnd == m_bufferStart && !Fill(0))
+            {
+                break;
+            }
+            auto available = m_bufferEnd - m_bufferStart;
+            auto count = size - skipped < available ? size - skipped : available;
+            m_bufferStart += count;
+            skipped += (uint32_t)count;
+        }
+        return skipped;
+    }
+
+    // Unmaps and closes the file. It is safe to call more than once.
+    void Close()
+    {
+        if (m_mapped != nullptr)
+        {
+            munmap((void*)m_mapped, m_mappedSize);
+            m_mapped = nullptr;
+        }
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+        m_mappedSize = 0;
+        m_position = 0;
+        m_bufferStart = m_bufferEnd = 0;
+    }
+
+    // Gets the number of read() calls made on the file so far.
+    uint64_t GetReadCalls() const
+    {
+        return m_readCalls;
+    }
+
+private:
+    // Reads into the read-ahead buffer from 'offset' on, with the unread data in front of it.
+    // It returns false at the end of the file, after an error, or once closed.
+    bool Fill(size_t offset)
+    {
+        if (m_fd < 0 || m_endOfFile)
+        {
+            return false;
+        }
+
+        ssize_t count;
+        do
+        {
+            count = read(m_fd, m_buffer.data() + offset, m_buffer.size() - offset);
+            m_readCalls++;
+        } while (count < 0 && errno == EINTR);
+
+        if (count <= 0)
+        {
+            m_endOfFile = true;
+            return false;
+        }
+        if (offset == 0)
+        {
+            m_bufferStart = 0;
+        }
+        m_bufferEnd = offset + (size_t)count;
+        return true;
+    }
+
+    const Mode m_mode;
+    int m_fd = -1;
+
+    std::vector<uint8_t> m_buffer;
+    size_t m_bufferStart = 0;
+    size_t m_bufferEnd = 0;
+    bool m_endOfFile = false;
+    uint64_t m_readCalls = 0;
+
+    const uint8_t* m_mapped = nullptr;
+    size_t m_mappedSize = 0;
+    size_t m_position = 0;
+};
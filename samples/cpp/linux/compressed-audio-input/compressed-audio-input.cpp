@@ -4,49 +4,47 @@
 //
 
 #include <iostream> // cin, cout
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <speechapi_cxx.h>
+#include "audio_format_sniffer.h"
+#include "buffered_audio_file_reader.h"
+#ifdef ENCODE_OPUS
+#include "opus_uplink_encoder.h"
+#endif
 
 using namespace Microsoft::CognitiveServices::Speech;
 using namespace Microsoft::CognitiveServices::Speech::Audio;
 
-static void* OpenCompressedFile(const std::string& compressedFileName)
+// The pull stream reads the file through a buffered reader, one large read serves many small requests of the SDK.
+static int ReadCompressedBinaryData(void *stream, uint8_t *ptr, uint32_t bufSize)
 {
-    FILE *filep = NULL;
-    filep = fopen(compressedFileName.c_str(), "rb");
-    return filep;
+    return ((BufferedAudioFileReader*)stream)->Read(ptr, bufSize);
 }
 
-static void closeStream(void* fp)
+static void closeStream(void* stream)
 {
-    if (fp != NULL)
-    {
-        fclose((FILE*)fp);
-    }
+    ((BufferedAudioFileReader*)stream)->Close();
 }
 
-static int ReadCompressedBinaryData(void *stream, uint8_t *ptr, uint32_t bufSize)
+static bool HasSuffix(const std::string& text, const std::string& suffix)
 {
-    FILE* compressedStreamfptr = (FILE*)stream;
-    if (compressedStreamfptr != NULL && !feof(compressedStreamfptr))
-    {
-        return fread(ptr, 1, bufSize, compressedStreamfptr);
-    }
-    else
-    {
-        return 0;
-    }
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
 }
 
-void recognizeSpeech(const std::string& compressedFileName)
+void recognizeSpeech(const std::string& compressedFileName, BufferedAudioFileReader::Mode readMode, bool encodeOpus)
 {
-    std::shared_ptr<SpeechRecognizer> recognizer;
-    std::shared_ptr<PullAudioInputStream> pullAudioStream;
-
-    void *compressedFilePtr = OpenCompressedFile(compressedFileName);
-
-    if (compressedFilePtr == NULL)
+    // The reader outlives the recognizer, which reads from it until the end of the file.
+    std::unique_ptr<BufferedAudioFileReader> reader;
+    try
+    {
+        reader.reset(new BufferedAudioFileReader(compressedFileName, readMode));
+    }
+    catch (const std::exception& e)
     {
-        std::cout << "Error: Input file doesn't exist" << std::endl;
+        std::cout << "Error: " << e.what() << std::endl;
         return;
     }
 
@@ -54,78 +52,179 @@ void recognizeSpeech(const std::string& compressedFileName)
     // Replace with your own subscription key and service region (e.g., "westus").
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    AudioStreamContainerFormat inputFormat;
-
-    if (compressedFileName.find(".mp3") == (compressedFileName.size() - 4))
+    // Chooses the input format from the first bytes of the file, so that files without an extension work too.
+    // Headerless A-law and mu-law audio can't be sniffed, for these the extension is still needed.
+    auto sniffed = SniffAudioFormat(*reader);
+    if (sniffed.InputPath == SniffedAudioFormat::Path::Unknown)
     {
-        inputFormat = AudioStreamContainerFormat::MP3;
+        if (HasSuffix(compressedFileName, ".alaw"))
+        {
+            sniffed.InputPath = SniffedAudioFormat::Path::Compressed;
+            sniffed.Container = AudioStreamContainerFormat::ALAW;
+        }
+        else if (HasSuffix(compressedFileName, ".mulaw"))
+        {
+            sniffed.InputPath = SniffedAudioFormat::Path::Compressed;
+            sniffed.Container = AudioStreamContainerFormat::MULAW;
+        }
+        else
+        {
+            std::cout << "Only MP3, Opus, FLAC, A-law, mu-law and PCM wav input files are currently supported" << std::endl;
+            return;
+        }
     }
-    else if (compressedFileName.find(".opus") == (compressedFileName.size() - 5))
+
+    // The wav header is not audio, it is consumed from the buffer that was filled while sniffing.
+    reader->Skip(sniffed.HeaderSize);
+
+    // With --encode-opus, 16-bit PCM is encoded to Opus here and pushed compressed, which takes a fraction of the bandwidth.
+    std::shared_ptr<AudioConfig> audioConfig;
+#ifdef ENCODE_OPUS
+    std::shared_ptr<PushAudioInputStream> pushAudioStream;
+    std::unique_ptr<OpusUplinkEncoder> encoder;
+    if (encodeOpus && sniffed.InputPath == SniffedAudioFormat::Path::Pcm && sniffed.BitsPerSample == 16)
     {
-        inputFormat = AudioStreamContainerFormat::OGG_OPUS;
+        pushAudioStream = AudioInputStream::CreatePushStream(AudioStreamFormat::GetCompressedFormat(AudioStreamContainerFormat::OGG_OPUS));
+        try
+        {
+            encoder.reset(new OpusUplinkEncoder(pushAudioStream, sniffed.SamplesPerSecond, sniffed.Channels));
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << "Error: " << e.what() << std::endl;
+            return;
+        }
+        audioConfig = AudioConfig::FromStreamInput(pushAudioStream);
     }
-    else if (compressedFileName.find(".alaw") == (compressedFileName.size() - 5))
+    else
+#endif
     {
-        inputFormat = AudioStreamContainerFormat::ALAW;
+        auto pullAudioStream = AudioInputStream::CreatePullStream(
+            sniffed.CreateStreamFormat(),
+            reader.get(),
+            ReadCompressedBinaryData,
+            closeStream
+        );
+        audioConfig = AudioConfig::FromStreamInput(pullAudioStream);
     }
-    else if (compressedFileName.find(".mulaw") == (compressedFileName.size() - 6))
+
+    // Both Canceled and SessionStopped can end the session, only the first one completes the promise.
+    // These outlive the recognizer, so that no late event handler can touch them after destruction.
+    std::promise<void> recognitionEnd;
+    std::once_flag endSignaled;
+    auto signalEnd = [&recognitionEnd, &endSignaled]()
     {
-        inputFormat = AudioStreamContainerFormat::MULAW;
-    }
-    else if (compressedFileName.find(".flac") == (compressedFileName.size() - 5))
+        std::call_once(endSignaled, [&recognitionEnd]() { recognitionEnd.set_value(); });
+    };
+
+    auto recognizer = SpeechRecognizer::FromConfig(config, audioConfig);
+
+    // Subscribes to events.
+    recognizer->Recognizing.Connect([](const SpeechRecognitionEventArgs& e)
     {
-        inputFormat = AudioStreamContainerFormat::FLAC;
-    }
-    else
+        std::cout << "Recognizing:" << e.Result->Text << std::endl;
+    });
+
+    recognizer->Recognized.Connect([](const SpeechRecognitionEventArgs& e)
     {
-        std::cout << "Only Opus and MP3 input files are currently supported" << std::endl;
-        return;
-    }
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            std::cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl
+                << "  Offset=" << e.Result->Offset() << std::endl
+                << "  Duration=" << e.Result->Duration() << std::endl;
+        }
+        else if (e.Result->Reason == ResultReason::NoMatch)
+        {
+            std::cout << "NOMATCH: Speech could not be recognized." << std::endl;
+        }
+    });
+
+    recognizer->Canceled.Connect([&signalEnd](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        std::cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
 
-    pullAudioStream = AudioInputStream::CreatePullStream(
-        AudioStreamFormat::GetCompressedFormat(inputFormat),
-        compressedFilePtr,
-        ReadCompressedBinaryData,
-        closeStream
-    );
-    recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pullAudioStream));
+        if (e.Reason == CancellationReason::Error)
+        {
+            std::cout << "CANCELED: ErrorCode= " << (int)e.ErrorCode << std::endl;
+            std::cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
+            std::cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            signalEnd();
+        }
+    });
+
+    recognizer->SessionStopped.Connect([&signalEnd](const SessionEventArgs&)
+    {
+        std::cout << "Session stopped." << std::endl;
+        signalEnd();
+    });
 
     std::cout << "Recognizing ..." << std::endl;
 
-    // Starts speech recognition, and returns after a single utterance is recognized. The end of a
-    // single utterance is determined by listening for silence at the end or until a maximum of 15
-    // seconds of audio is processed.  The task returns the recognition text as result. 
-    // Note: Since RecognizeOnceAsync() returns only a single utterance, it is suitable only for single
-    // shot recognition like command or query. 
-    // For long-running multi-utterance recognition, use StartContinuousRecognitionAsync() instead.
-    auto result = recognizer->RecognizeOnceAsync().get();
-
-    // Checks result.
-    if (result->Reason == ResultReason::RecognizedSpeech) {
-        std::cout << "We recognized: " << result->Text << std::endl;
-    }
-    else if (result->Reason == ResultReason::NoMatch) {
-        std::cout << "NOMATCH: Speech could not be recognized." << std::endl;
-    }
-    else if (result->Reason == ResultReason::Canceled) {
-        auto cancellation = CancellationDetails::FromResult(result);
-        std::cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+    // Starts continuous recognition, which runs over the whole file, however long it is,
+    // and stops once the reader reaches the end of the file.
+    recognizer->StartContinuousRecognitionAsync().get();
 
-        if (cancellation->Reason == CancellationReason::Error) {
-            std::cout << "CANCELED: ErrorCode= " << (int)cancellation->ErrorCode << std::endl;
-            std::cout << "CANCELED: ErrorDetails=" << cancellation->ErrorDetails << std::endl;
-            std::cout << "CANCELED: Did you update the subscription info?" << std::endl;
+#ifdef ENCODE_OPUS
+    if (encoder != nullptr)
+    {
+        // Encodes the file 100 ms at a time, the encoder pushes each Ogg page once it is full and closes the stream at the end.
+        std::vector<uint8_t> buffer(sniffed.SamplesPerSecond / 10 * sniffed.Channels * 2);
+        int readBytes;
+        while ((readBytes = reader->Read(buffer.data(), (uint32_t)buffer.size())) > 0)
+        {
+            encoder->Write(buffer.data(), (uint32_t)readBytes);
         }
+        encoder->Close();
+        std::cout << "Encoded " << encoder->GetPcmBytes() << " bytes of PCM to " << encoder->GetEncodedBytes() << " bytes of Ogg Opus." << std::endl;
     }
+#endif
+
+    // Waits for recognition end.
+    recognitionEnd.get_future().get();
+
+    // Stops recognition.
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    std::cout << "Read the file with " << reader->GetReadCalls() << " read calls." << std::endl;
 }
 
 int main(int argc, char **argv) {
-    if (argc != 2)
+    auto readMode = BufferedAudioFileReader::Mode::Buffered;
+    bool encodeOpus = false;
+    int first = 1;
+    for (; first < argc; first++)
     {
-        std::cout << "Usage: ./compressed-audio-input <filename>" << std::endl;
+        std::string option = argv[first];
+        if (option == "--mmap")
+        {
+            readMode = BufferedAudioFileReader::Mode::Mapped;
+        }
+        else if (option == "--encode-opus")
+        {
+#ifdef ENCODE_OPUS
+            encodeOpus = true;
+#else
+            std::cout << "--encode-opus needs libopus, build the sample with: make ENCODE_OPUS=1" << std::endl;
+            return 1;
+#endif
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (first >= argc)
+    {
+        std::cout << "Usage: ./compressed-audio-input [--mmap] [--encode-opus] <filename> [<filename> ...]" << std::endl;
         return 0;
     }
     setlocale(LC_ALL, "");
-    recognizeSpeech(argv[1]);
+
+    // Files of different formats can be mixed, the format of each is sniffed from its content.
+    for (int i = first; i < argc; i++)
+    {
+        std::cout << "File: " << argv[i] << std::endl;
+        recognizeSpeech(argv[i], readMode, encodeOpus);
+    }
     return 0;
 }
@@ -0,0 +1,322 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <opus/opus.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Defines how PCM audio is encoded to Opus before it is pushed.
+struct OpusUplinkOptions
+{
+    // Target bitrate in bits per second. Speech is well recognized from 16 kbps on, against 256 kbps for 16 kHz 16-bit PCM.
+    int32_t Bitrate = 16000;
+
+    // Duration of an Opus frame, one of 5, 10, 20, 40 or 60 ms. Longer frames cost less overhead and add latency.
+    uint32_t FrameMs = 20;
+
+    // Duration of audio collected in an Ogg page before it is pushed. Each page costs about 30 bytes of overhead.
+    uint32_t PageMs = 200;
+};
+
+namespace OggOpus
+{
+    // Computes the CRC of an Ogg page: polynomial 0x04c11db7, not reflected, no initial or final xor.
+    inline uint32_t PageCrc(const uint8_t* data, size_t size)
+    {
+        static const std::vector<uint32_t> table = []()
+        {
+            std::vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t r = i << 24;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    r = (r & 0x80000000u) != 0 ? (r << 1) ^ 0x04c11db7u : r << 1;
+                }
+                t[i] = r;
+            }
+            return t;
+        }();
+
+        uint32_t crc = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc = (crc << 8) ^ table[((crc >> 24) ^ data[i]) & 0xFF];
+        }
+        return crc;
+    }
+
+    inline void AppendLittleEndian(std::vector<uint8_t>& out, uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+        {
+            out.push_back((uint8_t)(value >> (8 * i)));
+        }
+    }
+}
+
+// Encodes 16-bit PCM to Opus in an Ogg container on the fly, and writes it to a push stream created with the
+// OGG_OPUS compressed format, so that PCM sources, such as a wav file or a microphone, go over the network compressed.
+// Write() takes PCM in any amount; the encoded pages are pushed as they fill up, and Close() pushes the rest and ends the stream.
+// Opus takes 8, 12, 16, 24 or 48 kHz audio, in one or two channels.
+class OpusUplinkEncoder final
+{
+public:
+    OpusUplinkEncoder(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> pushStream,
+        uint32_t samplesPerSecond, uint16_t channels, const OpusUplinkOptions& options = OpusUplinkOptions())
+        : m_pushStream(pushStream), m_samplesPerSecond(samplesPerSecond), m_channels(channels), m_options(options)
+    {
+        if (pushStream == nullptr)
+        {
+            throw std::invalid_argument("A push stream is required");
+        }
+        if (channels < 1 || channels > 2 || (samplesPerSecond != 8000 && samplesPerSecond != 12000 && samplesPerSecond != 16000 &&
+            samplesPerSecond != 24000 && samplesPerSecond != 48000))
+        {
+            throw std::invalid_argument("Opus encodes 8, 12, 16, 24 or 48 kHz audio in one or two channels, not " +
+                std::to_string(samplesPerSecond) + " Hz in " + std::to_string(channels));
+        }
+        if (options.FrameMs != 5 && options.FrameMs != 10 && options.FrameMs != 20 && options.FrameMs != 40 && options.FrameMs != 60)
+        {
+            throw std::invalid_argument("The Opus frame duration must be 5, 10, 20, 40 or 60 ms");
+        }
+        if (options.Bitrate < 6000 || options.Bitrate > 510000 || options.PageMs < options.FrameMs)
+        {
+            throw std::invalid_argument("The bitrate must be within 6 and 510 kbps, and a page must hold at least one frame");
+        }
+
+        int error = OPUS_OK;
+        m_encoder = opus_encoder_create((opus_int32)samplesPerSecond, channels, OPUS_APPLICATION_VOIP, &error);
+        if (m_encoder == nullptr || error != OPUS_OK)
+        {
+            throw std::runtime_error(std::string("Failed to create the Opus encoder: ") + opus_strerror(error));
+        }
+        opus_encoder_ctl(m_encoder, OPUS_SET_BITRATE(options.Bitrate));
+        opus_encoder_ctl(m_encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+
+        // The decoder drops the encoder's lookahead at the start, which is given in 48 kHz samples.
+        opus_int32 lookahead = 0;
+        opus_encoder_ctl(m_encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+        m_preSkip = (uint16_t)(lookahead * (48000 / samplesPerSecond));
+
+        m_frameSamples = samplesPerSecond / 1000 * options.FrameMs;
+        m_pcm.reserve(m_frameSamples * channels);
+        m_packet.resize(4000);
+        m_serial = (uint32_t)(reinterpret_cast<uintptr_t>(this) >> 4);
+
+        WriteHeaders();
+    }
+
+    ~OpusUplinkEncoder()
+    {
+        try
+        {
+            Close();
+        }
+        catch (...)
+        {
+        }
+        opus_encoder_destroy(m_encoder);
+    }
+
+    OpusUplinkEncoder(const OpusUplinkEncoder&) = delete;
+    OpusUplinkEncoder& operator=(const OpusUplinkEncoder&) = delete;
+
+    // Encodes 16-bit little-endian interleaved PCM. Any size works, a frame is encoded once enough samples are collected.
+    void Write(const uint8_t* data, uint32_t size)
+    {
+        if (m_closed)
+        {
+            throw std::logic_error("The encoder is closed");
+        }
+        m_pcmBytes += size;
+
+        // Completes a sample split across writes, then copies whole samples, assuming a little-endian host.
+        uint32_t i = 0;
+        if (m_haveOddByte && size > 0)
+        {
+            m_haveOddByte = false;
+            m_pcm.push_back((int16_t)(m_oddByte | (data[0] << 8)));
+            i = 1;
+
+            // Encodes the frame right away if that sample completed it, before another odd byte can add to it.
+            AddSamples(data, 0);
+        }
+        while (size - i >= 2)
+        {
+            auto count = (std::min)(m_frameSamples * m_channels - m_pcm.size(), (size_t)(size - i) / 2);
+            AddSamples(data + i, count);
+            i += (uint32_t)count * 2;
+        }
+        if (i < size)
+        {
+            m_oddByte = data[i];
+            m_haveOddByte = true;
+        }
+    }
+
+    // Encodes the last partial frame, padded with silence, pushes the final page and closes the push stream.
+    void Close()
+    {
+        if (m_closed)
+        {
+            return;
+        }
+        m_closed = true;
+
+        auto remaining = (uint32_t)(m_pcm.size() / m_channels);
+        if (remaining > 0)
+        {
+            m_pcm.resize(m_frameSamples * m_channels, 0);
+            EncodeFrame(remaining);
+        }
+        FlushPage(true);
+        m_pushStream->Close();
+    }
+
+    // Gets the number of PCM bytes written, and the number of Ogg Opus bytes pushed for them.
+    uint64_t GetPcmBytes() const { return m_pcmBytes; }
+    uint64_t GetEncodedBytes() const { return m_encodedBytes; }
+
+private:
+    // Writes the identification and the comment headers, each on a page of its own as the Ogg Opus mapping requires.
+    void WriteHeaders()
+    {
+        std::vector<uint8_t> head = { 'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, (uint8_t)m_channels };
+        OggOpus::AppendLittleEndian(head, m_preSkip, 2);
+        OggOpus::AppendLittleEndian(head, m_samplesPerSecond, 4);
+        OggOpus::AppendLittleEndian(head, 0, 2);    // output gain.
+        head.push_back(0);                          // channel mapping family 0, mono or stereo.
+        AddPacket(head.data(), head.size());
+        FlushPage(false, 0x02);
+
+        std::string vendor = opus_get_version_string();
+        std::vector<uint8_t> tags = { 'O', 'p', 'u', 's', 'T', 'a', 'g', 's' };
+        OggOpus::AppendLittleEndian(tags, vendor.size(), 4);
+        tags.insert(tags.end(), vendor.begin(), vendor.end());
+        OggOpus::AppendLittleEndian(tags, 0, 4);    // no user comments.
+        AddPacket(tags.data(), tags.size());
+        FlushPage(false);
+    }
+
+    // Appends 'count' samples, no more than what completes the frame, and encodes the frame once it is complete.
+    void AddSamples(const uint8_t* data, size_t count)
+    {
+        if (m_pcm.size() == m_frameSamples * m_channels)
+        {
+            EncodeFrame(m_frameSamples);
+        }
+        if (count > 0)
+        {
+            auto used = m_pcm.size();
+            m_pcm.resize(used + count);
+            memcpy(m_pcm.data() + used, data, count * 2);
+        }
+        if (m_pcm.size() == m_frameSamples * m_channels)
+        {
+            EncodeFrame(m_frameSamples);
+        }
+    }
+
+    // Encodes the collected frame, of which 'samples' per channel are audio and the rest padding.
+    void EncodeFrame(uint32_t samples)
+    {
+        auto size = opus_encode(m_encoder, m_pcm.data(), (int)m_frameSamples, m_packet.data(), (opus_int32)m_packet.size());
+        if (size < 0)
+        {
+            throw std::runtime_error(std::string("Opus encoding failed: ") + opus_strerror(size));
+        }
+        m_pcm.clear();
+
+        // The granule position counts 48 kHz samples, and only the audio of the last frame, so that its padding is cut.
+        m_granule += (uint64_t)samples * (48000 / m_samplesPerSecond);
+        AddPacket(m_packet.data(), (size_t)size);
+        m_pageMs += m_options.FrameMs;
+        if (m_pageMs >= m_options.PageMs)
+        {
+            FlushPage(false);
+        }
+    }
+
+    void AddPacket(const uint8_t* data, size_t size)
+    {
+        // A packet is laced in segments of 255 bytes, ended by a shorter one, which is empty for a multiple of 255.
+        // A page holds up to 255 segments; frames are small enough that a page never holds more than a few hundred bytes.
+        for (size_t left = size; ; left -= 255)
+        {
+            m_lacing.push_back((uint8_t)(left < 255 ? left : 255));
+            if (left < 255)
+            {
+                break;
+            }
+        }
+        m_pageData.insert(m_pageData.end(), data, data + size);
+        if (m_lacing.size() > 200)
+        {
+            FlushPage(false);
+        }
+    }
+
+    void FlushPage(bool last, uint8_t flags = 0)
+    {
+        if (m_lacing.empty() && !last)
+        {
+            return;
+        }
+
+        std::vector<uint8_t> page = { 'O', 'g', 'g', 'S', 0, (uint8_t)(flags | (last ? 0x04 : 0)) };
+        OggOpus::AppendLittleEndian(page, m_granule + (m_granule > 0 ? m_preSkip : 0), 8);
+        OggOpus::AppendLittleEndian(page, m_serial, 4);
+        OggOpus::AppendLittleEndian(page, m_pageSequence++, 4);
+        OggOpus::AppendLittleEndian(page, 0, 4);    // CRC, computed over the page with this field zero.
+        page.push_back((uint8_t)m_lacing.size());
+        page.insert(page.end(), m_lacing.begin(), m_lacing.end());
+        page.insert(page.end(), m_pageData.begin(), m_pageData.end());
+
+        auto crc = OggOpus::PageCrc(page.data(), page.size());
+        for (int i = 0; i < 4; i++)
+        {
+            page[22 + i] = (uint8_t)(crc >> (8 * i));
+        }
+
+        m_pushStream->Write(page.data(), (uint32_t)page.size());
+        m_encodedBytes += page.size();
+        m_lacing.clear();
+        m_pageData.clear();
+        m_pageMs = 0;
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> m_pushStream;
+    const uint32_t m_samplesPerSecond;
+    const uint16_t m_channels;
+    const OpusUplinkOptions m_options;
+    OpusEncoder* m_encoder = nullptr;
+    uint16_t m_preSkip = 0;
+    uint32_t m_frameSamples = 0;
+
+    std::vector<int16_t> m_pcm;
+    uint8_t m_oddByte = 0;
+    bool m_haveOddByte = false;
+    std::vector<uint8_t> m_packet;
+
+    // The page being collected.
+    uint32_t m_serial = 0;
+    uint32_t m_pageSequence = 0;
+    uint64_t m_granule = 0;
+    uint32_t m_pageMs = 0;
+    std::vector<uint8_t> m_lacing;
+    std::vector<uint8_t> m_pageData;
+
+    bool m_closed = false;
+    uint64_t m_pcmBytes = 0;
+    uint64_t m_encodedBytes = 0;
+};
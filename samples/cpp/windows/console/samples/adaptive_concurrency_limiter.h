@@ -0,0 +1,246 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+// How a request that held a permit ended, for the limiter to adapt to.
+enum class ConcurrencyOutcome
+{
+    Succeeded,
+    Throttled,      // the service asked to slow down, e.g. TooManyRequests or HTTP 429.
+    Failed          // any other failure, which says nothing about the load.
+};
+
+struct AdaptiveConcurrencyOptions
+{
+    uint32_t Initial = 4;
+    uint32_t Min = 1;
+    uint32_t Max = 64;
+
+    // The limit is multiplied by this on throttling, and grows by one per limit's worth of successes.
+    double DecreaseFactor = 0.5;
+
+    // Throttling within this time of the last decrease does not decrease again, as it comes from the same overload.
+    std::chrono::milliseconds Cooldown{ 2000 };
+};
+
+struct AdaptiveConcurrencyStatistics
+{
+    uint32_t Limit = 0;
+    uint32_t InFlight = 0;
+    uint32_t PeakInFlight = 0;
+    uint64_t Succeeded = 0;
+    uint64_t Throttled = 0;
+    uint64_t Failed = 0;
+    uint64_t Increases = 0;
+    uint64_t Decreases = 0;
+};
+
+// Limits the requests in flight to a subscription with additive increase and multiplicative decrease, like TCP
+// congestion control: the limit grows by one each time as many requests as the limit succeeded while it was reached,
+// and is cut by the decrease factor when the service throttles. So the batch pipelines settle at the concurrency the
+// service sustains, without tuning. Throttling is per subscription, so the pipelines that share one share a limiter.
+class AdaptiveConcurrencyLimiter final
+{
+public:
+    // The right to have one request in flight. Releasing it tells the limiter how the request went; one that is
+    // destroyed without being released counts as Failed.
+    class Permit final
+    {
+    public:
+        Permit() = default;
+
+        Permit(Permit&& other) noexcept
+            : m_limiter(other.m_limiter), m_saturated(other.m_saturated)
+        {
+            other.m_limiter = nullptr;
+        }
+
+        Permit& operator=(Permit&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Release(ConcurrencyOutcome::Failed);
+                m_limiter = other.m_limiter;
+                m_saturated = other.m_saturated;
+                other.m_limiter = nullptr;
+            }
+            return *this;
+        }
+
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+
+        ~Permit()
+        {
+            Release(ConcurrencyOutcome::Failed);
+        }
+
+        void Release(ConcurrencyOutcome outcome)
+        {
+            if (m_limiter != nullptr)
+            {
+                m_limiter->Complete(m_saturated, outcome);
+                m_limiter = nullptr;
+            }
+        }
+
+        explicit operator bool() const
+        {
+            return m_limiter != nullptr;
+        }
+
+    private:
+        friend class AdaptiveConcurrencyLimiter;
+
+        Permit(AdaptiveConcurrencyLimiter* limiter, bool saturated)
+            : m_limiter(limiter), m_saturated(saturated)
+        {
+        }
+
+        AdaptiveConcurrencyLimiter* m_limiter = nullptr;
+
+        // Whether the limit was reached when it was granted; only then does its success show the limit can grow.
+        bool m_saturated = false;
+    };
+
+    explicit AdaptiveConcurrencyLimiter(AdaptiveConcurrencyOptions options = AdaptiveConcurrencyOptions())
+        : m_options(options), m_limit(options.Initial)
+    {
+        if (options.Min == 0 || options.Min > options.Initial || options.Initial > options.Max ||
+            options.DecreaseFactor <= 0 || options.DecreaseFactor >= 1)
+        {
+            throw std::invalid_argument("Limits with 0 < Min <= Initial <= Max and a decrease factor in (0, 1) are required");
+        }
+    }
+
+    AdaptiveConcurrencyLimiter(const AdaptiveConcurrencyLimiter&) = delete;
+    AdaptiveConcurrencyLimiter& operator=(const AdaptiveConcurrencyLimiter&) = delete;
+
+    // Gets whether a cancellation error code means the service is throttling.
+    static bool IsThrottling(Microsoft::CognitiveServices::Speech::CancellationErrorCode code)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        return code == CancellationErrorCode::TooManyRequests || code == CancellationErrorCode::ServiceUnavailable;
+    }
+
+    // Gets whether an HTTP status code of a REST request, e.g. of the batch transcription API, means the service is throttling.
+    static bool IsThrottling(int httpStatusCode)
+    {
+        return httpStatusCode == 429 || httpStatusCode == 503;
+    }
+
+    // Gets whether an exception of a request that reports errors by throwing, e.g. VoiceProfileClient::CreateProfileAsync(),
+    // says that the service is throttling, by the HTTP status or the error name in its message.
+    static bool IsThrottling(const std::exception& error)
+    {
+        std::string message = error.what();
+        std::transform(message.begin(), message.end(), message.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+        return message.find("429") != std::string::npos || message.find("too many requests") != std::string::npos
+            || message.find("toomanyrequests") != std::string::npos;
+    }
+
+    // Waits until fewer requests than the limit are in flight.
+    Permit Acquire()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_available.wait(lock, [this]() { return m_inFlight < m_limit; });
+        return Grant();
+    }
+
+    // Gets a permit without waiting, for a caller that has other work to do meanwhile. Returns false if at the limit.
+    bool TryAcquire(Permit& permit)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_inFlight >= m_limit)
+        {
+            return false;
+        }
+        permit = Grant();
+        return true;
+    }
+
+    uint32_t GetLimit() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_limit;
+    }
+
+    AdaptiveConcurrencyStatistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto statistics = m_statistics;
+        statistics.Limit = m_limit;
+        statistics.InFlight = m_inFlight;
+        return statistics;
+    }
+
+private:
+    Permit Grant()
+    {
+        m_inFlight++;
+        m_statistics.PeakInFlight = (std::max)(m_statistics.PeakInFlight, m_inFlight);
+        return Permit(this, m_inFlight >= m_limit);
+    }
+
+    void Complete(bool saturated, ConcurrencyOutcome outcome)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight--;
+            switch (outcome)
+            {
+            case ConcurrencyOutcome::Succeeded:
+                m_statistics.Succeeded++;
+                if (saturated && m_limit < m_options.Max)
+                {
+                    m_credit += 1.0 / m_limit;
+                    if (m_credit >= 1)
+                    {
+                        m_credit = 0;
+                        m_limit++;
+                        m_statistics.Increases++;
+                    }
+                }
+                break;
+            case ConcurrencyOutcome::Throttled:
+            {
+                m_statistics.Throttled++;
+                auto now = std::chrono::steady_clock::now();
+                if (m_statistics.Decreases == 0 || now - m_lastDecrease >= m_options.Cooldown)
+                {
+                    m_limit = (std::max)(m_options.Min, (uint32_t)(m_limit * m_options.DecreaseFactor));
+                    m_lastDecrease = now;
+                    m_credit = 0;
+                    m_statistics.Decreases++;
+                }
+                break;
+            }
+            case ConcurrencyOutcome::Failed:
+                m_statistics.Failed++;
+                break;
+            }
+        }
+        m_available.notify_all();
+    }
+
+    const AdaptiveConcurrencyOptions m_options;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_available;
+    uint32_t m_limit;
+    uint32_t m_inFlight = 0;
+    double m_credit = 0;
+    std::chrono::steady_clock::time_point m_lastDecrease;
+    AdaptiveConcurrencyStatistics m_statistics;
+};
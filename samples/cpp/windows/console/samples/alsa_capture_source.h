@@ -0,0 +1,401 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audio_stream_tee.h"
+#include "latency_histogram.h"
+
+// The capture source needs the ALSA headers, of e.g. the libasound2-dev package, besides the library the Linux build links.
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<alsa/asoundlib.h>)
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <sched.h>
+#define ALSA_CAPTURE_SOURCE_AVAILABLE
+#endif
+#endif
+
+// A lock-free ring of one producer and one consumer thread, each of which never waits on the other: a write that does
+// not fit is cut short, and a read gets what there is. The capacity is rounded up to a power of two.
+template <class T>
+class SpscRing final
+{
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("Capacity must be positive");
+        }
+        size_t rounded = 1;
+        while (rounded < capacity)
+        {
+            rounded *= 2;
+        }
+        m_data.resize(rounded);
+        m_mask = rounded - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // On the producer thread: writes up to 'count' items, and returns how many fit.
+    size_t Write(const T* items, size_t count)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        auto tail = m_tail.load(std::memory_order_acquire);
+        count = (std::min)(count, m_data.size() - (head - tail));
+        for (size_t i = 0; i < count; i++)
+        {
+            m_data[(head + i) & m_mask] = items[i];
+        }
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // On the consumer thread: reads up to 'count' items, and returns how many there were.
+    size_t Read(T* items, size_t count)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto head = m_head.load(std::memory_order_acquire);
+        count = (std::min)(count, head - tail);
+        for (size_t i = 0; i < count; i++)
+        {
+            items[i] = m_data[(tail + i) & m_mask];
+        }
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // On the consumer thread: gets the oldest item without reading it. Returns false if there is none.
+    bool Peek(T& item) const
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail)
+        {
+            return false;
+        }
+        item = m_data[tail & m_mask];
+        return true;
+    }
+
+    size_t Capacity() const
+    {
+        return m_data.size();
+    }
+
+private:
+    std::vector<T> m_data;
+    size_t m_mask;
+
+    // Count the items written and read since the start; they are apart by a cache line, as each is written by one thread.
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+};
+
+struct AlsaCaptureOptions
+{
+    std::string Device = "default";
+    uint32_t SamplesPerSecond = 16000;
+    uint16_t Channels = 1;
+
+    // The period is the audio ALSA hands over at a time, and the latency it adds; the buffer holds 'Periods' of them,
+    // the margin the capture thread has when it is late, before an overrun loses audio.
+    uint32_t PeriodFrames = 160;            // 10 ms at 16 kHz.
+    uint32_t Periods = 4;
+
+    // Runs the capture thread with SCHED_FIFO at this priority, 0 for the normal scheduling. It needs CAP_SYS_NICE
+    // or an rtprio limit, e.g. in /etc/security/limits.conf; without them the thread keeps the normal scheduling.
+    int RealTimePriority = 50;
+
+    // How much audio the ring between the capture thread and the push thread holds.
+    uint32_t RingMilliseconds = 1000;
+};
+
+struct AlsaCaptureStatistics
+{
+    uint64_t CapturedBytes = 0;
+    uint64_t PushedBytes = 0;
+    uint64_t Overruns = 0;                  // xruns: ALSA's buffer was full as the capture thread was late.
+    uint64_t RingOverflows = 0;             // periods cut short as the push thread was late.
+    bool RealTime = false;                  // whether the capture thread got the real-time priority.
+    uint32_t PeriodFrames = 0;              // what the device granted, which may differ from what was asked.
+    uint32_t BufferFrames = 0;
+    LatencyHistogram LatencyMilliseconds;   // from the capture of the last sample of each period to its push.
+};
+
+#ifdef ALSA_CAPTURE_SOURCE_AVAILABLE
+
+// Captures 16-bit PCM audio from an ALSA device into a push stream, instead of FromDefaultMicrophoneInput(), with the
+// period and buffer sizes under control, for a lower latency. A capture thread, real-time if it may, only reads the
+// periods and writes them to a lock-free ring; a push thread writes the ring to the push stream, so that the SDK
+// never delays the capture. The overruns of ALSA's buffer and of the ring are counted, and the latency from the
+// capture of each period, counting the delay ALSA reports, to its push.
+class AlsaCaptureSource final
+{
+public:
+    // With an archive, e.g. a FileAudioSink, the audio pushed is also written to it, on the push thread.
+    explicit AlsaCaptureSource(const AlsaCaptureOptions& options = AlsaCaptureOptions(), std::shared_ptr<AudioSink> archive = nullptr)
+        : m_options(Validate(options)),
+        m_frameBytes(2u * options.Channels),
+        m_audio((size_t)options.SamplesPerSecond * options.RingMilliseconds / 1000 * 2u * options.Channels),
+        m_periods(m_audio.Capacity() / ((size_t)options.PeriodFrames * 2u * options.Channels) + 1),
+        m_archive(std::move(archive))
+    {
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        m_stream = AudioInputStream::CreatePushStream(
+            AudioStreamFormat::GetWaveFormatPCM(options.SamplesPerSecond, 16, (uint8_t)options.Channels));
+    }
+
+    ~AlsaCaptureSource()
+    {
+        Stop();
+    }
+
+    AlsaCaptureSource(const AlsaCaptureSource&) = delete;
+    AlsaCaptureSource& operator=(const AlsaCaptureSource&) = delete;
+
+    // Gets the push stream the audio goes to, for AudioConfig::FromStreamInput().
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> GetStream() const
+    {
+        return m_stream;
+    }
+
+    // Opens the device and starts capturing. Throws if the device or its parameters are refused.
+    void Start()
+    {
+        if (m_pcm != nullptr)
+        {
+            throw std::logic_error("The capture is started already");
+        }
+        Open();
+        m_stopping = false;
+        m_captureDone = false;
+        m_pushThread = std::thread([this]() { PushLoop(); });
+        m_captureThread = std::thread([this]() { CaptureLoop(); });
+    }
+
+    // Stops capturing, pushes what was captured, and closes the push stream, which ends the recognition.
+    // The archive, if any, is left for its owner to close.
+    void Stop()
+    {
+        if (m_pcm == nullptr)
+        {
+            return;
+        }
+        m_stopping = true;
+        m_captureThread.join();
+        m_captureDone = true;
+        m_pushThread.join();
+        snd_pcm_close(m_pcm);
+        m_pcm = nullptr;
+        m_stream->Close();
+    }
+
+    AlsaCaptureStatistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto statistics = m_statistics;
+        statistics.CapturedBytes = m_capturedBytes;
+        statistics.Overruns = m_overruns;
+        statistics.RingOverflows = m_ringOverflows;
+        statistics.RealTime = m_realTime;
+        return statistics;
+    }
+
+private:
+    // Checks the options before the rings are sized from them, in the first member initializer.
+    static const AlsaCaptureOptions& Validate(const AlsaCaptureOptions& options)
+    {
+        if (options.Channels == 0 || options.PeriodFrames == 0 || options.Periods < 2 || options.SamplesPerSecond == 0)
+        {
+            throw std::invalid_argument("Channels, a period and at least two periods of buffer are required");
+        }
+        return options;
+    }
+
+    // The end of a period in the audio captured, and when its last sample was captured.
+    struct PeriodStamp
+    {
+        uint64_t EndByte;
+        std::chrono::steady_clock::time_point Captured;
+    };
+
+    void Open()
+    {
+        auto check = [this](int error, const char* what)
+        {
+            if (error < 0)
+            {
+                if (m_pcm != nullptr)
+                {
+                    snd_pcm_close(m_pcm);
+                    m_pcm = nullptr;
+                }
+                throw std::runtime_error(std::string("ALSA capture failed to ") + what + ": " + snd_strerror(error));
+            }
+        };
+
+        check(snd_pcm_open(&m_pcm, m_options.Device.c_str(), SND_PCM_STREAM_CAPTURE, 0), "open the device");
+
+        snd_pcm_hw_params_t* hardware;
+        snd_pcm_hw_params_alloca(&hardware);
+        check(snd_pcm_hw_params_any(m_pcm, hardware), "get the hardware parameters");
+        check(snd_pcm_hw_params_set_access(m_pcm, hardware, SND_PCM_ACCESS_RW_INTERLEAVED), "set interleaved access");
+        check(snd_pcm_hw_params_set_format(m_pcm, hardware, SND_PCM_FORMAT_S16_LE), "set 16-bit samples");
+        check(snd_pcm_hw_params_set_channels(m_pcm, hardware, m_options.Channels), "set the channels");
+
+        // The SDK is told the rate of the stream, so the device must capture at that rate exactly.
+        unsigned int rate = m_options.SamplesPerSecond;
+        check(snd_pcm_hw_params_set_rate(m_pcm, hardware, rate, 0), "set the sample rate");
+
+        snd_pcm_uframes_t period = m_options.PeriodFrames;
+        check(snd_pcm_hw_params_set_period_size_near(m_pcm, hardware, &period, nullptr), "set the period size");
+        snd_pcm_uframes_t buffer = period * m_options.Periods;
+        check(snd_pcm_hw_params_set_buffer_size_near(m_pcm, hardware, &buffer), "set the buffer size");
+        check(snd_pcm_hw_params(m_pcm, hardware), "apply the hardware parameters");
+
+        // Wakes the capture thread for each period.
+        snd_pcm_sw_params_t* software;
+        snd_pcm_sw_params_alloca(&software);
+        check(snd_pcm_sw_params_current(m_pcm, software), "get the software parameters");
+        check(snd_pcm_sw_params_set_avail_min(m_pcm, software, period), "set the wakeup threshold");
+        check(snd_pcm_sw_params(m_pcm, software), "apply the software parameters");
+        check(snd_pcm_prepare(m_pcm), "prepare the device");
+
+        m_periodFrames = (uint32_t)period;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.PeriodFrames = (uint32_t)period;
+        m_statistics.BufferFrames = (uint32_t)buffer;
+    }
+
+    void CaptureLoop()
+    {
+        if (m_options.RealTimePriority > 0)
+        {
+            sched_param parameters{};
+            parameters.sched_priority = m_options.RealTimePriority;
+            m_realTime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0;
+        }
+
+        std::vector<uint8_t> period((size_t)m_periodFrames * m_frameBytes);
+        uint64_t captured = 0;
+        snd_pcm_start(m_pcm);
+        while (!m_stopping)
+        {
+            auto frames = snd_pcm_readi(m_pcm, period.data(), m_periodFrames);
+            if (frames < 0)
+            {
+                // An overrun, on -EPIPE, or a suspend is recovered from by restarting the capture; the audio is lost.
+                if (frames == -EPIPE)
+                {
+                    m_overruns++;
+                }
+                if (snd_pcm_recover(m_pcm, (int)frames, 1) < 0 || snd_pcm_start(m_pcm) < 0)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            // The frames of the device's buffer not read yet were captured after the last one of this period.
+            snd_pcm_sframes_t delay = 0;
+            auto now = std::chrono::steady_clock::now();
+            if (snd_pcm_delay(m_pcm, &delay) == 0 && delay > 0)
+            {
+                now -= std::chrono::microseconds((uint64_t)delay * 1000000 / m_options.SamplesPerSecond);
+            }
+
+            auto bytes = (size_t)frames * m_frameBytes;
+            auto written = m_audio.Write(period.data(), bytes);
+            if (written < bytes)
+            {
+                m_ringOverflows++;
+            }
+            captured += written;
+            m_capturedBytes += bytes;
+
+            PeriodStamp stamp{ captured, now };
+            m_periods.Write(&stamp, 1);
+        }
+        snd_pcm_drop(m_pcm);
+    }
+
+    void PushLoop()
+    {
+        std::vector<uint8_t> buffer((size_t)m_periodFrames * m_frameBytes * m_options.Periods);
+        auto idle = std::chrono::microseconds((uint64_t)m_periodFrames * 1000000 / m_options.SamplesPerSecond / 2);
+        uint64_t pushed = 0;
+        while (true)
+        {
+            // Checked before reading, so that the audio captured before the capture thread ended is pushed too.
+            bool done = m_captureDone;
+            auto size = m_audio.Read(buffer.data(), buffer.size());
+            if (size == 0)
+            {
+                if (done)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(idle);
+                continue;
+            }
+
+            m_stream->Write(buffer.data(), (uint32_t)size);
+            if (m_archive != nullptr)
+            {
+                m_archive->Write(buffer.data(), size);
+            }
+            pushed += size;
+
+            auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_statistics.PushedBytes = pushed;
+            PeriodStamp stamp;
+            while (m_periods.Peek(stamp) && stamp.EndByte <= pushed)
+            {
+                m_periods.Read(&stamp, 1);
+                m_statistics.LatencyMilliseconds.Add(std::chrono::duration<double, std::milli>(now - stamp.Captured).count());
+            }
+        }
+    }
+
+    const AlsaCaptureOptions m_options;
+    const uint32_t m_frameBytes;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> m_stream;
+    snd_pcm_t* m_pcm = nullptr;
+    uint32_t m_periodFrames = 0;
+
+    SpscRing<uint8_t> m_audio;
+    SpscRing<PeriodStamp> m_periods;
+    const std::shared_ptr<AudioSink> m_archive;
+    std::atomic<bool> m_stopping{ false };
+    std::atomic<bool> m_captureDone{ false };
+    std::thread m_captureThread;
+    std::thread m_pushThread;
+
+    // Counted by the capture thread without a lock.
+    std::atomic<uint64_t> m_capturedBytes{ 0 };
+    std::atomic<uint64_t> m_overruns{ 0 };
+    std::atomic<uint64_t> m_ringOverflows{ 0 };
+    std::atomic<bool> m_realTime{ false };
+
+    mutable std::mutex m_mutex;
+    AlsaCaptureStatistics m_statistics;
+};
+
+#endif
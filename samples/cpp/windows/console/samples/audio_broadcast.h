@@ -0,0 +1,255 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "wav_file_reader.h"
+
+// Reads an audio source once and hands the same audio to several consumers, e.g. recognizers that verify the speaker
+// against different profiles. The audio is read into reference-counted blocks kept in a bounded window. Every
+// consumer walks the window at its own speed, and a block is released once the slowest consumer is past it. The
+// producer waits while the window is full, so a slow consumer holds back the source instead of growing the memory.
+// The blocks are shared by all the consumers, the payload is never copied per consumer.
+class AudioBroadcast final
+{
+    struct SharedState;
+
+public:
+    // A block of audio shared by all the consumers.
+    using Block = std::vector<uint8_t>;
+
+    // One reader of the broadcast audio.
+    class Consumer final
+    {
+    public:
+        // Gets the next block, or nullptr at the end of the audio. Waits until the producer has read it.
+        std::shared_ptr<const Block> Next()
+        {
+            std::unique_lock<std::mutex> lock(m_state->Mutex);
+            m_state->Changed.wait(lock, [this]() { return Index() < m_state->Blocks.size() || m_state->Ended; });
+            if (Index() >= m_state->Blocks.size())
+            {
+                return nullptr;
+            }
+
+            auto block = m_state->Blocks[Index()];
+            m_position++;
+            m_state->Trim();
+            lock.unlock();
+            m_state->Changed.notify_all();
+            return block;
+        }
+
+        // Copies no more than 'size' bytes of audio to 'dataBuffer', with the semantics of WavFileReader::Read().
+        int Read(uint8_t* dataBuffer, uint32_t size)
+        {
+            if (m_current == nullptr || m_offset == m_current->size())
+            {
+                m_current = Next();
+                m_offset = 0;
+                if (m_current == nullptr)
+                {
+                    return 0;
+                }
+            }
+
+            auto remaining = m_current->size() - m_offset;
+            auto count = size < remaining ? size : (uint32_t)remaining;
+            memcpy(dataBuffer, m_current->data() + m_offset, count);
+            m_offset += count;
+            return (int)count;
+        }
+
+        // Stops reading, so that the producer no longer waits for this consumer.
+        void Close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_state->Mutex);
+                m_closed = true;
+                m_state->Trim();
+            }
+            m_state->Changed.notify_all();
+            m_current = nullptr;
+        }
+
+    private:
+        friend class AudioBroadcast;
+
+        // Gets the index of the next block in the window. Called with the mutex held.
+        size_t Index() const
+        {
+            return (size_t)(m_position - m_state->FirstPosition);
+        }
+
+        std::shared_ptr<SharedState> m_state;
+        uint64_t m_position = 0;            // position of the next block in the whole audio.
+        bool m_closed = false;
+        std::shared_ptr<const Block> m_current;
+        size_t m_offset = 0;
+    };
+
+    // A pull stream callback that reads from a consumer of the broadcast.
+    class PullCallback final : public Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback
+    {
+    public:
+        PullCallback(std::shared_ptr<Consumer> consumer)
+            : m_consumer(consumer)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            return m_consumer->Read(dataBuffer, size);
+        }
+
+        void Close() override
+        {
+            m_consumer->Close();
+        }
+
+    private:
+        std::shared_ptr<Consumer> m_consumer;
+    };
+
+    // Defines the default block size, 100 ms of 16 kHz 16-bit mono audio.
+    static constexpr uint32_t defaultBlockSize = 3200;
+
+    // Constructor for a window of up to 'capacity' blocks of 'blockSize' bytes.
+    AudioBroadcast(uint32_t blockSize = defaultBlockSize, size_t capacity = 64)
+        : m_state(std::make_shared<SharedState>()), m_blockSize(blockSize)
+    {
+        if (blockSize == 0 || capacity == 0)
+        {
+            throw std::invalid_argument("Block size and capacity must be positive");
+        }
+        m_state->Capacity = capacity;
+    }
+
+    // Adds a consumer. All the consumers must be added before the audio is read.
+    std::shared_ptr<Consumer> AddConsumer()
+    {
+        auto consumer = std::shared_ptr<Consumer>(new Consumer());
+        consumer->m_state = m_state;
+
+        std::lock_guard<std::mutex> lock(m_state->Mutex);
+        if (m_state->FirstPosition != 0 || !m_state->Blocks.empty())
+        {
+            throw std::logic_error("Consumers must be added before the audio is read");
+        }
+        m_state->Consumers.push_back(consumer);
+        return consumer;
+    }
+
+    // Creates a pull stream that reads from a new consumer.
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStream> CreatePullStream(const WavFormat& format)
+    {
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        auto streamFormat = AudioStreamFormat::GetWaveFormatPCM(format.SamplesPerSec, (uint8_t)format.BitsPerSample, (uint8_t)format.Channels);
+        return AudioInputStream::CreatePullStream(streamFormat, std::make_shared<PullCallback>(AddConsumer()));
+    }
+
+    // Starts a thread that writes the blocks of a new consumer into 'pushStream', and closes the stream at the end.
+    // The caller joins the thread.
+    std::thread FeedPushStream(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> pushStream)
+    {
+        auto consumer = AddConsumer();
+        return std::thread([consumer, pushStream]()
+        {
+            while (auto block = consumer->Next())
+            {
+                pushStream->Write(const_cast<uint8_t*>(block->data()), (uint32_t)block->size());
+            }
+            pushStream->Close();
+        });
+    }
+
+    // Stops reading the source, e.g. when consumers are done before the end of the audio but don't close their streams.
+    // The consumers still get the blocks already read, and then the end of the audio.
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_state->Mutex);
+            m_state->Stopped = true;
+        }
+        m_state->Changed.notify_all();
+    }
+
+    // Reads all the audio of 'reader' into the window, waiting while the window is full, and then ends the broadcast.
+    // 'Reader' is any type with the Read() of WavFileReader.
+    template<typename Reader>
+    void Run(Reader& reader)
+    {
+        while (true)
+        {
+            auto block = std::make_shared<Block>(m_blockSize);
+            auto size = reader.Read(block->data(), m_blockSize);
+            if (size <= 0)
+            {
+                break;
+            }
+            block->resize((size_t)size);
+
+            std::unique_lock<std::mutex> lock(m_state->Mutex);
+            m_state->Changed.wait(lock, [this]() { return m_state->Blocks.size() < m_state->Capacity || m_state->Stopped; });
+            if (m_state->Stopped)
+            {
+                break;
+            }
+            m_state->Blocks.push_back(std::move(block));
+            lock.unlock();
+            m_state->Changed.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_state->Mutex);
+            m_state->Ended = true;
+        }
+        m_state->Changed.notify_all();
+    }
+
+private:
+    struct SharedState
+    {
+        std::mutex Mutex;
+        std::condition_variable Changed;
+        std::deque<std::shared_ptr<const Block>> Blocks;
+        uint64_t FirstPosition = 0;         // position of Blocks.front() in the whole audio.
+        size_t Capacity = 0;
+        bool Ended = false;
+        bool Stopped = false;
+        std::vector<std::weak_ptr<Consumer>> Consumers;
+
+        // Releases the blocks that all the open consumers are past. Called with the mutex held.
+        void Trim()
+        {
+            auto slowest = FirstPosition + Blocks.size();
+            for (auto& weak : Consumers)
+            {
+                auto consumer = weak.lock();
+                if (consumer != nullptr && !consumer->m_closed && consumer->m_position < slowest)
+                {
+                    slowest = consumer->m_position;
+                }
+            }
+            while (FirstPosition < slowest)
+            {
+                Blocks.pop_front();
+                FirstPosition++;
+            }
+        }
+    };
+
+    std::shared_ptr<SharedState> m_state;
+    const uint32_t m_blockSize;
+};
@@ -0,0 +1,124 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// Returns true if the file name ends with the given (lower case) extension, e.g. ".wav".
+inline bool HasFileExtension(const std::string& fileName, const std::string& extension)
+{
+    if (fileName.size() < extension.size())
+    {
+        return false;
+    }
+    auto suffix = fileName.substr(fileName.size() - extension.size());
+    std::transform(suffix.begin(), suffix.end(), suffix.begin(), [](char c) { return (char)::tolower((unsigned char)c); });
+    return suffix == extension;
+}
+
+// Returns true if the path names an existing directory.
+inline bool IsDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    auto attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    struct stat pathStat;
+    return stat(path.c_str(), &pathStat) == 0 && S_ISDIR(pathStat.st_mode);
+#endif
+}
+
+// Lists the audio files to process from either a directory or a manifest file.
+// For a directory, all the files with the given extension directly in it are returned, sorted by name.
+// A manifest is a text file with one audio file path per line; empty lines and lines starting with '#' are skipped.
+inline std::vector<std::string> ListAudioFiles(const std::string& path, const std::string& extension = ".wav")
+{
+    std::vector<std::string> files;
+
+    if (IsDirectory(path))
+    {
+        auto directory = path;
+        if (directory.back() != '/' && directory.back() != '\\')
+        {
+#ifdef _WIN32
+            directory += '\\';
+#else
+            directory += '/';
+#endif
+        }
+
+#ifdef _WIN32
+        WIN32_FIND_DATAA findData;
+        auto find = FindFirstFileA((directory + "*").c_str(), &findData);
+        if (find != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                std::string name = findData.cFileName;
+                if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && HasFileExtension(name, extension))
+                {
+                    files.push_back(directory + name);
+                }
+            } while (FindNextFileA(find, &findData));
+            FindClose(find);
+        }
+#else
+        auto dir = opendir(directory.c_str());
+        if (dir == nullptr)
+        {
+            throw std::invalid_argument("Failed to open the specified directory.");
+        }
+        while (auto entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (HasFileExtension(name, extension) && !IsDirectory(directory + name))
+            {
+                files.push_back(directory + name);
+            }
+        }
+        closedir(dir);
+#endif
+        std::sort(files.begin(), files.end());
+    }
+    else
+    {
+        std::ifstream manifest(path);
+        if (!manifest.good())
+        {
+            throw std::invalid_argument("Failed to open the specified directory or manifest file.");
+        }
+
+        std::string line;
+        while (getline(manifest, line))
+        {
+            // Tolerates manifests with Windows line endings.
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!line.empty() && line[0] != '#')
+            {
+                files.push_back(line);
+            }
+        }
+    }
+
+    return files;
+}
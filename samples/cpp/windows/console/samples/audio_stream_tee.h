@@ -0,0 +1,414 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chunked_audio_buffer.h"
+
+// A destination of the audio read by an AudioStreamTee.
+class AudioSink
+{
+public:
+    virtual ~AudioSink() = default;
+
+    // Consumes a chunk of audio. The data is only valid during the call.
+    virtual void Write(const uint8_t* data, size_t size) = 0;
+
+    // Called once after the last chunk.
+    virtual void Close() {}
+};
+
+// Writes the audio to a file on a background thread, so that the disk never stalls the other sinks.
+// With a wave format, a RIFF header is written in front of the audio and its lengths are filled in on Close().
+class FileAudioSink final : public AudioSink
+{
+public:
+    // Constructor for a raw audio file.
+    FileAudioSink(const std::string& fileName)
+        : FileAudioSink(fileName, 0, 0, 0)
+    {
+    }
+
+    // Constructor for a wav file of PCM audio in the given format.
+    FileAudioSink(const std::string& fileName, uint32_t samplesPerSecond, uint16_t bitsPerSample, uint16_t channels)
+        : m_file(fileName, std::ios::binary), m_fileName(fileName)
+    {
+        if (!m_file.good())
+        {
+            throw std::invalid_argument("Failed to open " + fileName);
+        }
+
+        m_wavHeader = samplesPerSecond != 0;
+        if (m_wavHeader)
+        {
+            WriteWavHeader(samplesPerSecond, bitsPerSample, channels, 0);
+        }
+        m_writer = std::thread([this]() { WriterLoop(); });
+    }
+
+    // Creates a sink for the audio of a speech synthesis output format, e.g. "riff-24khz-16bit-mono-pcm": a wav file in
+    // that format for PCM, or a raw file for compressed formats. An empty name is the SDK default, 16 kHz 16-bit mono PCM.
+    static std::shared_ptr<FileAudioSink> FromSynthesisOutputFormat(const std::string& fileName, const std::string& outputFormat)
+    {
+        if (outputFormat.empty())
+        {
+            return std::make_shared<FileAudioSink>(fileName, 16000, 16, 1);
+        }
+
+        if (!EndsWith(outputFormat, "-pcm"))
+        {
+            return std::make_shared<FileAudioSink>(fileName);
+        }
+
+        // The fields are e.g. "16khz" or "22050hz", "16bit" and "mono" or "stereo".
+        uint32_t samplesPerSecond = 0;
+        uint16_t bitsPerSample = 0;
+        uint16_t channels = 0;
+        size_t start = 0;
+        while (start < outputFormat.size())
+        {
+            auto end = outputFormat.find('-', start);
+            auto field = outputFormat.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            auto value = (uint32_t)strtoul(field.c_str(), nullptr, 10);
+            if (field == "mono" || field == "stereo")
+            {
+                channels = field == "mono" ? 1 : 2;
+            }
+            else if (EndsWith(field, "khz"))
+            {
+                samplesPerSecond = value * 1000;
+            }
+            else if (EndsWith(field, "hz"))
+            {
+                samplesPerSecond = value;
+            }
+            else if (EndsWith(field, "bit"))
+            {
+                bitsPerSample = (uint16_t)value;
+            }
+            start = end == std::string::npos ? outputFormat.size() : end + 1;
+        }
+
+        if (samplesPerSecond == 0 || bitsPerSample == 0 || channels == 0)
+        {
+            throw std::invalid_argument("Unsupported synthesis output format " + outputFormat);
+        }
+        return std::make_shared<FileAudioSink>(fileName, samplesPerSecond, bitsPerSample, channels);
+    }
+
+    ~FileAudioSink()
+    {
+        try
+        {
+            Close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    FileAudioSink(const FileAudioSink&) = delete;
+    FileAudioSink& operator=(const FileAudioSink&) = delete;
+
+    // Copies the chunk into a recycled buffer, and queues it for the writer thread.
+    void Write(const uint8_t* data, size_t size) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        std::vector<uint8_t> buffer;
+        if (!m_free.empty())
+        {
+            buffer.swap(m_free.back());
+            m_free.pop_back();
+        }
+        lock.unlock();
+
+        buffer.assign(data, data + size);
+
+        lock.lock();
+        m_queue.push_back(std::move(buffer));
+        lock.unlock();
+        m_available.notify_one();
+    }
+
+    // Waits for the queued chunks to be written, and completes the file.
+    void Close() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed)
+            {
+                return;
+            }
+            m_closed = true;
+        }
+        m_available.notify_one();
+        m_writer.join();
+
+        if (m_wavHeader)
+        {
+            // Only the two length fields of the header change once the audio size is known.
+            auto dataSize = (uint32_t)m_dataSize;
+            m_file.seekp(4);
+            WriteLittleEndian32(36 + dataSize);
+            m_file.seekp(40);
+            WriteLittleEndian32(dataSize);
+        }
+        m_file.close();
+        if (m_file.fail())
+        {
+            throw std::runtime_error("Failed to write " + m_fileName);
+        }
+    }
+
+private:
+    static bool EndsWith(const std::string& text, const std::string& suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    void WriterLoop()
+    {
+        // Takes all the chunks queued at once, so that a writer that fell behind catches up with one lock per batch.
+        std::deque<std::vector<uint8_t>> batch;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                for (auto& buffer : batch)
+                {
+                    m_free.push_back(std::move(buffer));
+                }
+                batch.clear();
+                m_available.wait(lock, [this]() { return m_closed || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                batch.swap(m_queue);
+            }
+
+            for (const auto& buffer : batch)
+            {
+                m_file.write((const char*)buffer.data(), buffer.size());
+                m_dataSize += buffer.size();
+            }
+        }
+    }
+
+    void WriteLittleEndian32(uint32_t value)
+    {
+        const uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+        m_file.write((const char*)bytes, sizeof(bytes));
+    }
+
+    void WriteWavHeader(uint32_t samplesPerSecond, uint16_t bitsPerSample, uint16_t channels, uint32_t dataSize)
+    {
+        auto blockAlign = (uint16_t)(channels * bitsPerSample / 8);
+        auto writeLittleEndian16 = [this](uint16_t value)
+        {
+            const uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+            m_file.write((const char*)bytes, sizeof(bytes));
+        };
+
+        m_file.write("RIFF", 4);
+        WriteLittleEndian32(36 + dataSize);
+        m_file.write("WAVEfmt ", 8);
+        WriteLittleEndian32(16);
+        writeLittleEndian16(1);     // PCM
+        writeLittleEndian16(channels);
+        WriteLittleEndian32(samplesPerSecond);
+        WriteLittleEndian32(samplesPerSecond * blockAlign);
+        writeLittleEndian16(blockAlign);
+        writeLittleEndian16(bitsPerSample);
+        m_file.write("data", 4);
+        WriteLittleEndian32(dataSize);
+    }
+
+    std::ofstream m_file;
+    const std::string m_fileName;
+    bool m_wavHeader = false;
+    uint64_t m_dataSize = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_available;
+    std::deque<std::vector<uint8_t>> m_queue;
+    std::vector<std::vector<uint8_t>> m_free;
+    bool m_closed = false;
+    std::thread m_writer;
+};
+
+// Keeps the audio in memory, in a chunked buffer that can be reserved up front.
+class MemoryAudioSink final : public AudioSink
+{
+public:
+    MemoryAudioSink(size_t reservedBytes = 0)
+        : m_buffer(std::make_shared<ChunkedAudioBuffer>((size_t)ChunkedAudioBuffer::defaultBlockSize, reservedBytes))
+    {
+    }
+
+    void Write(const uint8_t* data, size_t size) override
+    {
+        m_buffer->Append(data, size);
+    }
+
+    // Gets the audio collected so far.
+    std::shared_ptr<ChunkedAudioBuffer> GetBuffer() const
+    {
+        return m_buffer;
+    }
+
+private:
+    std::shared_ptr<ChunkedAudioBuffer> m_buffer;
+};
+
+// Computes a 64-bit FNV-1a hash of the audio, e.g. to detect duplicates or to verify a copy.
+class HashAudioSink final : public AudioSink
+{
+public:
+    void Write(const uint8_t* data, size_t size) override
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            m_hash = (m_hash ^ data[i]) * 1099511628211ull;
+        }
+    }
+
+    // Gets the hash of the audio written so far.
+    uint64_t GetHash() const
+    {
+        return m_hash;
+    }
+
+private:
+    uint64_t m_hash = 14695981039346656037ull;
+};
+
+// Hands the audio to a function, e.g. one that sends it over a network socket.
+class CallbackAudioSink final : public AudioSink
+{
+public:
+    CallbackAudioSink(std::function<void(const uint8_t*, size_t)> write, std::function<void()> close = nullptr)
+        : m_write(std::move(write)), m_close(std::move(close))
+    {
+        if (!m_write)
+        {
+            throw std::invalid_argument("A write function is required");
+        }
+    }
+
+    void Write(const uint8_t* data, size_t size) override
+    {
+        m_write(data, size);
+    }
+
+    void Close() override
+    {
+        if (m_close)
+        {
+            m_close();
+        }
+    }
+
+private:
+    std::function<void(const uint8_t*, size_t)> m_write;
+    std::function<void()> m_close;
+};
+
+// Passes the audio a pull stream reads on to a sink as well, e.g. a FileAudioSink that archives exactly the audio sent
+// for recognition, without reading the source twice. Read() only hands each chunk to the sink, so the sink must not
+// block: FileAudioSink copies it to a recycled buffer and writes it on its own thread. The sink is not closed with
+// the stream, which the SDK does on its thread; its owner closes it once the recognition is done.
+class TeePullAudioInputCallback final : public Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback
+{
+public:
+    TeePullAudioInputCallback(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback> source,
+        std::shared_ptr<AudioSink> sink)
+        : m_source(std::move(source)), m_sink(std::move(sink))
+    {
+        if (m_source == nullptr || m_sink == nullptr)
+        {
+            throw std::invalid_argument("A source callback and a sink are required");
+        }
+    }
+
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        auto read = m_source->Read(dataBuffer, size);
+        if (read > 0)
+        {
+            m_sink->Write(dataBuffer, (size_t)read);
+        }
+        return read;
+    }
+
+    void Close() override
+    {
+        m_source->Close();
+    }
+
+private:
+    const std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback> m_source;
+    const std::shared_ptr<AudioSink> m_sink;
+};
+
+// Reads an audio data stream once, chunk by chunk, and feeds every chunk to all its sinks,
+// instead of saving the stream to a file and then rewinding it to read it again.
+class AudioStreamTee final
+{
+public:
+    // Defines the default chunk size, half a second of 16 kHz 16-bit mono audio.
+    static constexpr uint32_t defaultChunkSize = 16000;
+
+    AudioStreamTee(uint32_t chunkSize = defaultChunkSize)
+        : m_chunk(chunkSize)
+    {
+        if (chunkSize == 0)
+        {
+            throw std::invalid_argument("Chunk size must be positive");
+        }
+    }
+
+    // Adds a sink, which gets the chunks in the order the sinks were added.
+    void AddSink(std::shared_ptr<AudioSink> sink)
+    {
+        m_sinks.push_back(std::move(sink));
+    }
+
+    // Reads 'stream' from its current position to its end, closes the sinks, and returns the number of bytes read.
+    uint64_t Run(Microsoft::CognitiveServices::Speech::AudioDataStream& stream)
+    {
+        uint64_t totalSize = 0;
+        uint32_t filledSize = 0;
+        while ((filledSize = stream.ReadData(m_chunk.data(), (uint32_t)m_chunk.size())) > 0)
+        {
+            for (auto& sink : m_sinks)
+            {
+                sink->Write(m_chunk.data(), filledSize);
+            }
+            totalSize += filledSize;
+        }
+
+        for (auto& sink : m_sinks)
+        {
+            sink->Close();
+        }
+        return totalSize;
+    }
+
+private:
+    std::vector<uint8_t> m_chunk;
+    std::vector<std::shared_ptr<AudioSink>> m_sinks;
+};
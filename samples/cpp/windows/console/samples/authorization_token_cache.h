@@ -0,0 +1,221 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A token issued by the token service, e.g. in exchange for the subscription key at
+// https://<region>.api.cognitive.microsoft.com/sts/v1.0/issueToken, and for how long it is valid (10 minutes there).
+struct IssuedToken
+{
+    std::string Token;
+    std::chrono::seconds ValidFor{ 600 };
+};
+
+// Gets a new token, or throws on failure. It is called on the refresh thread, never on a request thread but the first time.
+using AuthorizationTokenIssuer = std::function<IssuedToken()>;
+
+struct AuthorizationTokenCacheOptions
+{
+    // How long before its expiry a token is replaced.
+    std::chrono::seconds RefreshBefore{ 120 };
+
+    // How long to wait before trying again after the issuer failed; the current token is used until it expires.
+    std::chrono::seconds RetryInterval{ 5 };
+};
+
+struct AuthorizationTokenCacheStatistics
+{
+    uint64_t Refreshes = 0;
+    uint64_t Failures = 0;
+    uint64_t ClientFailures = 0;    // clients that threw when given a new token; they get the next one still.
+    uint64_t Tracked = 0;   // recognizers and synthesizers alive that get the refreshed tokens.
+};
+
+// Caches an authorization token for the whole process, and replaces it on a background thread before it expires.
+// The speech configs it creates carry the current token, and the recognizers and synthesizers it tracks get each new
+// token with SetAuthorizationToken(), which the SDK needs as those do not see later changes to their config.
+// So a request creates its config or takes a pooled recognizer without ever waiting on the token service.
+class AuthorizationTokenCache final
+{
+public:
+    // Gets the first token on the calling thread, at startup, and throws if the issuer fails.
+    AuthorizationTokenCache(AuthorizationTokenIssuer issuer, std::string region, AuthorizationTokenCacheOptions options = AuthorizationTokenCacheOptions())
+        : m_issuer(std::move(issuer)), m_region(std::move(region)), m_options(options)
+    {
+        if (!m_issuer || m_region.empty() || options.RetryInterval.count() <= 0)
+        {
+            throw std::invalid_argument("An issuer, a region and a positive retry interval are required");
+        }
+
+        Store(m_issuer());
+        m_refreshThread = std::thread([this]() { RefreshLoop(); });
+    }
+
+    ~AuthorizationTokenCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_refreshThread.join();
+    }
+
+    AuthorizationTokenCache(const AuthorizationTokenCache&) = delete;
+    AuthorizationTokenCache& operator=(const AuthorizationTokenCache&) = delete;
+
+    std::string GetToken() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_token;
+    }
+
+    const std::string& GetRegion() const
+    {
+        return m_region;
+    }
+
+    // Creates a speech config with the current token, for the recognizers and synthesizers to Track().
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> CreateSpeechConfig() const
+    {
+        return Microsoft::CognitiveServices::Speech::SpeechConfig::FromAuthorizationToken(GetToken(), m_region);
+    }
+
+    // Gives the current token to 'client', a recognizer or a synthesizer, and each new one while it is alive.
+    template <class Client>
+    void Track(const std::shared_ptr<Client>& client)
+    {
+        if (client == nullptr)
+        {
+            throw std::invalid_argument("A recognizer or synthesizer is required");
+        }
+
+        std::weak_ptr<Client> weak = client;
+        auto apply = [weak](const std::string& token)
+        {
+            auto client = weak.lock();
+            if (client == nullptr)
+            {
+                return false;
+            }
+            client->SetAuthorizationToken(token);
+            return true;
+        };
+
+        // Under the lock, so that a refresh in progress cannot give it an older token after this one.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        apply(m_token);
+        m_clients.push_back(apply);
+    }
+
+    AuthorizationTokenCacheStatistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto statistics = m_statistics;
+        statistics.Tracked = m_clients.size();
+        return statistics;
+    }
+
+private:
+    void Store(const IssuedToken& issued)
+    {
+        if (issued.Token.empty())
+        {
+            throw std::runtime_error("The token issuer returned no token");
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_token = issued.Token;
+        m_expiry = std::chrono::steady_clock::now() + issued.ValidFor;
+    }
+
+    void RefreshLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto due = m_expiry - m_options.RefreshBefore;
+        while (!m_stopping)
+        {
+            if (m_changed.wait_until(lock, due, [this]() { return m_stopping; }))
+            {
+                return;
+            }
+
+            // Calls the issuer without the lock, the requests keep using the current token.
+            lock.unlock();
+            bool issued = false;
+            try
+            {
+                Store(m_issuer());
+                issued = true;
+            }
+            catch (const std::exception&)
+            {
+            }
+            lock.lock();
+
+            if (!issued)
+            {
+                m_statistics.Failures++;
+                due = std::chrono::steady_clock::now() + m_options.RetryInterval;
+                continue;
+            }
+            m_statistics.Refreshes++;
+            due = m_expiry - m_options.RefreshBefore;
+
+            // Gives the new token to the clients alive without the lock, so that neither a slow client nor one that
+            // throws holds up Track() and the others. Clients are only appended meanwhile, so those copied keep their
+            // positions; the ones gone are forgotten.
+            auto clients = m_clients;
+            auto token = m_token;
+            lock.unlock();
+            std::vector<size_t> gone;
+            uint64_t failures = 0;
+            for (size_t i = 0; i < clients.size(); i++)
+            {
+                try
+                {
+                    if (!clients[i](token))
+                    {
+                        gone.push_back(i);
+                    }
+                }
+                catch (const std::exception&)
+                {
+                    failures++;
+                }
+            }
+            lock.lock();
+
+            m_statistics.ClientFailures += failures;
+            for (auto i = gone.rbegin(); i != gone.rend(); ++i)
+            {
+                m_clients.erase(m_clients.begin() + *i);
+            }
+        }
+    }
+
+    const AuthorizationTokenIssuer m_issuer;
+    const std::string m_region;
+    const AuthorizationTokenCacheOptions m_options;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::string m_token;
+    std::chrono::steady_clock::time_point m_expiry;
+    std::vector<std::function<bool(const std::string&)>> m_clients;
+    AuthorizationTokenCacheStatistics m_statistics;
+    bool m_stopping = false;
+    std::thread m_refreshThread;
+};
@@ -0,0 +1,297 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "adaptive_concurrency_limiter.h"
+#include "latency_histogram.h"
+#include "mapped_wav_file_reader.h"
+#include "push_audio_feeder.h"
+#include "session_completion.h"
+#include "worker_pool.h"
+
+// Defines how the audio of each file of a batch is handed to its recognizer.
+enum class BatchInputMode
+{
+    File,           // AudioConfig::FromWavFileInput()
+    PullStream,     // a pull stream reading the memory-mapped file
+    PushStream      // a push stream fed from the memory-mapped file as fast as it is accepted
+};
+
+// A pull stream callback that reads the audio data of a wav file through a memory-mapped view.
+class MappedWavPullCallback final : public Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback
+{
+public:
+    MappedWavPullCallback(const std::string& fileName)
+        : m_reader(fileName)
+    {
+    }
+
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        return m_reader.Read(dataBuffer, size);
+    }
+
+    void Close() override
+    {
+        m_reader.Close();
+    }
+
+    const WavFormat& GetFormat() const
+    {
+        return m_reader.GetFormat();
+    }
+
+    // Gets the size of the audio data in bytes.
+    uint32_t Size() const
+    {
+        return m_reader.Size();
+    }
+
+private:
+    MappedWavFileReader m_reader;
+};
+
+// The outcome of recognizing one file of a batch.
+struct BatchFileResult
+{
+    std::string FileName;
+    std::vector<std::string> Texts;     // recognized text, one entry per utterance.
+    double AudioSeconds = 0;            // duration of the audio in the file.
+    double LatencySeconds = 0;          // wall time from starting recognition to the end of the session.
+    bool Succeeded = false;
+    std::string ErrorDetails;
+    uint64_t RecognizingCount = 0;      // number of Recognizing events.
+    uint64_t RecognizedCount = 0;       // number of Recognized events.
+    uint64_t CanceledCount = 0;         // number of Canceled events.
+    bool Throttled = false;             // canceled because the service throttled.
+    int Attempts = 0;
+};
+
+// Recognizes a batch of wav files with continuous recognition, running up to 'maxInFlight' recognizers
+// concurrently on a bounded worker pool. All the recognizers share one speech config.
+// With a limiter, the recognizers in flight are also kept within its limit, which adapts to the throttling of the
+// service, and a file whose recognition was throttled is tried again.
+class BatchRecognitionDriver final
+{
+public:
+    BatchRecognitionDriver(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, uint32_t maxInFlight,
+        BatchInputMode mode = BatchInputMode::File, std::shared_ptr<AdaptiveConcurrencyLimiter> limiter = nullptr)
+        : m_config(config), m_maxInFlight(maxInFlight), m_mode(mode), m_limiter(limiter)
+    {
+        if (m_config == nullptr || m_maxInFlight == 0)
+        {
+            throw std::invalid_argument("A speech config and a positive in-flight limit are required");
+        }
+    }
+
+    // Recognizes all the files, and returns their results in the order of the input.
+    std::vector<BatchFileResult> Run(const std::vector<std::string>& files)
+    {
+        std::vector<BatchFileResult> results(files.size());
+        auto start = std::chrono::steady_clock::now();
+        {
+            WorkerPool pool(m_maxInFlight, m_maxInFlight * 2);
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                pool.Submit([this, &files, &results, i]()
+                {
+                    results[i] = Recognize(files[i]);
+                });
+            }
+            pool.WaitIdle();
+        }
+        m_wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return results;
+    }
+
+    // Recognizes one file on the calling thread, within the limiter if there is one, e.g. for a worker that takes
+    // the files of a batch from a queue instead of having all of them at once.
+    BatchFileResult Recognize(const std::string& fileName)
+    {
+        return m_limiter != nullptr ? RecognizeFileWithinLimit(fileName) : RecognizeFile(fileName);
+    }
+
+    // Gets the wall time of the last Run() in seconds.
+    double GetWallSeconds() const
+    {
+        return m_wallSeconds;
+    }
+
+    // Prints the throughput and per-file latency of a batch.
+    static void PrintSummary(std::ostream& out, const std::vector<BatchFileResult>& results, double wallSeconds)
+    {
+        double audioSeconds = 0;
+        size_t failed = 0;
+        LatencyHistogram latencies;
+        for (const auto& result : results)
+        {
+            audioSeconds += result.AudioSeconds;
+            if (!result.Succeeded)
+            {
+                failed++;
+            }
+            latencies.Add(result.LatencySeconds);
+        }
+
+        out << "Files: " << results.size() << ", failed: " << failed << "\n"
+            << "Audio: " << audioSeconds / 3600 << " hours, wall time: " << wallSeconds / 3600 << " hours\n"
+            << "Throughput: " << (wallSeconds > 0 ? audioSeconds / wallSeconds : 0) << " audio-hours per wall-hour\n";
+        latencies.Print(out, "Per-file latency", "s");
+        out.flush();
+    }
+
+private:
+    // Defines how many times a file is recognized while the service throttles it.
+    static constexpr int maxThrottledAttempts = 3;
+
+    BatchFileResult RecognizeFileWithinLimit(const std::string& fileName)
+    {
+        BatchFileResult result;
+        for (int attempt = 1; attempt <= maxThrottledAttempts; attempt++)
+        {
+            auto permit = m_limiter->Acquire();
+            result = RecognizeFile(fileName);
+            result.Attempts = attempt;
+            permit.Release(result.Succeeded ? ConcurrencyOutcome::Succeeded
+                : result.Throttled ? ConcurrencyOutcome::Throttled : ConcurrencyOutcome::Failed);
+            if (!result.Throttled)
+            {
+                break;
+            }
+        }
+        return result;
+    }
+
+    // Gets the duration of the audio of a file. A header without a byte rate fails the file, rather than dividing by 0.
+    static double GetAudioSeconds(uint64_t size, const WavFormat& format)
+    {
+        if (format.AvgBytesPerSec == 0)
+        {
+            throw std::invalid_argument("The WAV header has no byte rate");
+        }
+        return (double)size / format.AvgBytesPerSec;
+    }
+
+    BatchFileResult RecognizeFile(const std::string& fileName)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        BatchFileResult result;
+        result.FileName = fileName;
+        result.Attempts = 1;
+        auto start = std::chrono::steady_clock::now();
+
+        try
+        {
+            std::shared_ptr<AudioConfig> audioConfig;
+            std::shared_ptr<PushAudioInputStream> pushStream;
+            std::shared_ptr<MappedWavFileReader> pushReader;
+            switch (m_mode)
+            {
+            case BatchInputMode::File:
+            {
+                // Only the header is parsed, the audio itself is read by the recognizer.
+                MappedWavFileReader reader(fileName);
+                result.AudioSeconds = GetAudioSeconds(reader.Size(), reader.GetFormat());
+                audioConfig = AudioConfig::FromWavFileInput(fileName);
+                break;
+            }
+            case BatchInputMode::PullStream:
+            {
+                auto callback = std::make_shared<MappedWavPullCallback>(fileName);
+                result.AudioSeconds = GetAudioSeconds(callback->Size(), callback->GetFormat());
+                audioConfig = AudioConfig::FromStreamInput(AudioInputStream::CreatePullStream(CreateAudioStreamFormat(callback->GetFormat()), callback));
+                break;
+            }
+            case BatchInputMode::PushStream:
+                pushReader = std::make_shared<MappedWavFileReader>(fileName);
+                result.AudioSeconds = GetAudioSeconds(pushReader->Size(), pushReader->GetFormat());
+                pushStream = AudioInputStream::CreatePushStream(CreateAudioStreamFormat(pushReader->GetFormat()));
+                audioConfig = AudioConfig::FromStreamInput(pushStream);
+                break;
+            }
+
+            // Both Canceled and SessionStopped can end the session, only the first one completes it.
+            // These outlive the recognizer, so that no late event handler can touch them after destruction.
+            std::mutex resultMutex;
+            SessionCompletion recognitionEnd;
+
+            auto recognizer = SpeechRecognizer::FromConfig(m_config, audioConfig);
+
+            recognizer->Recognizing.Connect([&result, &resultMutex](const SpeechRecognitionEventArgs&)
+            {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                result.RecognizingCount++;
+            });
+
+            recognizer->Recognized.Connect([&result, &resultMutex](const SpeechRecognitionEventArgs& e)
+            {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                result.RecognizedCount++;
+                if (e.Result->Reason == ResultReason::RecognizedSpeech)
+                {
+                    result.Texts.push_back(e.Result->Text);
+                }
+            });
+
+            recognizer->Canceled.Connect([&result, &resultMutex, &recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(resultMutex);
+                    result.CanceledCount++;
+                    if (e.Reason == CancellationReason::Error)
+                    {
+                        result.ErrorDetails = e.ErrorDetails;
+                        result.Throttled = AdaptiveConcurrencyLimiter::IsThrottling(e.ErrorCode);
+                    }
+                }
+                if (e.Reason == CancellationReason::Error)
+                {
+                    recognitionEnd.Complete(SessionOutcome::Canceled);
+                }
+            });
+
+            recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
+            {
+                recognitionEnd.Complete(SessionOutcome::Stopped);
+            });
+
+            recognizer->StartContinuousRecognitionAsync().get();
+            if (pushStream != nullptr)
+            {
+                PushAudioFeeder feeder(pushStream, pushReader->GetFormat());
+                feeder.Feed(*pushReader);
+                pushStream->Close();
+            }
+            recognitionEnd.Wait();
+            recognizer->StopContinuousRecognitionAsync().get();
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            result.Succeeded = result.ErrorDetails.empty();
+        }
+        catch (const std::exception& e)
+        {
+            result.ErrorDetails = e.what();
+        }
+
+        result.LatencySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    uint32_t m_maxInFlight;
+    BatchInputMode m_mode;
+    std::shared_ptr<AdaptiveConcurrencyLimiter> m_limiter;
+    double m_wallSeconds = 0;
+};
@@ -0,0 +1,244 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+
+// <toplevel>
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audio_file_list.h"
+#include "batch_recognition_driver.h"
+#include "distributed_work_queue.h"
+#include "pronunciation_batch_scorer.h"
+#include "sample_console.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+// </toplevel>
+
+// Batch speech recognition of all the wav files in a directory or listed in a manifest file.
+void SpeechBatchRecognitionWithFiles()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    // The config is shared by all the recognizers of the batch.
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    cout << "Enter a directory of WAV files or a manifest file with one WAV file per line (empty for the current directory)." << std::endl;
+    cout << "> ";
+    string path;
+    ReadSampleLine(path);
+    if (path.empty())
+    {
+        path = ".";
+    }
+
+    cout << "Enter the maximum number of concurrent recognitions (empty for 16)." << std::endl;
+    cout << "> ";
+    uint32_t maxInFlight;
+    if (!ReadSampleCount(16, maxInFlight))
+    {
+        return;
+    }
+
+    vector<string> files;
+    try
+    {
+        files = ListAudioFiles(path);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+    cout << "Recognizing " << files.size() << " files with up to " << maxInFlight << " concurrent recognitions..." << std::endl;
+
+    // Adapts the concurrency to the throttling of the service, up to the maximum entered.
+    AdaptiveConcurrencyOptions limits;
+    limits.Max = maxInFlight;
+    limits.Initial = (std::min)(limits.Initial, limits.Max);
+    auto limiter = make_shared<AdaptiveConcurrencyLimiter>(limits);
+
+    // Runs the recognizers on a bounded worker pool, and collects the recognized text per file.
+    BatchRecognitionDriver driver(config, maxInFlight, BatchInputMode::File, limiter);
+    auto results = driver.Run(files);
+
+    for (const auto& result : results)
+    {
+        if (result.Succeeded)
+        {
+            cout << "RECOGNIZED: File=" << result.FileName << ", Latency=" << result.LatencySeconds << "s" << std::endl;
+            for (const auto& text : result.Texts)
+            {
+                cout << "  Text=" << text << std::endl;
+            }
+        }
+        else
+        {
+            cout << "FAILED: File=" << result.FileName << ", ErrorDetails=" << result.ErrorDetails << std::endl;
+        }
+    }
+
+    BatchRecognitionDriver::PrintSummary(cout, results, driver.GetWallSeconds());
+    auto concurrency = limiter->GetStatistics();
+    cout << "Concurrency limit: " << concurrency.Limit << ", peak in flight: " << concurrency.PeakInFlight
+         << ", throttled: " << concurrency.Throttled << std::endl;
+}
+
+// Batch speech recognition spread over many machines through a queue in a shared directory. The node that submits the
+// files coordinates the batch and works on it too; the other nodes only work, e.g. started with
+//     samples --scenario SpeechBatchRecognitionWithWorkQueue --line /mnt/share/queue --line "" --line 16
+// Files leased by a node that stops are leased again by the others once their leases expire.
+void SpeechBatchRecognitionWithWorkQueue()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    cout << "Enter the queue directory shared by all the nodes." << std::endl;
+    cout << "> ";
+    string queueDirectory;
+    ReadSampleLine(queueDirectory);
+
+    cout << "Enter a directory of WAV files or a manifest file to submit (empty to only work on the queue)." << std::endl;
+    cout << "> ";
+    string path;
+    ReadSampleLine(path);
+
+    cout << "Enter the maximum number of concurrent recognitions of this node (empty for 16)." << std::endl;
+    cout << "> ";
+    uint32_t maxInFlight;
+    if (!ReadSampleCount(16, maxInFlight))
+    {
+        return;
+    }
+
+    try
+    {
+        auto queue = make_shared<FileLockWorkQueue>(queueDirectory);
+
+        // Names the node after its host, and its process, so that several can run on one machine.
+        DistributedWorkerOptions options;
+        char hostName[256] = "node";
+#ifdef _WIN32
+        DWORD size = sizeof(hostName);
+        GetComputerNameA(hostName, &size);
+        options.WorkerId = string(hostName) + "-" + to_string(GetCurrentProcessId());
+#else
+        gethostname(hostName, sizeof(hostName) - 1);
+        options.WorkerId = string(hostName) + "-" + to_string(getpid());
+#endif
+        replace(options.WorkerId.begin(), options.WorkerId.end(), '.', '-');
+        options.MaxInFlight = maxInFlight;
+
+        unique_ptr<DistributedBatchCoordinator> coordinator;
+        if (!path.empty())
+        {
+            auto files = ListAudioFiles(path);
+            coordinator.reset(new DistributedBatchCoordinator(queue));
+            coordinator->Submit(files);
+            cout << "Submitted " << files.size() << " files to " << queueDirectory << std::endl;
+        }
+
+        // Works on the queue until all of its files are done, by this node or by the others.
+        AdaptiveConcurrencyOptions limits;
+        limits.Max = maxInFlight;
+        limits.Initial = (std::min)(limits.Initial, limits.Max);
+        DistributedBatchWorker worker(config, queue, options, make_shared<AdaptiveConcurrencyLimiter>(limits));
+        cout << "Working on the queue as " << options.WorkerId << "..." << std::endl;
+
+        // The coordinator prints the progress of all the nodes while this one works, and waits for the others after.
+        vector<BatchFileResult> results;
+        thread progress;
+        if (coordinator != nullptr)
+        {
+            progress = thread([&coordinator, &results]() { results = coordinator->WaitForCompletion(cout, chrono::seconds(10)); });
+        }
+        WorkerReport report;
+        try
+        {
+            report = worker.Run();
+        }
+        catch (...)
+        {
+            if (coordinator != nullptr)
+            {
+                coordinator->Stop();
+                progress.join();
+            }
+            throw;
+        }
+        cout << "This node completed " << report.Files << " files, " << report.Failed << " failed, " << report.Lost << " lost." << std::endl;
+
+        if (coordinator != nullptr)
+        {
+            progress.join();
+            BatchRecognitionDriver::PrintSummary(cout, results, coordinator->GetWallSeconds());
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
+
+// Batch pronunciation assessment of the recordings listed in a manifest, with their scores written to a columnar file.
+void PronunciationAssessmentBatchWithManifest()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    // Note: The pronunciation assessment feature is currently only available on westus, eastasia and centralindia regions.
+    // And this feature is currently only available on en-US language.
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+    config->SetOutputFormat(OutputFormat::Detailed);
+
+    cout << "Enter a manifest file with one <WAV file><TAB><reference text> entry per line." << std::endl;
+    cout << "> ";
+    string path;
+    ReadSampleLine(path);
+
+    cout << "Enter the maximum number of concurrent assessments (empty for 4)." << std::endl;
+    cout << "> ";
+    uint32_t maxInFlight;
+    if (!ReadSampleCount(4, maxInFlight))
+    {
+        return;
+    }
+
+    try
+    {
+        auto jobs = ReadPronunciationManifest(path);
+        cout << "Scoring " << jobs.size() << " recordings with up to " << maxInFlight << " concurrent assessments..." << std::endl;
+
+        // Writes a row per recording as it is scored, and aggregates the phonemes of all of them.
+        auto outputFile = SampleOutputFile("pronunciation_scores.bin");
+        PronunciationScoreWriter output(outputFile);
+        PronunciationBatchScorer scorer(config, maxInFlight);
+        scorer.Run(jobs, output);
+
+        cout << "Wrote " << output.GetRowCount() << " rows to " << outputFile << std::endl;
+        scorer.PrintSummary(cout);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,319 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "adaptive_concurrency_limiter.h"
+#include "latency_histogram.h"
+
+// One entry of a batch synthesis manifest.
+struct BatchSynthesisJob
+{
+    std::string Text;           // plain text, or SSML if it starts with "<speak".
+    std::string OutputPath;
+    bool IsSsml = false;
+};
+
+// The outcome of synthesizing one entry of a batch.
+struct BatchSynthesisResult
+{
+    std::string OutputPath;
+    size_t Characters = 0;
+    uint64_t AudioBytes = 0;
+    double FirstByteSeconds = 0;        // wall time from submitting the request to its first audio chunk.
+    double LatencySeconds = 0;          // wall time from submitting the request to its completion.
+    bool Succeeded = false;
+    std::string ErrorDetails;
+    bool Throttled = false;             // canceled because the service throttled.
+    int Attempts = 0;
+};
+
+// Reads a batch synthesis manifest, a text file with one "<output path><TAB><text or SSML>" entry per line.
+// Empty lines and lines starting with '#' are skipped.
+inline std::vector<BatchSynthesisJob> ReadSynthesisManifest(const std::string& path)
+{
+    std::ifstream manifest(path);
+    if (!manifest.good())
+    {
+        throw std::invalid_argument("Failed to open the specified manifest file.");
+    }
+
+    std::vector<BatchSynthesisJob> jobs;
+    std::string line;
+    while (getline(manifest, line))
+    {
+        // Tolerates manifests with Windows line endings.
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        auto tab = line.find('\t');
+        if (tab == std::string::npos || tab == 0 || tab + 1 == line.size())
+        {
+            throw std::invalid_argument("Malformed manifest line, expected <output path><TAB><text>: " + line);
+        }
+
+        BatchSynthesisJob job;
+        job.OutputPath = line.substr(0, tab);
+        job.Text = line.substr(tab + 1);
+        job.IsSsml = job.Text.compare(0, 6, "<speak") == 0;
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// Synthesizes a batch of texts to files, keeping up to 'maxInFlight' requests outstanding across a small pool
+// of synthesizers, so that the network is never idle between requests. Results are written as they complete.
+// With a limiter, the requests in flight are also kept within its limit, which adapts to the throttling of the
+// service, and a throttled request is submitted again.
+class BatchSynthesisDriver final
+{
+public:
+    BatchSynthesisDriver(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, uint32_t synthesizerCount, uint32_t maxInFlight,
+        std::shared_ptr<AdaptiveConcurrencyLimiter> limiter = nullptr)
+        : m_maxInFlight(maxInFlight), m_limiter(limiter)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (config == nullptr || synthesizerCount == 0 || maxInFlight == 0)
+        {
+            throw std::invalid_argument("A speech config, a positive synthesizer count and a positive in-flight limit are required");
+        }
+
+        // The audio only goes to the results, which are saved to the output files.
+        m_firstBytes = std::make_shared<FirstByteTimes>();
+        for (uint32_t i = 0; i < synthesizerCount; i++)
+        {
+            auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+
+            // Records when the first audio chunk of each request arrives, by result id.
+            auto firstBytes = m_firstBytes;
+            synthesizer->Synthesizing += [firstBytes](const SpeechSynthesisEventArgs& e)
+            {
+                std::lock_guard<std::mutex> lock(firstBytes->Mutex);
+                firstBytes->Times.emplace(e.Result->ResultId, std::chrono::steady_clock::now());
+            };
+            m_synthesizers.push_back(synthesizer);
+        }
+    }
+
+    // Synthesizes all the jobs, and returns their results in the order of the input.
+    std::vector<BatchSynthesisResult> Run(const std::vector<BatchSynthesisJob>& jobs)
+    {
+        std::vector<BatchSynthesisResult> results(jobs.size());
+        std::deque<Request> pending;
+        std::deque<size_t> retries;
+        size_t next = 0;
+        size_t submitted = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        while (next < jobs.size() || !retries.empty() || !pending.empty())
+        {
+            if ((next == jobs.size() && retries.empty()) || pending.size() >= m_maxInFlight)
+            {
+                CompleteReady(pending, results, retries);
+                continue;
+            }
+
+            AdaptiveConcurrencyLimiter::Permit permit;
+            if (m_limiter != nullptr && !m_limiter->TryAcquire(permit))
+            {
+                if (!pending.empty())
+                {
+                    CompleteReady(pending, results, retries);
+                    continue;
+                }
+
+                // Only the other pipelines sharing the limiter hold permits, waits for one of theirs.
+                permit = m_limiter->Acquire();
+            }
+
+            // The throttled requests go first, they have waited the longest.
+            size_t i;
+            if (!retries.empty())
+            {
+                i = retries.front();
+                retries.pop_front();
+            }
+            else
+            {
+                i = next++;
+            }
+
+            // Spreads the requests over the synthesizers, each synthesizer works through its own requests in order.
+            auto& synthesizer = m_synthesizers[submitted++ % m_synthesizers.size()];
+            Request request;
+            request.Index = i;
+            request.Submitted = std::chrono::steady_clock::now();
+            request.Permit = std::move(permit);
+            request.Result = jobs[i].IsSsml ? synthesizer->SpeakSsmlAsync(jobs[i].Text) : synthesizer->SpeakTextAsync(jobs[i].Text);
+            results[i].OutputPath = jobs[i].OutputPath;
+            results[i].Characters = jobs[i].Text.size();
+            results[i].Attempts++;
+            pending.push_back(std::move(request));
+        }
+
+        m_wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return results;
+    }
+
+    // Gets the wall time of the last Run() in seconds.
+    double GetWallSeconds() const
+    {
+        return m_wallSeconds;
+    }
+
+    // Prints the throughput and the latencies of a batch.
+    static void PrintSummary(std::ostream& out, const std::vector<BatchSynthesisResult>& results, double wallSeconds)
+    {
+        size_t characters = 0;
+        size_t failed = 0;
+        uint64_t audioBytes = 0;
+        LatencyHistogram firstByte;
+        LatencyHistogram latency;
+        for (const auto& result : results)
+        {
+            characters += result.Characters;
+            audioBytes += result.AudioBytes;
+            if (!result.Succeeded)
+            {
+                failed++;
+                continue;
+            }
+            firstByte.Add(result.FirstByteSeconds);
+            latency.Add(result.LatencySeconds);
+        }
+
+        out << "Requests: " << results.size() << ", failed: " << failed << "\n"
+            << "Characters: " << characters << ", audio: " << audioBytes << " bytes, wall time: " << wallSeconds << "s\n"
+            << "Throughput: " << (wallSeconds > 0 ? characters / wallSeconds : 0) << " characters per second\n";
+        firstByte.Print(out, "Time to first byte", "s");
+        latency.Print(out, "Request latency", "s");
+        out.flush();
+    }
+
+private:
+    struct Request
+    {
+        size_t Index;
+        std::chrono::steady_clock::time_point Submitted;
+        std::future<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesisResult>> Result;
+        AdaptiveConcurrencyLimiter::Permit Permit;
+    };
+
+    // Defines how many times a request is submitted while the service throttles it.
+    static constexpr int maxThrottledAttempts = 3;
+
+    struct FirstByteTimes
+    {
+        std::mutex Mutex;
+        std::map<std::string, std::chrono::steady_clock::time_point> Times;
+    };
+
+    // Writes out the pending requests that have completed, waiting for at least one of them.
+    // With a limiter, the throttled requests are queued to 'retries' rather than failed.
+    void CompleteReady(std::deque<Request>& pending, std::vector<BatchSynthesisResult>& results, std::deque<size_t>& retries)
+    {
+        // Defines how long to wait for the oldest request before checking the others again.
+        constexpr auto pollInterval = std::chrono::milliseconds(10);
+
+        bool completedAny = false;
+        while (!completedAny && !pending.empty())
+        {
+            for (auto it = pending.begin(); it != pending.end();)
+            {
+                if (it->Result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                {
+                    auto& result = results[it->Index];
+                    Complete(*it, result);
+                    it->Permit.Release(result.Succeeded ? ConcurrencyOutcome::Succeeded
+                        : result.Throttled ? ConcurrencyOutcome::Throttled : ConcurrencyOutcome::Failed);
+                    if (result.Throttled && m_limiter != nullptr && result.Attempts < maxThrottledAttempts)
+                    {
+                        retries.push_back(it->Index);
+                    }
+                    it = pending.erase(it);
+                    completedAny = true;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            if (!completedAny)
+            {
+                pending.front().Result.wait_for(pollInterval);
+            }
+        }
+    }
+
+    void Complete(Request& request, BatchSynthesisResult& result)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        // Whatever an earlier, throttled, attempt left.
+        result.ErrorDetails.clear();
+        result.Throttled = false;
+        try
+        {
+            auto synthesisResult = request.Result.get();
+            auto completed = std::chrono::steady_clock::now();
+            result.LatencySeconds = std::chrono::duration<double>(completed - request.Submitted).count();
+
+            {
+                std::lock_guard<std::mutex> lock(m_firstBytes->Mutex);
+                auto firstByte = m_firstBytes->Times.find(synthesisResult->ResultId);
+                if (firstByte != m_firstBytes->Times.end())
+                {
+                    result.FirstByteSeconds = std::chrono::duration<double>(firstByte->second - request.Submitted).count();
+                    m_firstBytes->Times.erase(firstByte);
+                }
+                else
+                {
+                    result.FirstByteSeconds = result.LatencySeconds;
+                }
+            }
+
+            if (synthesisResult->Reason == ResultReason::SynthesizingAudioCompleted)
+            {
+                result.AudioBytes = synthesisResult->GetAudioData()->size();
+                AudioDataStream::FromResult(synthesisResult)->SaveToWavFile(result.OutputPath);
+                result.Succeeded = true;
+            }
+            else if (synthesisResult->Reason == ResultReason::Canceled)
+            {
+                auto cancellation = SpeechSynthesisCancellationDetails::FromResult(synthesisResult);
+                result.ErrorDetails = cancellation->ErrorDetails;
+                result.Throttled = AdaptiveConcurrencyLimiter::IsThrottling(cancellation->ErrorCode);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            result.ErrorDetails = e.what();
+        }
+    }
+
+    const uint32_t m_maxInFlight;
+    const std::shared_ptr<AdaptiveConcurrencyLimiter> m_limiter;
+    std::vector<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer>> m_synthesizers;
+    std::shared_ptr<FirstByteTimes> m_firstBytes;
+    double m_wallSeconds = 0;
+};
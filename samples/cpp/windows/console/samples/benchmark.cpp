@@ -0,0 +1,188 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+// Recognition throughput benchmark.
+// It runs the same set of wav files through file input, pull stream input and push stream input at a given
+// concurrency, and prints one JSON object per input mode, so that results can be tracked across SDK versions.
+//
+// Usage: benchmark [--mode file|pull|push|all] [--concurrency N] [--label TEXT] [directory or manifest]
+// The subscription key and service region are taken from the SPEECH_KEY and SPEECH_REGION environment variables.
+
+#include "stdafx.h"
+
+#include <speechapi_cxx.h>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include "audio_file_list.h"
+#include "batch_recognition_driver.h"
+#include "latency_histogram.h"
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+
+// Defines the corpus that is used when none is given, relative to this directory.
+static const char* defaultCorpus = "../../../../../sampledata/audiofiles";
+
+static double CpuSeconds(const struct rusage& usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static const char* ModeName(BatchInputMode mode)
+{
+    switch (mode)
+    {
+    case BatchInputMode::File:
+        return "file";
+    case BatchInputMode::PullStream:
+        return "pull";
+    case BatchInputMode::PushStream:
+        return "push";
+    }
+    return "unknown";
+}
+
+static string JsonEscape(const string& text)
+{
+    string escaped;
+    for (auto c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Runs all the files through one input mode, and prints the measurements as a single line of JSON.
+static void RunMode(shared_ptr<SpeechConfig> config, BatchInputMode mode, uint32_t concurrency, const vector<string>& files, const string& label)
+{
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+
+    BatchRecognitionDriver driver(config, concurrency, mode);
+    auto results = driver.Run(files);
+
+    getrusage(RUSAGE_SELF, &after);
+
+    double audioSeconds = 0;
+    uint64_t recognizing = 0, recognized = 0, canceled = 0;
+    size_t failed = 0;
+    LatencyHistogram latencies;
+    for (const auto& result : results)
+    {
+        audioSeconds += result.AudioSeconds;
+        recognizing += result.RecognizingCount;
+        recognized += result.RecognizedCount;
+        canceled += result.CanceledCount;
+        failed += result.Succeeded ? 0 : 1;
+        latencies.Add(result.LatencySeconds);
+    }
+    auto wallSeconds = driver.GetWallSeconds();
+    auto cpuSeconds = CpuSeconds(after) - CpuSeconds(before);
+
+    // The real-time factor is the wall time spent per second of audio, lower is faster.
+    // Peak RSS is the high-water mark of the whole process so far, in kilobytes.
+    cout << "{\"label\":\"" << JsonEscape(label) << "\""
+         << ",\"mode\":\"" << ModeName(mode) << "\""
+         << ",\"concurrency\":" << concurrency
+         << ",\"files\":" << results.size()
+         << ",\"failed\":" << failed
+         << ",\"audioSeconds\":" << audioSeconds
+         << ",\"wallSeconds\":" << wallSeconds
+         << ",\"realTimeFactor\":" << (audioSeconds > 0 ? wallSeconds / audioSeconds : 0)
+         << ",\"cpuSecondsPerAudioSecond\":" << (audioSeconds > 0 ? cpuSeconds / audioSeconds : 0)
+         << ",\"peakRssKb\":" << after.ru_maxrss
+         << ",\"recognizingEvents\":" << recognizing
+         << ",\"recognizedEvents\":" << recognized
+         << ",\"canceledEvents\":" << canceled
+         << ",\"latencyP50\":" << latencies.Percentile(50)
+         << ",\"latencyP95\":" << latencies.Percentile(95)
+         << ",\"latencyMax\":" << latencies.Max()
+         << "}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    string modeName = "all";
+    uint32_t concurrency = 4;
+    string label;
+    string path = defaultCorpus;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--mode" && i + 1 < argc)
+        {
+            modeName = argv[++i];
+        }
+        else if (arg == "--concurrency" && i + 1 < argc)
+        {
+            concurrency = (uint32_t)stoul(argv[++i]);
+        }
+        else if (arg == "--label" && i + 1 < argc)
+        {
+            label = argv[++i];
+        }
+        else if (!arg.empty() && arg[0] != '-')
+        {
+            path = arg;
+        }
+        else
+        {
+            cerr << "Usage: benchmark [--mode file|pull|push|all] [--concurrency N] [--label TEXT] [directory or manifest]" << std::endl;
+            return 1;
+        }
+    }
+
+    vector<BatchInputMode> modes;
+    if (modeName == "file" || modeName == "all")
+    {
+        modes.push_back(BatchInputMode::File);
+    }
+    if (modeName == "pull" || modeName == "all")
+    {
+        modes.push_back(BatchInputMode::PullStream);
+    }
+    if (modeName == "push" || modeName == "all")
+    {
+        modes.push_back(BatchInputMode::PushStream);
+    }
+    if (modes.empty() || concurrency == 0)
+    {
+        cerr << "Unknown mode '" << modeName << "' or zero concurrency." << std::endl;
+        return 1;
+    }
+
+    auto key = getenv("SPEECH_KEY");
+    auto region = getenv("SPEECH_REGION");
+    if (key == nullptr || region == nullptr)
+    {
+        cerr << "Please set SPEECH_KEY and SPEECH_REGION to your subscription key and service region." << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        auto files = ListAudioFiles(path);
+        auto config = SpeechConfig::FromSubscription(key, region);
+        for (auto mode : modes)
+        {
+            RunMode(config, mode, concurrency, files, label);
+        }
+    }
+    catch (const exception& e)
+    {
+        cerr << "Exit due to exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
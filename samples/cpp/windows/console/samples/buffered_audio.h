@@ -0,0 +1,57 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mapped_wav_file_reader.h"
+
+// The audio data of a wav file, read into memory once and shared by all the streams that read it.
+struct BufferedAudio
+{
+    std::vector<uint8_t> Data;
+    WavFormat Format;
+
+    // Reads the audio data of a wav file.
+    static std::shared_ptr<const BufferedAudio> FromWavFile(const std::string& fileName)
+    {
+        MappedWavFileReader reader(fileName);
+        auto audio = std::make_shared<BufferedAudio>();
+        audio->Data.assign(reader.Data(), reader.Data() + reader.Size());
+        audio->Format = reader.GetFormat();
+        return audio;
+    }
+};
+
+// Reads a buffered audio from the beginning, each stream with its own position in the shared data.
+class BufferedAudioPullCallback final : public Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback
+{
+public:
+    BufferedAudioPullCallback(std::shared_ptr<const BufferedAudio> audio)
+        : m_audio(audio)
+    {
+    }
+
+    int Read(uint8_t* dataBuffer, uint32_t size) override
+    {
+        auto remaining = m_audio->Data.size() - m_position;
+        auto available = size < remaining ? size : remaining;
+        memcpy(dataBuffer, m_audio->Data.data() + m_position, available);
+        m_position += available;
+        return (int)available;
+    }
+
+    void Close() override
+    {
+    }
+
+private:
+    std::shared_ptr<const BufferedAudio> m_audio;
+    size_t m_position = 0;
+};
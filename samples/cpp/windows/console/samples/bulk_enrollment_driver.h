@@ -0,0 +1,416 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "adaptive_concurrency_limiter.h"
+#include "worker_pool.h"
+
+// One entry of an enrollment manifest: a user and the audio files to enroll their voice profile with.
+struct EnrollmentJob
+{
+    std::string User;
+    std::vector<std::string> AudioFiles;
+};
+
+// Reads an enrollment manifest, a text file with one "<user><TAB><audio file>[<TAB><audio file>...]" entry per line.
+// Empty lines and lines starting with '#' are skipped.
+inline std::vector<EnrollmentJob> ReadEnrollmentManifest(const std::string& path)
+{
+    std::ifstream manifest(path);
+    if (!manifest.good())
+    {
+        throw std::invalid_argument("Failed to open the specified manifest file.");
+    }
+
+    std::vector<EnrollmentJob> jobs;
+    std::string line;
+    while (getline(manifest, line))
+    {
+        // Tolerates manifests with Windows line endings.
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        EnrollmentJob job;
+        size_t start = 0;
+        while (start <= line.size())
+        {
+            auto tab = line.find('\t', start);
+            auto field = line.substr(start, tab == std::string::npos ? std::string::npos : tab - start);
+            if (job.User.empty())
+            {
+                job.User = field;
+            }
+            else if (!field.empty())
+            {
+                job.AudioFiles.push_back(field);
+            }
+            start = tab == std::string::npos ? line.size() + 1 : tab + 1;
+        }
+        if (job.User.empty() || job.AudioFiles.empty())
+        {
+            throw std::invalid_argument("Malformed manifest line, expected <user><TAB><audio file>: " + line);
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// Keeps the mapping from users to voice profile ids in an append-only text file, one
+// "<user><TAB><profile id><TAB><state>[<TAB><audio files enrolled>]" line per change, flushed as it is written. The last
+// line of a user wins when the file is loaded, so that a restarted enrollment skips the users already enrolled, and
+// continues the profiles already created after the audio files they were enrolled with.
+class EnrollmentStore final
+{
+public:
+    // Defines the states of a user's profile.
+    enum class State
+    {
+        Created,    // the profile exists, its enrollment isn't complete.
+        Enrolled,
+        Failed
+    };
+
+    struct Entry
+    {
+        std::string ProfileId;
+        State ProfileState;
+        size_t FilesEnrolled;       // the audio files of the user the profile was enrolled with, in the manifest's order.
+    };
+
+    // Constructor that loads the entries written by earlier runs, and opens the file to append to it.
+    EnrollmentStore(const std::string& fileName)
+    {
+        std::ifstream existing(fileName);
+        std::string line;
+        while (getline(existing, line))
+        {
+            auto first = line.find('\t');
+            auto second = first == std::string::npos ? std::string::npos : line.find('\t', first + 1);
+            if (second == std::string::npos)
+            {
+                // A line cut short by a crash while it was written.
+                continue;
+            }
+            auto third = line.find('\t', second + 1);
+            auto state = line.substr(second + 1, third == std::string::npos ? std::string::npos : third - second - 1);
+            auto filesEnrolled = third == std::string::npos ? 0 : (size_t)strtoul(line.c_str() + third + 1, nullptr, 10);
+            m_entries[line.substr(0, first)] = Entry{ line.substr(first + 1, second - first - 1),
+                state == "enrolled" ? State::Enrolled : state == "failed" ? State::Failed : State::Created, filesEnrolled };
+        }
+
+        m_file.open(fileName, std::ios::app);
+        if (!m_file.good())
+        {
+            throw std::invalid_argument("Failed to open " + fileName);
+        }
+    }
+
+    // Gets the entry of a user, returns false if there is none.
+    bool Find(const std::string& user, Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(user);
+        if (it == m_entries.end())
+        {
+            return false;
+        }
+        entry = it->second;
+        return true;
+    }
+
+    // Records a change of a user's profile, and the number of its audio files enrolled so far.
+    void Record(const std::string& user, const std::string& profileId, State state, size_t filesEnrolled = 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[user] = Entry{ profileId, state, filesEnrolled };
+        m_file << user << '\t' << profileId << '\t'
+            << (state == State::Enrolled ? "enrolled" : state == State::Failed ? "failed" : "created") << '\t' << filesEnrolled << std::endl;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    std::ofstream m_file;
+};
+
+// Enrolls the voice profiles of many users, up to 'maxConcurrency' at a time. Each user's profile is created, or
+// reused from the store, and enrolled with the user's audio files until the service needs no more speech.
+// Throttled and failed requests are retried with exponential backoff and jitter. The profile of a user whose enrollment
+// fails is deleted, and the next run starts over with a new one. With a limiter, the requests in flight are also kept
+// within its limit, which adapts to the throttling of the service.
+class BulkEnrollmentDriver final
+{
+public:
+    // Counts of the users of a run.
+    struct Summary
+    {
+        size_t Enrolled = 0;
+        size_t Skipped = 0;         // already enrolled by an earlier run.
+        size_t Failed = 0;
+        double WallSeconds = 0;
+    };
+
+    BulkEnrollmentDriver(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, EnrollmentStore& store,
+        uint32_t maxConcurrency, Microsoft::CognitiveServices::Speech::VoiceProfileType profileType, const std::string& locale = "en-us",
+        std::shared_ptr<AdaptiveConcurrencyLimiter> limiter = nullptr)
+        : m_client(Microsoft::CognitiveServices::Speech::VoiceProfileClient::FromConfig(config)), m_store(store),
+          m_maxConcurrency(maxConcurrency), m_profileType(profileType), m_locale(locale), m_limiter(limiter), m_random(std::random_device()())
+    {
+        if (maxConcurrency == 0)
+        {
+            throw std::invalid_argument("A positive concurrency is required");
+        }
+    }
+
+    // Enrolls all the users of the manifest. 'log' gets one line per user as they complete.
+    Summary Run(const std::vector<EnrollmentJob>& jobs, std::ostream& log)
+    {
+        Summary summary;
+        std::mutex summaryMutex;
+        auto start = std::chrono::steady_clock::now();
+        {
+            WorkerPool pool(m_maxConcurrency, m_maxConcurrency * 2);
+            for (const auto& job : jobs)
+            {
+                pool.Submit([this, &job, &summary, &summaryMutex, &log]()
+                {
+                    std::string error;
+                    auto outcome = Enroll(job, error);
+
+                    std::lock_guard<std::mutex> lock(summaryMutex);
+                    if (outcome == Outcome::Enrolled)
+                    {
+                        summary.Enrolled++;
+                        log << "ENROLLED: User=" << job.User << std::endl;
+                    }
+                    else if (outcome == Outcome::Skipped)
+                    {
+                        summary.Skipped++;
+                    }
+                    else
+                    {
+                        summary.Failed++;
+                        log << "FAILED: User=" << job.User << ", ErrorDetails=[" << error << "]" << std::endl;
+                    }
+                });
+            }
+            pool.WaitIdle();
+        }
+        summary.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return summary;
+    }
+
+private:
+    // Defines how many times a throttled or failed request is retried, and the backoff before the first retry.
+    static constexpr int maxAttempts = 6;
+    static constexpr int initialBackoffMilliseconds = 500;
+
+    enum class Outcome
+    {
+        Enrolled,
+        Skipped,
+        Failed
+    };
+
+    Outcome Enroll(const EnrollmentJob& job, std::string& error)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        EnrollmentStore::Entry entry;
+        std::shared_ptr<VoiceProfile> profile;
+        size_t filesEnrolled = 0;
+        if (m_store.Find(job.User, entry) && entry.ProfileState != EnrollmentStore::State::Failed)
+        {
+            if (entry.ProfileState == EnrollmentStore::State::Enrolled)
+            {
+                return Outcome::Skipped;
+            }
+            profile = VoiceProfile::FromId(entry.ProfileId, m_profileType);
+            filesEnrolled = entry.FilesEnrolled;
+        }
+        else
+        {
+            profile = WithRetries([this]()
+            {
+                auto permit = AcquirePermit();
+                try
+                {
+                    auto created = m_client->CreateProfileAsync(m_profileType, m_locale).get();
+                    permit.Release(ConcurrencyOutcome::Succeeded);
+                    return created;
+                }
+                catch (const std::exception& e)
+                {
+                    // Profile creation reports throttling by throwing, with the HTTP status in the message.
+                    permit.Release(AdaptiveConcurrencyLimiter::IsThrottling(e) ? ConcurrencyOutcome::Throttled : ConcurrencyOutcome::Failed);
+                    throw;
+                }
+            }, error);
+            if (profile == nullptr)
+            {
+                return Outcome::Failed;
+            }
+            m_store.Record(job.User, profile->GetId(), EnrollmentStore::State::Created);
+        }
+
+        // Enrolls with the files in turn, after those a restarted run already enrolled, until the service has enough speech.
+        for (; filesEnrolled < job.AudioFiles.size(); filesEnrolled++)
+        {
+            const auto& audioFile = job.AudioFiles[filesEnrolled];
+            std::shared_ptr<VoiceProfileEnrollmentResult> result;
+            for (int attempt = 0; attempt < maxAttempts; attempt++)
+            {
+                auto permit = AcquirePermit();
+                try
+                {
+                    result = m_client->EnrollProfileAsync(profile, AudioConfig::FromWavFileInput(audioFile)).get();
+                }
+                catch (const std::exception& e)
+                {
+                    permit.Release(ConcurrencyOutcome::Failed);
+                    error = e.what();
+                    result = nullptr;
+                    BackoffBeforeRetry(attempt);
+                    continue;
+                }
+
+                if (result->Reason != ResultReason::Canceled)
+                {
+                    permit.Release(ConcurrencyOutcome::Succeeded);
+                    break;
+                }
+
+                auto cancellation = VoiceProfileEnrollmentCancellationDetails::FromResult(result);
+                permit.Release(AdaptiveConcurrencyLimiter::IsThrottling(cancellation->ErrorCode) ? ConcurrencyOutcome::Throttled : ConcurrencyOutcome::Failed);
+                error = cancellation->ErrorDetails;
+                if (cancellation->ErrorCode != CancellationErrorCode::TooManyRequests &&
+                    cancellation->ErrorCode != CancellationErrorCode::ServiceUnavailable &&
+                    cancellation->ErrorCode != CancellationErrorCode::ServiceTimeout)
+                {
+                    break;
+                }
+                BackoffBeforeRetry(attempt);
+            }
+
+            if (result == nullptr || result->Reason == ResultReason::Canceled)
+            {
+                DeleteProfile(profile);
+                m_store.Record(job.User, profile->GetId(), EnrollmentStore::State::Failed);
+                return Outcome::Failed;
+            }
+            if (IsComplete(*result))
+            {
+                m_store.Record(job.User, profile->GetId(), EnrollmentStore::State::Enrolled, filesEnrolled + 1);
+                return Outcome::Enrolled;
+            }
+            m_store.Record(job.User, profile->GetId(), EnrollmentStore::State::Created, filesEnrolled + 1);
+        }
+
+        // The profile stays created, so that a later run with more audio continues its enrollment.
+        error = "Not enough speech in the audio files";
+        return Outcome::Failed;
+    }
+
+    // Checks whether the service needs no more enrollment audio for the profile.
+    bool IsComplete(const Microsoft::CognitiveServices::Speech::VoiceProfileEnrollmentResult& result) const
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (result.Reason == ResultReason::EnrolledVoiceProfile)
+        {
+            return true;
+        }
+        return m_profileType == VoiceProfileType::TextDependentVerification
+            ? result.GetEnrollmentInfo(EnrollmentInfoType::RemainingEnrollmentsCount) == 0
+            : result.GetEnrollmentInfo(EnrollmentInfoType::RemainingEnrollmentsSpeechLength) == 0;
+    }
+
+    // Gets a permit of the limiter, or an empty one without a limiter.
+    AdaptiveConcurrencyLimiter::Permit AcquirePermit()
+    {
+        return m_limiter != nullptr ? m_limiter->Acquire() : AdaptiveConcurrencyLimiter::Permit();
+    }
+
+    // Runs 'request' until it doesn't throw, up to 'maxAttempts' times. Returns nullptr if all the attempts threw.
+    template<typename Request>
+    auto WithRetries(Request request, std::string& error) -> decltype(request())
+    {
+        for (int attempt = 0; attempt < maxAttempts; attempt++)
+        {
+            try
+            {
+                return request();
+            }
+            catch (const std::exception& e)
+            {
+                error = e.what();
+                BackoffBeforeRetry(attempt);
+            }
+        }
+        return nullptr;
+    }
+
+    // Deletes the profile of a failed enrollment, so that it doesn't stay in the subscription. It is best effort:
+    // a profile that can't be deleted is left behind, as before.
+    void DeleteProfile(const std::shared_ptr<Microsoft::CognitiveServices::Speech::VoiceProfile>& profile)
+    {
+        try
+        {
+            auto permit = AcquirePermit();
+            m_client->DeleteProfileAsync(profile).get();
+            permit.Release(ConcurrencyOutcome::Succeeded);
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    // Waits before retrying after a failed 'attempt', doubling the delay with each attempt and randomizing it so that
+    // the workers don't retry in lockstep. It doesn't wait after the last attempt, which isn't retried.
+    void BackoffBeforeRetry(int attempt)
+    {
+        if (attempt + 1 >= maxAttempts)
+        {
+            return;
+        }
+
+        auto delay = initialBackoffMilliseconds << attempt;
+        int jittered;
+        {
+            std::lock_guard<std::mutex> lock(m_randomMutex);
+            jittered = std::uniform_int_distribution<int>(delay / 2, delay)(m_random);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(jittered));
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::VoiceProfileClient> m_client;
+    EnrollmentStore& m_store;
+    const uint32_t m_maxConcurrency;
+    const Microsoft::CognitiveServices::Speech::VoiceProfileType m_profileType;
+    const std::string m_locale;
+    const std::shared_ptr<AdaptiveConcurrencyLimiter> m_limiter;
+    std::mutex m_randomMutex;
+    std::mt19937 m_random;
+};
@@ -0,0 +1,229 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "session_completion.h"
+#include "wav_file_reader.h"
+
+// A final result of a checkpointed recognition, its offset from the start of the file whichever session recognized it.
+struct CheckpointedResult
+{
+    std::string Text;
+    uint64_t Offset = 0;        // in ticks of 100 ns.
+    uint64_t Duration = 0;
+    int Session = 0;            // 0 for the first session, 1 for the first one that resumed, and so on.
+};
+
+struct CheckpointedRecognitionOptions
+{
+    // Where the checkpoint is saved, so that a restarted process resumes too; empty to keep it in memory only.
+    std::string CheckpointFile;
+
+    // How often, at most, the checkpoint is saved. It is always saved when the recognition ends.
+    std::chrono::seconds SaveInterval{ 5 };
+
+    // How many times in a row a session may fail without recognizing anything before giving up, and the wait before each retry.
+    int MaxFailedSessions = 3;
+    std::chrono::seconds RetryDelay{ 2 };
+};
+
+// Recognizes a long wav file with continuous recognition, resuming after a network error rather than restarting.
+// It checkpoints the end of the last Recognized result, and when a session is canceled with an error, starts a fresh
+// recognizer that reads the file from the checkpoint, rounded down to a frame, so that the audio already recognized
+// is not sent again. The offsets of the results are rebased on the start of the file, so that the transcript is continuous.
+class CheckpointedRecognition final
+{
+public:
+    CheckpointedRecognition(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, std::string fileName,
+        CheckpointedRecognitionOptions options = CheckpointedRecognitionOptions())
+        : m_config(config), m_fileName(std::move(fileName)), m_options(options)
+    {
+        if (m_config == nullptr || m_fileName.empty() || options.MaxFailedSessions <= 0)
+        {
+            throw std::invalid_argument("A speech config, a file name and a positive number of failed sessions are required");
+        }
+        LoadCheckpoint();
+    }
+
+    CheckpointedRecognition(const CheckpointedRecognition&) = delete;
+    CheckpointedRecognition& operator=(const CheckpointedRecognition&) = delete;
+
+    // Recognizes the file from the checkpoint to its end, calling 'onResult' with each final result, from the threads of the SDK.
+    // Returns true if the end was reached, false if the sessions kept failing; a later Run() resumes from the checkpoint.
+    bool Run(std::function<void(const CheckpointedResult&)> onResult)
+    {
+        int failedSessions = 0;
+        while (true)
+        {
+            auto checkpointBefore = GetCheckpoint();
+            auto outcome = RunSession(onResult);
+            SaveCheckpoint(true);
+            if (outcome == SessionOutcome::Stopped)
+            {
+                return true;
+            }
+
+            // Gives up only when sessions keep failing without getting any further.
+            failedSessions = GetCheckpoint() > checkpointBefore ? 1 : failedSessions + 1;
+            if (failedSessions >= m_options.MaxFailedSessions)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(m_options.RetryDelay);
+        }
+    }
+
+    // Gets the end of the last recognized result, in ticks from the start of the file.
+    uint64_t GetCheckpoint() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_checkpoint;
+    }
+
+    // Gets the number of sessions that resumed after an error.
+    int GetResumes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_sessions > 0 ? m_sessions - 1 : 0;
+    }
+
+private:
+    // Reads the file from where the session starts.
+    class ResumedWavCallback final : public Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback
+    {
+    public:
+        explicit ResumedWavCallback(const std::string& fileName)
+            : m_reader(fileName)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            return m_reader.Read(dataBuffer, size);
+        }
+
+        void Close() override
+        {
+            m_reader.Close();
+        }
+
+        const WavFormat& GetFormat() const
+        {
+            return m_reader.GetFormat();
+        }
+
+        // Starts at 'offset' bytes into the audio data, rounded down to a whole frame. Returns the offset it starts at.
+        uint64_t Seek(uint64_t offset)
+        {
+            return m_reader.SeekAudio(offset);
+        }
+
+    private:
+        WavFileReader m_reader;
+    };
+
+    SessionOutcome RunSession(const std::function<void(const CheckpointedResult&)>& onResult)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        int session;
+        uint64_t checkpoint;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            session = m_sessions++;
+            checkpoint = m_checkpoint;
+        }
+
+        // The offsets of this session's results are from where it starts in the file.
+        auto callback = std::make_shared<ResumedWavCallback>(m_fileName);
+        const auto& format = callback->GetFormat();
+        auto base = AudioBytesToTicks(callback->Seek(AudioTicksToBytes(checkpoint, format)), format);
+        auto stream = AudioInputStream::CreatePullStream(CreateAudioStreamFormat(format), callback);
+        auto recognizer = SpeechRecognizer::FromConfig(m_config, AudioConfig::FromStreamInput(stream));
+
+        // The recognizer is destroyed before this returns, so its handler may use this.
+        recognizer->Recognized.Connect([this, base, session, onResult](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason != ResultReason::RecognizedSpeech)
+            {
+                return;
+            }
+
+            CheckpointedResult result;
+            result.Text = e.Result->Text;
+            result.Offset = base + e.Result->Offset();
+            result.Duration = e.Result->Duration();
+            result.Session = session;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_checkpoint = (std::max)(m_checkpoint, result.Offset + result.Duration);
+            }
+            SaveCheckpoint(false);
+            onResult(result);
+        });
+        auto sessionEnd = SessionCompletion::Watch(*recognizer);
+
+        recognizer->StartContinuousRecognitionAsync().get();
+        auto outcome = sessionEnd->Wait();
+        recognizer->StopContinuousRecognitionAsync().get();
+        return outcome;
+    }
+
+    // The checkpoint file has one line: the checkpoint in ticks, a tab, and the name of the audio file.
+    void LoadCheckpoint()
+    {
+        if (m_options.CheckpointFile.empty())
+        {
+            return;
+        }
+        std::ifstream file(m_options.CheckpointFile);
+        uint64_t checkpoint = 0;
+        std::string fileName;
+        if (file >> checkpoint && file.get() == '\t' && std::getline(file, fileName) && fileName == m_fileName)
+        {
+            m_checkpoint = checkpoint;
+        }
+    }
+
+    void SaveCheckpoint(bool always)
+    {
+        if (m_options.CheckpointFile.empty())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (!always && now - m_lastSaved < m_options.SaveInterval)
+        {
+            return;
+        }
+        m_lastSaved = now;
+
+        std::ofstream file(m_options.CheckpointFile, std::ios::trunc);
+        file << m_checkpoint << '\t' << m_fileName << '\n';
+    }
+
+    const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    const std::string m_fileName;
+    const CheckpointedRecognitionOptions m_options;
+
+    mutable std::mutex m_mutex;
+    uint64_t m_checkpoint = 0;
+    int m_sessions = 0;
+    std::chrono::steady_clock::time_point m_lastSaved;
+};
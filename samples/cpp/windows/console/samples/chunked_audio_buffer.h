@@ -0,0 +1,147 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// Collects audio data in a list of fixed-size blocks instead of one contiguous vector.
+// Appending never reallocates or moves the data already written, so that a long-form synthesis doesn't copy
+// an ever-growing buffer on the SDK's callback thread. Blocks can be reserved up front from a size hint,
+// and the blocks of a cleared buffer are kept for reuse. The data is handed out as a scatter-gather list.
+class ChunkedAudioBuffer final
+{
+public:
+    // A contiguous piece of the buffered audio.
+    struct Segment
+    {
+        const uint8_t* Data;
+        size_t Size;
+    };
+
+    // Defines the default block size, a little over 2 seconds of 16 kHz 16-bit mono audio.
+    static constexpr size_t defaultBlockSize = 64 * 1024;
+
+    // Constructor that preallocates enough blocks for 'reservedBytes'.
+    ChunkedAudioBuffer(size_t blockSize = defaultBlockSize, size_t reservedBytes = 0)
+        : m_blockSize(blockSize)
+    {
+        if (m_blockSize == 0)
+        {
+            throw std::invalid_argument("Block size must be positive");
+        }
+        Reserve(reservedBytes);
+    }
+
+    ChunkedAudioBuffer(const ChunkedAudioBuffer&) = delete;
+    ChunkedAudioBuffer& operator=(const ChunkedAudioBuffer&) = delete;
+
+    // Estimates the audio size of synthesizing 'characters' characters of text, as a hint for Reserve().
+    // It assumes a speaking rate of about 15 characters per second of audio.
+    static size_t EstimateSynthesizedBytes(size_t characters, uint32_t bytesPerSecond = 32000)
+    {
+        constexpr size_t charactersPerSecond = 15;
+        return (characters / charactersPerSecond + 1) * bytesPerSecond;
+    }
+
+    // Makes sure that 'bytes' more bytes can be appended without allocating.
+    void Reserve(size_t bytes)
+    {
+        auto spare = m_blocks.empty() ? 0 : m_blockSize - m_lastBlockUsed;
+        spare += m_free.size() * m_blockSize;
+        while (spare < bytes)
+        {
+            m_free.emplace_back(new uint8_t[m_blockSize]);
+            spare += m_blockSize;
+        }
+        m_blocks.reserve(m_blocks.size() + m_free.size());
+    }
+
+    // Appends data. Only the tail of the last block is written, earlier blocks are never touched.
+    void Append(const uint8_t* data, size_t size)
+    {
+        while (size > 0)
+        {
+            if (m_blocks.empty() || m_lastBlockUsed == m_blockSize)
+            {
+                AddBlock();
+            }
+            auto count = size < m_blockSize - m_lastBlockUsed ? size : m_blockSize - m_lastBlockUsed;
+            memcpy(m_blocks.back().get() + m_lastBlockUsed, data, count);
+            m_lastBlockUsed += count;
+            m_size += count;
+            data += count;
+            size -= count;
+        }
+    }
+
+    // Gets the number of bytes appended.
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    // Gets the buffered audio as a list of segments in order, without copying it.
+    // The segments stay valid until the buffer is cleared or destroyed.
+    std::vector<Segment> GetSegments() const
+    {
+        std::vector<Segment> segments;
+        segments.reserve(m_blocks.size());
+        for (size_t i = 0; i < m_blocks.size(); i++)
+        {
+            auto size = i + 1 == m_blocks.size() ? m_lastBlockUsed : m_blockSize;
+            segments.push_back(Segment{ m_blocks[i].get(), size });
+        }
+        return segments;
+    }
+
+    // Copies the buffered audio into one contiguous vector, for consumers that can't take segments.
+    std::vector<uint8_t> Flatten() const
+    {
+        std::vector<uint8_t> data;
+        data.reserve(m_size);
+        for (const auto& segment : GetSegments())
+        {
+            data.insert(data.end(), segment.Data, segment.Data + segment.Size);
+        }
+        return data;
+    }
+
+    // Empties the buffer, keeping its blocks for the next appends.
+    void Clear()
+    {
+        for (auto& block : m_blocks)
+        {
+            m_free.push_back(std::move(block));
+        }
+        m_blocks.clear();
+        m_lastBlockUsed = 0;
+        m_size = 0;
+    }
+
+private:
+    void AddBlock()
+    {
+        if (m_free.empty())
+        {
+            m_blocks.emplace_back(new uint8_t[m_blockSize]);
+        }
+        else
+        {
+            m_blocks.push_back(std::move(m_free.back()));
+            m_free.pop_back();
+        }
+        m_lastBlockUsed = 0;
+    }
+
+    const size_t m_blockSize;
+    std::vector<std::unique_ptr<uint8_t[]>> m_blocks;
+    std::vector<std::unique_ptr<uint8_t[]>> m_free;
+    size_t m_lastBlockUsed = 0;
+    size_t m_size = 0;
+};
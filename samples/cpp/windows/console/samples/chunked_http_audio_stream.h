@@ -0,0 +1,647 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Winsock 2 must come before any windows.h that pulls in the original winsock.h.
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+#else
+using SocketHandle = int;
+#endif
+
+// An HTTP connection, with just enough of HTTP/1.1 to read one request and stream one response, or to post one request.
+class HttpConnection final
+{
+public:
+    HttpConnection(SocketHandle socket)
+        : m_socket(socket)
+    {
+        // Small audio chunks go out as they are written rather than waiting to be coalesced, which delays the first byte.
+        int noDelay = 1;
+        setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+        // A client that stops reading fails the response after a while, rather than holding its sender forever.
+#ifdef _WIN32
+        DWORD timeout = sendTimeoutSeconds * 1000;
+#else
+        timeval timeout = { sendTimeoutSeconds, 0 };
+#endif
+        setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+    }
+
+    ~HttpConnection()
+    {
+        Close();
+    }
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    // Connects to an HTTP server, e.g. to post to a collector. 'timeout' bounds the connection to each address of the
+    // host, and then each receive, so that a server that does not answer fails the request rather than holding it.
+    static std::shared_ptr<HttpConnection> Connect(const std::string& host, uint16_t port,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(10000))
+    {
+#ifdef _WIN32
+        // Winsock stays initialized for the rest of the process.
+        static const bool initialized = []() { WSADATA data; return WSAStartup(MAKEWORD(2, 2), &data) == 0; }();
+        if (!initialized)
+        {
+            throw std::runtime_error("Failed to initialize Winsock");
+        }
+#endif
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+        {
+            throw std::runtime_error("Failed to resolve " + host);
+        }
+
+        auto socket = invalidSocket;
+        for (auto address = addresses; address != nullptr && socket == invalidSocket; address = address->ai_next)
+        {
+            socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (socket != invalidSocket && !ConnectWithin(socket, address, timeout))
+            {
+                CloseSocket(socket);
+                socket = invalidSocket;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (socket == invalidSocket)
+        {
+            throw std::runtime_error("Failed to connect to " + host + ":" + std::to_string(port));
+        }
+        auto connection = std::make_shared<HttpConnection>(socket);
+        connection->SetReceiveTimeout(timeout);
+        return connection;
+    }
+
+    // Makes a receive fail once it has waited 'timeout' for data, as a send does after sendTimeoutSeconds.
+    void SetReceiveTimeout(std::chrono::milliseconds timeout)
+    {
+#ifdef _WIN32
+        DWORD value = (DWORD)timeout.count();
+#else
+        timeval value = { (time_t)(timeout.count() / 1000), (suseconds_t)(timeout.count() % 1000 * 1000) };
+#endif
+        setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&value, sizeof(value));
+    }
+
+    // Reads the request line and headers, up to the empty line, or the status line and headers of a response.
+    // It throws if the peer disconnects or sends too much.
+    std::string ReadRequestHead(size_t maxSize = 8192)
+    {
+        std::string head;
+        char buffer[1024];
+        while (head.find("\r\n\r\n") == std::string::npos)
+        {
+            if (head.size() > maxSize)
+            {
+                throw std::runtime_error("Request head too large");
+            }
+            auto received = recv(m_socket, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                throw std::runtime_error("Connection closed before the end of the request head");
+            }
+            head.append(buffer, (size_t)received);
+        }
+        return head;
+    }
+
+    // Gets the target of the request line, e.g. "/speak?text=Hello".
+    static std::string GetRequestTarget(const std::string& head)
+    {
+        auto start = head.find(' ');
+        auto end = start == std::string::npos ? std::string::npos : head.find(' ', start + 1);
+        return end == std::string::npos ? std::string() : head.substr(start + 1, end - start - 1);
+    }
+
+    // Gets the decoded value of a query parameter of a request target, or an empty string if it has none.
+    static std::string GetQueryParameter(const std::string& target, const std::string& name)
+    {
+        auto query = target.find('?');
+        while (query != std::string::npos)
+        {
+            auto start = query + 1;
+            auto end = target.find('&', start);
+            auto parameter = target.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            if (parameter.compare(0, name.size() + 1, name + "=") == 0)
+            {
+                return UrlDecode(parameter.substr(name.size() + 1));
+            }
+            query = end;
+        }
+        return std::string();
+    }
+
+    // Sends all of 'data', waiting while the socket buffer is full, which is what slows a writer down to the pace
+    // of the client. It returns false, and the connection stays failed, if the client disconnected.
+    bool SendAll(const uint8_t* data, size_t size)
+    {
+        while (size > 0 && !m_failed)
+        {
+#ifdef _WIN32
+            auto sent = send(m_socket, (const char*)data, (int)(std::min)(size, (size_t)INT32_MAX), 0);
+#else
+            auto sent = send(m_socket, data, size, MSG_NOSIGNAL);
+#endif
+            if (sent <= 0)
+            {
+                m_failed = true;
+                break;
+            }
+            data += sent;
+            size -= (size_t)sent;
+        }
+        return !m_failed;
+    }
+
+    bool SendAll(const std::string& text)
+    {
+        return SendAll((const uint8_t*)text.data(), text.size());
+    }
+
+    // Sends a response without a body, e.g. "404 Not Found".
+    bool SendStatus(const std::string& status)
+    {
+        return SendAll("HTTP/1.1 " + status + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    }
+
+    // Makes a send or receive blocked on another thread fail, without closing the socket under it.
+    void Shutdown()
+    {
+#ifdef _WIN32
+        shutdown(m_socket, SD_BOTH);
+#else
+        shutdown(m_socket, SHUT_RDWR);
+#endif
+    }
+
+    void Close()
+    {
+        if (m_socket != invalidSocket)
+        {
+            CloseSocket(m_socket);
+            m_socket = invalidSocket;
+        }
+    }
+
+#ifdef _WIN32
+    static constexpr SocketHandle invalidSocket = INVALID_SOCKET;
+#else
+    static constexpr SocketHandle invalidSocket = -1;
+#endif
+
+    static void CloseSocket(SocketHandle socket)
+    {
+#ifdef _WIN32
+        closesocket(socket);
+#else
+        close(socket);
+#endif
+    }
+
+private:
+    // Defines how long a send may wait for the client to read.
+    static constexpr int sendTimeoutSeconds = 30;
+
+    // Connects without blocking, and waits at most 'timeout' for the connection, then makes the socket blocking again.
+    static bool ConnectWithin(SocketHandle socket, const addrinfo* address, std::chrono::milliseconds timeout)
+    {
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket(socket, FIONBIO, &nonBlocking);
+        auto connected = connect(socket, address->ai_addr, (int)address->ai_addrlen) == 0;
+        auto pending = !connected && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        auto flags = fcntl(socket, F_GETFL, 0);
+        fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+        auto connected = connect(socket, address->ai_addr, address->ai_addrlen) == 0;
+        auto pending = !connected && errno == EINPROGRESS;
+#endif
+        if (pending)
+        {
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(socket, &writable);
+            timeval wait = { (long)(timeout.count() / 1000), (long)(timeout.count() % 1000 * 1000) };
+            int error = 0;
+            socklen_t size = sizeof(error);
+            connected = select((int)socket + 1, nullptr, &writable, nullptr, &wait) > 0
+                && getsockopt(socket, SOL_SOCKET, SO_ERROR, (char*)&error, &size) == 0 && error == 0;
+        }
+#ifdef _WIN32
+        u_long blocking = 0;
+        ioctlsocket(socket, FIONBIO, &blocking);
+#else
+        fcntl(socket, F_SETFL, flags);
+#endif
+        return connected;
+    }
+
+    static std::string UrlDecode(const std::string& text)
+    {
+        std::string decoded;
+        auto hexValue = [](char c) { return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1; };
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '+')
+            {
+                decoded += ' ';
+            }
+            else if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0)
+            {
+                decoded += (char)(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+                i += 2;
+            }
+            else
+            {
+                decoded += text[i];
+            }
+        }
+        return decoded;
+    }
+
+    SocketHandle m_socket;
+    bool m_failed = false;
+};
+
+// Listens for HTTP connections on a port of all local addresses.
+class HttpListener final
+{
+public:
+    HttpListener(uint16_t port)
+    {
+#ifdef _WIN32
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        {
+            throw std::runtime_error("Failed to initialize Winsock");
+        }
+#endif
+        m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (m_socket == HttpConnection::invalidSocket)
+        {
+            Cleanup();
+            throw std::runtime_error("Failed to create a socket");
+        }
+        int reuse = 1;
+        setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(m_socket, (const sockaddr*)&address, sizeof(address)) != 0 || listen(m_socket, SOMAXCONN) != 0)
+        {
+            HttpConnection::CloseSocket(m_socket);
+            Cleanup();
+            throw std::runtime_error("Failed to listen on port " + std::to_string(port));
+        }
+    }
+
+    ~HttpListener()
+    {
+        HttpConnection::CloseSocket(m_socket);
+        Cleanup();
+    }
+
+    HttpListener(const HttpListener&) = delete;
+    HttpListener& operator=(const HttpListener&) = delete;
+
+    // Waits for the next connection.
+    std::shared_ptr<HttpConnection> Accept()
+    {
+        auto socket = accept(m_socket, nullptr, nullptr);
+        if (socket == HttpConnection::invalidSocket)
+        {
+            throw std::runtime_error("Failed to accept a connection");
+        }
+        return std::make_shared<HttpConnection>(socket);
+    }
+
+private:
+    static void Cleanup()
+    {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    SocketHandle m_socket;
+};
+
+// Recycles the buffers audio chunks are copied into, across responses, so that streaming allocates nothing
+// once the pool has warmed up. It is thread safe.
+class AudioChunkPool final
+{
+public:
+    // Defines the room kept in front of and after the audio of a chunk, for the frame of an HTTP chunk.
+    static constexpr size_t headerRoom = 10;    // up to 8 hex digits and CRLF.
+    static constexpr size_t trailerRoom = 2;    // CRLF.
+
+    // Constructor with the largest audio chunk a buffer holds, and the number of free buffers kept.
+    AudioChunkPool(size_t chunkSize = 16 * 1024, size_t maxFree = 256)
+        : m_chunkSize(chunkSize), m_maxFree(maxFree)
+    {
+        if (chunkSize == 0)
+        {
+            throw std::invalid_argument("Chunk size must be positive");
+        }
+    }
+
+    AudioChunkPool(const AudioChunkPool&) = delete;
+    AudioChunkPool& operator=(const AudioChunkPool&) = delete;
+
+    size_t GetChunkSize() const
+    {
+        return m_chunkSize;
+    }
+
+    // Gets an empty buffer with room for a chunk and its frame.
+    std::vector<uint8_t> Acquire()
+    {
+        std::vector<uint8_t> buffer;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_free.empty())
+            {
+                buffer.swap(m_free.back());
+                m_free.pop_back();
+                return buffer;
+            }
+            m_allocated++;
+        }
+        buffer.reserve(headerRoom + m_chunkSize + trailerRoom);
+        return buffer;
+    }
+
+    void Release(std::vector<uint8_t>&& buffer)
+    {
+        buffer.clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.size() < m_maxFree)
+        {
+            m_free.push_back(std::move(buffer));
+        }
+    }
+
+    // Gets the number of buffers allocated, rather than recycled.
+    uint64_t GetAllocated() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_allocated;
+    }
+
+private:
+    const size_t m_chunkSize;
+    const size_t m_maxFree;
+    mutable std::mutex m_mutex;
+    std::vector<std::vector<uint8_t>> m_free;
+    uint64_t m_allocated = 0;
+};
+
+// The timing of a streamed response.
+struct HttpStreamStatistics
+{
+    double TimeToFirstByteMilliseconds = 0;     // from the construction of the callback to the first audio byte sent.
+    double StallMilliseconds = 0;               // time the synthesizer was held up in Write() by a slow client.
+    uint64_t Bytes = 0;                         // of audio sent.
+    uint64_t Chunks = 0;
+    bool Disconnected = false;                  // whether the client went away before the end of the audio.
+};
+
+// Streams the audio of a synthesizer to an HTTP client as a chunked response, as it is synthesized, so that playback
+// starts with the first chunk instead of after the whole synthesis. Write() copies each chunk into a pooled buffer and
+// queues it for a sender thread, and only waits once 'maxInFlightChunks' are queued: a client that reads slower than
+// the audio is synthesized holds the synthesizer back, instead of the audio piling up in memory.
+class ChunkedHttpAudioOutputCallback final : public Microsoft::CognitiveServices::Speech::Audio::PushAudioOutputStreamCallback
+{
+public:
+    ChunkedHttpAudioOutputCallback(std::shared_ptr<HttpConnection> connection, std::shared_ptr<AudioChunkPool> pool,
+        const std::string& contentType, size_t maxInFlightChunks = 8)
+        : m_connection(connection), m_pool(pool), m_maxInFlight(maxInFlightChunks), m_start(std::chrono::steady_clock::now())
+    {
+        if (connection == nullptr || pool == nullptr || maxInFlightChunks == 0)
+        {
+            throw std::invalid_argument("A connection, a buffer pool and a positive number of chunks in flight are required");
+        }
+
+        auto head = "HTTP/1.1 200 OK\r\nContent-Type: " + contentType + "\r\nTransfer-Encoding: chunked\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n";
+        m_sender = std::thread([this, head]() { SendLoop(head); });
+    }
+
+    // Aborts a response the synthesizer did not close, and waits for the sender.
+    ~ChunkedHttpAudioOutputCallback()
+    {
+        Abort();
+        if (m_sender.joinable())
+        {
+            m_sender.join();
+        }
+    }
+
+    ChunkedHttpAudioOutputCallback(const ChunkedHttpAudioOutputCallback&) = delete;
+    ChunkedHttpAudioOutputCallback& operator=(const ChunkedHttpAudioOutputCallback&) = delete;
+
+    // Called by the synthesizer with each chunk of audio. It always takes the whole chunk; once the client has
+    // disconnected, the audio is dropped, and the synthesis can be stopped by checking IsDisconnected().
+    int Write(uint8_t* dataBuffer, uint32_t size) override
+    {
+        auto chunkSize = m_pool->GetChunkSize();
+        for (uint32_t offset = 0; offset < size; offset += (uint32_t)chunkSize)
+        {
+            auto count = (std::min)(chunkSize, (size_t)(size - offset));
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_queue.size() >= m_maxInFlight && !m_disconnected)
+                {
+                    auto stallStart = std::chrono::steady_clock::now();
+                    m_sent.wait(lock, [this]() { return m_queue.size() < m_maxInFlight || m_disconnected; });
+                    m_statistics.StallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stallStart).count();
+                }
+                if (m_disconnected || m_closed)
+                {
+                    break;
+                }
+            }
+
+            // Leaves room for the chunk size in front of the audio, so that the frame and the audio go out in one send.
+            auto buffer = m_pool->Acquire();
+            buffer.resize(AudioChunkPool::headerRoom);
+            buffer.insert(buffer.end(), dataBuffer + offset, dataBuffer + offset + count);
+            buffer.push_back('\r');
+            buffer.push_back('\n');
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.push_back(std::move(buffer));
+            }
+            m_available.notify_one();
+        }
+        return (int)size;
+    }
+
+    // Called by the synthesizer after the last chunk. The response is completed once the queued chunks are sent.
+    void Close() override
+    {
+        Finish(false);
+    }
+
+    // Ends the response without its last chunk, e.g. when the synthesis is canceled, so that the client sees it is incomplete.
+    void Abort()
+    {
+        Finish(true);
+    }
+
+    bool IsDisconnected() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_disconnected;
+    }
+
+    // Waits for the response to be completed or aborted, and gets its timing.
+    HttpStreamStatistics GetStatistics()
+    {
+        if (m_sender.joinable())
+        {
+            m_sender.join();
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+
+private:
+    void Finish(bool abort)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed)
+            {
+                return;
+            }
+            m_closed = true;
+            m_aborted = abort;
+        }
+        if (abort)
+        {
+            m_connection->Shutdown();
+        }
+        m_available.notify_one();
+        m_sent.notify_all();
+    }
+
+    void SendLoop(const std::string& head)
+    {
+        bool connected = m_connection->SendAll(head);
+        while (connected)
+        {
+            std::vector<uint8_t> buffer;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_available.wait(lock, [this]() { return m_aborted || (m_closed && m_queue.empty()) || !m_queue.empty(); });
+                if (m_aborted || m_queue.empty())
+                {
+                    break;
+                }
+                buffer.swap(m_queue.front());
+                m_queue.pop_front();
+            }
+
+            // Writes the chunk size right before the audio, in the room left for it.
+            char frame[AudioChunkPool::headerRoom + 1];
+            auto audioSize = buffer.size() - AudioChunkPool::headerRoom - AudioChunkPool::trailerRoom;
+            auto frameSize = (size_t)snprintf(frame, sizeof(frame), "%zx\r\n", audioSize);
+            auto start = AudioChunkPool::headerRoom - frameSize;
+            memcpy(buffer.data() + start, frame, frameSize);
+            connected = m_connection->SendAll(buffer.data() + start, buffer.size() - start);
+            m_pool->Release(std::move(buffer));
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (connected)
+            {
+                if (m_statistics.Chunks == 0)
+                {
+                    m_statistics.TimeToFirstByteMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+                }
+                m_statistics.Chunks++;
+                m_statistics.Bytes += audioSize;
+            }
+            m_sent.notify_all();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (connected && !m_aborted)
+        {
+            lock.unlock();
+            connected = m_connection->SendAll("0\r\n\r\n");
+            lock.lock();
+        }
+        m_disconnected = !connected;
+        m_statistics.Disconnected = !connected;
+        for (auto& buffer : m_queue)
+        {
+            m_pool->Release(std::move(buffer));
+        }
+        m_queue.clear();
+        lock.unlock();
+        m_sent.notify_all();
+        m_connection->Close();
+    }
+
+    const std::shared_ptr<HttpConnection> m_connection;
+    const std::shared_ptr<AudioChunkPool> m_pool;
+    const size_t m_maxInFlight;
+    const std::chrono::steady_clock::time_point m_start;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_available;
+    std::condition_variable m_sent;
+    std::deque<std::vector<uint8_t>> m_queue;
+    bool m_closed = false;
+    bool m_aborted = false;
+    bool m_disconnected = false;
+    HttpStreamStatistics m_statistics;
+    std::thread m_sender;
+};
@@ -8,6 +8,11 @@
 #include <speechapi_cxx.h>
 #include <fstream>
 #include "wav_file_reader.h"
+#include "frame_aligned_wav_reader.h"
+#include "push_audio_feeder.h"
+#include "voice_signature_store.h"
+#include "session_completion.h"
+#include "sample_console.h"
 #include <chrono>
 
 using namespace std;
@@ -23,7 +28,9 @@ void ConversationWithPullAudioStream()
     // First, define your own pull audio input stream callback class that implements the
     // PullAudioInputStreamCallback interface. The sample here illustrates how to define such
     // a callback that reads audio data from a wav file.
-    // AudioInputFromFileCallback implements PullAudioInputStreamCallback interface, and uses a wav file as source
+    // AudioInputFromFileCallback implements PullAudioInputStreamCallback interface, and uses a wav file as source.
+    // The file is memory-mapped and read in whole frames, so that the samples of the 8 channels of one instant
+    // always arrive in the same read.
     class AudioInputFromFileCallback final : public PullAudioInputStreamCallback
     {
     public:
@@ -48,8 +55,14 @@ void ConversationWithPullAudioStream()
             m_reader.Close();
         }
 
+        // Gets the audio format parsed from the wav file header.
+        const WavFormat& GetFormat() const
+        {
+            return m_reader.GetFormat();
+        }
+
     private:
-        WavFileReader m_reader;
+        FrameAlignedWavReader m_reader;
     };
 
     // Creates an instance of a speech config with your subscription key and region.
@@ -60,19 +73,24 @@ void ConversationWithPullAudioStream()
 
     // Creates a callback that will read audio data from a WAV file.
     shared_ptr<AudioInputFromFileCallback> callback;
+    shared_ptr<AudioStreamFormat> format;
     try
     {
         // Replace with your own audio file name.
         // The audio file should be in a format of 16 kHz sampling rate, 16 bits per sample, and 8 channels.
-        callback = make_shared<AudioInputFromFileCallback>("katiesteve.wav");
+        callback = make_shared<AudioInputFromFileCallback>(SampleFile("katiesteve.wav"));
+
+        // Takes the stream format from the WAV file header, and validates it before any audio is sent to the service.
+        format = CreateAudioStreamFormat(callback->GetFormat());
     }
     catch (const exception& e)
     {
         cout << "Exit due to exception: " << e.what() << endl;
+        return;
     }
 
-    // Create a pull stream that support 16kHz, 16 bits and 8 channels of PCM audio.
-    auto pullStream = AudioInputStream::CreatePullStream(AudioStreamFormat::GetWaveFormatPCM(16000, 16, 8), callback);
+    // Create a pull stream in the PCM format of the WAV file, e.g. 16kHz, 16 bits and 8 channels.
+    auto pullStream = AudioInputStream::CreatePullStream(format, callback);
     auto audioInput = AudioConfig::FromStreamInput(pullStream);
 
     // Create a conversation from a speech config and conversation Id.
@@ -99,20 +117,23 @@ void ConversationWithPullAudioStream()
                   "Data": "DizY04Z7PH/sYu2Yw2EcL4Mvj1GnEDOWJ/DhXHGdQJsQ8/zDc13z1cwllbEo5OSr3oGoKEHLV95OUA6PgksZzvTkf42iOFEv3yifUNfYkZuIzStZoDxWu1H1BoFBejqzSpCYyvqLwilWOyUeMn+z+E4+zXjqHUCyYJ/xf0C3+58kCbmyA55yj7YZ6OtMVyFmfT2GLiXr4YshUB14dgwl3Y08SRNavnG+/QOs+ixf3UoZ6BC1VZcVQnC2tn2FB+8v6ehnIOTQedo++6RWIB0RYmQ8VaEeI0E4hkpA1OxQ9f2gBVtw3KZXWSWBz8sXig2igpwMsQoFRmmIOGsu+p6tM8/OThQpARZ7OyAxsurzmaSGZAaXYt0YwMdIIXKeDBF6/KnUyw+NNzku1875u2Fde/bxgVvCOwhrLPPuu/RZUeAkwVQge7nKYNW5YjDcz8mfg4LfqWEGOVCcmf2IitQtcIEjY3MwLVNvsAB6GT2es1/1QieCfQKy/Tdu8IUfEvekwSCxSlWhfVrLjRhGeWa9idCjsngQbNkqYUNdnIlidkn2DC4BavSTYXR5lVxV4SR/Vvj8h4N5nP/URPDhkzl7n7Tqd4CGFZDzZzAr7yRo3PeUBX0CmdrKLW3+GIXAdvpFAx592pB0ySCv5qBFhJNErEINawfGcmeWZSORxJg1u+agj51zfTdrHZeugFcMs6Be"
                  })";
 
-    // creates a participant
-    auto katie = Participant::From("katie@example.com", "en-us", voiceSignatureKatie);
-
-    // creates another participant
-    auto steve = Participant::From("steve@example.com", "en-us", voiceSignatureSteve);
-
-    // Adds katie as a participant to the conversation.
-    conversation->AddParticipantAsync(katie).get();
+    // Keeps the signatures of recurring attendees across runs, so that they are only created once.
+    VoiceSignatureStore signatures(SampleOutputFile("voice_signatures.txt"));
+    vector<ConversationParticipant> participants = { { "katie@example.com", "en-us" }, { "steve@example.com", "en-us" } };
 
-    // Adds steve as a participant to the conversation.
-    conversation->AddParticipantAsync(steve).get();
+    // Adds katie and steve as participants to the conversation, both at once.
+    // The signatures above stand for calls to the REST API, which are only made for users not in the store yet.
+    auto loaded = AddParticipants(conversation, participants, signatures, [&](const string& userId)
+    {
+        return userId == "katie@example.com" ? voiceSignatureKatie : voiceSignatureSteve;
+    });
+    for (const auto& error : loaded.Errors)
+    {
+        cout << "Failed to add participant " << error << std::endl;
+    }
+    cout << "Added " << loaded.Participants.size() << " participants in " << loaded.WallSeconds << "s" << std::endl;
 
-    // a promise for synchronization of recognition end.
-    promise<void> recognitionEnd;
+    SessionCompletion recognitionEnd;
 
     // Subscribes to events.
     recognizer->Transcribing.Connect([](const ConversationTranscriptionEventArgs& e)
@@ -146,7 +167,7 @@ void ConversationWithPullAudioStream()
         case CancellationReason::Error:
             cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
             cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
-            recognitionEnd.set_value();
+            recognitionEnd.Complete(SessionOutcome::Canceled);
             break;
 
         default:
@@ -157,14 +178,14 @@ void ConversationWithPullAudioStream()
     recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
     {
         cout << "SESSION: " << e.SessionId << " stopped." << std::endl;
-        recognitionEnd.set_value(); // Notify to stop recognition.
+        recognitionEnd.Complete(SessionOutcome::Stopped); // Notify to stop recognition.
     });
 
     // Starts transcribing.
     recognizer->StartTranscribingAsync().wait();
 
     // Waits for transcribing to end.
-    recognitionEnd.get_future().wait();
+    recognitionEnd.Wait();
 
     // Stops transcribing. This is optional.
     recognizer->StopTranscribingAsync().wait();
@@ -214,8 +235,7 @@ void ConversationWithPushAudioStream()
     // adds steve as a participant to the conversation.
     conversation->AddParticipantAsync(steve).get();
 
-    // promise for synchronization of recognition end.
-    promise<void> recognitionEnd;
+    SessionCompletion recognitionEnd;
 
     // Subscribes to events.
     recognizer->Transcribing.Connect([](const ConversationTranscriptionEventArgs& e)
@@ -249,7 +269,7 @@ void ConversationWithPushAudioStream()
         case CancellationReason::Error:
             cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
             cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
-            recognitionEnd.set_value();
+            recognitionEnd.Complete(SessionOutcome::Canceled);
             break;
 
         default:
@@ -263,7 +283,7 @@ void ConversationWithPushAudioStream()
         cout << "SESSION: " << e.SessionId << " stopped." << std::endl;
 
         // Notify transcribing ends.
-        recognitionEnd.set_value();
+        recognitionEnd.Complete(SessionOutcome::Stopped);
     });
 
     // open and read the wave file and push the buffers into the recognizer
@@ -272,17 +292,12 @@ void ConversationWithPushAudioStream()
     // The audio file should be in a format of 16 kHz sampling rate, 16 bits per sample, and 8 channels.
     try
     {
-        WavFileReader reader("katiesteve.wav");
-        vector<uint8_t> buffer(1000);
+        WavFileReader reader(SampleFile("katiesteve.wav"));
 
-        // Read data and push them into the stream
-        int readSamples = 0;
-        while ((readSamples = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
-        {
-            // Push a buffer into the stream
-            pushStream->Write(buffer.data(), readSamples);
-            this_thread::sleep_for(10ms);
-        }
+        // Read data and push them into the stream at the rate of a live 8 channel microphone array.
+        PushAudioFeeder feeder(pushStream, reader.GetFormat());
+        feeder.SetSpeed(1.0);
+        feeder.Feed(reader);
     }
     catch (const exception& e)
     {
@@ -293,7 +308,7 @@ void ConversationWithPushAudioStream()
     pushStream->Close();
 
     // Waits for completion.
-    recognitionEnd.get_future().wait();
+    recognitionEnd.Wait();
 
     // Leaves the conversation.
     recognizer->StopTranscribingAsync().wait();
@@ -0,0 +1,170 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "json_scanner.h"
+
+// A word of an NBest entry, with its audio offset and duration in ticks of 100 nanoseconds.
+struct NBestWord
+{
+    JsonSpan Word;
+    uint64_t Offset = 0;
+    uint64_t Duration = 0;
+};
+
+// One recognition alternative of a detailed result. Its words are Words()[FirstWord, FirstWord + WordCount)
+// of the extractor, present when word level timestamps were requested.
+struct NBestEntry
+{
+    double Confidence = 0;
+    JsonSpan Lexical;
+    JsonSpan Itn;
+    JsonSpan MaskedItn;
+    JsonSpan Display;
+    size_t FirstWord = 0;
+    size_t WordCount = 0;
+};
+
+// Extracts the NBest alternatives and their words from the JSON of a result recognized with OutputFormat::Detailed,
+// the value of PropertyId::SpeechServiceResponse_JsonResult:
+//   { "RecognitionStatus": ..., "Offset": ..., "Duration": ..., "DisplayText": ...,
+//     "NBest": [ { "Confidence": ..., "Lexical": ..., "ITN": ..., "MaskedITN": ..., "Display": ...,
+//                  "Words": [ { "Word": ..., "Offset": ..., "Duration": ... } ] } ] }
+// The texts are spans of the JSON string, which must outlive them, and the entries and words are kept in vectors
+// that are reused from one result to the next. So once the vectors have grown to the largest result, extracting
+// allocates nothing. Use ForThisThread() to get an extractor per thread, e.g. per SDK callback thread.
+class DetailedResultExtractor final
+{
+public:
+    // Gets the extractor of the calling thread.
+    static DetailedResultExtractor& ForThisThread()
+    {
+        static thread_local DetailedResultExtractor extractor;
+        return extractor;
+    }
+
+    // Extracts a result, replacing the previous one. It returns false if the JSON is malformed.
+    // The spans of the result point into 'json', so it cannot be a temporary string.
+    bool Extract(std::string&&) = delete;
+
+    bool Extract(const std::string& json)
+    {
+        m_entries.clear();
+        m_words.clear();
+        m_offset = 0;
+        m_duration = 0;
+
+        JsonScanner scanner(json);
+        return scanner.ReadObject([this, &scanner](const JsonSpan& key)
+        {
+            if (key.Equals("Offset"))
+            {
+                return scanner.ReadUnsigned(m_offset);
+            }
+            if (key.Equals("Duration"))
+            {
+                return scanner.ReadUnsigned(m_duration);
+            }
+            if (key.Equals("NBest"))
+            {
+                return scanner.ReadArray([this, &scanner]() { return ReadEntry(scanner); });
+            }
+            return scanner.SkipValue();
+        });
+    }
+
+    // Gets the alternatives of the result, best first as the service ranks them.
+    const std::vector<NBestEntry>& Entries() const
+    {
+        return m_entries;
+    }
+
+    // Gets the words of all the alternatives.
+    const std::vector<NBestWord>& Words() const
+    {
+        return m_words;
+    }
+
+    // Gets the audio offset of the result, in ticks of 100 nanoseconds.
+    uint64_t GetOffset() const
+    {
+        return m_offset;
+    }
+
+    // Gets the audio duration of the result, in ticks of 100 nanoseconds.
+    uint64_t GetDuration() const
+    {
+        return m_duration;
+    }
+
+private:
+    bool ReadEntry(JsonScanner& scanner)
+    {
+        NBestEntry entry;
+        entry.FirstWord = m_words.size();
+        auto read = scanner.ReadObject([this, &scanner, &entry](const JsonSpan& key)
+        {
+            if (key.Equals("Confidence"))
+            {
+                return scanner.ReadNumber(entry.Confidence);
+            }
+            if (key.Equals("Lexical"))
+            {
+                return scanner.ReadString(entry.Lexical);
+            }
+            if (key.Equals("ITN"))
+            {
+                return scanner.ReadString(entry.Itn);
+            }
+            if (key.Equals("MaskedITN"))
+            {
+                return scanner.ReadString(entry.MaskedItn);
+            }
+            if (key.Equals("Display"))
+            {
+                return scanner.ReadString(entry.Display);
+            }
+            if (key.Equals("Words"))
+            {
+                return scanner.ReadArray([this, &scanner]() { return ReadWord(scanner); });
+            }
+            return scanner.SkipValue();
+        });
+        entry.WordCount = m_words.size() - entry.FirstWord;
+        m_entries.push_back(entry);
+        return read;
+    }
+
+    bool ReadWord(JsonScanner& scanner)
+    {
+        NBestWord word;
+        auto read = scanner.ReadObject([&scanner, &word](const JsonSpan& key)
+        {
+            if (key.Equals("Word"))
+            {
+                return scanner.ReadString(word.Word);
+            }
+            if (key.Equals("Offset"))
+            {
+                return scanner.ReadUnsigned(word.Offset);
+            }
+            if (key.Equals("Duration"))
+            {
+                return scanner.ReadUnsigned(word.Duration);
+            }
+            return scanner.SkipValue();
+        });
+        m_words.push_back(word);
+        return read;
+    }
+
+    std::vector<NBestEntry> m_entries;
+    std::vector<NBestWord> m_words;
+    uint64_t m_offset = 0;
+    uint64_t m_duration = 0;
+};
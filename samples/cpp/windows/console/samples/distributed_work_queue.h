@@ -0,0 +1,817 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audio_file_list.h"
+#include "batch_recognition_driver.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A file of a batch leased to a worker, which has it to itself until the lease expires.
+struct WorkLease
+{
+    uint64_t Item = 0;                  // the position of the file in the queue.
+    std::string File;
+    std::string Token;                  // of this lease, so that a worker whose lease expired cannot complete the file.
+};
+
+// The progress of a worker node, reported to the queue now and then.
+struct WorkerReport
+{
+    std::string Worker;
+    uint64_t Files = 0;                 // files completed.
+    uint64_t Failed = 0;                // of which the recognition failed.
+    uint64_t Lost = 0;                  // files whose lease expired before they were completed, left to other workers.
+    uint32_t InFlight = 0;
+    double AudioSeconds = 0;            // of the files completed.
+    double WallSeconds = 0;             // since the worker started.
+    int64_t UpdatedMilliseconds = 0;    // when it was reported, in milliseconds since the epoch.
+};
+
+struct WorkQueueProgress
+{
+    uint64_t Total = 0;
+    uint64_t Done = 0;
+    uint64_t Leased = 0;
+};
+
+// The queue shared by the coordinator and the workers of a distributed batch. The coordinator enqueues the files and
+// reads the results; each worker leases files, renews the leases while it recognizes them, and completes them. A file
+// whose lease expires, e.g. as its worker crashed, can be leased again by any worker.
+// Implementations only need atomic operations on shared state, e.g. files on a shared directory or a Redis server.
+class WorkQueue
+{
+public:
+    virtual ~WorkQueue() = default;
+
+    virtual void Enqueue(const std::vector<std::string>& files) = 0;
+
+    // Leases the next file nobody holds or has completed. Returns false if there is none for now.
+    virtual bool TryLease(const std::string& worker, std::chrono::milliseconds duration, WorkLease& lease) = 0;
+
+    // Extends a lease. Returns false if it was lost, as it expired and the file was leased again.
+    virtual bool Renew(const WorkLease& lease, std::chrono::milliseconds duration) = 0;
+
+    // Records the result of a file and releases its lease. Returns false if the lease was lost, the result is dropped.
+    virtual bool Complete(const WorkLease& lease, const BatchFileResult& result) = 0;
+
+    virtual void Report(const WorkerReport& report) = 0;
+    virtual std::vector<WorkerReport> GetReports() = 0;
+    virtual WorkQueueProgress GetProgress() = 0;
+
+    // Gets the results of the files completed, in the order they were enqueued.
+    virtual std::vector<BatchFileResult> GetResults() = 0;
+};
+
+// Gets the milliseconds since the epoch. Leases are compared across machines, whose clocks are assumed to be within
+// a small fraction of a lease duration of each other.
+inline int64_t WorkQueueNowMilliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// A work queue in a directory shared by all the nodes, e.g. on a network file system. It relies on the atomic
+// creation and rename of files only, so that it needs no server:
+//   files.txt           the files of the batch, one per line, appended by the coordinator.
+//   leases/<item>       the token, expiry and worker of a lease, created only if it does not exist.
+//   done/<item>         the result of a file.
+//   workers/<worker>    the last report of a worker.
+// An expired lease is taken over by renaming it away first, which only one worker can do.
+class FileLockWorkQueue final : public WorkQueue
+{
+public:
+    explicit FileLockWorkQueue(const std::string& directory)
+        : m_directory(directory), m_random(std::random_device()())
+    {
+        if (directory.empty())
+        {
+            throw std::invalid_argument("A queue directory is required");
+        }
+        for (auto path : { m_directory, Path("leases"), Path("done"), Path("workers") })
+        {
+            if (!MakeDirectory(path))
+            {
+                throw std::runtime_error("Failed to create the queue directory " + path);
+            }
+        }
+    }
+
+    void Enqueue(const std::vector<std::string>& files) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ofstream manifest(Path("files.txt"), std::ios::app);
+        for (const auto& file : files)
+        {
+            manifest << file << '\n';
+        }
+        manifest.flush();
+        if (!manifest)
+        {
+            throw std::runtime_error("Failed to write the queue manifest " + Path("files.txt"));
+        }
+    }
+
+    bool TryLease(const std::string& worker, std::chrono::milliseconds duration, WorkLease& lease) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        LoadManifest();
+        if (m_files.empty())
+        {
+            return false;
+        }
+
+        // Starts where this worker last found one, so that it does not walk over the start of the queue every time.
+        auto count = (uint64_t)m_files.size();
+        for (uint64_t scanned = 0; scanned < count; scanned++)
+        {
+            auto item = (m_cursor + scanned) % count;
+            if (m_done[item])
+            {
+                continue;
+            }
+            if (Exists(DonePath(item)))
+            {
+                m_done[item] = true;
+                continue;
+            }
+
+            auto token = worker + "-" + RandomHex();
+            if (TryAcquire(item, token, worker, duration))
+            {
+                m_cursor = item + 1;
+                lease.Item = item;
+                lease.File = m_files[item];
+                lease.Token = token;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Renew(const WorkLease& lease, std::chrono::milliseconds duration) override
+    {
+        // Renewed well before it expires, so that nobody takes it over between the check and the replace.
+        std::string token, worker;
+        int64_t expiry;
+        if (!ReadLease(lease.Item, token, expiry, worker) || token != lease.Token)
+        {
+            return false;
+        }
+        auto temporary = LeasePath(lease.Item) + "." + lease.Token + ".tmp";
+        return WriteFile(temporary, LeaseText(lease.Token, WorkQueueNowMilliseconds() + duration.count(), worker))
+            && ReplaceFile(temporary, LeasePath(lease.Item));
+    }
+
+    bool Complete(const WorkLease& lease, const BatchFileResult& result) override
+    {
+        // The lease is renamed away before it is checked, so that a worker that took it over in the meantime does not
+        // lose its own lease; until the result is published, the file can be leased again, but not completed twice.
+        auto leasePath = LeasePath(lease.Item);
+        auto completing = leasePath + "." + lease.Token + ".completing";
+        if (std::rename(leasePath.c_str(), completing.c_str()) != 0)
+        {
+            return false;
+        }
+        std::string text, token;
+        std::istringstream fields(ReadFile(completing, text) ? text : std::string());
+        int64_t expiry = 0;
+        std::string worker;
+        if (!(fields >> token >> expiry >> worker) || token != lease.Token)
+        {
+            if (!PublishFile(completing, leasePath))
+            {
+                std::remove(completing.c_str());
+            }
+            return false;
+        }
+
+        // Published under its final name only once written whole; if another worker completed it, its result is kept.
+        std::ostringstream done;
+        done << (result.Succeeded ? 1 : 0) << '\t' << result.AudioSeconds << '\t' << result.LatencySeconds << '\t'
+             << result.Attempts << '\t' << worker << '\n' << OneLine(result.ErrorDetails) << '\n';
+        for (const auto& line : result.Texts)
+        {
+            done << OneLine(line) << '\n';
+        }
+        auto temporary = DonePath(lease.Item) + "." + lease.Token + ".tmp";
+        if (!WriteFile(temporary, done.str()) || !PublishFile(temporary, DonePath(lease.Item)))
+        {
+            std::remove(temporary.c_str());
+        }
+        std::remove(completing.c_str());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (lease.Item < m_done.size())
+        {
+            m_done[lease.Item] = true;
+        }
+        return true;
+    }
+
+    void Report(const WorkerReport& report) override
+    {
+        std::ostringstream text;
+        text << report.Files << '\t' << report.Failed << '\t' << report.Lost << '\t' << report.InFlight << '\t'
+             << report.AudioSeconds << '\t' << report.WallSeconds << '\t' << report.UpdatedMilliseconds << '\n';
+        auto path = Path("workers/" + report.Worker);
+        std::string temporary;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            temporary = path + "." + RandomHex() + ".tmp";
+        }
+        if (!WriteFile(temporary, text.str()) || !ReplaceFile(temporary, path))
+        {
+            std::remove(temporary.c_str());
+        }
+    }
+
+    std::vector<WorkerReport> GetReports() override
+    {
+        std::vector<WorkerReport> reports;
+        for (const auto& name : ListNames(Path("workers")))
+        {
+            std::string text;
+            WorkerReport report;
+            report.Worker = name;
+            std::istringstream fields(ReadFile(Path("workers/" + name), text) ? text : std::string());
+            if (fields >> report.Files >> report.Failed >> report.Lost >> report.InFlight >> report.AudioSeconds
+                >> report.WallSeconds >> report.UpdatedMilliseconds)
+            {
+                reports.push_back(report);
+            }
+        }
+        return reports;
+    }
+
+    WorkQueueProgress GetProgress() override
+    {
+        WorkQueueProgress progress;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            LoadManifest();
+            progress.Total = m_files.size();
+        }
+        progress.Done = ListNames(Path("done")).size();
+        progress.Leased = ListNames(Path("leases")).size();
+        return progress;
+    }
+
+    std::vector<BatchFileResult> GetResults() override
+    {
+        std::vector<std::string> files;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            LoadManifest();
+            files = m_files;
+        }
+
+        std::vector<BatchFileResult> results;
+        for (uint64_t item = 0; item < files.size(); item++)
+        {
+            std::string text;
+            if (!ReadFile(DonePath(item), text))
+            {
+                continue;
+            }
+            std::istringstream lines(text);
+            std::string header;
+            std::getline(lines, header);
+            BatchFileResult result;
+            result.FileName = files[item];
+            int succeeded = 0;
+            std::string worker;
+            std::istringstream fields(header);
+            fields >> succeeded >> result.AudioSeconds >> result.LatencySeconds >> result.Attempts >> worker;
+            result.Succeeded = succeeded != 0;
+            std::getline(lines, result.ErrorDetails);
+            for (std::string line; std::getline(lines, line); )
+            {
+                result.Texts.push_back(line);
+            }
+            results.push_back(result);
+        }
+        return results;
+    }
+
+private:
+    std::string Path(const std::string& name) const
+    {
+        return m_directory + "/" + name;
+    }
+
+    // Items are named with a fixed width, so that the names of the directories sort in the order of the queue.
+    std::string ItemName(uint64_t item) const
+    {
+        char name[24];
+        snprintf(name, sizeof(name), "%010llu", (unsigned long long)item);
+        return name;
+    }
+
+    std::string LeasePath(uint64_t item) const
+    {
+        return Path("leases/" + ItemName(item));
+    }
+
+    std::string DonePath(uint64_t item) const
+    {
+        return Path("done/" + ItemName(item));
+    }
+
+    static std::string LeaseText(const std::string& token, int64_t expiry, const std::string& worker)
+    {
+        return token + "\t" + std::to_string(expiry) + "\t" + worker + "\n";
+    }
+
+    static std::string OneLine(std::string text)
+    {
+        std::replace(text.begin(), text.end(), '\n', ' ');
+        std::replace(text.begin(), text.end(), '\r', ' ');
+        return text;
+    }
+
+    std::string RandomHex()
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)m_random());
+        return hex;
+    }
+
+    // Reads the complete lines of the manifest that were not read yet.
+    void LoadManifest()
+    {
+        std::ifstream manifest(Path("files.txt"), std::ios::binary);
+        manifest.seekg((std::streamoff)m_manifestBytes);
+        std::string line;
+        while (std::getline(manifest, line) && !manifest.eof())
+        {
+            m_manifestBytes += line.size() + 1;
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            m_files.push_back(line);
+            m_done.push_back(false);
+        }
+    }
+
+    bool ReadLease(uint64_t item, std::string& token, int64_t& expiry, std::string& worker) const
+    {
+        std::string text;
+        if (!ReadFile(LeasePath(item), text))
+        {
+            return false;
+        }
+        std::istringstream fields(text);
+        return (bool)(fields >> token >> expiry >> worker);
+    }
+
+    bool TryAcquire(uint64_t item, const std::string& token, const std::string& worker, std::chrono::milliseconds duration)
+    {
+        auto leasePath = LeasePath(item);
+        auto temporary = leasePath + "." + token + ".tmp";
+        if (!WriteFile(temporary, LeaseText(token, WorkQueueNowMilliseconds() + duration.count(), worker)))
+        {
+            return false;
+        }
+        if (PublishFile(temporary, leasePath))
+        {
+            return true;
+        }
+
+        // Held already; taken over if it expired, by the one worker that manages to rename it away.
+        std::string heldToken, heldWorker;
+        int64_t expiry;
+        auto stale = leasePath + "." + token + ".stale";
+        if (ReadLease(item, heldToken, expiry, heldWorker) && expiry < WorkQueueNowMilliseconds() && std::rename(leasePath.c_str(), stale.c_str()) == 0)
+        {
+            // It may have been renewed between reading and renaming it; then it is handed back.
+            std::string text;
+            std::istringstream fields(ReadFile(stale, text) ? text : std::string());
+            std::string renamedToken;
+            int64_t renamedExpiry = 0;
+            fields >> renamedToken >> renamedExpiry;
+            if (renamedToken == heldToken && renamedExpiry < WorkQueueNowMilliseconds())
+            {
+                std::remove(stale.c_str());
+                if (PublishFile(temporary, leasePath))
+                {
+                    return true;
+                }
+            }
+            else if (!PublishFile(stale, leasePath))
+            {
+                std::remove(stale.c_str());
+            }
+        }
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    std::vector<std::string> ListNames(const std::string& directory) const
+    {
+        // Only the names of the items and workers, not those of the files being written or taken over.
+        std::vector<std::string> names;
+        for (const auto& path : ListAudioFiles(directory, ""))
+        {
+            auto name = path.substr(path.find_last_of("/\\") + 1);
+            if (name.find('.') == std::string::npos)
+            {
+                names.push_back(name);
+            }
+        }
+        return names;
+    }
+
+    static bool Exists(const std::string& path)
+    {
+#ifdef _WIN32
+        return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+        struct stat pathStat;
+        return stat(path.c_str(), &pathStat) == 0;
+#endif
+    }
+
+    static bool MakeDirectory(const std::string& path)
+    {
+#ifdef _WIN32
+        return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+        return mkdir(path.c_str(), 0777) == 0 || errno == EEXIST;
+#endif
+    }
+
+    static bool ReadFile(const std::string& path, std::string& text)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        std::ostringstream content;
+        content << file.rdbuf();
+        text = content.str();
+        return true;
+    }
+
+    static bool WriteFile(const std::string& path, const std::string& text)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+        file.close();
+        return !file.fail();
+    }
+
+    // Gives a file written whole its final name, unless that exists: the atomic, exclusive creation of a file.
+    static bool PublishFile(const std::string& from, const std::string& to)
+    {
+#ifdef _WIN32
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        if (link(from.c_str(), to.c_str()) != 0)
+        {
+            return false;
+        }
+        unlink(from.c_str());
+        return true;
+#endif
+    }
+
+    // Gives a file written whole the name of another, atomically replacing it.
+    static bool ReplaceFile(const std::string& from, const std::string& to)
+    {
+#ifdef _WIN32
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+
+    const std::string m_directory;
+    std::mutex m_mutex;
+    std::vector<std::string> m_files;
+    std::vector<bool> m_done;           // the items known to be done, which are never leased again.
+    uint64_t m_manifestBytes = 0;
+    uint64_t m_cursor = 0;
+    std::mt19937_64 m_random;
+};
+
+struct DistributedWorkerOptions
+{
+    std::string WorkerId;                                   // unique per node, e.g. the host name.
+    uint32_t MaxInFlight = 8;
+    std::chrono::milliseconds LeaseDuration{ 120000 };      // renewed every third of it while a file is recognized.
+    std::chrono::milliseconds PollInterval{ 2000 };         // between attempts while no file can be leased.
+    std::chrono::milliseconds ReportInterval{ 10000 };
+    BatchInputMode Mode = BatchInputMode::File;
+};
+
+// A node of a distributed batch: recognizes the files it leases from a shared queue, up to 'MaxInFlight' at once,
+// until all the files of the queue are done. The leases of the files being recognized are renewed, so that long
+// files stay with the node, and the node reports its throughput to the queue.
+class DistributedBatchWorker final
+{
+public:
+    DistributedBatchWorker(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, std::shared_ptr<WorkQueue> queue,
+        const DistributedWorkerOptions& options, std::shared_ptr<AdaptiveConcurrencyLimiter> limiter = nullptr)
+        : m_driver(config, (std::max)(options.MaxInFlight, 1u), options.Mode, limiter), m_queue(queue), m_options(options)
+    {
+        if (m_queue == nullptr || options.WorkerId.empty() || options.MaxInFlight == 0
+            || options.LeaseDuration.count() <= 0 || options.ReportInterval.count() <= 0)
+        {
+            throw std::invalid_argument("A queue, a worker id, a positive in-flight limit and positive intervals are required");
+        }
+
+        // The id names the files of the worker in the queue, and is a field of its leases.
+        if (options.WorkerId.find_first_of("./\\:\t\r\n ") != std::string::npos)
+        {
+            throw std::invalid_argument("A worker id cannot have dots, slashes, colons or white space");
+        }
+    }
+
+    // Runs until all the files of the queue are done, or Stop(). Returns the last report of the node.
+    WorkerReport Run()
+    {
+        m_start = std::chrono::steady_clock::now();
+        m_running = m_options.MaxInFlight;
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < m_options.MaxInFlight; i++)
+        {
+            threads.emplace_back([this]() { Work(); });
+        }
+
+        auto renewInterval = m_options.LeaseDuration / 3;
+        auto nextRenewal = std::chrono::steady_clock::now() + renewInterval;
+        auto nextReport = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_running > 0)
+            {
+                m_changed.wait_until(lock, (std::min)(nextRenewal, nextReport));
+                auto now = std::chrono::steady_clock::now();
+                if (now >= nextRenewal)
+                {
+                    std::vector<WorkLease> leases;
+                    for (const auto& active : m_active)
+                    {
+                        leases.push_back(active.second);
+                    }
+                    lock.unlock();
+                    std::vector<WorkLease> lost;
+                    for (const auto& lease : leases)
+                    {
+                        if (!m_queue->Renew(lease, m_options.LeaseDuration))
+                        {
+                            lost.push_back(lease);
+                        }
+                    }
+                    lock.lock();
+
+                    // A file whose lease was lost is left to the worker that has it now, unless it was completed meanwhile.
+                    for (const auto& lease : lost)
+                    {
+                        auto active = m_active.find(lease.Item);
+                        if (active != m_active.end() && active->second.Token == lease.Token)
+                        {
+                            m_lost.insert(lease.Item);
+                        }
+                    }
+                    nextRenewal = now + renewInterval;
+                }
+                if (now >= nextReport)
+                {
+                    auto report = MakeReport();
+                    lock.unlock();
+                    m_queue->Report(report);
+                    lock.lock();
+                    nextReport = now + m_options.ReportInterval;
+                }
+            }
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto report = MakeReport();
+        m_queue->Report(report);
+        return report;
+    }
+
+    // Stops leasing files; the files in flight are completed.
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+    }
+
+private:
+    void Work()
+    {
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_stopping)
+                {
+                    break;
+                }
+            }
+
+            WorkLease lease;
+            if (!m_queue->TryLease(m_options.WorkerId, m_options.LeaseDuration, lease))
+            {
+                // Done only once every file is; the files leased by a node that crashed come back when their leases expire.
+                auto progress = m_queue->GetProgress();
+                if (progress.Total > 0 && progress.Done >= progress.Total)
+                {
+                    break;
+                }
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait_for(lock, m_options.PollInterval, [this]() { return m_stopping; });
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_active[lease.Item] = lease;
+            }
+            auto result = m_driver.Recognize(lease.File);
+            bool lost;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_active.erase(lease.Item);
+                lost = m_lost.erase(lease.Item) > 0;
+            }
+            if (lost)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_report.Lost++;
+                continue;
+            }
+
+            auto completed = m_queue->Complete(lease, result);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (completed)
+            {
+                m_report.Files++;
+                m_report.Failed += result.Succeeded ? 0 : 1;
+                m_report.AudioSeconds += result.AudioSeconds;
+            }
+            else
+            {
+                m_report.Lost++;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running--;
+        }
+        m_changed.notify_all();
+    }
+
+    // Called with the lock held.
+    WorkerReport MakeReport() const
+    {
+        auto report = m_report;
+        report.Worker = m_options.WorkerId;
+        report.InFlight = (uint32_t)m_active.size();
+        report.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        report.UpdatedMilliseconds = WorkQueueNowMilliseconds();
+        return report;
+    }
+
+    BatchRecognitionDriver m_driver;
+    std::shared_ptr<WorkQueue> m_queue;
+    const DistributedWorkerOptions m_options;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::map<uint64_t, WorkLease> m_active;
+    std::set<uint64_t> m_lost;          // the items in flight whose leases could not be renewed.
+    WorkerReport m_report;
+    uint32_t m_running = 0;
+    bool m_stopping = false;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Submits the files of a distributed batch and follows it: the progress of the queue, and the throughput of each node
+// and of all of them, from the reports of the workers.
+class DistributedBatchCoordinator final
+{
+public:
+    explicit DistributedBatchCoordinator(std::shared_ptr<WorkQueue> queue)
+        : m_queue(queue), m_start(std::chrono::steady_clock::now())
+    {
+        if (m_queue == nullptr)
+        {
+            throw std::invalid_argument("A queue is required");
+        }
+    }
+
+    void Submit(const std::vector<std::string>& files)
+    {
+        m_queue->Enqueue(files);
+    }
+
+    // Waits for all the files to be done, or Stop(), printing the progress every 'interval', and returns the results
+    // of the files done.
+    std::vector<BatchFileResult> WaitForCompletion(std::ostream& out, std::chrono::milliseconds interval)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            lock.unlock();
+            auto progress = m_queue->GetProgress();
+            out << "Done: " << progress.Done << "/" << progress.Total << ", leased: " << progress.Leased << "\n";
+            PrintNodes(out, m_queue->GetReports(), 3 * interval);
+            out.flush();
+            lock.lock();
+            if ((progress.Total > 0 && progress.Done >= progress.Total) || m_changed.wait_for(lock, interval, [this]() { return m_stopping; }))
+            {
+                break;
+            }
+        }
+        lock.unlock();
+        return m_queue->GetResults();
+    }
+
+    // Makes WaitForCompletion() return, e.g. as the worker of this node failed.
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+    }
+
+    // Gets the wall time since the coordinator started in seconds.
+    double GetWallSeconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    // Prints the throughput of each node in audio-hours per wall-hour, and their sum. A node that has not reported for
+    // 'staleAfter' is marked; the files it held are leased again once their leases expire.
+    static void PrintNodes(std::ostream& out, const std::vector<WorkerReport>& reports, std::chrono::milliseconds staleAfter)
+    {
+        auto now = WorkQueueNowMilliseconds();
+        double total = 0;
+        for (const auto& report : reports)
+        {
+            auto throughput = report.WallSeconds > 0 ? report.AudioSeconds / report.WallSeconds : 0;
+            auto stale = now - report.UpdatedMilliseconds > staleAfter.count();
+            if (!stale)
+            {
+                total += throughput;
+            }
+            out << "  " << report.Worker << ": files " << report.Files << ", failed " << report.Failed << ", lost " << report.Lost
+                << ", in flight " << report.InFlight << ", throughput " << throughput << (stale ? " (not reporting)" : "") << "\n";
+        }
+        out << "  Nodes: " << reports.size() << ", throughput: " << total << " audio-hours per wall-hour\n";
+    }
+
+private:
+    std::shared_ptr<WorkQueue> m_queue;
+    const std::chrono::steady_clock::time_point m_start;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    bool m_stopping = false;
+};
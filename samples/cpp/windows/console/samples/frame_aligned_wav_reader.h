@@ -0,0 +1,207 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mapped_wav_file_reader.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_ALIGNED_WAV_READER_SSE2
+#endif
+
+// Reads the audio of a multichannel wav file in whole interleaved frames, so that a read never splits the samples
+// of one instant across two calls. The file is memory-mapped, each read is a slice of the mapped region.
+// Optionally, only some of the channels are passed on, in a given order, or the channels are mixed down to mono.
+// Selecting and mixing work on 16-bit PCM, mixing eight channels, the layout of a circular microphone array, uses SSE2.
+class FrameAlignedWavReader final
+{
+public:
+    // Constructor that passes all the channels on as they are.
+    FrameAlignedWavReader(const std::string& audioFileName)
+        : FrameAlignedWavReader(audioFileName, std::vector<uint16_t>(), false)
+    {
+    }
+
+    // Constructor that passes on the input 'channels' in that order, all of them if empty, or their average if 'downmix'.
+    FrameAlignedWavReader(const std::string& audioFileName, const std::vector<uint16_t>& channels, bool downmix)
+        : m_reader(audioFileName), m_channels(channels), m_downmix(downmix)
+    {
+        m_inputFormat = m_reader.GetFormat();
+        if (m_inputFormat.BlockAlign == 0)
+        {
+            throw std::invalid_argument("Invalid wav format, block align is zero.");
+        }
+
+        if (m_channels.empty() && m_downmix)
+        {
+            for (uint16_t i = 0; i < m_inputFormat.Channels; i++)
+            {
+                m_channels.push_back(i);
+            }
+        }
+        for (auto channel : m_channels)
+        {
+            if (channel >= m_inputFormat.Channels)
+            {
+                throw std::invalid_argument("Channel " + std::to_string(channel) + " is not in the file.");
+            }
+        }
+        if (!m_channels.empty() && m_inputFormat.BitsPerSample != 16)
+        {
+            throw std::invalid_argument("Selecting or mixing channels is only supported for 16-bit audio.");
+        }
+
+        m_outputFormat = m_inputFormat;
+        if (!m_channels.empty())
+        {
+            m_outputFormat.Channels = m_downmix ? 1 : (uint16_t)m_channels.size();
+            m_outputFormat.BlockAlign = (uint16_t)(m_outputFormat.Channels * sizeof(int16_t));
+            m_outputFormat.AvgBytesPerSec = m_outputFormat.SamplesPerSec * m_outputFormat.BlockAlign;
+        }
+    }
+
+    FrameAlignedWavReader(const FrameAlignedWavReader&) = delete;
+    FrameAlignedWavReader& operator=(const FrameAlignedWavReader&) = delete;
+
+    // Copies as many whole output frames as fit in 'size' bytes to 'dataBuffer'. A buffer smaller than one frame gets
+    // a frame in pieces, over as many calls as it takes, before the next whole frames.
+    // It has the same semantics as WavFileReader::Read(), it returns 0 at the end of the audio data.
+    int Read(uint8_t* dataBuffer, uint32_t size)
+    {
+        if (m_partialNext == m_partial.size())
+        {
+            auto frames = size / m_outputFormat.BlockAlign;
+            if (frames > 0)
+            {
+                return (int)ReadFrames(dataBuffer, frames);
+            }
+            m_partial.resize(m_outputFormat.BlockAlign);
+            m_partial.resize(ReadFrames(m_partial.data(), 1));
+            m_partialNext = 0;
+        }
+
+        auto count = (std::min)(size, (uint32_t)(m_partial.size() - m_partialNext));
+        memcpy(dataBuffer, m_partial.data() + m_partialNext, count);
+        m_partialNext += count;
+        return (int)count;
+    }
+
+    void Close()
+    {
+        m_reader.Close();
+    }
+
+    // Gets the format of the audio returned by Read(), with the selected or mixed channels.
+    const WavFormat& GetFormat() const
+    {
+        return m_outputFormat;
+    }
+
+    // Gets the format of the audio in the file.
+    const WavFormat& GetInputFormat() const
+    {
+        return m_inputFormat;
+    }
+
+private:
+    // Converts up to 'frames' frames of the file into 'dataBuffer', and returns the number of bytes written.
+    uint32_t ReadFrames(uint8_t* dataBuffer, uint32_t frames)
+    {
+        uint8_t* data = nullptr;
+        auto available = m_reader.ReadSpan(&data, frames * m_inputFormat.BlockAlign);
+
+        // A truncated frame at the end of the file is dropped.
+        frames = available / m_inputFormat.BlockAlign;
+        if (m_channels.empty())
+        {
+            memcpy(dataBuffer, data, frames * m_inputFormat.BlockAlign);
+        }
+        else if (m_downmix)
+        {
+            Downmix(reinterpret_cast<const int16_t*>(data), reinterpret_cast<int16_t*>(dataBuffer), frames);
+        }
+        else
+        {
+            Select(reinterpret_cast<const int16_t*>(data), reinterpret_cast<int16_t*>(dataBuffer), frames);
+        }
+        return frames * m_outputFormat.BlockAlign;
+    }
+
+    void Select(const int16_t* input, int16_t* output, uint32_t frames) const
+    {
+        auto inputChannels = m_inputFormat.Channels;
+        auto outputChannels = m_channels.size();
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+            for (size_t i = 0; i < outputChannels; i++)
+            {
+                output[i] = input[m_channels[i]];
+            }
+            input += inputChannels;
+            output += outputChannels;
+        }
+    }
+
+    void Downmix(const int16_t* input, int16_t* output, uint32_t frames) const
+    {
+        auto inputChannels = m_inputFormat.Channels;
+        uint32_t frame = 0;
+
+#ifdef FRAME_ALIGNED_WAV_READER_SSE2
+        // With all of eight channels, a frame is one 128-bit vector and madd sums its samples in pairs.
+        if (inputChannels == 8 && m_channels.size() == 8)
+        {
+            const __m128i ones = _mm_set1_epi16(1);
+            for (; frame + 2 <= frames; frame += 2)
+            {
+                auto first = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input)), ones);
+                auto second = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 8)), ones);
+
+                // Adds the four pair sums of each frame, leaving the sum of the first frame in lane 0 and the second in lane 2.
+                auto low = _mm_unpacklo_epi64(first, second);
+                auto high = _mm_unpackhi_epi64(first, second);
+                auto sums = _mm_add_epi32(low, high);
+                sums = _mm_add_epi32(sums, _mm_srli_epi64(sums, 32));
+
+                // The sum of eight samples fits in 19 bits, an arithmetic shift by three is the average.
+                sums = _mm_srai_epi32(sums, 3);
+                output[0] = (int16_t)_mm_cvtsi128_si32(sums);
+                output[1] = (int16_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+                input += 16;
+                output += 2;
+            }
+        }
+#endif
+
+        auto count = (int32_t)m_channels.size();
+        for (; frame < frames; frame++)
+        {
+            int32_t sum = 0;
+            for (auto channel : m_channels)
+            {
+                sum += input[channel];
+            }
+
+            // Rounds toward negative infinity like the shift above, so the SIMD and scalar paths agree.
+            auto average = sum >= 0 ? sum / count : -((-sum + count - 1) / count);
+            *output++ = (int16_t)average;
+            input += inputChannels;
+        }
+    }
+
+    MappedWavFileReader m_reader;
+    std::vector<uint16_t> m_channels;
+    bool m_downmix;
+    WavFormat m_inputFormat;
+    WavFormat m_outputFormat;
+    std::vector<uint8_t> m_partial;     // the frame handed out in pieces, to a buffer smaller than a frame.
+    size_t m_partialNext = 0;
+};
@@ -0,0 +1,224 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// The intent of an utterance, as the Language Understanding service or a local command table resolved it.
+struct IntentMatch
+{
+    std::string IntentId;               // empty if no intent was recognized.
+    std::string Json;                   // the service response, empty for local commands.
+};
+
+// Resolves the intent of recognized text locally when it can, before it goes to the Language Understanding service.
+// Two tables are consulted, keyed by the normalized text: a fixed table of commands, and a bounded LRU of the recent
+// results of the service. Only misses are resolved by the service, through the function passed to Resolve().
+// The LRU belongs to one version of a model: changing the app id or version with SetModel() empties it.
+// It is thread safe.
+class IntentCache final
+{
+public:
+    // Constructor for the results of a model, with room for 'capacity' recent results.
+    IntentCache(const std::string& appId, const std::string& version, size_t capacity = 1024)
+        : m_model(MakeModelKey(appId, version)), m_capacity(capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("Capacity must be positive");
+        }
+    }
+
+    IntentCache(const IntentCache&) = delete;
+    IntentCache& operator=(const IntentCache&) = delete;
+
+    // Normalizes text for matching: letters are lowercased, punctuation other than apostrophes is dropped,
+    // and whitespace runs collapse to one space, so that "Turn on the lights." matches "turn on the lights".
+    static std::string Normalize(const std::string& text)
+    {
+        std::string normalized;
+        normalized.reserve(text.size());
+        bool space = false;
+        for (auto c : text)
+        {
+            auto u = (unsigned char)c;
+            if (isspace(u))
+            {
+                space = true;
+                continue;
+            }
+            // Bytes of multibyte UTF-8 characters are kept as they are.
+            if (u < 0x80 && ispunct(u) && c != '\'')
+            {
+                continue;
+            }
+            if (space && !normalized.empty())
+            {
+                normalized += ' ';
+            }
+            space = false;
+            normalized += u < 0x80 ? (char)tolower(u) : c;
+        }
+        return normalized;
+    }
+
+    // Adds a fixed command, a phrase that always resolves to 'intentId'.
+    void AddCommand(const std::string& phrase, const std::string& intentId)
+    {
+        auto key = Normalize(phrase);
+        if (key.empty())
+        {
+            throw std::invalid_argument("Empty command phrase");
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_commands[key] = IntentMatch{ intentId, std::string() };
+    }
+
+    // Switches to another model, or version of it, and drops the results of the previous one.
+    void SetModel(const std::string& appId, const std::string& version)
+    {
+        auto model = MakeModelKey(appId, version);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (model != m_model)
+        {
+            m_model = model;
+            m_entries.clear();
+            m_index.clear();
+            m_invalidations++;
+        }
+    }
+
+    // Looks the text up in the commands and the recent results. It returns false on a miss.
+    bool Find(const std::string& text, IntentMatch& match)
+    {
+        return Find(Normalize(text), match, false);
+    }
+
+    // Resolves the intent of the text, locally if possible, otherwise with 'resolve', whose result is then cached
+    // if it has an intent: a failed resolution, or one that found no intent, returns an empty IntentId and is retried next time.
+    // The time 'resolve' takes is measured, to estimate the latency saved by the hits.
+    IntentMatch Resolve(const std::string& text, const std::function<IntentMatch(const std::string& text)>& resolve)
+    {
+        auto key = Normalize(text);
+        IntentMatch match;
+        if (Find(key, match, true))
+        {
+            return match;
+        }
+
+        std::string model;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            model = m_model;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        match = resolve(text);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_serviceMilliseconds += elapsed;
+
+        // A result of a model switched away from while it was resolved isn't cached.
+        if (model == m_model && !key.empty() && !match.IntentId.empty())
+        {
+            Store(key, match);
+        }
+        return match;
+    }
+
+    // Prints the hits and misses, and the latency saved, estimated from the average time the service took on the misses.
+    void PrintStatistics(std::ostream& out) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto hits = m_commandHits + m_resultHits;
+        auto lookups = hits + m_misses;
+        auto averageServiceMilliseconds = m_misses > 0 ? m_serviceMilliseconds / m_misses : 0;
+        out << "Intent lookups: " << lookups << ", command hits: " << m_commandHits << ", cached result hits: " << m_resultHits
+            << ", misses: " << m_misses << ", hit rate: " << (lookups > 0 ? 100.0 * hits / lookups : 0) << "%"
+            << ", average service latency: " << averageServiceMilliseconds << "ms"
+            << ", estimated latency saved: " << hits * averageServiceMilliseconds << "ms"
+            << ", model invalidations: " << m_invalidations << std::endl;
+    }
+
+private:
+    struct Entry
+    {
+        std::string Key;
+        IntentMatch Match;
+    };
+
+    static std::string MakeModelKey(const std::string& appId, const std::string& version)
+    {
+        return appId + '@' + version;
+    }
+
+    bool Find(const std::string& key, IntentMatch& match, bool count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto command = m_commands.find(key);
+        if (command != m_commands.end())
+        {
+            match = command->second;
+            m_commandHits += count ? 1 : 0;
+            return true;
+        }
+
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            // Moves the entry to the front of the LRU list.
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            match = it->second->Match;
+            m_resultHits += count ? 1 : 0;
+            return true;
+        }
+
+        m_misses += count ? 1 : 0;
+        return false;
+    }
+
+    // Adds a result to the front of the LRU list, evicting the least recently used one if full. Called with the mutex held.
+    void Store(const std::string& key, const IntentMatch& match)
+    {
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            it->second->Match = match;
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            return;
+        }
+
+        m_entries.push_front(Entry{ key, match });
+        m_index[key] = m_entries.begin();
+        if (m_entries.size() > m_capacity)
+        {
+            m_index.erase(m_entries.back().Key);
+            m_entries.pop_back();
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::string m_model;
+    const size_t m_capacity;
+    std::unordered_map<std::string, IntentMatch> m_commands;
+    std::list<Entry> m_entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+
+    uint64_t m_commandHits = 0;
+    uint64_t m_resultHits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_invalidations = 0;
+    double m_serviceMilliseconds = 0;
+};
@@ -7,6 +7,13 @@
 
 // <toplevel>
 #include <speechapi_cxx.h>
+#include <mutex>
+#include <vector>
+#include "buffered_audio.h"
+#include "intent_cache.h"
+#include "language_understanding_json_view.h"
+#include "session_completion.h"
+#include "sample_console.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -156,11 +163,10 @@ void IntentContinuousRecognitionWithFile()
 
     // Creates an intent recognizer using file as audio input.
     // Replace with your own audio file name.
-    auto audioInput = AudioConfig::FromWavFileInput("whatstheweatherlike.wav");
+    auto audioInput = AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav"));
     auto recognizer = IntentRecognizer::FromConfig(config, audioInput);
 
-    // promise for synchronization of recognition end.
-    std::promise<void> recognitionEnd;
+    SessionCompletion recognitionEnd;
 
     // Creates a Language Understanding model using the app id, and adds specific intents from your model
     auto model = LanguageUnderstandingModel::FromAppId("YourLanguageUnderstandingAppId");
@@ -180,7 +186,21 @@ void IntentContinuousRecognitionWithFile()
         {
             cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
             cout << "  Intent Id: " << e.Result->IntentId << std::endl;
-            cout << "  Intent Service JSON: " << e.Result->Properties.GetProperty(PropertyId::LanguageUnderstandingServiceResponse_JsonResult) << std::endl;
+
+            // Reads only the top intent and one entity from the service JSON, instead of parsing all of it.
+            auto json = e.Result->Properties.GetProperty(PropertyId::LanguageUnderstandingServiceResponse_JsonResult);
+            LanguageUnderstandingJsonView view(json);
+            string intent, entity;
+            double score = 0, entityScore = 0;
+            if (view.GetTopIntent(intent, score))
+            {
+                cout << "  Top scoring intent: " << intent << " (score " << score << ")" << std::endl;
+            }
+            // Replace with the type of an entity of your model.
+            if (view.FindEntity("YourLanguageUnderstandingEntityType", entity, entityScore))
+            {
+                cout << "  Entity: " << entity << " (score " << entityScore << ")" << std::endl;
+            }
         }
         else if (e.Result->Reason == ResultReason::RecognizedSpeech)
         {
@@ -203,22 +223,126 @@ void IntentContinuousRecognitionWithFile()
             cout << "CANCELED: Did you update the subscription info?" << std::endl;
         }
 
-        recognitionEnd.set_value(); // Notify to stop recognition.
+        recognitionEnd.Complete(SessionOutcome::Canceled); // Notify to stop recognition.
     });
 
     recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
     {
         cout << "Session stopped.";
-        recognitionEnd.set_value(); // Notify to stop recognition.
+        recognitionEnd.Complete(SessionOutcome::Stopped); // Notify to stop recognition.
     });
 
     // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
     recognizer->StartContinuousRecognitionAsync().get();
 
     // Waits for recognition end.
-    recognitionEnd.get_future().get();
+    recognitionEnd.Wait();
 
     // Stops recognition.
     recognizer->StopContinuousRecognitionAsync().get();
     // </IntentContinuousRecognitionWithFile>
 }
+
+// Intent recognition with a local cache in front of the Language Understanding service.
+// The utterances of a file are transcribed first. Then the intent of each one is resolved locally when its text is a
+// known command or was resolved before, and only the misses are sent to the service, with the audio of the utterance.
+// A miss is recognized a second time on purpose: the IntentRecognizer resolves intents from audio only, it has no
+// text input, and transcribing everything with it would send every utterance to Language Understanding.
+void IntentRecognitionWithLocalCache()
+{
+    // Replace below with your own Language Understanding subscription key, service region (e.g., "westus"),
+    // app id and the version of the app that is published.
+    auto config = SpeechConfig::FromSubscription("YourLanguageUnderstandingSubscriptionKey", "YourLanguageUnderstandingServiceRegion");
+    IntentCache cache("YourLanguageUnderstandingAppId", "0.1");
+
+    // The fixed commands resolve without the service. Replace with the phrases of your own commands.
+    cache.AddCommand("What's the weather like?", "id1");
+    cache.AddCommand("Turn on the lights.", "id2");
+
+    // Replace with your own audio file name.
+    auto audio = BufferedAudio::FromWavFile(SampleFile("whatstheweatherlike.wav"));
+
+    // Transcribes the utterances of the file.
+    struct Utterance
+    {
+        string Text;
+        uint64_t Offset;
+        uint64_t Duration;
+    };
+    vector<Utterance> utterances;
+    {
+        mutex utterancesMutex;
+        SessionCompletion recognitionEnd;
+        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav")));
+        recognizer->Recognized.Connect([&utterances, &utterancesMutex](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                lock_guard<mutex> lock(utterancesMutex);
+                utterances.push_back(Utterance{ e.Result->Text, e.Result->Offset(), e.Result->Duration() });
+            }
+        });
+        recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
+            }
+            recognitionEnd.Complete(SessionOutcome::Canceled);
+        });
+        recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
+        {
+            recognitionEnd.Complete(SessionOutcome::Stopped);
+        });
+
+        recognizer->StartContinuousRecognitionAsync().get();
+        recognitionEnd.Wait();
+        recognizer->StopContinuousRecognitionAsync().get();
+    }
+
+    // Sends the audio of one utterance to the service, for the utterances the cache can't resolve.
+    auto recognizeWithService = [&config, &audio](const Utterance& utterance)
+    {
+        // Offsets and durations are in ticks of 100 nanoseconds. A little audio around the utterance is kept.
+        const uint64_t margin = 2000000;
+        auto blockAlign = audio->Format.BlockAlign;
+        auto toBytes = [&audio, blockAlign](uint64_t ticks)
+        {
+            auto bytes = ticks * audio->Format.AvgBytesPerSec / 10000000;
+            bytes -= bytes % blockAlign;
+            return (size_t)(bytes < audio->Data.size() ? bytes : audio->Data.size());
+        };
+        auto begin = toBytes(utterance.Offset > margin ? utterance.Offset - margin : 0);
+        auto end = toBytes(utterance.Offset + utterance.Duration + margin);
+
+        auto slice = make_shared<BufferedAudio>();
+        slice->Format = audio->Format;
+        slice->Data.assign(audio->Data.begin() + begin, audio->Data.begin() + end);
+
+        auto format = AudioStreamFormat::GetWaveFormatPCM(slice->Format.SamplesPerSec, (uint8_t)slice->Format.BitsPerSample, (uint8_t)slice->Format.Channels);
+        auto stream = AudioInputStream::CreatePullStream(format, make_shared<BufferedAudioPullCallback>(slice));
+        auto recognizer = IntentRecognizer::FromConfig(config, AudioConfig::FromStreamInput(stream));
+        auto model = LanguageUnderstandingModel::FromAppId("YourLanguageUnderstandingAppId");
+        recognizer->AddIntent(model, "YourLanguageUnderstandingIntentName1", "id1");
+        recognizer->AddIntent(model, "YourLanguageUnderstandingIntentName2", "id2");
+        recognizer->AddIntent(model, "YourLanguageUnderstandingIntentName3", "any-IntentId-here");
+
+        auto result = recognizer->RecognizeOnceAsync().get();
+        IntentMatch match;
+        if (result->Reason == ResultReason::RecognizedIntent)
+        {
+            match.IntentId = result->IntentId;
+            match.Json = result->Properties.GetProperty(PropertyId::LanguageUnderstandingServiceResponse_JsonResult);
+        }
+        return match;
+    };
+
+    for (const auto& utterance : utterances)
+    {
+        auto match = cache.Resolve(utterance.Text, [&](const string&) { return recognizeWithService(utterance); });
+        cout << "RECOGNIZED: Text=" << utterance.Text << std::endl;
+        cout << "  Intent Id: " << (match.IntentId.empty() ? "(none)" : match.IntentId) << std::endl;
+    }
+    cache.PrintStatistics(cout);
+}
@@ -0,0 +1,345 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// A piece of a JSON text: the raw content of a string, still escaped if HasEscapes.
+// It points into the text it was read from, which must outlive it.
+struct JsonSpan
+{
+    const char* Data = nullptr;
+    size_t Length = 0;
+    bool HasEscapes = false;
+
+    bool Equals(const char* text) const
+    {
+        return !HasEscapes && strlen(text) == Length && memcmp(Data, text, Length) == 0;
+    }
+
+    // Copies the span into 'value', unescaping it.
+    void CopyTo(std::string& value) const;
+
+    std::string ToString() const
+    {
+        std::string value;
+        CopyTo(value);
+        return value;
+    }
+};
+
+// A forward-only cursor over a JSON text, for reading a few values out of a service response without building a
+// document of it. Values that aren't asked for are skipped over without being parsed, and strings are handed out as
+// spans of the text. Each read returns false on malformed or unexpected input, and the cursor is then unusable.
+// The cursor and the spans point into the text, so a scanner cannot be made from a temporary string.
+class JsonScanner final
+{
+public:
+    JsonScanner(const char* begin, const char* end)
+        : m_p(begin), m_end(end)
+    {
+    }
+
+    JsonScanner(const std::string& json)
+        : JsonScanner(json.data(), json.data() + json.size())
+    {
+    }
+
+    JsonScanner(std::string&&) = delete;
+
+    // Skips whitespace and consumes 'c' if it comes next.
+    bool Consume(char c)
+    {
+        SkipWhitespace();
+        if (m_p < m_end && *m_p == c)
+        {
+            m_p++;
+            return true;
+        }
+        return false;
+    }
+
+    // Reads the members of an object, calling 'onMember(key)' with the cursor before each value; it must read or
+    // skip the value and return true, or return false to stop.
+    template<typename OnMember>
+    bool ReadObject(OnMember onMember)
+    {
+        if (!Consume('{'))
+        {
+            return false;
+        }
+        if (Consume('}'))
+        {
+            return true;
+        }
+        do
+        {
+            JsonSpan key;
+            if (!ReadString(key) || !Consume(':') || !onMember(key))
+            {
+                return false;
+            }
+        } while (Consume(','));
+        return Consume('}');
+    }
+
+    // Reads the elements of an array, calling 'onElement()' with the cursor before each one; it must read or
+    // skip the element and return true, or return false to stop.
+    template<typename OnElement>
+    bool ReadArray(OnElement onElement)
+    {
+        if (!Consume('['))
+        {
+            return false;
+        }
+        if (Consume(']'))
+        {
+            return true;
+        }
+        do
+        {
+            if (!onElement())
+            {
+                return false;
+            }
+        } while (Consume(','));
+        return Consume(']');
+    }
+
+    // Reads a string as a span of the text.
+    bool ReadString(JsonSpan& value)
+    {
+        if (!Consume('"'))
+        {
+            return false;
+        }
+        value.Data = m_p;
+        value.HasEscapes = false;
+        while (m_p < m_end && *m_p != '"')
+        {
+            if (*m_p == '\\')
+            {
+                value.HasEscapes = true;
+                m_p++;
+            }
+            m_p++;
+        }
+        if (m_p >= m_end)
+        {
+            return false;
+        }
+        value.Length = (size_t)(m_p - value.Data);
+        m_p++;
+        return true;
+    }
+
+    // Reads a string and unescapes it into 'value'.
+    bool ReadString(std::string& value)
+    {
+        JsonSpan span;
+        if (!ReadString(span))
+        {
+            return false;
+        }
+        span.CopyTo(value);
+        return true;
+    }
+
+    bool ReadNumber(double& value)
+    {
+        SkipWhitespace();
+        auto begin = m_p;
+        while (m_p < m_end && ((*m_p >= '0' && *m_p <= '9') || *m_p == '-' || *m_p == '+' || *m_p == '.' || *m_p == 'e' || *m_p == 'E'))
+        {
+            m_p++;
+        }
+        if (m_p == begin || m_p - begin > 63)
+        {
+            return false;
+        }
+
+        // strtod needs a terminated string, the JSON text may continue right after the number.
+        char number[64];
+        memcpy(number, begin, (size_t)(m_p - begin));
+        number[m_p - begin] = '\0';
+        char* numberEnd;
+        value = strtod(number, &numberEnd);
+        return *numberEnd == '\0';
+    }
+
+    // Reads a non-negative integer, e.g. an offset in ticks, without going through floating point.
+    bool ReadUnsigned(uint64_t& value)
+    {
+        SkipWhitespace();
+        auto begin = m_p;
+        value = 0;
+        while (m_p < m_end && *m_p >= '0' && *m_p <= '9')
+        {
+            value = value * 10 + (uint64_t)(*m_p - '0');
+            m_p++;
+        }
+        return m_p > begin && m_p - begin <= 19;
+    }
+
+    // Skips over any value, without looking into it more than needed to find its end.
+    bool SkipValue()
+    {
+        return SkipValue(0);
+    }
+
+    // Unescapes the raw content of a JSON string into 'value'.
+    static void Unescape(const char* begin, size_t length, std::string& value)
+    {
+        value.clear();
+        auto end = begin + length;
+        for (auto q = begin; q < end; q++)
+        {
+            if (*q != '\\' || q + 1 >= end)
+            {
+                value += *q;
+                continue;
+            }
+            switch (*++q)
+            {
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'u':
+            {
+                uint32_t codePoint;
+                if (!ReadHex4(q + 1, end, codePoint))
+                {
+                    value += *q;
+                    break;
+                }
+                q += 4;
+                // Combines a surrogate pair.
+                if (codePoint >= 0xD800 && codePoint < 0xDC00 && q + 6 < end && q[1] == '\\' && q[2] == 'u')
+                {
+                    uint32_t low;
+                    if (ReadHex4(q + 3, end, low) && low >= 0xDC00 && low < 0xE000)
+                    {
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        q += 6;
+                    }
+                }
+                AppendUtf8(value, codePoint);
+                break;
+            }
+            default:
+                // \" \\ and \/ stand for the character itself.
+                value += *q;
+                break;
+            }
+        }
+    }
+
+private:
+    // Defines how deeply nested arrays and objects may be skipped, to bound the work on hostile input.
+    static constexpr int maxDepth = 64;
+
+    void SkipWhitespace()
+    {
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r'))
+        {
+            m_p++;
+        }
+    }
+
+    bool SkipValue(int depth)
+    {
+        SkipWhitespace();
+        if (m_p >= m_end || depth > maxDepth)
+        {
+            return false;
+        }
+
+        JsonSpan span;
+        switch (*m_p)
+        {
+        case '"':
+            return ReadString(span);
+        case '{':
+            return ReadObject([this, depth](const JsonSpan&) { return SkipValue(depth + 1); });
+        case '[':
+            return ReadArray([this, depth]() { return SkipValue(depth + 1); });
+        default:
+        {
+            // A number, true, false or null.
+            auto begin = m_p;
+            while (m_p < m_end && *m_p != ',' && *m_p != '}' && *m_p != ']' && *m_p != ' ' && *m_p != '\t' && *m_p != '\n' && *m_p != '\r')
+            {
+                m_p++;
+            }
+            return m_p > begin;
+        }
+        }
+    }
+
+    static bool ReadHex4(const char* p, const char* end, uint32_t& value)
+    {
+        if (end - p < 4)
+        {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            auto c = p[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= (uint32_t)(c - '0');
+            else if (c >= 'a' && c <= 'f') value |= (uint32_t)(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') value |= (uint32_t)(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& value, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            value += (char)codePoint;
+        }
+        else if (codePoint < 0x800)
+        {
+            value += (char)(0xC0 | (codePoint >> 6));
+            value += (char)(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            value += (char)(0xE0 | (codePoint >> 12));
+            value += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            value += (char)(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            value += (char)(0xF0 | (codePoint >> 18));
+            value += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            value += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            value += (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    const char* m_p;
+    const char* m_end;
+};
+
+inline void JsonSpan::CopyTo(std::string& value) const
+{
+    if (HasEscapes)
+    {
+        JsonScanner::Unescape(Data, Length, value);
+    }
+    else
+    {
+        value.assign(Data, Length);
+    }
+}
@@ -0,0 +1,292 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "latency_histogram.h"
+#include "recognizer_pool.h"
+
+// What the recognizers of a pool are set up for: a Custom Speech endpoint, or the base model if the id is empty,
+// the recognition language and the output format.
+struct RecognizerPoolKey
+{
+    std::string EndpointId;
+    std::string Language;
+    Microsoft::CognitiveServices::Speech::OutputFormat Format = Microsoft::CognitiveServices::Speech::OutputFormat::Simple;
+
+    bool operator<(const RecognizerPoolKey& other) const
+    {
+        return std::tie(EndpointId, Language, Format) < std::tie(other.EndpointId, other.Language, other.Format);
+    }
+};
+
+struct KeyedRecognizerPoolOptions
+{
+    uint32_t WarmPerKey = 2;                                // recognizers kept connected for each key in use.
+    size_t MaxKeys = 16;                                    // keys kept warm; the least recently used idle one goes first.
+    std::chrono::seconds KeyIdleTimeout{ 300 };             // after which a key nobody asked for is dropped.
+    std::chrono::seconds RecognizerIdleTimeout{ 60 };
+};
+
+// The metrics of the pool of one key.
+struct KeyedRecognizerPoolStatistics
+{
+    RecognizerPoolKey Key;
+    uint64_t Acquires = 0;
+    uint64_t WarmHits = 0;
+    uint64_t ColdMisses = 0;
+    uint32_t InUse = 0;
+    uint32_t PeakInUse = 0;
+    double Utilization = 0;                 // time the recognizers were in use, over the warm capacity kept.
+    LatencyHistogram AcquireLatency;        // in milliseconds, the setup a request waited for.
+    LatencyHistogram UseLatency;            // in milliseconds, from Acquire() to Release().
+};
+
+// Keeps a RecognizerPool for each (endpoint id, language, output format) in use, so that requests for dozens of Custom
+// Speech endpoints get a recognizer already set up and connected for theirs, instead of a config and a connection
+// per request. The pool of a key is created on its first request, with its own config; pools are dropped when their
+// key stays idle, or when more keys are in use than MaxKeys, the least recently used first. Keys with recognizers in
+// use are never dropped.
+class KeyedRecognizerPool final
+{
+public:
+    // Creates the base config of a key, e.g. SpeechConfig::FromSubscription(), which the pool sets up for the key.
+    using ConfigFactory = std::function<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig>()>;
+
+    KeyedRecognizerPool(ConfigFactory createConfig, std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> format,
+        const KeyedRecognizerPoolOptions& options = KeyedRecognizerPoolOptions())
+        : m_createConfig(createConfig), m_format(format), m_options(options)
+    {
+        if (!m_createConfig || options.WarmPerKey == 0 || options.MaxKeys == 0)
+        {
+            throw std::invalid_argument("A config factory, a positive warm capacity and a positive key limit are required");
+        }
+    }
+
+    KeyedRecognizerPool(const KeyedRecognizerPool&) = delete;
+    KeyedRecognizerPool& operator=(const KeyedRecognizerPool&) = delete;
+
+    // Hands out a recognizer for a key, warm if its pool has one ready.
+    std::shared_ptr<PooledRecognizer> Acquire(const RecognizerPoolKey& key)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::unique_ptr<KeyState>> dropped;
+        std::shared_ptr<RecognizerPool> pool;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& state = Touch(key);
+            state->InUse++;
+            state->PeakInUse = (std::max)(state->PeakInUse, state->InUse);
+            pool = state->Pool;
+            dropped = Sweep(start);
+        }
+
+        // Closes the pools dropped and waits for the recognizer without the lock.
+        dropped.clear();
+        std::shared_ptr<PooledRecognizer> entry;
+        try
+        {
+            entry = pool->Acquire();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_keys.at(key)->InUse--;
+            throw;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& state = m_keys.at(key);
+        state->Acquires++;
+        state->AcquireLatency.Add(std::chrono::duration<double, std::milli>(now - start).count());
+        state->Acquired[entry.get()] = now;
+        return entry;
+    }
+
+    // Returns a recognizer to the pool of its key.
+    void Release(const RecognizerPoolKey& key, std::shared_ptr<PooledRecognizer> entry)
+    {
+        if (entry == nullptr)
+        {
+            return;
+        }
+
+        std::shared_ptr<RecognizerPool> pool;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_keys.find(key);
+            if (found == m_keys.end())
+            {
+                throw std::invalid_argument("The recognizer was not acquired from this pool");
+            }
+            auto& state = found->second;
+            auto acquired = state->Acquired.find(entry.get());
+            if (acquired != state->Acquired.end())
+            {
+                auto used = std::chrono::steady_clock::now() - acquired->second;
+                state->UseLatency.Add(std::chrono::duration<double, std::milli>(used).count());
+                state->BusySeconds += std::chrono::duration<double>(used).count();
+                state->Acquired.erase(acquired);
+            }
+            state->InUse--;
+            state->LastUsed = std::chrono::steady_clock::now();
+            pool = state->Pool;
+        }
+        pool->Release(entry);
+    }
+
+    // Drops the pools of the keys idle for longer than KeyIdleTimeout. Acquire() does so too.
+    void EvictIdle()
+    {
+        std::vector<std::unique_ptr<KeyState>> dropped;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            dropped = Sweep(std::chrono::steady_clock::now());
+        }
+    }
+
+    // Gets the metrics of each key with a pool, most recently used first.
+    std::vector<KeyedRecognizerPoolStatistics> GetStatistics() const
+    {
+        std::vector<KeyedRecognizerPoolStatistics> statistics;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& key : m_recency)
+        {
+            const auto& state = m_keys.at(key);
+            KeyedRecognizerPoolStatistics keyStatistics;
+            keyStatistics.Key = key;
+            keyStatistics.Acquires = state->Acquires;
+            keyStatistics.WarmHits = state->Pool->GetWarmHits();
+            keyStatistics.ColdMisses = state->Pool->GetColdMisses();
+            keyStatistics.InUse = state->InUse;
+            keyStatistics.PeakInUse = state->PeakInUse;
+            auto capacitySeconds = std::chrono::duration<double>(now - state->Created).count() * m_options.WarmPerKey;
+            keyStatistics.Utilization = capacitySeconds > 0 ? state->BusySeconds / capacitySeconds : 0;
+            keyStatistics.AcquireLatency = state->AcquireLatency;
+            keyStatistics.UseLatency = state->UseLatency;
+            statistics.push_back(keyStatistics);
+        }
+        return statistics;
+    }
+
+    // Gets the number of pools dropped, as idle or least recently used.
+    uint64_t GetEvictions() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_evictions;
+    }
+
+    // Prints a line of metrics per key.
+    static void PrintStatistics(std::ostream& out, const std::vector<KeyedRecognizerPoolStatistics>& statistics)
+    {
+        for (const auto& keyStatistics : statistics)
+        {
+            out << (keyStatistics.Key.EndpointId.empty() ? "base model" : keyStatistics.Key.EndpointId) << " " << keyStatistics.Key.Language
+                << (keyStatistics.Key.Format == Microsoft::CognitiveServices::Speech::OutputFormat::Detailed ? " detailed" : " simple")
+                << ": acquires=" << keyStatistics.Acquires << ", warm=" << keyStatistics.WarmHits << ", cold=" << keyStatistics.ColdMisses
+                << ", in use=" << keyStatistics.InUse << ", peak=" << keyStatistics.PeakInUse
+                << ", utilization=" << keyStatistics.Utilization * 100 << "%\n";
+            keyStatistics.AcquireLatency.Print(out, "  Acquire latency");
+            keyStatistics.UseLatency.Print(out, "  Use latency");
+        }
+        out.flush();
+    }
+
+private:
+    struct KeyState
+    {
+        std::shared_ptr<RecognizerPool> Pool;
+        std::list<RecognizerPoolKey>::iterator Recency;
+        std::chrono::steady_clock::time_point Created;
+        std::chrono::steady_clock::time_point LastUsed;
+        uint32_t InUse = 0;
+        uint32_t PeakInUse = 0;
+        uint64_t Acquires = 0;
+        double BusySeconds = 0;
+        LatencyHistogram AcquireLatency;
+        LatencyHistogram UseLatency;
+        std::map<const PooledRecognizer*, std::chrono::steady_clock::time_point> Acquired;
+    };
+
+    // Gets the state of a key, creating its pool the first time, and makes it the most recently used. Called with the lock held.
+    std::unique_ptr<KeyState>& Touch(const RecognizerPoolKey& key)
+    {
+        auto found = m_keys.find(key);
+        if (found != m_keys.end())
+        {
+            m_recency.splice(m_recency.begin(), m_recency, found->second->Recency);
+            found->second->LastUsed = std::chrono::steady_clock::now();
+            return found->second;
+        }
+
+        // The config of a key is set up once, and shared by all the recognizers of its pool.
+        auto config = m_createConfig();
+        if (config == nullptr)
+        {
+            throw std::runtime_error("The config factory returned no config");
+        }
+        if (!key.EndpointId.empty())
+        {
+            config->SetEndpointId(key.EndpointId);
+        }
+        if (!key.Language.empty())
+        {
+            config->SetSpeechRecognitionLanguage(key.Language);
+        }
+        config->SetOutputFormat(key.Format);
+
+        std::unique_ptr<KeyState> state(new KeyState());
+        state->Pool = std::make_shared<RecognizerPool>(config, m_format, m_options.WarmPerKey, m_options.RecognizerIdleTimeout);
+        state->Created = state->LastUsed = std::chrono::steady_clock::now();
+        m_recency.push_front(key);
+        state->Recency = m_recency.begin();
+        return m_keys.emplace(key, std::move(state)).first->second;
+    }
+
+    // Takes out the keys to drop, idle for too long or beyond MaxKeys, so that the caller destroys their pools without
+    // the lock: that closes their connections and joins their maintenance threads. Called with the lock held.
+    std::vector<std::unique_ptr<KeyState>> Sweep(std::chrono::steady_clock::time_point now)
+    {
+        std::vector<std::unique_ptr<KeyState>> dropped;
+        auto keys = m_keys.size();
+        for (auto it = m_recency.end(); it != m_recency.begin();)
+        {
+            --it;
+            auto found = m_keys.find(*it);
+            auto& state = found->second;
+            if (state->InUse == 0 && (keys > m_options.MaxKeys || now - state->LastUsed > m_options.KeyIdleTimeout))
+            {
+                dropped.push_back(std::move(state));
+                m_keys.erase(found);
+                it = m_recency.erase(it);
+                keys--;
+                m_evictions++;
+            }
+        }
+        return dropped;
+    }
+
+    const ConfigFactory m_createConfig;
+    const std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> m_format;
+    const KeyedRecognizerPoolOptions m_options;
+
+    mutable std::mutex m_mutex;
+    std::map<RecognizerPoolKey, std::unique_ptr<KeyState>> m_keys;
+    std::list<RecognizerPoolKey> m_recency;         // most recently used first.
+    uint64_t m_evictions = 0;
+};
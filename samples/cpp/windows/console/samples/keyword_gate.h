@@ -0,0 +1,441 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include "recognizer_pool.h"
+#include "wav_file_reader.h"
+#include "worker_pool.h"
+
+// Keeps the last 'capacity' bytes of the audio written to it, overwriting the oldest.
+class PreRollBuffer final
+{
+public:
+    PreRollBuffer(size_t capacity)
+        : m_data(capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("Capacity must be positive");
+        }
+    }
+
+    void Write(const uint8_t* data, size_t size)
+    {
+        auto capacity = m_data.size();
+        if (size >= capacity)
+        {
+            // Only the tail of a write larger than the buffer is kept.
+            memcpy(m_data.data(), data + size - capacity, capacity);
+            m_next = 0;
+            m_size = capacity;
+            return;
+        }
+
+        auto first = capacity - m_next < size ? capacity - m_next : size;
+        memcpy(m_data.data() + m_next, data, first);
+        memcpy(m_data.data(), data + first, size - first);
+        m_next = (m_next + size) % capacity;
+        m_size = m_size + size < capacity ? m_size + size : capacity;
+    }
+
+    // Appends the buffered audio, oldest first, to 'out' and empties the buffer.
+    void Drain(std::vector<uint8_t>& out)
+    {
+        auto capacity = m_data.size();
+        auto start = (m_next + capacity - m_size) % capacity;
+        auto first = capacity - start < m_size ? capacity - start : m_size;
+        out.insert(out.end(), m_data.begin() + start, m_data.begin() + start + first);
+        out.insert(out.end(), m_data.begin(), m_data.begin() + (m_size - first));
+        m_size = 0;
+    }
+
+    // Gets the number of bytes buffered.
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+private:
+    std::vector<uint8_t> m_data;
+    size_t m_next = 0;
+    size_t m_size = 0;
+};
+
+// Listens for a keyword on many always-on audio feeds, and streams a feed to the cloud only once its keyword was
+// spotted, so that the speech service is only paid for the audio that follows a keyword.
+// Each feed has a push stream read by an on-device KeywordRecognizer. On RecognizedKeyword, a shared worker pool takes
+// a speech recognizer from a RecognizerPool and streams the feed to it until the end of the utterance, then listens
+// for the keyword again. The last 'preRollMilliseconds' of each feed are kept in a ring buffer, and sent ahead of the
+// live audio, so that the keyword and the speech before the recognizer was ready aren't lost.
+// The number of worker threads bounds the number of feeds streamed at the same time; a feed that waits for a worker
+// keeps its audio until one takes it. A keyword spotted while the queue of the worker pool is full is dropped and
+// counted, as the SDK's thread must not wait, and its feed listens again. A feed stops writing to the cloud recognizer
+// at the end of the speech, so that the audio that follows is listened to for the keyword again.
+// The audio of a feed is written by one thread; feeds are added before any is written.
+class KeywordGate final
+{
+public:
+    // Gets the index of the feed and the cloud recognition of the utterance that followed its keyword.
+    using ResultCallback = std::function<void(size_t feed, std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognitionResult> result)>;
+
+    KeywordGate(std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel> model,
+        RecognizerPool& recognizers, WorkerPool& workers, const WavFormat& format, ResultCallback onResult,
+        uint32_t preRollMilliseconds = 1500)
+        : m_shared(std::make_shared<Shared>(model, recognizers, workers, std::move(onResult))), m_format(CreateAudioStreamFormat(format))
+    {
+        if (model == nullptr || !m_shared->OnResult || format.BlockAlign == 0)
+        {
+            throw std::invalid_argument("A keyword model, a callback and a PCM format are required");
+        }
+
+        // Keeps whole sample frames.
+        m_preRollBytes = (size_t)format.AvgBytesPerSec * preRollMilliseconds / 1000 / format.BlockAlign * format.BlockAlign;
+        if (m_preRollBytes == 0)
+        {
+            throw std::invalid_argument("The pre-roll must hold at least one sample frame");
+        }
+    }
+
+    ~KeywordGate()
+    {
+        try
+        {
+            Close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    KeywordGate(const KeywordGate&) = delete;
+    KeywordGate& operator=(const KeywordGate&) = delete;
+
+    // Adds a feed and starts listening for its keyword. It returns the index of the feed.
+    size_t AddFeed()
+    {
+        if (m_closed)
+        {
+            throw std::logic_error("The gate is closed");
+        }
+
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        auto feed = std::make_shared<Feed>(m_feeds.size(), m_preRollBytes);
+        feed->KeywordStream = AudioInputStream::CreatePushStream(m_format);
+        feed->KeywordRecognizer = KeywordRecognizer::FromConfig(AudioConfig::FromStreamInput(feed->KeywordStream));
+
+        // The handler holds a weak reference, so that the recognizer doesn't keep its own feed alive.
+        std::weak_ptr<Feed> weakFeed = feed;
+        auto shared = m_shared;
+        feed->KeywordRecognizer->Recognized.Connect([weakFeed, shared](const KeywordRecognitionEventArgs& e)
+        {
+            auto feed = weakFeed.lock();
+            if (feed != nullptr && e.Result->Reason == ResultReason::RecognizedKeyword)
+            {
+                OnKeyword(shared, feed);
+            }
+        });
+
+        Arm(*m_shared, *feed);
+        m_feeds.push_back(feed);
+        return feed->Index;
+    }
+
+    // Writes audio to a feed: to its keyword recognizer while listening, to its cloud recognizer after a keyword.
+    void Write(size_t feedIndex, const uint8_t* data, uint32_t size)
+    {
+        if (feedIndex >= m_feeds.size())
+        {
+            throw std::out_of_range("Unknown feed");
+        }
+
+        auto& feed = *m_feeds[feedIndex];
+        std::lock_guard<std::mutex> lock(feed.Mutex);
+        m_shared->BytesWritten += size;
+        switch (feed.State)
+        {
+        case FeedState::Listening:
+            if (feed.Rearm)
+            {
+                feed.Rearm = false;
+                Arm(*m_shared, feed);
+            }
+            feed.PreRoll.Write(data, size);
+            feed.KeywordStream->Write(const_cast<uint8_t*>(data), size);
+            break;
+        case FeedState::Triggered:
+            feed.Pending.insert(feed.Pending.end(), data, data + size);
+            break;
+        case FeedState::Streaming:
+            feed.Lease->Stream->Write(const_cast<uint8_t*>(data), size);
+            m_shared->BytesStreamed += size;
+            break;
+        }
+    }
+
+    // Waits for the utterances being streamed to be recognized, and stops listening on all the feeds.
+    void Close()
+    {
+        if (m_closed)
+        {
+            return;
+        }
+        m_closed = true;
+
+        {
+            std::unique_lock<std::mutex> lock(m_shared->Mutex);
+            m_shared->Closing = true;
+            m_shared->Idle.wait(lock, [this]() { return m_shared->Handoffs == 0; });
+        }
+
+        for (auto& feed : m_feeds)
+        {
+            feed->KeywordRecognizer->StopRecognitionAsync().get();
+            feed->KeywordStream->Close();
+            WaitArmed(*feed);
+        }
+    }
+
+    // Prints the keywords spotted, the cloud sessions, and the share of the audio that never left the device.
+    void PrintStatistics(std::ostream& out) const
+    {
+        uint64_t written = m_shared->BytesWritten;
+        uint64_t streamed = m_shared->BytesStreamed;
+        out << "Feeds: " << m_feeds.size() << ", keywords: " << m_shared->Keywords << ", cloud sessions: " << m_shared->Sessions
+            << ", dropped: " << m_shared->Dropped << ", failed: " << m_shared->Failures << ", audio streamed to the cloud: " << streamed << " of " << written << " bytes ("
+            << (written > 0 ? 100.0 * streamed / written : 0) << "%)" << std::endl;
+    }
+
+private:
+    enum class FeedState
+    {
+        Listening,                      // the audio goes to the keyword recognizer, and to the pre-roll.
+        Triggered,                      // the keyword was spotted, the audio is kept until a cloud recognizer takes it.
+        Streaming                       // the audio goes to the cloud recognizer.
+    };
+
+    struct Feed
+    {
+        Feed(size_t index, size_t preRollBytes)
+            : Index(index), PreRoll(preRollBytes)
+        {
+        }
+
+        const size_t Index;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> KeywordStream;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognizer> KeywordRecognizer;
+        std::future<std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionResult>> Armed;
+
+        std::mutex Mutex;
+        FeedState State = FeedState::Listening;
+        PreRollBuffer PreRoll;
+        std::vector<uint8_t> Pending;   // the pre-roll and the audio written since the keyword, while Triggered.
+        std::shared_ptr<PooledRecognizer> Lease;
+        bool Rearm = false;             // the keyword was dropped, the writer listens for it again.
+    };
+
+    // What the handlers and the worker tasks share with the gate.
+    struct Shared
+    {
+        Shared(std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel> model,
+            RecognizerPool& recognizers, WorkerPool& workers, ResultCallback onResult)
+            : Model(model), Recognizers(recognizers), Workers(workers), OnResult(std::move(onResult))
+        {
+        }
+
+        const std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel> Model;
+        RecognizerPool& Recognizers;
+        WorkerPool& Workers;
+        const ResultCallback OnResult;
+
+        std::mutex Mutex;
+        std::condition_variable Idle;
+        uint32_t Handoffs = 0;          // feeds triggered or streaming.
+        bool Closing = false;
+
+        std::atomic<uint64_t> Keywords{ 0 };
+        std::atomic<uint64_t> Sessions{ 0 };
+        std::atomic<uint64_t> Dropped{ 0 };
+        std::atomic<uint64_t> Failures{ 0 };
+        std::atomic<uint64_t> BytesWritten{ 0 };
+        std::atomic<uint64_t> BytesStreamed{ 0 };
+    };
+
+    // Starts listening for the keyword. The audio written in the meantime is already in the keyword stream.
+    static void Arm(Shared& shared, Feed& feed)
+    {
+        WaitArmed(feed);
+        feed.Armed = feed.KeywordRecognizer->RecognizeOnceAsync(shared.Model);
+    }
+
+    // Waits for the last keyword recognition of the feed to complete.
+    static void WaitArmed(Feed& feed)
+    {
+        if (feed.Armed.valid())
+        {
+            try
+            {
+                feed.Armed.get();
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+    }
+
+    // Called on the SDK's thread when a feed's keyword is spotted. The feed keeps its audio until a worker streams it.
+    static void OnKeyword(std::shared_ptr<Shared> shared, std::shared_ptr<Feed> feed)
+    {
+        {
+            std::lock_guard<std::mutex> lock(shared->Mutex);
+            if (shared->Closing)
+            {
+                return;
+            }
+            shared->Handoffs++;
+        }
+        shared->Keywords++;
+        size_t preRoll;
+        {
+            std::lock_guard<std::mutex> lock(feed->Mutex);
+            feed->State = FeedState::Triggered;
+            feed->Pending.clear();
+            feed->PreRoll.Drain(feed->Pending);
+            preRoll = feed->Pending.size();
+        }
+        if (shared->Workers.TrySubmit([shared, feed]() { Stream(shared, feed); }))
+        {
+            return;
+        }
+
+        // Dropped: the audio is given back to the pre-roll and the keyword stream, and the writer arms the keyword
+        // recognizer again, as it can't be from the handler of its own recognition.
+        shared->Dropped++;
+        {
+            std::lock_guard<std::mutex> lock(feed->Mutex);
+            feed->PreRoll.Write(feed->Pending.data(), feed->Pending.size());
+            if (feed->Pending.size() > preRoll)
+            {
+                feed->KeywordStream->Write(feed->Pending.data() + preRoll, (uint32_t)(feed->Pending.size() - preRoll));
+            }
+            feed->Pending.clear();
+            feed->State = FeedState::Listening;
+            feed->Rearm = true;
+        }
+        std::lock_guard<std::mutex> lock(shared->Mutex);
+        shared->Handoffs--;
+        shared->Idle.notify_all();
+    }
+
+    // Runs on a worker: streams the feed to a cloud recognizer until the end of the utterance, then listens again.
+    static void Stream(std::shared_ptr<Shared> shared, std::shared_ptr<Feed> feed)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        std::shared_ptr<PooledRecognizer> lease;
+        std::shared_ptr<SpeechRecognitionResult> result;
+        try
+        {
+            lease = shared->Recognizers.Acquire();
+
+            // At the end of the speech the feed goes back to its keyword recognizer, while the cloud recognizer
+            // finishes the utterance.
+            std::weak_ptr<Feed> weakFeed = feed;
+            std::weak_ptr<PooledRecognizer> weakLease = lease;
+            lease->Recognizer->SpeechEndDetected.Connect([weakFeed, weakLease](const RecognitionEventArgs&)
+            {
+                auto feed = weakFeed.lock();
+                auto lease = weakLease.lock();
+                if (feed != nullptr && lease != nullptr)
+                {
+                    std::lock_guard<std::mutex> lock(feed->Mutex);
+                    if (feed->State == FeedState::Streaming && feed->Lease == lease)
+                    {
+                        feed->State = FeedState::Listening;
+                        feed->Lease = nullptr;
+                    }
+                }
+            });
+            auto recognition = lease->Recognizer->RecognizeOnceAsync();
+            {
+                // Sends the pre-roll and what was written since the keyword, then lets the writes go to the recognizer.
+                std::lock_guard<std::mutex> lock(feed->Mutex);
+                if (!feed->Pending.empty())
+                {
+                    lease->Stream->Write(feed->Pending.data(), (uint32_t)feed->Pending.size());
+                    shared->BytesStreamed += feed->Pending.size();
+                }
+                feed->Pending.clear();
+                feed->Lease = lease;
+                feed->State = FeedState::Streaming;
+            }
+            shared->Sessions++;
+            result = recognition.get();
+        }
+        catch (const std::exception&)
+        {
+            shared->Failures++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(feed->Mutex);
+            feed->State = FeedState::Listening;
+            feed->Lease = nullptr;
+            feed->Pending.clear();
+        }
+        shared->Recognizers.Release(lease);
+
+        if (result != nullptr)
+        {
+            try
+            {
+                shared->OnResult(feed->Index, result);
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+
+        // Close() waits for the handoff to end before it stops the keyword recognizers, so it can't miss this one.
+        bool closing;
+        {
+            std::lock_guard<std::mutex> lock(shared->Mutex);
+            closing = shared->Closing;
+        }
+        if (!closing)
+        {
+            try
+            {
+                Arm(*shared, *feed);
+            }
+            catch (const std::exception&)
+            {
+                shared->Failures++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(shared->Mutex);
+        shared->Handoffs--;
+        shared->Idle.notify_all();
+    }
+
+    std::shared_ptr<Shared> m_shared;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> m_format;
+    size_t m_preRollBytes;
+    std::vector<std::shared_ptr<Feed>> m_feeds;
+    bool m_closed = false;
+};
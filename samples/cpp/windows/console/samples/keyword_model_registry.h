@@ -0,0 +1,174 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <climits>
+#include <unistd.h>
+#endif
+
+// Gets the memory committed by the process, to measure what loading models costs: the private bytes on Windows,
+// the resident set elsewhere. Returns 0 where it cannot be read.
+inline uint64_t GetProcessMemoryBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS_EX counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+    {
+        return counters.PrivateUsage;
+    }
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    return statm >> size >> resident ? resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+struct KeywordModelRegistryStatistics
+{
+    uint64_t Loads = 0;         // models loaded from their file.
+    uint64_t Hits = 0;          // requests served with a model loaded before, or being loaded by another thread.
+    uint64_t Failures = 0;
+    double LoadSeconds = 0;     // spent loading, in total.
+    size_t Models = 0;          // models held.
+};
+
+// Loads each keyword recognition model once, and hands the same model to every recognizer that asks for its file,
+// instead of a KeywordRecognitionModel::FromFile() per recognizer. FromFile() itself only holds the path of the file;
+// the table is read by the SDK when a recognition starts with the model, so what sharing one model saves depends on
+// the SDK, and KeywordRecognitionWithSharedModel measures it.
+// A model is read-only once loaded, so that recognizers can share it, across StartKeywordRecognitionAsync() and
+// KeywordRecognizer::RecognizeOnceAsync() calls alike. The models are held until Evict(), by the full path of their
+// file, so that two spellings of a path share one. Loading is done by the first thread that asks, the others wait on it.
+class KeywordModelRegistry final
+{
+public:
+    KeywordModelRegistry() = default;
+
+    KeywordModelRegistry(const KeywordModelRegistry&) = delete;
+    KeywordModelRegistry& operator=(const KeywordModelRegistry&) = delete;
+
+    // Gets the registry of the process.
+    static KeywordModelRegistry& Default()
+    {
+        static KeywordModelRegistry registry;
+        return registry;
+    }
+
+    // Gets the model of a file, loading it the first time. Throws if loading fails; the next call tries again.
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel> Get(const std::string& fileName)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (fileName.empty())
+        {
+            throw std::invalid_argument("A keyword model file name is required");
+        }
+
+        auto path = FullPath(fileName);
+        std::promise<std::shared_ptr<KeywordRecognitionModel>> loading;
+        std::shared_future<std::shared_ptr<KeywordRecognitionModel>> loaded;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_models.find(path);
+            if (found != m_models.end())
+            {
+                m_statistics.Hits++;
+                loaded = found->second;
+            }
+            else
+            {
+                m_models.emplace(path, loading.get_future().share());
+            }
+        }
+
+        // Waits without the lock for the thread loading it, if it is not loaded yet.
+        if (loaded.valid())
+        {
+            return loaded.get();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<KeywordRecognitionModel> model;
+        try
+        {
+            model = KeywordRecognitionModel::FromFile(path);
+            if (model == nullptr)
+            {
+                throw std::runtime_error("Failed to load the keyword model " + path);
+            }
+        }
+        catch (...)
+        {
+            // Forgets the failure, after handing it to the threads that wait, so that the next call loads again.
+            loading.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_models.erase(path);
+            m_statistics.Failures++;
+            throw;
+        }
+        loading.set_value(model);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.Loads++;
+        m_statistics.LoadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return model;
+    }
+
+    // Releases the registry's reference to the model of a file, e.g. after the file changed; the recognizers that use
+    // it keep it. Returns false if it was not loaded.
+    bool Evict(const std::string& fileName)
+    {
+        auto path = FullPath(fileName);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_models.erase(path) > 0;
+    }
+
+    KeywordModelRegistryStatistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto statistics = m_statistics;
+        statistics.Models = m_models.size();
+        return statistics;
+    }
+
+private:
+    // Gets the full path of a file, or its name as given if it cannot be resolved, e.g. as it does not exist.
+    static std::string FullPath(const std::string& fileName)
+    {
+#ifdef _WIN32
+        char path[MAX_PATH];
+        auto length = GetFullPathNameA(fileName.c_str(), MAX_PATH, path, nullptr);
+        return length > 0 && length < MAX_PATH ? std::string(path, length) : fileName;
+#else
+        char path[PATH_MAX];
+        return realpath(fileName.c_str(), path) != nullptr ? std::string(path) : fileName;
+#endif
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::shared_future<std::shared_ptr<Microsoft::CognitiveServices::Speech::KeywordRecognitionModel>>> m_models;
+    KeywordModelRegistryStatistics m_statistics;
+};
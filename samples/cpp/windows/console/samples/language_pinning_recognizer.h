@@ -0,0 +1,282 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "session_completion.h"
+#include "wav_file_reader.h"
+
+// Recognizes a long multilingual audio stream in one continuous session, detecting its language only until it is stable.
+// It starts with a recognizer that detects the source language among the candidates. Once 'stableUtterances' utterances
+// in a row are recognized in the same language, the following audio goes to a recognizer pinned to that language, which
+// skips detection. If the pinned recognizer then returns 'maxNoMatches' no-matches in a row, e.g. because the speaker
+// switched languages, the audio goes back to a detecting recognizer.
+// The audio is written by the caller, and recognizers are only switched between utterances, by the writing thread,
+// so that the SDK's callback threads never wait on a recognizer starting or stopping.
+// Each recognizer counts its offsets from its own start; they are moved onto the timeline of the whole stream, from
+// the audio written before the recognizer started.
+class LanguagePinningRecognizer final
+{
+public:
+    // Gets the text and language of each recognized utterance, whether it came from a pinned recognizer, and its offset
+    // and duration in ticks of 100 nanoseconds, from the start of the audio written.
+    using RecognizedCallback = std::function<void(const std::string& text, const std::string& language, bool pinned, uint64_t offset, uint64_t duration)>;
+
+    // Constructor for audio written in 'format', the PCM format of a WAV file.
+    LanguagePinningRecognizer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config,
+        const std::vector<std::string>& languages, const WavFormat& format,
+        RecognizedCallback onRecognized, uint32_t stableUtterances = 2, uint32_t maxNoMatches = 2)
+        : m_config(config), m_languages(languages), m_format(CreateAudioStreamFormat(format)), m_bytesPerSecond(format.AvgBytesPerSec),
+        m_state(std::make_shared<State>())
+    {
+        if (config == nullptr || languages.size() < 2 || !onRecognized || stableUtterances == 0 || maxNoMatches == 0 || m_bytesPerSecond == 0)
+        {
+            throw std::invalid_argument("A speech config, two or more candidate languages, a callback, positive thresholds and a byte rate are required");
+        }
+        m_state->OnRecognized = std::move(onRecognized);
+        m_state->StableUtterances = stableUtterances;
+        m_state->MaxNoMatches = maxNoMatches;
+    }
+
+    ~LanguagePinningRecognizer()
+    {
+        try
+        {
+            Close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    LanguagePinningRecognizer(const LanguagePinningRecognizer&) = delete;
+    LanguagePinningRecognizer& operator=(const LanguagePinningRecognizer&) = delete;
+
+    // Starts the session with a detecting recognizer.
+    void Start()
+    {
+        Switch(std::string());
+    }
+
+    // Writes audio to the current recognizer, switching recognizers first if the last utterance asked for it.
+    void Write(uint8_t* data, uint32_t size)
+    {
+        if (m_current == nullptr)
+        {
+            throw std::logic_error("Start() must be called before audio is written");
+        }
+
+        std::string language;
+        bool switchNeeded;
+        {
+            std::lock_guard<std::mutex> lock(m_state->Mutex);
+            switchNeeded = m_state->SwitchRequested;
+            m_state->SwitchRequested = false;
+            language = m_state->PinnedLanguage;
+        }
+        if (switchNeeded)
+        {
+            Switch(language);
+        }
+        m_current->Stream->Write(data, size);
+        m_bytesWritten += size;
+    }
+
+    // Ends the audio, and waits for all the recognizers to deliver their last results and stop.
+    void Close()
+    {
+        if (m_current != nullptr)
+        {
+            Retire();
+        }
+        for (auto& recognizer : m_retired)
+        {
+            recognizer->Stopped->Wait();
+        }
+        m_retired.clear();
+    }
+
+    // Gets the number of utterances recognized without detecting their language, the detections avoided.
+    uint64_t GetDetectionsAvoided() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->Mutex);
+        return m_state->PinnedUtterances;
+    }
+
+    // Prints the utterances recognized, how many of them skipped language detection, and the recognizer switches.
+    void PrintStatistics(std::ostream& out) const
+    {
+        std::lock_guard<std::mutex> lock(m_state->Mutex);
+        out << "Utterances: " << m_state->Utterances << ", language detections avoided: " << m_state->PinnedUtterances
+            << ", pinned: " << m_pins << " times, back to detection: " << m_unpins << " times" << std::endl;
+    }
+
+private:
+    // What the event handlers of all the recognizers share. Only the handlers of the current recognizer, the latest
+    // generation, change the pinning; the results of the recognizers being retired are still delivered.
+    struct State
+    {
+        std::mutex Mutex;
+        RecognizedCallback OnRecognized;
+        uint32_t StableUtterances = 0;
+        uint32_t MaxNoMatches = 0;
+
+        uint64_t Generation = 0;
+        std::string PinnedLanguage;         // empty while detecting.
+        std::string StreakLanguage;
+        uint32_t Streak = 0;                // utterances in a row detected in StreakLanguage, or no-matches in a row while pinned.
+        bool SwitchRequested = false;
+
+        uint64_t Utterances = 0;
+        uint64_t PinnedUtterances = 0;
+    };
+
+    struct Recognizer
+    {
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> Stream;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer> SpeechRecognizer;
+        std::shared_ptr<SessionCompletion> Stopped;
+    };
+
+    // Starts a recognizer pinned to 'language', or a detecting one if it is empty, and retires the current one.
+    void Switch(const std::string& language)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        auto recognizer = std::make_shared<Recognizer>();
+        recognizer->Stream = AudioInputStream::CreatePushStream(m_format);
+        auto audioConfig = AudioConfig::FromStreamInput(recognizer->Stream);
+        recognizer->SpeechRecognizer = language.empty()
+            ? SpeechRecognizer::FromConfig(m_config, AutoDetectSourceLanguageConfig::FromLanguages(m_languages), audioConfig)
+            : SpeechRecognizer::FromConfig(m_config, language, audioConfig);
+
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(m_state->Mutex);
+            generation = ++m_state->Generation;
+            m_state->PinnedLanguage = language;
+            m_state->StreakLanguage.clear();
+            m_state->Streak = 0;
+
+            // Drops a request the previous generation made while this switch was on its way.
+            m_state->SwitchRequested = false;
+        }
+        if (m_current != nullptr)
+        {
+            (language.empty() ? m_unpins : m_pins)++;
+        }
+
+        // The recognizer hears the audio from here on, its offsets start at the audio written so far.
+        auto baseOffset = m_bytesWritten * 10000000 / m_bytesPerSecond;
+        auto state = m_state;
+        recognizer->SpeechRecognizer->Recognized.Connect([state, generation, language, baseOffset](const SpeechRecognitionEventArgs& e)
+        {
+            OnRecognized(*state, generation, language, baseOffset, e);
+        });
+
+        // Completed once, either on stop or on an error, whichever comes first.
+        recognizer->Stopped = SessionCompletion::Watch(*recognizer->SpeechRecognizer);
+
+        recognizer->SpeechRecognizer->StartContinuousRecognitionAsync().get();
+        if (m_current != nullptr)
+        {
+            Retire();
+        }
+        m_current = recognizer;
+    }
+
+    // Ends the audio of the current recognizer. It finishes its last utterance on its own and stops at the end of the stream.
+    void Retire()
+    {
+        m_current->Stream->Close();
+        m_retired.push_back(m_current);
+        m_current = nullptr;
+
+        // Releases the recognizers that have stopped since.
+        for (auto it = m_retired.begin(); it != m_retired.end();)
+        {
+            if ((*it)->Stopped->IsComplete())
+            {
+                it = m_retired.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    static void OnRecognized(State& state, uint64_t generation, const std::string& pinnedLanguage, uint64_t baseOffset,
+        const Microsoft::CognitiveServices::Speech::SpeechRecognitionEventArgs& e)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto recognized = e.Result->Reason == ResultReason::RecognizedSpeech;
+        std::string language = pinnedLanguage;
+        if (language.empty())
+        {
+            auto detected = AutoDetectSourceLanguageResult::FromResult(e.Result);
+            language = detected != nullptr ? detected->Language : std::string();
+        }
+
+        std::unique_lock<std::mutex> lock(state.Mutex);
+        if (recognized)
+        {
+            state.Utterances++;
+            state.PinnedUtterances += pinnedLanguage.empty() ? 0 : 1;
+        }
+
+        if (generation == state.Generation && !state.SwitchRequested)
+        {
+            if (pinnedLanguage.empty() && recognized && !language.empty())
+            {
+                state.Streak = language == state.StreakLanguage ? state.Streak + 1 : 1;
+                state.StreakLanguage = language;
+                if (state.Streak >= state.StableUtterances)
+                {
+                    state.PinnedLanguage = language;
+                    state.SwitchRequested = true;
+                }
+            }
+            else if (!pinnedLanguage.empty())
+            {
+                state.Streak = e.Result->Reason == ResultReason::NoMatch ? state.Streak + 1 : 0;
+                if (state.Streak >= state.MaxNoMatches)
+                {
+                    state.PinnedLanguage.clear();
+                    state.SwitchRequested = true;
+                }
+            }
+        }
+        lock.unlock();
+
+        if (recognized)
+        {
+            state.OnRecognized(e.Result->Text, language, !pinnedLanguage.empty(), baseOffset + e.Result->Offset(), e.Result->Duration());
+        }
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    const std::vector<std::string> m_languages;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> m_format;
+    const uint64_t m_bytesPerSecond;
+    std::shared_ptr<State> m_state;
+
+    // Used by the writing thread only.
+    uint64_t m_bytesWritten = 0;
+    std::shared_ptr<Recognizer> m_current;
+    std::vector<std::shared_ptr<Recognizer>> m_retired;
+    uint64_t m_pins = 0;
+    uint64_t m_unpins = 0;
+};
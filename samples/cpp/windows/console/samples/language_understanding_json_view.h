@@ -0,0 +1,120 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <string>
+#include "json_scanner.h"
+
+// Reads the few fields handlers need from the Language Understanding JSON of an intent result, the value of
+// PropertyId::LanguageUnderstandingServiceResponse_JsonResult, without building a document of the whole response.
+// Each accessor scans the text on demand: the values it doesn't look at are skipped over, not parsed, and only the
+// strings it returns are unescaped and copied. It reads the top scoring intent and the entities of the response:
+//   { "query": ..., "topScoringIntent": { "intent": ..., "score": ... }, "entities": [ { "entity": ..., "type": ..., "score": ... } ] }
+// The view refers to the JSON text, which must outlive it, so it cannot be made from a temporary string.
+// Malformed or unexpected JSON makes the accessors return false.
+class LanguageUnderstandingJsonView final
+{
+public:
+    LanguageUnderstandingJsonView(const std::string& json)
+        : m_json(json)
+    {
+    }
+
+    LanguageUnderstandingJsonView(std::string&&) = delete;
+
+    // Gets the top scoring intent and its score. The scan is done once, on the first call.
+    bool GetTopIntent(std::string& intent, double& score)
+    {
+        if (!m_topIntentScanned)
+        {
+            m_topIntentScanned = true;
+            ReadTopLevelMember("topScoringIntent", [this](JsonScanner& scanner)
+            {
+                bool hasIntent = false;
+                m_hasTopIntent = scanner.ReadObject([this, &scanner, &hasIntent](const JsonSpan& key)
+                {
+                    if (key.Equals("intent"))
+                    {
+                        return hasIntent = scanner.ReadString(m_topIntent);
+                    }
+                    if (key.Equals("score"))
+                    {
+                        return scanner.ReadNumber(m_topIntentScore);
+                    }
+                    return scanner.SkipValue();
+                }) && hasIntent;
+            });
+        }
+        intent = m_topIntent;
+        score = m_topIntentScore;
+        return m_hasTopIntent;
+    }
+
+    // Gets the first entity of the given type, e.g. "Weather.Location", with its text and score.
+    bool FindEntity(const std::string& type, std::string& entity, double& score) const
+    {
+        bool found = false;
+        ReadTopLevelMember("entities", [&](JsonScanner& scanner)
+        {
+            return scanner.ReadArray([&]()
+            {
+                // Reads only the members of interest of each entity object, and stops at the first match.
+                JsonSpan entityType;
+                JsonSpan text;
+                double entityScore = 0;
+                auto read = scanner.ReadObject([&](const JsonSpan& key)
+                {
+                    if (key.Equals("type"))
+                    {
+                        return scanner.ReadString(entityType);
+                    }
+                    if (key.Equals("entity"))
+                    {
+                        return scanner.ReadString(text);
+                    }
+                    if (key.Equals("score"))
+                    {
+                        return scanner.ReadNumber(entityScore);
+                    }
+                    return scanner.SkipValue();
+                });
+                if (read && entityType.ToString() == type)
+                {
+                    text.CopyTo(entity);
+                    score = entityScore;
+                    found = true;
+                    return false;
+                }
+                return read;
+            });
+        });
+        return found;
+    }
+
+private:
+    // Finds a member of the top-level object and calls 'read(scanner)' to read its value.
+    template<typename Read>
+    void ReadTopLevelMember(const char* name, Read read) const
+    {
+        JsonScanner scanner(m_json);
+        scanner.ReadObject([&](const JsonSpan& key)
+        {
+            if (!key.Equals(name))
+            {
+                return scanner.SkipValue();
+            }
+            read(scanner);
+
+            // Stops the scan, the rest of the response isn't needed.
+            return false;
+        });
+    }
+
+    const std::string& m_json;
+    bool m_topIntentScanned = false;
+    bool m_hasTopIntent = false;
+    std::string m_topIntent;
+    double m_topIntentScore = 0;
+};
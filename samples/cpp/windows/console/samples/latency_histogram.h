@@ -0,0 +1,90 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Collects latency samples and reports their percentiles.
+// All the samples are kept, so that percentiles are exact and histograms of several sessions can be merged.
+// It is not thread safe, callers serialize access.
+class LatencyHistogram final
+{
+public:
+    // Adds a sample, in whatever unit the caller reports in (the samples use milliseconds).
+    void Add(double value)
+    {
+        m_values.push_back(value);
+        m_sorted = false;
+    }
+
+    // Adds all the samples of another histogram.
+    void Merge(const LatencyHistogram& other)
+    {
+        m_values.insert(m_values.end(), other.m_values.begin(), other.m_values.end());
+        m_sorted = false;
+    }
+
+    // Gets the number of samples.
+    size_t Count() const
+    {
+        return m_values.size();
+    }
+
+    // Gets the nearest-rank percentile of the samples, e.g. Percentile(95) for p95. It returns 0 if there are none.
+    double Percentile(double percent) const
+    {
+        if (m_values.empty())
+        {
+            return 0;
+        }
+        Sort();
+
+        auto rank = (size_t)std::ceil(percent / 100 * m_values.size());
+        return m_values[rank > 0 ? (std::min)(rank, m_values.size()) - 1 : 0];
+    }
+
+    // Gets the largest sample. It returns 0 if there are none.
+    double Max() const
+    {
+        if (m_values.empty())
+        {
+            return 0;
+        }
+        Sort();
+        return m_values.back();
+    }
+
+    // Prints the count, p50, p95, p99 and max of the samples on one line.
+    void Print(std::ostream& out, const std::string& name, const std::string& unit = "ms") const
+    {
+        out << name << ": count=" << Count();
+        if (!m_values.empty())
+        {
+            out << ", p50=" << Percentile(50) << unit
+                << ", p95=" << Percentile(95) << unit
+                << ", p99=" << Percentile(99) << unit
+                << ", max=" << Max() << unit;
+        }
+        out << "\n";
+    }
+
+private:
+    void Sort() const
+    {
+        if (!m_sorted)
+        {
+            std::sort(m_values.begin(), m_values.end());
+            m_sorted = true;
+        }
+    }
+
+    // Sorted lazily, when a percentile is first asked for.
+    mutable std::vector<double> m_values;
+    mutable bool m_sorted = true;
+};
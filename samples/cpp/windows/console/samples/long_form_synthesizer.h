@@ -0,0 +1,399 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "worker_pool.h"
+
+// A piece of a document that is synthesized with one request.
+struct TextSegment
+{
+    std::string Text;
+    uint32_t Offset;        // offset of the segment in the document, in bytes.
+};
+
+// Splits a document into segments of at most 'maxLength' bytes, at paragraph and sentence boundaries.
+// A paragraph always starts a new segment; sentences of a paragraph are packed together while they fit.
+// A single sentence longer than 'maxLength' is split at the last space that fits, or hard if there is none.
+inline std::vector<TextSegment> SegmentText(const std::string& text, size_t maxLength = 1000)
+{
+    if (maxLength == 0)
+    {
+        throw std::invalid_argument("Maximum segment length must be positive");
+    }
+
+    // Finds the sentences first, as [start, end) ranges, and whether each one ends its paragraph.
+    struct Sentence
+    {
+        size_t Start;
+        size_t End;
+        bool EndsParagraph;
+    };
+    std::vector<Sentence> sentences;
+    size_t start = 0;
+    for (size_t i = 0; i <= text.size(); i++)
+    {
+        bool endOfText = i == text.size();
+        bool paragraphBreak = !endOfText && text[i] == '\n' && i + 1 < text.size() && (text[i + 1] == '\n' || text[i + 1] == '\r');
+        bool sentenceEnd = !endOfText && (text[i] == '.' || text[i] == '!' || text[i] == '?') &&
+            (i + 1 == text.size() || isspace((unsigned char)text[i + 1]));
+        if (endOfText || paragraphBreak || sentenceEnd)
+        {
+            auto end = sentenceEnd ? i + 1 : i;
+            while (start < end && isspace((unsigned char)text[start]))
+            {
+                start++;
+            }
+            if (start < end)
+            {
+                sentences.push_back(Sentence{ start, end, paragraphBreak || endOfText });
+            }
+            else if (paragraphBreak && !sentences.empty())
+            {
+                sentences.back().EndsParagraph = true;
+            }
+            start = end;
+        }
+    }
+
+    std::vector<TextSegment> segments;
+    bool startNew = true;
+    for (const auto& sentence : sentences)
+    {
+        auto sentenceStart = sentence.Start;
+        while (sentence.End - sentenceStart > maxLength)
+        {
+            // Splits an overlong sentence at a space.
+            auto split = text.rfind(' ', sentenceStart + maxLength);
+            if (split == std::string::npos || split <= sentenceStart)
+            {
+                split = sentenceStart + maxLength;
+            }
+            segments.push_back(TextSegment{ text.substr(sentenceStart, split - sentenceStart), (uint32_t)sentenceStart });
+            sentenceStart = split;
+            while (sentenceStart < sentence.End && text[sentenceStart] == ' ')
+            {
+                sentenceStart++;
+            }
+            startNew = true;
+        }
+
+        if (!startNew && !segments.empty() && sentence.End - segments.back().Offset <= maxLength)
+        {
+            // Extends the previous segment up to the end of this sentence, keeping the text in between as is.
+            auto& last = segments.back();
+            last.Text = text.substr(last.Offset, sentence.End - last.Offset);
+        }
+        else
+        {
+            segments.push_back(TextSegment{ text.substr(sentenceStart, sentence.End - sentenceStart), (uint32_t)sentenceStart });
+        }
+        startNew = sentence.EndsParagraph;
+    }
+    return segments;
+}
+
+// A word boundary of a long-form synthesis, in the coordinates of the whole document.
+struct DocumentWordBoundary
+{
+    uint64_t AudioOffset;   // offset in the stitched audio, in ticks of 100 nanoseconds.
+    uint32_t TextOffset;    // offset in the document, in bytes, like the offsets of the segments.
+    uint32_t WordLength;    // in bytes.
+};
+
+// The outcome of a long-form synthesis.
+struct LongFormSynthesisResult
+{
+    bool Succeeded = false;
+    std::string ErrorDetails;
+    size_t SegmentCount = 0;
+    uint64_t AudioBytes = 0;
+    double FirstSegmentSeconds = 0;     // wall time until the first segment was ready, i.e. when playback could start.
+    double TotalSeconds = 0;
+    std::vector<DocumentWordBoundary> WordBoundaries;
+};
+
+// Synthesizes a long document by splitting it into segments, synthesizing up to 'maxConcurrency' segments
+// in parallel, and stitching their audio in order into one file. A failed segment is retried on its own,
+// rather than failing the whole document.
+class LongFormSynthesizer final
+{
+public:
+    // Defines the container of the stitched file.
+    enum class OutputContainer
+    {
+        Wav,    // 24 kHz 16-bit mono PCM, with a header written once the total length is known.
+        Mp3     // 24 kHz 48 kbit/s mono MP3, whose frames can be concatenated as they are.
+    };
+
+    // Constructor that sets the output format of 'config' to one that can be stitched.
+    LongFormSynthesizer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, OutputContainer container,
+        uint32_t maxConcurrency, size_t maxSegmentLength = 1000)
+        : m_container(container), m_maxConcurrency(maxConcurrency), m_maxSegmentLength(maxSegmentLength)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (config == nullptr || maxConcurrency == 0)
+        {
+            throw std::invalid_argument("A speech config and a positive concurrency are required");
+        }
+
+        config->SetSpeechSynthesisOutputFormat(m_container == OutputContainer::Wav
+            ? SpeechSynthesisOutputFormat::Raw24Khz16BitMonoPcm
+            : SpeechSynthesisOutputFormat::Audio24Khz48KBitRateMonoMp3);
+
+        for (uint32_t i = 0; i < maxConcurrency; i++)
+        {
+            m_synthesizers.push_back(std::make_shared<Worker>(config));
+        }
+    }
+
+    // Synthesizes 'text' to 'fileName'. The file is only written if all the segments succeed.
+    LongFormSynthesisResult SynthesizeToFile(const std::string& text, const std::string& fileName)
+    {
+        LongFormSynthesisResult result;
+        auto start = std::chrono::steady_clock::now();
+
+        auto segments = SegmentText(text, m_maxSegmentLength);
+        result.SegmentCount = segments.size();
+        std::vector<SegmentAudio> audio(segments.size());
+
+        std::mutex resultMutex;
+        {
+            WorkerPool pool(m_maxConcurrency, m_maxConcurrency * 2);
+            for (size_t i = 0; i < segments.size(); i++)
+            {
+                pool.Submit([this, i, start, &segments, &audio, &result, &resultMutex]()
+                {
+                    auto worker = AcquireWorker();
+                    audio[i] = worker->Synthesize(segments[i].Text, m_maxRetries);
+                    ReleaseWorker(worker);
+
+                    std::lock_guard<std::mutex> lock(resultMutex);
+                    if (i == 0 && audio[i].Succeeded)
+                    {
+                        result.FirstSegmentSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    }
+                });
+            }
+            pool.WaitIdle();
+        }
+
+        for (size_t i = 0; i < audio.size(); i++)
+        {
+            if (!audio[i].Succeeded)
+            {
+                result.ErrorDetails = "Segment " + std::to_string(i) + " failed: " + audio[i].ErrorDetails;
+                result.TotalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                return result;
+            }
+        }
+
+        // Stitches the segments in order, and moves their word boundaries into document coordinates.
+        std::ofstream file(fileName, std::ios::binary);
+        if (m_container == OutputContainer::Wav)
+        {
+            uint64_t dataSize = 0;
+            for (const auto& segment : audio)
+            {
+                dataSize += segment.Data->size();
+            }
+            WriteWavHeader(file, (uint32_t)dataSize);
+        }
+
+        uint64_t audioOffset = 0;
+        for (size_t i = 0; i < audio.size(); i++)
+        {
+            const auto& data = *audio[i].Data;
+            file.write((const char*)data.data(), data.size());
+            for (const auto& boundary : audio[i].WordBoundaries)
+            {
+                result.WordBoundaries.push_back(DocumentWordBoundary{
+                    audioOffset + boundary.AudioOffset, segments[i].Offset + boundary.TextOffset, boundary.WordLength });
+            }
+            audioOffset += BytesToTicks(data.size());
+            result.AudioBytes += data.size();
+        }
+        if (!file.good())
+        {
+            result.ErrorDetails = "Failed to write " + fileName;
+        }
+        else
+        {
+            result.Succeeded = true;
+        }
+
+        result.TotalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    // Defines how many times a failed segment is retried.
+    static constexpr uint32_t m_maxRetries = 2;
+
+    // Defines the sample rate and the MP3 bit rate of the output formats.
+    static constexpr uint32_t sampleRate = 24000;
+    static constexpr uint32_t mp3BytesPerSecond = 48000 / 8;
+
+    struct SegmentAudio
+    {
+        bool Succeeded = false;
+        std::string ErrorDetails;
+        std::shared_ptr<std::vector<uint8_t>> Data;
+        std::vector<DocumentWordBoundary> WordBoundaries;   // relative to the segment, in bytes.
+    };
+
+    // A synthesizer that handles one segment at a time, and collects the word boundaries of that segment.
+    class Worker final
+    {
+    public:
+        Worker(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config)
+            : m_boundaries(std::make_shared<Boundaries>())
+        {
+            using namespace Microsoft::CognitiveServices::Speech;
+
+            m_synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+            auto boundaries = m_boundaries;
+            m_synthesizer->WordBoundary += [boundaries](const SpeechSynthesisWordBoundaryEventArgs& e)
+            {
+                std::lock_guard<std::mutex> lock(boundaries->Mutex);
+                boundaries->Collected.push_back(DocumentWordBoundary{ e.AudioOffset, e.TextOffset, e.WordLength });
+            };
+        }
+
+        SegmentAudio Synthesize(const std::string& text, uint32_t maxRetries)
+        {
+            using namespace Microsoft::CognitiveServices::Speech;
+
+            SegmentAudio audio;
+            for (uint32_t attempt = 0; attempt <= maxRetries && !audio.Succeeded; attempt++)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_boundaries->Mutex);
+                    m_boundaries->Collected.clear();
+                }
+
+                try
+                {
+                    auto result = m_synthesizer->SpeakTextAsync(text).get();
+                    if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+                    {
+                        audio.Data = result->GetAudioData();
+                        audio.Succeeded = true;
+                    }
+                    else
+                    {
+                        audio.ErrorDetails = SpeechSynthesisCancellationDetails::FromResult(result)->ErrorDetails;
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    audio.ErrorDetails = e.what();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_boundaries->Mutex);
+                audio.WordBoundaries.swap(m_boundaries->Collected);
+            }
+
+            // The SDK counts the text offsets and lengths in characters; the document is counted in bytes of UTF-8.
+            size_t characters = 0;
+            size_t bytes = 0;
+            auto toBytes = [&text, &characters, &bytes](uint32_t offset)
+            {
+                if (offset < characters)
+                {
+                    characters = 0;
+                    bytes = 0;
+                }
+                for (; characters < offset && bytes < text.size(); characters++)
+                {
+                    // Skips the continuation bytes of the character.
+                    do
+                    {
+                        bytes++;
+                    } while (bytes < text.size() && ((unsigned char)text[bytes] & 0xC0) == 0x80);
+                }
+                return (uint32_t)bytes;
+            };
+            for (auto& boundary : audio.WordBoundaries)
+            {
+                auto start = toBytes(boundary.TextOffset);
+                auto end = toBytes(boundary.TextOffset + boundary.WordLength);
+                boundary.TextOffset = start;
+                boundary.WordLength = end - start;
+            }
+            return audio;
+        }
+
+    private:
+        struct Boundaries
+        {
+            std::mutex Mutex;
+            std::vector<DocumentWordBoundary> Collected;
+        };
+
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> m_synthesizer;
+        std::shared_ptr<Boundaries> m_boundaries;
+    };
+
+    std::shared_ptr<Worker> AcquireWorker()
+    {
+        // There are as many synthesizers as pool threads, so one is always free.
+        std::lock_guard<std::mutex> lock(m_workersMutex);
+        auto worker = m_synthesizers.back();
+        m_synthesizers.pop_back();
+        return worker;
+    }
+
+    void ReleaseWorker(std::shared_ptr<Worker> worker)
+    {
+        std::lock_guard<std::mutex> lock(m_workersMutex);
+        m_synthesizers.push_back(worker);
+    }
+
+    // Converts a size of audio data in the output format to a duration in ticks of 100 nanoseconds.
+    uint64_t BytesToTicks(uint64_t bytes) const
+    {
+        auto bytesPerSecond = m_container == OutputContainer::Wav ? sampleRate * 2 : mp3BytesPerSecond;
+        return bytes * 10000000 / bytesPerSecond;
+    }
+
+    static void WriteWavHeader(std::ostream& file, uint32_t dataSize)
+    {
+        auto write32 = [&file](uint32_t value) { file.write((const char*)&value, 4); };
+        auto write16 = [&file](uint16_t value) { file.write((const char*)&value, 2); };
+
+        file.write("RIFF", 4);
+        write32(36 + dataSize);
+        file.write("WAVE", 4);
+        file.write("fmt ", 4);
+        write32(16);
+        write16(1);                 // PCM
+        write16(1);                 // mono
+        write32(sampleRate);
+        write32(sampleRate * 2);    // bytes per second
+        write16(2);                 // block align
+        write16(16);                // bits per sample
+        file.write("data", 4);
+        write32(dataSize);
+    }
+
+    const OutputContainer m_container;
+    const uint32_t m_maxConcurrency;
+    const size_t m_maxSegmentLength;
+    std::mutex m_workersMutex;
+    std::vector<std::shared_ptr<Worker>> m_synthesizers;
+};
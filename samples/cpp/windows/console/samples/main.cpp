@@ -5,6 +5,18 @@
 #include "stdafx.h"
 #include <iostream>
 #include <string>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+#include "sample_runner.h"
+
+// Defines the counting operator new and delete when built with SESSION_MEMORY_TRACKING, in this one source file.
+#define SESSION_MEMORY_TRACKER_OPERATORS
+#include "session_memory_tracker.h"
 
 using namespace std;
 
@@ -16,10 +28,34 @@ extern void SpeechContinuousRecognitionWithPullStream();
 extern void SpeechContinuousRecognitionWithPushStream();
 extern void KeywordTriggeredSpeechRecognitionWithMicrophone();
 extern void PronunciationAssessmentWithMicrophone();
+extern void SpeechBatchRecognitionWithFiles();
+extern void SpeechRecognitionWithRecognizerPool();
+extern void SpeechContinuousRecognitionWithResultSink();
+extern void SpeechContinuousRecognitionWithLanguagePinning();
+extern void KeywordGatedSpeechRecognitionWithFeeds();
+extern void PronunciationAssessmentBatchWithManifest();
+extern void SpeechContinuousRecognitionWithSilenceTrimming();
+extern void SpeechContinuousRecognitionWithConvertedAudio();
+extern void SpeechContinuousRecognitionWithoutBlockingThreads();
+extern void SpeechContinuousRecognitionWithCompletionQueue();
+extern void SpeechContinuousRecognitionWithMemoryAccounting();
+extern void SpeechContinuousRecognitionWithPartialDeltas();
+extern void SpeechContinuousRecognitionWithCoalescedPartials();
+extern void SpeechRecognitionWithTokenCache();
+extern void SpeechContinuousRecognitionWithCheckpoints();
+extern void SpeechRecognitionWithSplitFile();
+extern void KeywordRecognitionWithSharedModel();
+extern void SpeechRecognitionWithAlsaCapture();
+extern void SpeechContinuousRecognitionWithAudioArchive();
+extern void SpeechBatchRecognitionWithWorkQueue();
+extern void SpeechRecognitionWithEndpointPools();
+extern void SpeechRecognitionWithTracing();
+extern void SpeechRecognitionRecordAndReplay();
 
 extern void IntentRecognitionWithMicrophone();
 extern void IntentRecognitionWithLanguage();
 extern void IntentContinuousRecognitionWithFile();
+extern void IntentRecognitionWithLocalCache();
 
 extern void TranslationWithMicrophone();
 extern void TranslationContinuousRecognition();
@@ -36,6 +72,12 @@ extern void SpeechSynthesisToAudioDataStream();
 extern void SpeechSynthesisEvents();
 extern void SpeechSynthesisWordBoundaryEvent();
 extern void SpeechSynthesisWithSourceLanguageAutoDetection();
+extern void SpeechSynthesisBatchToFiles();
+extern void SpeechSynthesisWithCache();
+extern void SpeechSynthesisLongDocument();
+extern void SpeechSynthesisWordBoundaryCaptions();
+extern void SpeechSynthesisWithSsmlTemplate();
+extern void SpeechSynthesisToHttpStream();
 
 extern void ConversationWithPullAudioStream();
 extern void ConversationWithPushAudioStream();
@@ -44,6 +86,78 @@ extern void SpeakerVerificationWithMicrophone();
 extern void SpeakerVerificationWithPushStream();
 extern void SpeakerIdentificationWithPullStream();
 extern void SpeakerIdentificationWithMicrophone();
+extern void SpeakerIdentificationWithShardedProfiles();
+extern void SpeakerIdentificationWithSpeechRecognition();
+extern void SpeakerBulkEnrollment();
+
+// The samples of the menus, for the non-interactive runner.
+static const SampleScenario scenarios[] =
+{
+    { "1.1", "SpeechRecognitionWithMicrophone", SpeechRecognitionWithMicrophone },
+    { "1.2", "SpeechRecognitionWithLanguageAndUsingDetailedOutputFormat", SpeechRecognitionWithLanguageAndUsingDetailedOutputFormat },
+    { "1.3", "SpeechContinuousRecognitionWithFile", SpeechContinuousRecognitionWithFile },
+    { "1.4", "SpeechRecognitionUsingCustomizedModel", SpeechRecognitionUsingCustomizedModel },
+    { "1.5", "SpeechContinuousRecognitionWithPullStream", SpeechContinuousRecognitionWithPullStream },
+    { "1.6", "SpeechContinuousRecognitionWithPushStream", SpeechContinuousRecognitionWithPushStream },
+    { "1.7", "KeywordTriggeredSpeechRecognitionWithMicrophone", KeywordTriggeredSpeechRecognitionWithMicrophone },
+    { "1.8", "PronunciationAssessmentWithMicrophone", PronunciationAssessmentWithMicrophone },
+    { "1.9", "SpeechBatchRecognitionWithFiles", SpeechBatchRecognitionWithFiles },
+    { "1.A", "SpeechRecognitionWithRecognizerPool", SpeechRecognitionWithRecognizerPool },
+    { "1.B", "SpeechContinuousRecognitionWithResultSink", SpeechContinuousRecognitionWithResultSink },
+    { "1.C", "SpeechContinuousRecognitionWithLanguagePinning", SpeechContinuousRecognitionWithLanguagePinning },
+    { "1.D", "KeywordGatedSpeechRecognitionWithFeeds", KeywordGatedSpeechRecognitionWithFeeds },
+    { "1.E", "PronunciationAssessmentBatchWithManifest", PronunciationAssessmentBatchWithManifest },
+    { "1.F", "SpeechContinuousRecognitionWithSilenceTrimming", SpeechContinuousRecognitionWithSilenceTrimming },
+    { "1.G", "SpeechContinuousRecognitionWithConvertedAudio", SpeechContinuousRecognitionWithConvertedAudio },
+    { "1.H", "SpeechContinuousRecognitionWithoutBlockingThreads", SpeechContinuousRecognitionWithoutBlockingThreads },
+    { "1.I", "SpeechContinuousRecognitionWithCompletionQueue", SpeechContinuousRecognitionWithCompletionQueue },
+    { "1.J", "SpeechContinuousRecognitionWithMemoryAccounting", SpeechContinuousRecognitionWithMemoryAccounting },
+    { "1.K", "SpeechContinuousRecognitionWithPartialDeltas", SpeechContinuousRecognitionWithPartialDeltas },
+    { "1.L", "SpeechContinuousRecognitionWithCoalescedPartials", SpeechContinuousRecognitionWithCoalescedPartials },
+    { "1.M", "SpeechRecognitionWithTokenCache", SpeechRecognitionWithTokenCache },
+    { "1.N", "SpeechContinuousRecognitionWithCheckpoints", SpeechContinuousRecognitionWithCheckpoints },
+    { "1.O", "SpeechRecognitionWithSplitFile", SpeechRecognitionWithSplitFile },
+    { "1.P", "KeywordRecognitionWithSharedModel", KeywordRecognitionWithSharedModel },
+    { "1.Q", "SpeechRecognitionWithAlsaCapture", SpeechRecognitionWithAlsaCapture },
+    { "1.R", "SpeechContinuousRecognitionWithAudioArchive", SpeechContinuousRecognitionWithAudioArchive },
+    { "1.S", "SpeechBatchRecognitionWithWorkQueue", SpeechBatchRecognitionWithWorkQueue },
+    { "1.T", "SpeechRecognitionWithEndpointPools", SpeechRecognitionWithEndpointPools },
+    { "1.U", "SpeechRecognitionWithTracing", SpeechRecognitionWithTracing },
+    { "1.V", "SpeechRecognitionRecordAndReplay", SpeechRecognitionRecordAndReplay },
+    { "2.1", "IntentRecognitionWithMicrophone", IntentRecognitionWithMicrophone },
+    { "2.2", "IntentRecognitionWithLanguage", IntentRecognitionWithLanguage },
+    { "2.3", "IntentContinuousRecognitionWithFile", IntentContinuousRecognitionWithFile },
+    { "2.4", "IntentRecognitionWithLocalCache", IntentRecognitionWithLocalCache },
+    { "3.1", "TranslationWithMicrophone", TranslationWithMicrophone },
+    { "3.2", "TranslationContinuousRecognition", TranslationContinuousRecognition },
+    { "4.1", "SpeechSynthesisToSpeaker", SpeechSynthesisToSpeaker },
+    { "4.2", "SpeechSynthesisWithLanguage", SpeechSynthesisWithLanguage },
+    { "4.3", "SpeechSynthesisWithVoice", SpeechSynthesisWithVoice },
+    { "4.4", "SpeechSynthesisToWaveFile", SpeechSynthesisToWaveFile },
+    { "4.5", "SpeechSynthesisToMp3File", SpeechSynthesisToMp3File },
+    { "4.6", "SpeechSynthesisToPullAudioOutputStream", SpeechSynthesisToPullAudioOutputStream },
+    { "4.7", "SpeechSynthesisToPushAudioOutputStream", SpeechSynthesisToPushAudioOutputStream },
+    { "4.8", "SpeechSynthesisToResult", SpeechSynthesisToResult },
+    { "4.9", "SpeechSynthesisToAudioDataStream", SpeechSynthesisToAudioDataStream },
+    { "4.A", "SpeechSynthesisEvents", SpeechSynthesisEvents },
+    { "4.B", "SpeechSynthesisWordBoundaryEvent", SpeechSynthesisWordBoundaryEvent },
+    { "4.C", "SpeechSynthesisWithSourceLanguageAutoDetection", SpeechSynthesisWithSourceLanguageAutoDetection },
+    { "4.D", "SpeechSynthesisBatchToFiles", SpeechSynthesisBatchToFiles },
+    { "4.E", "SpeechSynthesisWithCache", SpeechSynthesisWithCache },
+    { "4.F", "SpeechSynthesisLongDocument", SpeechSynthesisLongDocument },
+    { "4.G", "SpeechSynthesisWordBoundaryCaptions", SpeechSynthesisWordBoundaryCaptions },
+    { "4.H", "SpeechSynthesisWithSsmlTemplate", SpeechSynthesisWithSsmlTemplate },
+    { "4.I", "SpeechSynthesisToHttpStream", SpeechSynthesisToHttpStream },
+    { "5.1", "ConversationWithPullAudioStream", ConversationWithPullAudioStream },
+    { "5.2", "ConversationWithPushAudioStream", ConversationWithPushAudioStream },
+    { "6.1", "SpeakerVerificationWithMicrophone", SpeakerVerificationWithMicrophone },
+    { "6.2", "SpeakerVerificationWithPushStream", SpeakerVerificationWithPushStream },
+    { "6.3", "SpeakerIdentificationWithPullStream", SpeakerIdentificationWithPullStream },
+    { "6.4", "SpeakerIdentificationWithMicrophone", SpeakerIdentificationWithMicrophone },
+    { "6.5", "SpeakerIdentificationWithShardedProfiles", SpeakerIdentificationWithShardedProfiles },
+    { "6.6", "SpeakerIdentificationWithSpeechRecognition", SpeakerIdentificationWithSpeechRecognition },
+    { "6.7", "SpeakerBulkEnrollment", SpeakerBulkEnrollment },
+};
 
 void SpeechSamples()
 {
@@ -59,6 +173,29 @@ void SpeechSamples()
         cout << "6.) Speech recognition using push stream input.\n";
         cout << "7.) Speech recognition using microphone with a keyword trigger.\n";
         cout << "8.) Pronunciation assessment using microphone input.\n";
+        cout << "9.) Batch speech recognition of a directory or manifest of WAV files.\n";
+        cout << "A.) Speech recognition using a pool of pre-warmed recognizers.\n";
+        cout << "B.) Speech continuous recognition handing results off through a result sink.\n";
+        cout << "C.) Continuous speech recognition with language auto detection pinned once stable.\n";
+        cout << "D.) Keyword-gated speech recognition of many audio feeds.\n";
+        cout << "E.) Batch pronunciation assessment of a manifest of WAV files.\n";
+        cout << "F.) Speech recognition from a push stream with long silences trimmed.\n";
+        cout << "G.) Speech continuous recognition from a file in any PCM format, converted to 16 kHz mono.\n";
+        cout << "H.) Speech continuous recognition of several sessions without blocking a thread per session.\n";
+        cout << "I.) Speech continuous recognition of several sessions completing through one queue.\n";
+        cout << "J.) Speech continuous recognition with the memory of each session accounted.\n";
+        cout << "K.) Speech continuous recognition of several streams with partial results as deltas.\n";
+        cout << "L.) Speech continuous recognition with file input and partial results coalesced.\n";
+        cout << "M.) Speech recognition with pooled recognizers using a cached, refreshed authorization token.\n";
+        cout << "N.) Speech continuous recognition from a long file, resuming from checkpoints.\n";
+        cout << "O.) Speech recognition of a long file split into segments recognized in parallel.\n";
+        cout << "P.) Keyword recognition startup of many feeds, with a model per feed and a shared model.\n";
+        cout << "Q.) Speech recognition using an ALSA capture device with low-latency buffering (Linux).\n";
+        cout << "R.) Speech continuous recognition with pull stream input, archiving the audio sent to a wav file.\n";
+        cout << "S.) Batch speech recognition spread over many machines through a shared work queue.\n";
+        cout << "T.) Speech recognition with recognizers pooled per endpoint.\n";
+        cout << "U.) Speech recognition and synthesis traced with OpenTelemetry spans.\n";
+        cout << "V.) Speech session recording, and offline replay through the client pipeline.\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -91,6 +228,97 @@ void SpeechSamples()
         case '8':
             PronunciationAssessmentWithMicrophone();
             break;
+        case '9':
+            SpeechBatchRecognitionWithFiles();
+            break;
+        case 'A':
+        case 'a':
+            SpeechRecognitionWithRecognizerPool();
+            break;
+        case 'B':
+        case 'b':
+            SpeechContinuousRecognitionWithResultSink();
+            break;
+        case 'C':
+        case 'c':
+            SpeechContinuousRecognitionWithLanguagePinning();
+            break;
+        case 'D':
+        case 'd':
+            KeywordGatedSpeechRecognitionWithFeeds();
+            break;
+        case 'E':
+        case 'e':
+            PronunciationAssessmentBatchWithManifest();
+            break;
+        case 'F':
+        case 'f':
+            SpeechContinuousRecognitionWithSilenceTrimming();
+            break;
+        case 'G':
+        case 'g':
+            SpeechContinuousRecognitionWithConvertedAudio();
+            break;
+        case 'H':
+        case 'h':
+            SpeechContinuousRecognitionWithoutBlockingThreads();
+            break;
+        case 'I':
+        case 'i':
+            SpeechContinuousRecognitionWithCompletionQueue();
+            break;
+        case 'J':
+        case 'j':
+            SpeechContinuousRecognitionWithMemoryAccounting();
+            break;
+        case 'K':
+        case 'k':
+            SpeechContinuousRecognitionWithPartialDeltas();
+            break;
+        case 'L':
+        case 'l':
+            SpeechContinuousRecognitionWithCoalescedPartials();
+            break;
+        case 'M':
+        case 'm':
+            SpeechRecognitionWithTokenCache();
+            break;
+        case 'N':
+        case 'n':
+            SpeechContinuousRecognitionWithCheckpoints();
+            break;
+        case 'O':
+        case 'o':
+            SpeechRecognitionWithSplitFile();
+            break;
+        case 'P':
+        case 'p':
+            KeywordRecognitionWithSharedModel();
+            break;
+        case 'Q':
+        case 'q':
+            SpeechRecognitionWithAlsaCapture();
+            break;
+        case 'R':
+        case 'r':
+            SpeechContinuousRecognitionWithAudioArchive();
+            break;
+        case 'S':
+        case 's':
+            SpeechBatchRecognitionWithWorkQueue();
+            break;
+        case 'T':
+        case 't':
+            SpeechRecognitionWithEndpointPools();
+            break;
+        case 'U':
+        case 'u':
+            SpeechRecognitionWithTracing();
+            break;
+        case 'V':
+        case 'v':
+            SpeechRecognitionRecordAndReplay();
+            break;
         case '0':
             break;
         }
@@ -106,6 +334,7 @@ void IntentSamples()
         cout << "1.) Intent recognition with microphone input.\n";
         cout << "2.) Intent recognition in the specified language.\n";
         cout << "3.) Intent continuous recognition with file input.\n";
+        cout << "4.) Intent recognition with a local cache in front of the service.\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -123,6 +352,9 @@ void IntentSamples()
         case '3':
             IntentContinuousRecognitionWithFile();
             break;
+        case '4':
+            IntentRecognitionWithLocalCache();
+            break;
         case '0':
             break;
         }
@@ -175,6 +407,12 @@ void SpeechSynthesisSamples()
         cout << "A.) Speech synthesis events.\n";
         cout << "B.) Speech synthesis word boundary event.\n";
         cout << "C.) Speech synthesis with source language auto detection\n";
+        cout << "D.) Batch speech synthesis of a manifest of texts to files.\n";
+        cout << "E.) Speech synthesis with a cache of synthesized audio.\n";
+        cout << "F.) Long document speech synthesis in parallel segments.\n";
+        cout << "G.) Speech synthesis with word boundary captions.\n";
+        cout << "H.) Speech synthesis of SSML templates with cached static segments.\n";
+        cout << "I.) Speech synthesis streamed to HTTP clients as chunked MP3.\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -222,6 +460,30 @@ void SpeechSynthesisSamples()
         case 'c':
             SpeechSynthesisWithSourceLanguageAutoDetection();
             break;
+        case 'D':
+        case 'd':
+            SpeechSynthesisBatchToFiles();
+            break;
+        case 'E':
+        case 'e':
+            SpeechSynthesisWithCache();
+            break;
+        case 'F':
+        case 'f':
+            SpeechSynthesisLongDocument();
+            break;
+        case 'G':
+        case 'g':
+            SpeechSynthesisWordBoundaryCaptions();
+            break;
+        case 'H':
+        case 'h':
+            SpeechSynthesisWithSsmlTemplate();
+            break;
+        case 'I':
+        case 'i':
+            SpeechSynthesisToHttpStream();
+            break;
         case '0':
             break;
         }
@@ -266,6 +528,9 @@ void SpeakerRecognitionSamples()
         cout << "2.) Speaker verification with push audio stream input.\n";
         cout << "3.) Speaker identification with pull audio stream input.\n";
         cout << "4.) Speaker identification with microphone input.\n";
+        cout << "5.) Speaker identification among sharded profiles.\n";
+        cout << "6.) Speaker identification and speech recognition from one read of the audio.\n";
+        cout << "7.) Bulk voice profile enrollment from a manifest.\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -290,6 +555,15 @@ void SpeakerRecognitionSamples()
             SpeakerIdentificationWithMicrophone();
             break;
 
+        case '5':
+            SpeakerIdentificationWithShardedProfiles();
+            break;
+        case '6':
+            SpeakerIdentificationWithSpeechRecognition();
+            break;
+        case '7':
+            SpeakerBulkEnrollment();
+            break;
         case '0':
             break;
         }
@@ -302,6 +576,37 @@ int wmain(int argc, wchar_t **argv)
 int main(int argc, char **argv)
 #endif
 {
+    // With options, e.g. --scenario, runs the samples without the menus; --list shows them.
+    if (argc > 1)
+    {
+        vector<string> arguments;
+        for (int i = 1; i < argc; i++)
+        {
+#ifdef _WIN32
+            auto size = WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, nullptr, 0, nullptr, nullptr);
+            string argument(size > 0 ? size - 1 : 0, '\0');
+            if (size > 1)
+            {
+                WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, &argument[0], size, nullptr, nullptr);
+            }
+            arguments.push_back(argument);
+#else
+            arguments.push_back(argv[i]);
+#endif
+        }
+
+        try
+        {
+            SampleRunner runner(scenarios, sizeof(scenarios) / sizeof(scenarios[0]));
+            return runner.Run(SampleRunner::ParseArguments(arguments));
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << endl;
+            return 2;
+        }
+    }
+
     string input;
     do
     {
@@ -0,0 +1,302 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include "wav_file_reader.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Reads the audio data of a wav file through a memory-mapped view of the file.
+// The RIFF header is parsed once when the file is opened. After that, Read() copies straight from the
+// mapped region without a system call, and ReadSpan() hands out slices of the region itself, so that
+// push stream callers can pass them to PushAudioInputStream::Write() without an intermediate buffer.
+class MappedWavFileReader final
+{
+public:
+
+    // Constructor that maps the file into memory and locates the audio data.
+    MappedWavFileReader(const std::string& audioFileName)
+    {
+        if (audioFileName.empty())
+        {
+            throw std::invalid_argument("Audio filename is empty");
+        }
+
+        MapFile(audioFileName);
+
+        try
+        {
+            // Get audio format and the location of the audio data from the file header.
+            GetFormatFromWavFile();
+        }
+        catch (...)
+        {
+            Close();
+            throw;
+        }
+    }
+
+    ~MappedWavFileReader()
+    {
+        Close();
+    }
+
+    MappedWavFileReader(const MappedWavFileReader&) = delete;
+    MappedWavFileReader& operator=(const MappedWavFileReader&) = delete;
+
+    // Copies no more than 'size' bytes of audio data to 'dataBuffer'.
+    // It has the same semantics as WavFileReader::Read(), so it can be used from a pull stream callback.
+    int Read(uint8_t* dataBuffer, uint32_t size)
+    {
+        uint8_t* data = nullptr;
+        auto available = ReadSpan(&data, size);
+        if (available > 0)
+        {
+            memcpy(dataBuffer, data, available);
+        }
+        // returns the number of bytes that have been read, or 0 to indicate that the stream reaches end.
+        return (int)available;
+    }
+
+    // Returns in 'data' a pointer to the next audio bytes in the mapped region, and advances the read position.
+    // The returned slice stays valid until Close() is called.
+    // It returns the number of bytes in the slice, no more than 'size', and 0 at the end of the audio data.
+    uint32_t ReadSpan(uint8_t** data, uint32_t size)
+    {
+        auto remaining = m_dataSize - m_position;
+        auto available = size < remaining ? size : remaining;
+        *data = m_dataBegin + m_position;
+        m_position += available;
+        return available;
+    }
+
+    // Gets the beginning of the audio data in the mapped region.
+    uint8_t* Data() const
+    {
+        return m_dataBegin;
+    }
+
+    // Gets the size of the audio data in bytes.
+    uint32_t Size() const
+    {
+        return m_dataSize;
+    }
+
+    // Gets the audio format parsed from the file header.
+    const WavFormat& GetFormat() const
+    {
+        return m_formatHeader;
+    }
+
+    // Gets the format tag of the samples: the format tag, or for WAVE_FORMAT_EXTENSIBLE that of its sub-format,
+    // e.g. 1 for integer PCM and 3 for IEEE float.
+    uint16_t GetSampleFormatTag() const
+    {
+        return m_sampleFormatTag;
+    }
+
+    // Gets the current read position, relative to the beginning of the audio data.
+    uint32_t Position() const
+    {
+        return m_position;
+    }
+
+    void Close()
+    {
+        if (m_view != nullptr)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_view);
+#else
+            munmap(m_view, m_viewSize);
+#endif
+            m_view = nullptr;
+        }
+        m_viewSize = 0;
+        m_dataBegin = nullptr;
+        m_dataSize = 0;
+        m_position = 0;
+    }
+
+private:
+    // Defines common constants for WAV format.
+    static constexpr uint16_t tagBufferSize = 4;
+    static constexpr uint16_t chunkTypeBufferSize = 4;
+    static constexpr uint16_t chunkSizeBufferSize = 4;
+
+    // Maps the whole file into memory.
+    // The view is copy-on-write, so the slices handed out are writable pointers as PushAudioInputStream::Write()
+    // expects, while the file itself is never modified.
+    void MapFile(const std::string& audioFileName)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(audioFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::invalid_argument("Failed to open the specified audio file.");
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > UINT32_MAX)
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Unexpected size of the audio file.");
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+        {
+            throw std::runtime_error("Failed to map the audio file.");
+        }
+
+        m_view = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+        if (m_view == nullptr)
+        {
+            throw std::runtime_error("Failed to map the audio file.");
+        }
+        m_viewSize = (size_t)fileSize.QuadPart;
+#else
+        int fd = open(audioFileName.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::invalid_argument("Failed to open the specified audio file.");
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0 || (uint64_t)fileStat.st_size > UINT32_MAX)
+        {
+            close(fd);
+            throw std::runtime_error("Unexpected size of the audio file.");
+        }
+
+        auto view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map the audio file.");
+        }
+
+        // Audio is consumed front to back, let the kernel read ahead aggressively.
+        madvise(view, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+
+        m_view = (uint8_t*)view;
+        m_viewSize = (size_t)fileStat.st_size;
+#endif
+    }
+
+    // Get format data and the data chunk location from the mapped wav file.
+    void GetFormatFromWavFile()
+    {
+        size_t offset = 0;
+        uint32_t chunkSize = 0;
+
+        // Checks the RIFF tag
+        if (m_viewSize < offset + tagBufferSize || memcmp(m_view + offset, "RIFF", tagBufferSize) != 0)
+        {
+            throw std::runtime_error("Invalid file header, tag 'RIFF' is expected.");
+        }
+        offset += tagBufferSize;
+
+        // The next is the RIFF chunk size, ignore now.
+        offset += chunkSizeBufferSize;
+
+        // Checks the 'WAVE' tag in the wave header.
+        if (m_viewSize < offset + chunkTypeBufferSize || memcmp(m_view + offset, "WAVE", chunkTypeBufferSize) != 0)
+        {
+            throw std::runtime_error("Invalid file header, tag 'WAVE' is expected.");
+        }
+        offset += chunkTypeBufferSize;
+
+        bool foundFormatChunk = false;
+        while (m_viewSize >= offset + chunkTypeBufferSize + chunkSizeBufferSize)
+        {
+            const uint8_t* chunkType = m_view + offset;
+            chunkSize = ReadChunkSize(m_view + offset + chunkTypeBufferSize);
+            offset += chunkTypeBufferSize + chunkSizeBufferSize;
+
+            auto remaining = m_viewSize - offset;
+            if (memcmp(chunkType, "fmt ", chunkTypeBufferSize) == 0)
+            {
+                // Reads format data.
+                if (chunkSize < sizeof(m_formatHeader) || remaining < sizeof(m_formatHeader))
+                {
+                    throw std::runtime_error("Unexpected end of file or error when reading audio file.");
+                }
+                memcpy(&m_formatHeader, m_view + offset, sizeof(m_formatHeader));
+                m_sampleFormatTag = m_formatHeader.FormatTag;
+
+                // The sub-format GUID of an extensible format starts with the format tag of the samples.
+                constexpr uint16_t formatTagExtensible = 0xFFFE;
+                constexpr size_t subFormatOffset = 24;
+                if (m_formatHeader.FormatTag == formatTagExtensible && chunkSize >= subFormatOffset + 2 && remaining >= subFormatOffset + 2)
+                {
+                    m_sampleFormatTag = (uint16_t)(m_view[offset + subFormatOffset] | (m_view[offset + subFormatOffset + 1] << 8));
+                }
+                foundFormatChunk = true;
+            }
+            else if (memcmp(chunkType, "data", chunkTypeBufferSize) == 0)
+            {
+                if (!foundFormatChunk)
+                {
+                    throw std::runtime_error("Did not find format chunk before data chunk.");
+                }
+                if (remaining == 0 && chunkSize > 0)
+                {
+                    throw std::runtime_error("Unexpected end of file, before any audio data can be read.");
+                }
+
+                // Streamed wav files may carry a placeholder size, in that case the data runs to the end of the file.
+                m_dataBegin = m_view + offset;
+                m_dataSize = (chunkSize == 0 || chunkSize > remaining) ? (uint32_t)remaining : chunkSize;
+                return;
+            }
+
+            // Skips the rest of the chunk, chunks are aligned to a word boundary.
+            size_t skip = (size_t)chunkSize + (chunkSize & 1);
+            if (skip > remaining)
+            {
+                break;
+            }
+            offset += skip;
+        }
+
+        throw std::runtime_error("Did not find data chunk.");
+    }
+
+    static uint32_t ReadChunkSize(const uint8_t* chunkSizeBuffer)
+    {
+        // chunk size is little endian
+        return ((uint32_t)chunkSizeBuffer[3] << 24) |
+            ((uint32_t)chunkSizeBuffer[2] << 16) |
+            ((uint32_t)chunkSizeBuffer[1] << 8) |
+            (uint32_t)chunkSizeBuffer[0];
+    }
+
+    WavFormat m_formatHeader;
+    uint16_t m_sampleFormatTag = 0;
+
+private:
+    uint8_t* m_view = nullptr;
+    size_t m_viewSize = 0;
+    uint8_t* m_dataBegin = nullptr;
+    uint32_t m_dataSize = 0;
+    uint32_t m_position = 0;
+};
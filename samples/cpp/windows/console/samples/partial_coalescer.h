@@ -0,0 +1,166 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+// When a partial result is let through.
+struct PartialCoalescerOptions
+{
+    // At most one partial per interval, e.g. 200 ms for a UI that renders 5 updates a second.
+    std::chrono::milliseconds MinInterval{ 200 };
+
+    // Or as soon as this many characters changed since the last partial let through, 0 for no such limit.
+    size_t MinNewCharacters = 0;
+};
+
+struct PartialCoalescerStatistics
+{
+    uint64_t Received = 0;      // Recognizing events.
+    uint64_t Emitted = 0;       // partials let through.
+    uint64_t Suppressed = 0;    // partials never let through, replaced by a later one or by the final result.
+    uint64_t Finals = 0;        // Recognized results, always let through.
+};
+
+// Coalesces the Recognizing partials of a recognizer, so that a consumer across e.g. an IPC boundary gets at most one
+// per interval, or per so many new characters, instead of each of them. The Recognized result always goes through,
+// and replaces the partial held back, if any. As it runs in the event handlers, without a timer, a partial held back
+// goes when the next event comes, which for a session that is recognizing is soon.
+class PartialCoalescer final
+{
+public:
+    // Gets the text of a partial, or of the final result with 'isFinal'.
+    using Callback = std::function<void(const std::string& text, bool isFinal)>;
+
+    PartialCoalescer(PartialCoalescerOptions options, Callback callback)
+        : m_options(options), m_callback(std::move(callback))
+    {
+        if (!m_callback || options.MinInterval.count() < 0)
+        {
+            throw std::invalid_argument("A callback and an interval that is not negative are required");
+        }
+    }
+
+    PartialCoalescer(const PartialCoalescer&) = delete;
+    PartialCoalescer& operator=(const PartialCoalescer&) = delete;
+
+    // Creates a coalescer over the Recognizing and Recognized events of 'recognizer'.
+    template <class Recognizer>
+    static std::shared_ptr<PartialCoalescer> Attach(Recognizer& recognizer, PartialCoalescerOptions options, Callback callback)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto coalescer = std::make_shared<PartialCoalescer>(options, std::move(callback));
+        std::weak_ptr<PartialCoalescer> weak = coalescer;
+        recognizer.Recognizing.Connect([weak](const auto& e)
+        {
+            if (auto coalescer = weak.lock())
+            {
+                coalescer->OnRecognizing(e.Result->Text);
+            }
+        });
+        recognizer.Recognized.Connect([weak](const auto& e)
+        {
+            auto coalescer = weak.lock();
+            if (coalescer != nullptr && e.Result->Reason != ResultReason::NoMatch)
+            {
+                coalescer->OnRecognized(e.Result->Text);
+            }
+        });
+        return coalescer;
+    }
+
+    // Lets the partial through if the interval elapsed or enough characters changed, else holds it back.
+    void OnRecognizing(const std::string& text)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_statistics.Received++;
+        auto now = std::chrono::steady_clock::now();
+        bool due = !m_emittedAny || now - m_lastEmit >= m_options.MinInterval
+            || (m_options.MinNewCharacters > 0 && NewCharacters(m_lastText, text) >= m_options.MinNewCharacters);
+        if (!due)
+        {
+            if (m_held)
+            {
+                m_statistics.Suppressed++;
+            }
+            m_held = true;
+            return;
+        }
+
+        if (m_held)
+        {
+            m_statistics.Suppressed++;
+            m_held = false;
+        }
+        m_statistics.Emitted++;
+        m_emittedAny = true;
+        m_lastEmit = now;
+        m_lastText = text;
+        lock.unlock();
+        m_callback(text, false);
+    }
+
+    // Lets the final result through, dropping the partial held back, and starts the next utterance.
+    void OnRecognized(const std::string& text)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_held)
+        {
+            m_statistics.Suppressed++;
+            m_held = false;
+        }
+        m_statistics.Finals++;
+        m_lastText.clear();
+
+        // The first partial of the next utterance goes through right away.
+        m_emittedAny = false;
+        lock.unlock();
+        m_callback(text, true);
+    }
+
+    PartialCoalescerStatistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+
+private:
+    // Counts the UTF-8 characters of 'text' after the prefix it shares with 'previous'.
+    static size_t NewCharacters(const std::string& previous, const std::string& text)
+    {
+        size_t common = 0;
+        while (common < previous.size() && common < text.size() && previous[common] == text[common])
+        {
+            common++;
+        }
+        size_t characters = 0;
+        for (auto i = common; i < text.size(); i++)
+        {
+            if (((unsigned char)text[i] & 0xC0) != 0x80)
+            {
+                characters++;
+            }
+        }
+        return characters;
+    }
+
+    const PartialCoalescerOptions m_options;
+    const Callback m_callback;
+
+    mutable std::mutex m_mutex;
+    PartialCoalescerStatistics m_statistics;
+    bool m_emittedAny = false;
+    bool m_held = false;
+    std::chrono::steady_clock::time_point m_lastEmit;
+    std::string m_lastText;
+};
@@ -0,0 +1,203 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A view of text owned by an arena, valid until the arena is reset.
+struct TextSpan
+{
+    const char* Data = nullptr;
+    size_t Size = 0;
+
+    std::string ToString() const
+    {
+        return std::string(Data != nullptr ? Data : "", Size);
+    }
+};
+
+// A monotonic buffer: allocations bump a pointer and are only freed all at once by Reset(), which keeps the largest
+// chunk for the next round, so that once it has grown to what a round needs a round allocates nothing.
+// It is not thread safe: each session owns one, used by its event thread, so sessions do not contend on the allocator.
+class MonotonicArena final
+{
+public:
+    explicit MonotonicArena(size_t initialCapacity = 4096)
+        : m_initialCapacity(initialCapacity)
+    {
+        if (initialCapacity == 0)
+        {
+            throw std::invalid_argument("The initial capacity must be positive");
+        }
+    }
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    // Allocates 'size' bytes, unaligned, for text.
+    char* Allocate(size_t size)
+    {
+        if (m_chunks.empty() || m_chunks.back().Capacity - m_used < size)
+        {
+            auto capacity = m_chunks.empty() ? m_initialCapacity : m_chunks.back().Capacity * 2;
+            while (capacity < size)
+            {
+                capacity *= 2;
+            }
+            m_chunks.push_back({ std::unique_ptr<char[]>(new char[capacity]), capacity });
+            m_used = 0;
+        }
+        auto block = m_chunks.back().Data.get() + m_used;
+        m_used += size;
+        return block;
+    }
+
+    // Grows the last allocation, 'block' of 'size' bytes, by 'extra' bytes in place. Returns false if it does not fit,
+    // or if 'block' is not the last allocation.
+    bool TryExtend(const char* block, size_t size, size_t extra)
+    {
+        if (m_chunks.empty() || block + size != m_chunks.back().Data.get() + m_used || m_chunks.back().Capacity - m_used < extra)
+        {
+            return false;
+        }
+        m_used += extra;
+        return true;
+    }
+
+    // Frees all the allocations.
+    void Reset()
+    {
+        if (m_chunks.size() > 1)
+        {
+            // The last chunk is the largest.
+            auto largest = std::move(m_chunks.back());
+            m_chunks.clear();
+            m_chunks.push_back(std::move(largest));
+        }
+        m_used = 0;
+    }
+
+    // Gets the bytes held, whether allocated or not.
+    size_t GetCapacity() const
+    {
+        size_t capacity = 0;
+        for (const auto& chunk : m_chunks)
+        {
+            capacity += chunk.Capacity;
+        }
+        return capacity;
+    }
+
+private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> Data;
+        size_t Capacity;
+    };
+
+    const size_t m_initialCapacity;
+    std::vector<Chunk> m_chunks;
+    size_t m_used = 0;
+};
+
+// How a result changed the text of the utterance: drop the last 'Removed' bytes of the previous partial, keep the
+// 'Kept' bytes before them, and append 'Appended'. 'Appended' is valid until the next call of the PartialResultTracker.
+struct PartialDelta
+{
+    size_t Kept = 0;
+    size_t Removed = 0;
+    TextSpan Appended;
+    bool Final = false;
+};
+
+// Turns the Recognizing partials of a session into deltas from the previous partial, e.g. to update a caption or send
+// only the changed suffix downstream, instead of copying the whole text of every partial, dozens a second per stream.
+// The current partial is kept in an arena, in place when it only grows, and the arena is reset at each Recognized.
+// Use one per session, from its event handlers, which the SDK calls one at a time.
+class PartialResultTracker final
+{
+public:
+    explicit PartialResultTracker(size_t initialCapacity = 4096)
+        : m_arena(initialCapacity)
+    {
+    }
+
+    // Gets the delta of a Recognizing partial.
+    PartialDelta OnRecognizing(const std::string& text)
+    {
+        auto delta = Diff(text);
+        Store(text, delta.Kept);
+        delta.Appended = { m_current.Data + delta.Kept, m_current.Size - delta.Kept };
+        return delta;
+    }
+
+    // Gets the delta of the Recognized text from the last partial, and starts the next utterance.
+    // The final text is not copied, 'Appended' points into 'text'.
+    PartialDelta OnRecognized(const std::string& text)
+    {
+        auto delta = Diff(text);
+        delta.Appended = { text.data() + delta.Kept, text.size() - delta.Kept };
+        delta.Final = true;
+        m_current = TextSpan();
+        m_arena.Reset();
+        return delta;
+    }
+
+    // Gets the current partial, empty after Recognized.
+    TextSpan GetCurrent() const
+    {
+        return m_current;
+    }
+
+    size_t GetArenaCapacity() const
+    {
+        return m_arena.GetCapacity();
+    }
+
+private:
+    PartialDelta Diff(const std::string& text) const
+    {
+        size_t common = 0;
+        auto limit = m_current.Size < text.size() ? m_current.Size : text.size();
+        while (common < limit && m_current.Data[common] == text[common])
+        {
+            common++;
+        }
+
+        // Keeps a UTF-8 character whole, in the kept or in the appended text.
+        while (common > 0 && common < text.size() && ((unsigned char)text[common] & 0xC0) == 0x80)
+        {
+            common--;
+        }
+
+        PartialDelta delta;
+        delta.Kept = common;
+        delta.Removed = m_current.Size - common;
+        return delta;
+    }
+
+    void Store(const std::string& text, size_t kept)
+    {
+        // A partial that only adds to the previous one, the usual case, is appended in place.
+        if (m_current.Data != nullptr && kept == m_current.Size && m_arena.TryExtend(m_current.Data, m_current.Size, text.size() - kept))
+        {
+            std::memcpy(const_cast<char*>(m_current.Data) + kept, text.data() + kept, text.size() - kept);
+            m_current.Size = text.size();
+            return;
+        }
+
+        auto block = m_arena.Allocate(text.size() == 0 ? 1 : text.size());
+        std::memcpy(block, text.data(), text.size());
+        m_current = { block, text.size() };
+    }
+
+    MonotonicArena m_arena;
+    TextSpan m_current;
+};
@@ -0,0 +1,477 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mapped_wav_file_reader.h"
+#include "wav_file_reader.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PCM_FORMAT_CONVERTER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PCM_FORMAT_CONVERTER_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PCM_FORMAT_CONVERTER_NEON
+#endif
+
+// Converts PCM audio of any common layout to 16-bit mono at the rate the speech service expects, 16 kHz by default:
+// 8, 16, 24 or 32-bit integer or 32-bit float samples, any number of channels, any sample rate. The channels are
+// averaged, and the rate is changed by a polyphase windowed-sinc resampler, in float. The output is delayed by nothing:
+// the filter's own delay is skipped at the start and drained at the end, so that the offsets of the results stay in
+// the time base of the input. The conversions to and from float and the filter use AVX2, SSE2 or NEON where the build
+// targets them; it processes whole blocks of frames, a block per call.
+class PcmFormatConverter final
+{
+public:
+    // Defines the format tags of the samples.
+    static constexpr uint16_t formatTagPcm = 0x0001;
+    static constexpr uint16_t formatTagFloat = 0x0003;
+
+    // Constructor for input in 'format', whose samples are integers or floats as told by 'sampleFormatTag'.
+    PcmFormatConverter(const WavFormat& format, uint16_t sampleFormatTag, uint32_t outputSamplesPerSec = 16000)
+        : m_input(format), m_isFloat(sampleFormatTag == formatTagFloat)
+    {
+        auto bits = format.BitsPerSample;
+        if (sampleFormatTag != formatTagPcm && sampleFormatTag != formatTagFloat)
+        {
+            throw std::invalid_argument("Unsupported wav format, only integer PCM and float samples are supported.");
+        }
+        if ((m_isFloat && bits != 32) || (!m_isFloat && bits != 8 && bits != 16 && bits != 24 && bits != 32))
+        {
+            throw std::invalid_argument("Unsupported sample size of " + std::to_string(bits) + " bits.");
+        }
+        if (format.Channels == 0 || format.BlockAlign != format.Channels * bits / 8 || format.SamplesPerSec == 0 || outputSamplesPerSec == 0)
+        {
+            throw std::invalid_argument("Invalid wav format.");
+        }
+
+        m_output = WavFormat{ formatTagPcm, 1, outputSamplesPerSec, outputSamplesPerSec * 2, 2, 16 };
+        DesignFilter(format.SamplesPerSec, outputSamplesPerSec);
+    }
+
+    PcmFormatConverter(const PcmFormatConverter&) = delete;
+    PcmFormatConverter& operator=(const PcmFormatConverter&) = delete;
+
+    // Gets the format of the output, 16-bit mono PCM.
+    const WavFormat& GetFormat() const
+    {
+        return m_output;
+    }
+
+    // Converts 'frames' whole frames of input, and appends the samples they complete to 'output'.
+    void Convert(const uint8_t* data, size_t frames, std::vector<int16_t>& output)
+    {
+        m_inputFrames += frames;
+        Decode(data, frames);
+        Resample(output);
+    }
+
+    // Appends the last samples, those still in the filter, at the end of the input.
+    void Flush(std::vector<int16_t>& output)
+    {
+        m_history.insert(m_history.end(), m_tapsPerPhase + 1, 0.0f);
+        Resample(output);
+    }
+
+private:
+    // Defines the zero crossings of the sinc on each side of the center, at the lower of the two rates.
+    static constexpr uint32_t zeroCrossings = 16;
+
+    // Defines the cutoff as a fraction of the lower Nyquist frequency, leaving room for the transition band.
+    static constexpr double rolloff = 0.9;
+
+    static constexpr double pi = 3.14159265358979323846;
+
+    static uint32_t Gcd(uint32_t a, uint32_t b)
+    {
+        while (b != 0)
+        {
+            auto r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+
+    // Designs the prototype low-pass filter at the upsampled rate, input rate times L, and splits it into L phases.
+    void DesignFilter(uint32_t inputRate, uint32_t outputRate)
+    {
+        auto gcd = Gcd(inputRate, outputRate);
+        m_up = outputRate / gcd;
+        m_down = inputRate / gcd;
+        if (m_up == m_down)
+        {
+            // The rate is kept, the filter is a single tap of one.
+            m_phases.assign(1, 1.0f);
+            m_history.clear();
+            m_time = 0;
+            return;
+        }
+
+        auto factor = m_up > m_down ? m_up : m_down;
+        m_tapsPerPhase = 2 * zeroCrossings * (factor + m_up - 1) / m_up;
+        auto length = (size_t)m_tapsPerPhase * m_up;
+        auto cutoff = rolloff * 0.5 / factor;
+
+        // An odd number of taps puts the center on a sample, so that the delay is a whole number of samples.
+        // The prototype is padded with a zero to a multiple of L.
+        auto taps = length % 2 == 0 ? length - 1 : length;
+        auto center = (taps - 1) / 2;
+
+        std::vector<double> prototype(length, 0.0);
+        double sum = 0;
+        for (size_t i = 0; i < taps; i++)
+        {
+            auto x = (double)i - (double)center;
+            auto sinc = x == 0 ? 2 * cutoff : sin(2 * pi * cutoff * x) / (pi * x);
+            auto window = 0.42 - 0.5 * cos(2 * pi * i / (taps - 1)) + 0.08 * cos(4 * pi * i / (taps - 1));
+            prototype[i] = sinc * window;
+            sum += prototype[i];
+        }
+
+        // Each phase keeps the dc gain at one. Its taps are reversed, so that a dot product with the input in time order applies it.
+        m_phases.resize(length);
+        for (uint32_t phase = 0; phase < m_up; phase++)
+        {
+            for (uint32_t k = 0; k < m_tapsPerPhase; k++)
+            {
+                m_phases[(size_t)phase * m_tapsPerPhase + (m_tapsPerPhase - 1 - k)] = (float)(prototype[phase + (size_t)k * m_up] * m_up / sum);
+            }
+        }
+
+        // The history starts with the filter's span of silence, and the output with the filter's delay skipped.
+        m_history.assign(m_tapsPerPhase - 1, 0.0f);
+        m_time = (m_tapsPerPhase - 1) * (uint64_t)m_up + center;
+    }
+
+    // Converts the frames to float mono, appended to the history.
+    void Decode(const uint8_t* data, size_t frames)
+    {
+        auto channels = m_input.Channels;
+        auto samples = frames * channels;
+        if (channels == 1)
+        {
+            auto size = m_history.size();
+            m_history.resize(size + frames);
+            ToFloat(data, samples, m_history.data() + size);
+            return;
+        }
+
+        m_scratch.resize(samples);
+        ToFloat(data, samples, m_scratch.data());
+        auto size = m_history.size();
+        m_history.resize(size + frames);
+        auto output = m_history.data() + size;
+        auto scale = 1.0f / channels;
+        const float* input = m_scratch.data();
+        for (size_t frame = 0; frame < frames; frame++)
+        {
+            float sum = 0;
+            for (uint16_t channel = 0; channel < channels; channel++)
+            {
+                sum += input[channel];
+            }
+            output[frame] = sum * scale;
+            input += channels;
+        }
+    }
+
+    // Converts samples to floats in [-1, 1).
+    void ToFloat(const uint8_t* data, size_t samples, float* output) const
+    {
+        size_t i = 0;
+        switch (m_input.BitsPerSample)
+        {
+        case 8:
+            for (; i < samples; i++)
+            {
+                output[i] = ((int)data[i] - 128) * (1.0f / 128);
+            }
+            break;
+        case 16:
+        {
+            auto input = reinterpret_cast<const int16_t*>(data);
+#if defined(PCM_FORMAT_CONVERTER_AVX2)
+            const auto scale = _mm256_set1_ps(1.0f / 32768);
+            for (; i + 8 <= samples; i += 8)
+            {
+                auto integers = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)));
+                _mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_cvtepi32_ps(integers), scale));
+            }
+#elif defined(PCM_FORMAT_CONVERTER_SSE2)
+            const auto scale = _mm_set1_ps(1.0f / 32768);
+            for (; i + 8 <= samples; i += 8)
+            {
+                auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+
+                // Sign-extends by interleaving each sample above a zero and shifting it back down.
+                auto low = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), values), 16);
+                auto high = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), values), 16);
+                _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+                _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+            }
+#elif defined(PCM_FORMAT_CONVERTER_NEON)
+            for (; i + 8 <= samples; i += 8)
+            {
+                auto values = vld1q_s16(input + i);
+                vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(values))), 1.0f / 32768));
+                vst1q_f32(output + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(values))), 1.0f / 32768));
+            }
+#endif
+            for (; i < samples; i++)
+            {
+                output[i] = input[i] * (1.0f / 32768);
+            }
+            break;
+        }
+        case 24:
+            // Packed little endian; the three bytes are placed at the top of an int32 to sign-extend them.
+            for (; i < samples; i++)
+            {
+                auto p = data + i * 3;
+                auto value = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+                output[i] = (float)(value >> 8) * (1.0f / 8388608);
+            }
+            break;
+        case 32:
+            if (m_isFloat)
+            {
+                memcpy(output, data, samples * sizeof(float));
+            }
+            else
+            {
+                auto input = reinterpret_cast<const int32_t*>(data);
+                for (; i < samples; i++)
+                {
+                    output[i] = (float)((double)input[i] * (1.0 / 2147483648.0));
+                }
+            }
+            break;
+        }
+    }
+
+    // Computes the output samples whose filter span is in the history, and drops the history no longer needed.
+    // Output sample n is at time n * M of the upsampled rate; its phase is that time modulo L.
+    void Resample(std::vector<int16_t>& output)
+    {
+        auto available = m_history.size();
+        for (;;)
+        {
+            auto last = (size_t)(m_time / m_up);
+            if (last >= available)
+            {
+                break;
+            }
+            auto phase = (uint32_t)(m_time % m_up);
+            m_samples.push_back(Dot(m_phases.data() + (size_t)phase * m_tapsPerPhase, m_history.data() + last + 1 - m_tapsPerPhase, m_tapsPerPhase));
+            m_time += m_down;
+        }
+
+        // The output of the flush stops at the length of the input at the output rate.
+        auto expected = (m_inputFrames * m_up + m_down - 1) / m_down;
+        if (m_outputFrames + m_samples.size() > expected)
+        {
+            m_samples.resize((size_t)(expected - m_outputFrames));
+        }
+        if (!m_samples.empty())
+        {
+            auto size = output.size();
+            output.resize(size + m_samples.size());
+            ToInt16(m_samples.data(), m_samples.size(), output.data() + size);
+            m_outputFrames += m_samples.size();
+            m_samples.clear();
+        }
+
+        auto first = (size_t)(m_time / m_up);
+        auto keep = first + 1 >= m_tapsPerPhase ? first + 1 - m_tapsPerPhase : 0;
+        keep = keep < available ? keep : available;
+        if (keep > 0)
+        {
+            m_history.erase(m_history.begin(), m_history.begin() + keep);
+            m_time -= (uint64_t)keep * m_up;
+        }
+    }
+
+    static float Dot(const float* taps, const float* input, size_t count)
+    {
+        size_t i = 0;
+        float sum = 0;
+#if defined(PCM_FORMAT_CONVERTER_AVX2)
+        auto sums = _mm256_setzero_ps();
+        for (; i + 8 <= count; i += 8)
+        {
+            sums = _mm256_add_ps(sums, _mm256_mul_ps(_mm256_loadu_ps(taps + i), _mm256_loadu_ps(input + i)));
+        }
+        auto half = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        sum = _mm_cvtss_f32(half);
+#elif defined(PCM_FORMAT_CONVERTER_SSE2)
+        auto sums = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4)
+        {
+            sums = _mm_add_ps(sums, _mm_mul_ps(_mm_loadu_ps(taps + i), _mm_loadu_ps(input + i)));
+        }
+        sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+        sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+        sum = _mm_cvtss_f32(sums);
+#elif defined(PCM_FORMAT_CONVERTER_NEON)
+        auto sums = vdupq_n_f32(0);
+        for (; i + 4 <= count; i += 4)
+        {
+            sums = vmlaq_f32(sums, vld1q_f32(taps + i), vld1q_f32(input + i));
+        }
+        sum = vaddvq_f32(sums);
+#endif
+        for (; i < count; i++)
+        {
+            sum += taps[i] * input[i];
+        }
+        return sum;
+    }
+
+    // Converts floats to 16-bit samples, rounded to nearest and saturated.
+    static void ToInt16(const float* input, size_t count, int16_t* output)
+    {
+        size_t i = 0;
+#if defined(PCM_FORMAT_CONVERTER_AVX2)
+        const auto scale = _mm256_set1_ps(32768.0f);
+        const auto lowest = _mm256_set1_ps(-32768.0f);
+        const auto highest = _mm256_set1_ps(32767.0f);
+        for (; i + 16 <= count; i += 16)
+        {
+            auto first = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i), scale), lowest), highest));
+            auto second = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i + 8), scale), lowest), highest));
+
+            // Packing works within 128-bit lanes, the permutation puts the eight samples of each input back in order.
+            auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(first, second), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), packed);
+        }
+#elif defined(PCM_FORMAT_CONVERTER_SSE2)
+        const auto scale = _mm_set1_ps(32768.0f);
+        const auto lowest = _mm_set1_ps(-32768.0f);
+        const auto highest = _mm_set1_ps(32767.0f);
+        for (; i + 8 <= count; i += 8)
+        {
+            auto first = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i), scale), lowest), highest));
+            auto second = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i + 4), scale), lowest), highest));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(first, second));
+        }
+#elif defined(PCM_FORMAT_CONVERTER_NEON)
+        for (; i + 8 <= count; i += 8)
+        {
+            auto first = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(input + i), 32768.0f));
+            auto second = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(input + i + 4), 32768.0f));
+            vst1q_s16(output + i, vcombine_s16(vqmovn_s32(first), vqmovn_s32(second)));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            auto value = input[i] * 32768.0f;
+            value = value < -32768.0f ? -32768.0f : (value > 32767.0f ? 32767.0f : value);
+            output[i] = (int16_t)lrintf(value);
+        }
+    }
+
+    const WavFormat m_input;
+    const bool m_isFloat;
+    WavFormat m_output;
+
+    uint32_t m_up = 1;                  // L, the upsampling factor.
+    uint32_t m_down = 1;                // M, the downsampling factor.
+    uint32_t m_tapsPerPhase = 1;
+    std::vector<float> m_phases;        // L phases of 'm_tapsPerPhase' reversed taps.
+
+    std::vector<float> m_history;       // the mono input from the start of the filter span of the next output sample.
+    std::vector<float> m_scratch;
+    std::vector<float> m_samples;
+    uint64_t m_time = 0;                // of the next output sample, at the upsampled rate, relative to the history.
+    uint64_t m_inputFrames = 0;
+    uint64_t m_outputFrames = 0;
+};
+
+// Reads a wav file of any PCM layout as 16-bit mono audio at 16 kHz, converted by a PcmFormatConverter in blocks.
+// It has the same Read() semantics as WavFileReader, so it can be used from a pull stream callback or a push loop.
+class ConvertingWavReader final
+{
+public:
+    // Defines the number of input frames converted at a time.
+    static constexpr uint32_t blockFrames = 8192;
+
+    ConvertingWavReader(const std::string& audioFileName, uint32_t outputSamplesPerSec = 16000)
+        : m_reader(audioFileName), m_converter(m_reader.GetFormat(), m_reader.GetSampleFormatTag(), outputSamplesPerSec)
+    {
+    }
+
+    ConvertingWavReader(const ConvertingWavReader&) = delete;
+    ConvertingWavReader& operator=(const ConvertingWavReader&) = delete;
+
+    // Copies no more than 'size' bytes of converted audio to 'dataBuffer', in whole samples.
+    // It returns the number of bytes copied, or 0 at the end of the audio.
+    int Read(uint8_t* dataBuffer, uint32_t size)
+    {
+        size_t wanted = size / 2;
+        while (m_samples.size() - m_position < wanted && !m_flushed)
+        {
+            ConvertBlock();
+        }
+
+        auto available = m_samples.size() - m_position;
+        auto count = wanted < available ? wanted : available;
+        memcpy(dataBuffer, m_samples.data() + m_position, count * 2);
+        m_position += count;
+        return (int)(count * 2);
+    }
+
+    void Close()
+    {
+        m_reader.Close();
+    }
+
+    // Gets the format of the converted audio.
+    const WavFormat& GetFormat() const
+    {
+        return m_converter.GetFormat();
+    }
+
+    // Gets the format of the file.
+    const WavFormat& GetInputFormat() const
+    {
+        return m_reader.GetFormat();
+    }
+
+private:
+    void ConvertBlock()
+    {
+        // Drops the samples already read, before the next block is appended.
+        m_samples.erase(m_samples.begin(), m_samples.begin() + m_position);
+        m_position = 0;
+
+        uint8_t* data = nullptr;
+        auto blockAlign = m_reader.GetFormat().BlockAlign;
+        auto size = m_reader.ReadSpan(&data, blockFrames * blockAlign);
+        if (size < blockAlign)
+        {
+            m_converter.Flush(m_samples);
+            m_flushed = true;
+            return;
+        }
+        m_converter.Convert(data, size / blockAlign, m_samples);
+    }
+
+    MappedWavFileReader m_reader;
+    PcmFormatConverter m_converter;
+    std::vector<int16_t> m_samples;
+    size_t m_position = 0;
+    bool m_flushed = false;
+};
@@ -0,0 +1,574 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "json_scanner.h"
+#include "latency_histogram.h"
+#include "mapped_wav_file_reader.h"
+#include "push_audio_feeder.h"
+#include "recognizer_pool.h"
+#include "session_completion.h"
+#include "worker_pool.h"
+
+// One recording to score, and the text the speaker was asked to read.
+struct PronunciationJob
+{
+    std::string AudioPath;
+    std::string ReferenceText;
+};
+
+// Reads a pronunciation manifest, a text file with one "<wav path><TAB><reference text>" entry per line.
+// Empty lines and lines starting with '#' are skipped.
+inline std::vector<PronunciationJob> ReadPronunciationManifest(const std::string& path)
+{
+    std::ifstream manifest(path);
+    if (!manifest.good())
+    {
+        throw std::invalid_argument("Failed to open the specified manifest file.");
+    }
+
+    std::vector<PronunciationJob> jobs;
+    std::string line;
+    while (getline(manifest, line))
+    {
+        // Tolerates manifests with Windows line endings.
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        auto tab = line.find('\t');
+        if (tab == std::string::npos || tab == 0 || tab + 1 == line.size())
+        {
+            throw std::invalid_argument("Malformed manifest line, expected <wav path><TAB><reference text>: " + line);
+        }
+        jobs.push_back(PronunciationJob{ line.substr(0, tab), line.substr(tab + 1) });
+    }
+    return jobs;
+}
+
+// Defines the outcome of scoring one recording.
+enum class PronunciationStatus : uint8_t
+{
+    Scored = 0,
+    NoMatch = 1,
+    Failed = 2              // canceled, or the recording couldn't be read.
+};
+
+// Writes the scores of a batch to a file in blocks of columns, so that millions of rows take 21 bytes each and only
+// one block is held in memory. Each block is:
+//   "PAS1", uint32 row count, uint32 job index[rows], uint8 status[rows],
+//   float accuracy[rows], float pronunciation[rows], float completeness[rows], float fluency[rows]
+// in the byte order of the machine. The rows are in completion order, the job index refers to the input.
+// It is not thread safe, callers serialize access.
+class PronunciationScoreWriter final
+{
+public:
+    // Defines the default number of rows per block.
+    static constexpr size_t defaultBlockRows = 4096;
+
+    PronunciationScoreWriter(const std::string& path, size_t blockRows = defaultBlockRows)
+        : m_file(path, std::ios::binary | std::ios::trunc), m_blockRows(blockRows)
+    {
+        if (!m_file.good())
+        {
+            throw std::invalid_argument("Failed to open the score file " + path);
+        }
+        if (blockRows == 0)
+        {
+            throw std::invalid_argument("Block rows must be positive");
+        }
+        Reserve();
+    }
+
+    ~PronunciationScoreWriter()
+    {
+        Flush();
+    }
+
+    PronunciationScoreWriter(const PronunciationScoreWriter&) = delete;
+    PronunciationScoreWriter& operator=(const PronunciationScoreWriter&) = delete;
+
+    void Add(uint32_t jobIndex, PronunciationStatus status, float accuracy, float pronunciation, float completeness, float fluency)
+    {
+        m_jobIndexes.push_back(jobIndex);
+        m_statuses.push_back((uint8_t)status);
+        m_accuracy.push_back(accuracy);
+        m_pronunciation.push_back(pronunciation);
+        m_completeness.push_back(completeness);
+        m_fluency.push_back(fluency);
+        m_rows++;
+        if (m_jobIndexes.size() == m_blockRows)
+        {
+            Flush();
+        }
+    }
+
+    // Writes the rows added since the last block.
+    void Flush()
+    {
+        if (m_jobIndexes.empty())
+        {
+            return;
+        }
+
+        auto rows = (uint32_t)m_jobIndexes.size();
+        m_file.write("PAS1", 4);
+        m_file.write((const char*)&rows, sizeof(rows));
+        WriteColumn(m_jobIndexes);
+        WriteColumn(m_statuses);
+        WriteColumn(m_accuracy);
+        WriteColumn(m_pronunciation);
+        WriteColumn(m_completeness);
+        WriteColumn(m_fluency);
+        m_file.flush();
+
+        m_jobIndexes.clear();
+        m_statuses.clear();
+        m_accuracy.clear();
+        m_pronunciation.clear();
+        m_completeness.clear();
+        m_fluency.clear();
+    }
+
+    // Gets the number of rows added.
+    uint64_t GetRowCount() const
+    {
+        return m_rows;
+    }
+
+private:
+    void Reserve()
+    {
+        m_jobIndexes.reserve(m_blockRows);
+        m_statuses.reserve(m_blockRows);
+        m_accuracy.reserve(m_blockRows);
+        m_pronunciation.reserve(m_blockRows);
+        m_completeness.reserve(m_blockRows);
+        m_fluency.reserve(m_blockRows);
+    }
+
+    template<typename T>
+    void WriteColumn(const std::vector<T>& column)
+    {
+        m_file.write((const char*)column.data(), (std::streamsize)(column.size() * sizeof(T)));
+    }
+
+    std::ofstream m_file;
+    const size_t m_blockRows;
+    uint64_t m_rows = 0;
+    std::vector<uint32_t> m_jobIndexes;
+    std::vector<uint8_t> m_statuses;
+    std::vector<float> m_accuracy;
+    std::vector<float> m_pronunciation;
+    std::vector<float> m_completeness;
+    std::vector<float> m_fluency;
+};
+
+// Accumulates the accuracy of each phoneme and the error types of the words over a whole batch, reading them from
+// the JSON of each result as it comes in, so that no result is kept. The JSON of a phoneme granularity assessment is:
+//   { "NBest": [ { "Words": [ { "Word": ..., "PronunciationAssessment": { "AccuracyScore": ..., "ErrorType": ... },
+//                               "Phonemes": [ { "Phoneme": ..., "PronunciationAssessment": { "AccuracyScore": ... } } ] } ] } ] }
+// Only the best alternative is read. It is not thread safe, callers serialize access.
+class PhonemeAggregator final
+{
+public:
+    // The accuracy of one phoneme over the batch.
+    struct PhonemeStats
+    {
+        uint64_t Count = 0;
+        double AccuracySum = 0;
+        double AccuracyMin = 100;
+    };
+
+    // Adds the words and phonemes of a result. It returns false if the JSON is malformed.
+    bool Add(const std::string& json)
+    {
+        bool firstEntry = true;
+        JsonScanner scanner(json);
+        return scanner.ReadObject([&](const JsonSpan& key)
+        {
+            if (!key.Equals("NBest"))
+            {
+                return scanner.SkipValue();
+            }
+            return scanner.ReadArray([&]()
+            {
+                if (!firstEntry)
+                {
+                    return scanner.SkipValue();
+                }
+                firstEntry = false;
+                return scanner.ReadObject([&](const JsonSpan& entryKey)
+                {
+                    if (!entryKey.Equals("Words"))
+                    {
+                        return scanner.SkipValue();
+                    }
+                    return scanner.ReadArray([&]() { return ReadWord(scanner); });
+                });
+            });
+        });
+    }
+
+    // Adds the phonemes and error types of another aggregator, e.g. one per worker.
+    void Merge(const PhonemeAggregator& other)
+    {
+        for (const auto& entry : other.m_phonemes)
+        {
+            auto& stats = m_phonemes[entry.first];
+            stats.Count += entry.second.Count;
+            stats.AccuracySum += entry.second.AccuracySum;
+            stats.AccuracyMin = (std::min)(stats.AccuracyMin, entry.second.AccuracyMin);
+        }
+        for (const auto& entry : other.m_errorTypes)
+        {
+            m_errorTypes[entry.first] += entry.second;
+        }
+        m_words += other.m_words;
+    }
+
+    const std::unordered_map<std::string, PhonemeStats>& GetPhonemes() const
+    {
+        return m_phonemes;
+    }
+
+    // Prints the word error types, and the 'count' phonemes with the lowest average accuracy.
+    void Print(std::ostream& out, size_t count = 10) const
+    {
+        out << "Words: " << m_words;
+        for (const auto& entry : m_errorTypes)
+        {
+            out << ", " << entry.first << ": " << entry.second;
+        }
+        out << "\n";
+
+        std::vector<std::pair<double, std::string>> averages;
+        for (const auto& entry : m_phonemes)
+        {
+            averages.emplace_back(entry.second.AccuracySum / entry.second.Count, entry.first);
+        }
+        std::sort(averages.begin(), averages.end());
+        out << "Phonemes: " << m_phonemes.size() << ", lowest average accuracy:\n";
+        for (size_t i = 0; i < averages.size() && i < count; i++)
+        {
+            const auto& stats = m_phonemes.at(averages[i].second);
+            out << "  " << averages[i].second << ": average " << averages[i].first << ", min " << stats.AccuracyMin
+                << ", count " << stats.Count << "\n";
+        }
+        out.flush();
+    }
+
+private:
+    bool ReadWord(JsonScanner& scanner)
+    {
+        m_words++;
+        return scanner.ReadObject([&](const JsonSpan& key)
+        {
+            if (key.Equals("PronunciationAssessment"))
+            {
+                if (!ReadAssessment(scanner, nullptr, &m_errorType))
+                {
+                    return false;
+                }
+                if (!m_errorType.empty())
+                {
+                    m_errorTypes[m_errorType]++;
+                }
+                return true;
+            }
+            if (key.Equals("Phonemes"))
+            {
+                return scanner.ReadArray([&]() { return ReadPhoneme(scanner); });
+            }
+            return scanner.SkipValue();
+        });
+    }
+
+    bool ReadPhoneme(JsonScanner& scanner)
+    {
+        bool hasAccuracy = false;
+        double accuracy = 0;
+        m_phoneme.clear();
+        auto read = scanner.ReadObject([&](const JsonSpan& key)
+        {
+            if (key.Equals("Phoneme"))
+            {
+                return scanner.ReadString(m_phoneme);
+            }
+            if (key.Equals("PronunciationAssessment"))
+            {
+                hasAccuracy = true;
+                return ReadAssessment(scanner, &accuracy, nullptr);
+            }
+            return scanner.SkipValue();
+        });
+        if (read && hasAccuracy && !m_phoneme.empty())
+        {
+            auto& stats = m_phonemes[m_phoneme];
+            stats.Count++;
+            stats.AccuracySum += accuracy;
+            stats.AccuracyMin = (std::min)(stats.AccuracyMin, accuracy);
+        }
+        return read;
+    }
+
+    static bool ReadAssessment(JsonScanner& scanner, double* accuracy, std::string* errorType)
+    {
+        if (errorType != nullptr)
+        {
+            errorType->clear();
+        }
+        return scanner.ReadObject([&](const JsonSpan& key)
+        {
+            if (accuracy != nullptr && key.Equals("AccuracyScore"))
+            {
+                return scanner.ReadNumber(*accuracy);
+            }
+            if (errorType != nullptr && key.Equals("ErrorType"))
+            {
+                return scanner.ReadString(*errorType);
+            }
+            return scanner.SkipValue();
+        });
+    }
+
+    std::unordered_map<std::string, PhonemeStats> m_phonemes;
+    std::unordered_map<std::string, uint64_t> m_errorTypes;
+    uint64_t m_words = 0;
+
+    // Reused from one phoneme and word to the next.
+    std::string m_phoneme;
+    std::string m_errorType;
+};
+
+// Scores a batch of recordings against their reference texts, running up to 'maxInFlight' assessments concurrently
+// on recognizers taken from a RecognizerPool, with a pronunciation assessment config applied to the recognizer for
+// each recording. The scores are streamed to a PronunciationScoreWriter as they complete, and the phonemes are
+// aggregated from the JSON of each result, which is then dropped. All the recordings must share one PCM format.
+class PronunciationBatchScorer final
+{
+public:
+    PronunciationBatchScorer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, uint32_t maxInFlight)
+        : m_config(config), m_maxInFlight(maxInFlight)
+    {
+        if (m_config == nullptr || m_maxInFlight == 0)
+        {
+            throw std::invalid_argument("A speech config and a positive in-flight limit are required");
+        }
+    }
+
+    // Scores all the jobs, and writes a row per job to 'output'.
+    void Run(const std::vector<PronunciationJob>& jobs, PronunciationScoreWriter& output)
+    {
+        if (jobs.empty())
+        {
+            return;
+        }
+
+        // The pool's push streams are created in the format of the first recording.
+        WavFormat format;
+        {
+            MappedWavFileReader reader(jobs[0].AudioPath);
+            format = reader.GetFormat();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            RecognizerPool recognizers(m_config, CreateAudioStreamFormat(format), m_maxInFlight);
+            WorkerPool pool(m_maxInFlight, m_maxInFlight * 2);
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                pool.Submit([this, &jobs, &output, &recognizers, &format, i]()
+                {
+                    Score((uint32_t)i, jobs[i], format, recognizers, output);
+                });
+            }
+            pool.WaitIdle();
+        }
+        output.Flush();
+        m_wallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Prints the outcome counts, the average scores, the latency, and the phonemes with the lowest accuracy.
+    void PrintSummary(std::ostream& out) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        out << "Recordings: " << m_scored + m_noMatches + m_failures << ", scored: " << m_scored << ", no match: " << m_noMatches
+            << ", failed: " << m_failures << "\n"
+            << "Average scores: accuracy " << Average(m_accuracySum) << ", pronunciation " << Average(m_pronunciationSum)
+            << ", completeness " << Average(m_completenessSum) << ", fluency " << Average(m_fluencySum) << "\n"
+            << "Audio: " << m_audioSeconds / 3600 << " hours, wall time: " << m_wallSeconds / 3600 << " hours\n";
+        m_latencies.Print(out, "Per-recording latency", "s");
+        m_phonemes.Print(out);
+    }
+
+    // Gets the phonemes aggregated so far.
+    const PhonemeAggregator& GetPhonemes() const
+    {
+        return m_phonemes;
+    }
+
+private:
+    void Score(uint32_t index, const PronunciationJob& job, const WavFormat& format, RecognizerPool& recognizers, PronunciationScoreWriter& output)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto status = PronunciationStatus::Failed;
+        float scores[4] = {};
+        std::vector<std::string> json;
+        double audioSeconds = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        std::shared_ptr<PooledRecognizer> lease;
+        try
+        {
+            MappedWavFileReader reader(job.AudioPath);
+            if (memcmp(&reader.GetFormat(), &format, sizeof(format)) != 0)
+            {
+                throw std::invalid_argument("The recording's format differs from the batch's");
+            }
+            audioSeconds = (double)reader.Size() / format.AvgBytesPerSec;
+
+            lease = recognizers.Acquire();
+            auto pronunciationConfig = PronunciationAssessmentConfig::Create(job.ReferenceText,
+                PronunciationAssessmentGradingSystem::HundredMark, PronunciationAssessmentGranularity::Phoneme, true);
+            pronunciationConfig->ApplyTo(lease->Recognizer);
+
+            // A recording may hold several utterances, so it is recognized continuously until its stream is closed.
+            auto utterances = std::make_shared<Utterances>();
+            lease->Recognizer->Recognized.Connect([utterances](const SpeechRecognitionEventArgs& e)
+            {
+                if (e.Result->Reason == ResultReason::RecognizedSpeech)
+                {
+                    std::lock_guard<std::mutex> lock(utterances->Mutex);
+                    utterances->Results.push_back(e.Result);
+                }
+            });
+            auto completion = SessionCompletion::Watch(*lease->Recognizer);
+
+            lease->Recognizer->StartContinuousRecognitionAsync().get();
+            PushAudioFeeder feeder(lease->Stream, format);
+            feeder.Feed(reader);
+            lease->Stream->Close();
+            auto outcome = completion->Wait();
+            lease->Recognizer->StopContinuousRecognitionAsync().get();
+
+            std::lock_guard<std::mutex> lock(utterances->Mutex);
+            if (outcome == SessionOutcome::Canceled)
+            {
+                status = PronunciationStatus::Failed;
+            }
+            else if (utterances->Results.empty())
+            {
+                status = PronunciationStatus::NoMatch;
+            }
+            else
+            {
+                // Accuracy, pronunciation and fluency are averaged over the utterances, weighted by their duration.
+                // Each utterance is scored against the whole reference text, so completeness adds up.
+                double duration = 0;
+                double weighted[3] = {};
+                double completeness = 0;
+                for (const auto& result : utterances->Results)
+                {
+                    auto assessment = PronunciationAssessmentResult::FromResult(result);
+                    auto weight = (double)(std::max)(result->Duration(), (uint64_t)1);
+                    weighted[0] += assessment->AccuracyScore * weight;
+                    weighted[1] += assessment->PronunciationScore * weight;
+                    weighted[2] += assessment->FluencyScore * weight;
+                    completeness += assessment->CompletenessScore;
+                    duration += weight;
+                    json.push_back(result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult));
+                }
+                scores[0] = (float)(weighted[0] / duration);
+                scores[1] = (float)(weighted[1] / duration);
+                scores[2] = (float)(std::min)(completeness, 100.0);
+                scores[3] = (float)(weighted[2] / duration);
+                status = PronunciationStatus::Scored;
+            }
+        }
+        catch (const std::exception&)
+        {
+            // The status stays Failed.
+        }
+        recognizers.Release(lease);
+        auto latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Parses the phonemes outside the lock, then merges their few entries.
+        PhonemeAggregator phonemes;
+        for (const auto& utterance : json)
+        {
+            phonemes.Add(utterance);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        output.Add(index, status, scores[0], scores[1], scores[2], scores[3]);
+        m_phonemes.Merge(phonemes);
+        m_latencies.Add(latency);
+        m_audioSeconds += audioSeconds;
+        switch (status)
+        {
+        case PronunciationStatus::Scored:
+            m_scored++;
+            m_accuracySum += scores[0];
+            m_pronunciationSum += scores[1];
+            m_completenessSum += scores[2];
+            m_fluencySum += scores[3];
+            break;
+        case PronunciationStatus::NoMatch:
+            m_noMatches++;
+            break;
+        case PronunciationStatus::Failed:
+            m_failures++;
+            break;
+        }
+    }
+
+    // The results of the utterances of a recording, collected by the Recognized handler.
+    struct Utterances
+    {
+        std::mutex Mutex;
+        std::vector<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognitionResult>> Results;
+    };
+
+    double Average(double sum) const
+    {
+        return m_scored > 0 ? sum / m_scored : 0;
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    const uint32_t m_maxInFlight;
+
+    mutable std::mutex m_mutex;
+    PhonemeAggregator m_phonemes;
+    LatencyHistogram m_latencies;
+    uint64_t m_scored = 0;
+    uint64_t m_noMatches = 0;
+    uint64_t m_failures = 0;
+    double m_accuracySum = 0;
+    double m_pronunciationSum = 0;
+    double m_completenessSum = 0;
+    double m_fluencySum = 0;
+    double m_audioSeconds = 0;
+    double m_wallSeconds = 0;
+};
@@ -0,0 +1,165 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "wav_file_reader.h"
+#include "mapped_wav_file_reader.h"
+
+// Pushes the audio data of a wav file into a push audio input stream in large, frame-aligned chunks.
+// The chunk size is derived from the stream format, 100 ms of audio by default, instead of a fixed byte count.
+// Reads from the file are coalesced into page-aligned blocks, and the feeder counts the Write() calls and bytes
+// it issued, so that the per-call overhead in the stream can be measured.
+// Optionally, the audio is paced to arrive in real time or at a multiple of real time, as it would from a live source.
+class PushAudioFeeder final
+{
+public:
+    // Defines the default duration of audio pushed with each Write() call.
+    static constexpr uint32_t defaultFrameMilliseconds = 100;
+
+    // Defines the speed that pushes audio as fast as the reader returns it.
+    static constexpr double unthrottled = 0.0;
+
+    // Constructor that sizes the chunks from the audio format, 'frameMilliseconds' of audio per Write() call.
+    PushAudioFeeder(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> pushStream,
+        const WavFormat& format, uint32_t frameMilliseconds = defaultFrameMilliseconds)
+        : m_pushStream(pushStream), m_bytesPerSecond(format.AvgBytesPerSec)
+    {
+        if (m_pushStream == nullptr)
+        {
+            throw std::invalid_argument("Push stream is null");
+        }
+        if (format.AvgBytesPerSec == 0 || format.BlockAlign == 0 || frameMilliseconds == 0)
+        {
+            throw std::invalid_argument("Invalid audio format or frame duration");
+        }
+
+        // Rounds the chunk down to whole sample frames, so that a chunk never splits interleaved samples.
+        uint64_t chunkSize = (uint64_t)format.AvgBytesPerSec * frameMilliseconds / 1000;
+        chunkSize -= chunkSize % format.BlockAlign;
+        m_chunkSize = chunkSize > 0 ? (uint32_t)chunkSize : format.BlockAlign;
+    }
+
+    // Sets the speed at which audio is pushed, relative to real time: 1.0 pushes the audio at the rate it was
+    // recorded, 2.0 at twice that rate, and 'unthrottled' (the default) as fast as the reader returns data.
+    // Pacing follows a monotonic clock from the first Write() call, so sleeps don't accumulate drift.
+    void SetSpeed(double speed)
+    {
+        if (speed < 0)
+        {
+            throw std::invalid_argument("Speed must not be negative");
+        }
+        m_speed = speed;
+    }
+
+    // Gets the time of the first Write() call, e.g. to measure the latency of the first partial result against it.
+    std::chrono::steady_clock::time_point GetStartTime() const
+    {
+        return m_startTime;
+    }
+
+    // Gets the number of bytes pushed with each Write() call.
+    uint32_t GetChunkSize() const
+    {
+        return m_chunkSize;
+    }
+
+    // Gets the number of Write() calls issued so far.
+    uint64_t GetWriteCount() const
+    {
+        return m_writeCount;
+    }
+
+    // Gets the number of bytes pushed so far.
+    uint64_t GetBytesWritten() const
+    {
+        return m_bytesWritten;
+    }
+
+    // Pushes all the remaining audio data of the reader into the stream.
+    // The file is read in page-aligned blocks into a buffer that is reused, and pushed out in whole chunks.
+    // The stream is not closed, so that the caller can push more audio into it.
+    void Feed(WavFileReader& reader)
+    {
+        auto readBlockSize = (m_chunkSize + pageSize - 1) / pageSize * pageSize;
+        m_buffer.resize(readBlockSize + m_chunkSize);
+
+        uint32_t filled = 0;
+        int readBytes = 0;
+        while ((readBytes = reader.Read(m_buffer.data() + filled, readBlockSize)) != 0)
+        {
+            filled += (uint32_t)readBytes;
+
+            // Push all the whole chunks in the buffer, and keep the rest for the next read.
+            uint32_t pushed = 0;
+            while (filled - pushed >= m_chunkSize)
+            {
+                Write(m_buffer.data() + pushed, m_chunkSize);
+                pushed += m_chunkSize;
+            }
+            if (pushed > 0)
+            {
+                memmove(m_buffer.data(), m_buffer.data() + pushed, filled - pushed);
+                filled -= pushed;
+            }
+        }
+
+        // Push the tail of the file.
+        if (filled > 0)
+        {
+            Write(m_buffer.data(), filled);
+        }
+    }
+
+    // Pushes all the remaining audio data of the mapped reader into the stream.
+    // Slices of the mapped file are pushed directly, without copying them into a buffer.
+    void Feed(MappedWavFileReader& reader)
+    {
+        uint8_t* data = nullptr;
+        uint32_t size = 0;
+        while ((size = reader.ReadSpan(&data, m_chunkSize)) != 0)
+        {
+            Write(data, size);
+        }
+    }
+
+private:
+    // Defines the size of a memory page that reads are aligned to.
+    static constexpr uint32_t pageSize = 4096;
+
+    void Write(uint8_t* data, uint32_t size)
+    {
+        if (m_writeCount == 0)
+        {
+            m_startTime = std::chrono::steady_clock::now();
+        }
+        else if (m_speed > 0)
+        {
+            // Waits until the audio pushed so far would have arrived from a live source at the configured speed.
+            std::chrono::duration<double> audioTime((double)m_bytesWritten / (m_bytesPerSecond * m_speed));
+            std::this_thread::sleep_until(m_startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(audioTime));
+        }
+
+        m_pushStream->Write(data, size);
+        m_writeCount++;
+        m_bytesWritten += size;
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> m_pushStream;
+    uint32_t m_bytesPerSecond;
+    uint32_t m_chunkSize;
+    double m_speed = unthrottled;
+    std::chrono::steady_clock::time_point m_startTime;
+    std::vector<uint8_t> m_buffer;
+    std::atomic<uint64_t> m_writeCount{ 0 };
+    std::atomic<uint64_t> m_bytesWritten{ 0 };
+};
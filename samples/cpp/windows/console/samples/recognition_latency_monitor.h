@@ -0,0 +1,218 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "latency_histogram.h"
+
+// The latencies measured for one recognition session, in milliseconds.
+// Lags compare the wall time elapsed since the session started with the audio offset that a result reaches
+// (Offset() + Duration()), which is the latency of the result when the audio is fed in real time.
+struct SessionLatencies
+{
+    std::string SessionId;
+    LatencyHistogram SpeechStart;           // from session start to SpeechStartDetected.
+    LatencyHistogram FirstRecognizing;      // from session start to the first Recognizing of the session.
+    LatencyHistogram FirstRecognized;       // from session start to the first Recognized of the session.
+    LatencyHistogram RecognizingLag;        // lag of every Recognizing.
+    LatencyHistogram RecognizedLag;         // lag of every Recognized.
+    LatencyHistogram EndOfAudioToFinal;     // from MarkEndOfAudio() to every Recognized after it.
+    LatencyHistogram SessionDuration;       // from session start to SessionStopped or Canceled.
+    uint64_t RecognizingCount = 0;
+    uint64_t RecognizedCount = 0;
+    uint64_t CanceledCount = 0;
+
+    // Adds the samples and counts of another session, for aggregating over sessions.
+    void Merge(const SessionLatencies& other)
+    {
+        SpeechStart.Merge(other.SpeechStart);
+        FirstRecognizing.Merge(other.FirstRecognizing);
+        FirstRecognized.Merge(other.FirstRecognized);
+        RecognizingLag.Merge(other.RecognizingLag);
+        RecognizedLag.Merge(other.RecognizedLag);
+        EndOfAudioToFinal.Merge(other.EndOfAudioToFinal);
+        SessionDuration.Merge(other.SessionDuration);
+        RecognizingCount += other.RecognizingCount;
+        RecognizedCount += other.RecognizedCount;
+        CanceledCount += other.CanceledCount;
+    }
+
+    // Prints the p50/p95/p99 of every latency.
+    void Print(std::ostream& out) const
+    {
+        out << "Recognizing events: " << RecognizingCount << ", Recognized events: " << RecognizedCount
+            << ", Canceled events: " << CanceledCount << "\n";
+        SpeechStart.Print(out, "  Session start to speech start");
+        FirstRecognizing.Print(out, "  Session start to first Recognizing");
+        FirstRecognized.Print(out, "  Session start to first Recognized");
+        RecognizingLag.Print(out, "  Recognizing lag behind audio");
+        RecognizedLag.Print(out, "  Recognized lag behind audio");
+        EndOfAudioToFinal.Print(out, "  End of audio to Recognized");
+        SessionDuration.Print(out, "  Session duration");
+    }
+};
+
+// Timestamps the events of a speech recognizer and collects their latencies per session.
+// The handlers only hold the collected state, not the monitor, so the monitor can go away before the recognizer.
+class RecognitionLatencyMonitor final
+{
+public:
+    explicit RecognitionLatencyMonitor(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer> recognizer)
+        : m_state(std::make_shared<State>())
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto state = m_state;
+        recognizer->SessionStarted.Connect([state](const SessionEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            state->Sessions.emplace_back();
+            state->Sessions.back().SessionId = e.SessionId;
+            state->InSession = true;
+            state->SessionStart = std::chrono::steady_clock::now();
+            state->EndOfAudioMarked = false;
+        });
+
+        recognizer->SpeechStartDetected.Connect([state](const RecognitionEventArgs&)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            if (state->InSession)
+            {
+                state->Sessions.back().SpeechStart.Add(state->ElapsedMilliseconds(state->SessionStart));
+            }
+        });
+
+        recognizer->Recognizing.Connect([state](const SpeechRecognitionEventArgs& e)
+        {
+            auto audioEnd = e.Result->Offset() + e.Result->Duration();
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            if (state->InSession)
+            {
+                auto& session = state->Sessions.back();
+                auto elapsed = state->ElapsedMilliseconds(state->SessionStart);
+                if (session.RecognizingCount++ == 0)
+                {
+                    session.FirstRecognizing.Add(elapsed);
+                }
+                session.RecognizingLag.Add(elapsed - TicksToMilliseconds(audioEnd));
+            }
+        });
+
+        recognizer->Recognized.Connect([state](const SpeechRecognitionEventArgs& e)
+        {
+            auto audioEnd = e.Result->Offset() + e.Result->Duration();
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            if (state->InSession)
+            {
+                auto& session = state->Sessions.back();
+                auto elapsed = state->ElapsedMilliseconds(state->SessionStart);
+                if (session.RecognizedCount++ == 0)
+                {
+                    session.FirstRecognized.Add(elapsed);
+                }
+                session.RecognizedLag.Add(elapsed - TicksToMilliseconds(audioEnd));
+                if (state->EndOfAudioMarked)
+                {
+                    session.EndOfAudioToFinal.Add(state->ElapsedMilliseconds(state->EndOfAudio));
+                }
+            }
+        });
+
+        // A session ended by an error may never see SessionStopped, so its duration is closed here.
+        recognizer->Canceled.Connect([state](const SpeechRecognitionCanceledEventArgs&)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            if (state->InSession)
+            {
+                auto& session = state->Sessions.back();
+                session.CanceledCount++;
+                session.SessionDuration.Add(state->ElapsedMilliseconds(state->SessionStart));
+                state->InSession = false;
+            }
+        });
+
+        recognizer->SessionStopped.Connect([state](const SessionEventArgs&)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            if (state->InSession)
+            {
+                state->Sessions.back().SessionDuration.Add(state->ElapsedMilliseconds(state->SessionStart));
+                state->InSession = false;
+            }
+        });
+    }
+
+    // Records that the last audio of the current session has been handed to the recognizer,
+    // e.g. right before closing a push stream.
+    void MarkEndOfAudio()
+    {
+        std::lock_guard<std::mutex> lock(m_state->Mutex);
+        m_state->EndOfAudio = std::chrono::steady_clock::now();
+        m_state->EndOfAudioMarked = true;
+    }
+
+    // Gets a copy of the latencies of every session seen so far, in the order they started.
+    std::vector<SessionLatencies> GetSessions() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->Mutex);
+        return m_state->Sessions;
+    }
+
+    // Gets the latencies of all the sessions seen so far merged together.
+    SessionLatencies GetAggregate() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->Mutex);
+        SessionLatencies aggregate;
+        aggregate.SessionId = "aggregate";
+        for (const auto& session : m_state->Sessions)
+        {
+            aggregate.Merge(session);
+        }
+        return aggregate;
+    }
+
+    // Prints the latencies of every session, followed by the aggregate over all of them.
+    void Print(std::ostream& out) const
+    {
+        for (const auto& session : GetSessions())
+        {
+            out << "Session " << session.SessionId << ": ";
+            session.Print(out);
+        }
+        out << "All sessions: ";
+        GetAggregate().Print(out);
+        out.flush();
+    }
+
+private:
+    struct State
+    {
+        std::mutex Mutex;
+        std::vector<SessionLatencies> Sessions;
+        bool InSession = false;
+        bool EndOfAudioMarked = false;
+        std::chrono::steady_clock::time_point SessionStart;
+        std::chrono::steady_clock::time_point EndOfAudio;
+
+        static double ElapsedMilliseconds(std::chrono::steady_clock::time_point since)
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+        }
+    };
+
+    // Converts an audio offset or duration in ticks of 100 nanoseconds to milliseconds.
+    static double TicksToMilliseconds(uint64_t ticks)
+    {
+        return ticks / 10000.0;
+    }
+
+    std::shared_ptr<State> m_state;
+};
@@ -0,0 +1,244 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// A speech recognizer handed out by RecognizerPool, together with the push stream it reads from
+// and the connection that was opened ahead of time.
+// Each one serves a single caller. The caller may stop pushing mid-utterance, or push more than the recognizer
+// reads, and the SDK gives no way to drain a push stream, so the stream never carries audio over to another caller.
+class PooledRecognizer final
+{
+public:
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer> Recognizer;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> Stream;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Connection> Connection;
+
+private:
+    friend class RecognizerPool;
+
+    std::atomic<bool> m_connected{ false };
+    std::chrono::steady_clock::time_point m_lastUsed;
+};
+
+// Keeps a configurable number of speech recognizers with pre-opened connections, so that callers don't pay
+// for TLS and WebSocket setup before the first byte of audio.
+// A released recognizer is discarded with its stream, and a background thread connects a fresh one in its place.
+// The thread also checks the health of the idle recognizers, re-opens dropped connections, and evicts recognizers
+// that stayed idle for too long.
+class RecognizerPool final
+{
+public:
+    // Called with each recognizer the pool creates, from the thread creating it, e.g. to track its authorization token.
+    using RecognizerCreated = std::function<void(const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer>&)>;
+
+    RecognizerPool(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config,
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> format,
+        uint32_t size, std::chrono::seconds idleTimeout = std::chrono::seconds(60), RecognizerCreated onCreated = nullptr)
+        : m_config(config), m_format(format), m_size(size), m_idleTimeout(idleTimeout), m_onCreated(std::move(onCreated))
+    {
+        if (m_config == nullptr || m_size == 0)
+        {
+            throw std::invalid_argument("A speech config and a positive pool size are required");
+        }
+
+        m_maintenanceThread = std::thread([this]() { MaintenanceLoop(); });
+    }
+
+    ~RecognizerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_maintenance.notify_all();
+        m_maintenanceThread.join();
+
+        for (auto& entry : m_idle)
+        {
+            entry->Connection->Close();
+        }
+    }
+
+    RecognizerPool(const RecognizerPool&) = delete;
+    RecognizerPool& operator=(const RecognizerPool&) = delete;
+
+    // Hands out a warm recognizer, or creates one on the spot if none is ready.
+    std::shared_ptr<PooledRecognizer> Acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto it = m_idle.begin(); it != m_idle.end(); ++it)
+            {
+                auto entry = *it;
+                if (entry->m_connected)
+                {
+                    m_idle.erase(it);
+                    m_warmHits++;
+                    m_maintenance.notify_all();
+                    return entry;
+                }
+            }
+            m_coldMisses++;
+        }
+        m_maintenance.notify_all();
+        return CreateEntry();
+    }
+
+    // Returns a recognizer to the pool. It is closed, as its stream may still hold audio of the caller,
+    // and the pool is topped up with a fresh recognizer in the background.
+    void Release(std::shared_ptr<PooledRecognizer> entry)
+    {
+        if (entry == nullptr)
+        {
+            return;
+        }
+
+        entry->Connection->Close();
+        m_maintenance.notify_all();
+    }
+
+    // Gets the number of Acquire() calls served by a warm recognizer.
+    uint64_t GetWarmHits() const
+    {
+        return m_warmHits;
+    }
+
+    // Gets the number of Acquire() calls that had to create a recognizer.
+    uint64_t GetColdMisses() const
+    {
+        return m_coldMisses;
+    }
+
+private:
+    std::shared_ptr<PooledRecognizer> CreateEntry()
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        auto entry = std::make_shared<PooledRecognizer>();
+        entry->Stream = m_format != nullptr ? AudioInputStream::CreatePushStream(m_format) : AudioInputStream::CreatePushStream();
+        entry->Recognizer = SpeechRecognizer::FromConfig(m_config, AudioConfig::FromStreamInput(entry->Stream));
+        entry->Connection = Connection::FromRecognizer(entry->Recognizer);
+        if (m_onCreated)
+        {
+            m_onCreated(entry->Recognizer);
+        }
+        entry->m_lastUsed = std::chrono::steady_clock::now();
+
+        // The handlers hold a weak reference, so that the recognizer doesn't keep its own entry alive.
+        std::weak_ptr<PooledRecognizer> weakEntry = entry;
+        entry->Connection->Connected.Connect([weakEntry](const ConnectionEventArgs&)
+        {
+            if (auto e = weakEntry.lock())
+            {
+                e->m_connected = true;
+            }
+        });
+        entry->Connection->Disconnected.Connect([weakEntry](const ConnectionEventArgs&)
+        {
+            if (auto e = weakEntry.lock())
+            {
+                e->m_connected = false;
+            }
+        });
+
+        // Opens the connection ahead of the first recognition.
+        entry->Connection->Open(false);
+        return entry;
+    }
+
+    void MaintenanceLoop()
+    {
+        // Defines how often the idle recognizers are checked.
+        constexpr auto checkInterval = std::chrono::seconds(1);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stopping)
+        {
+            auto now = std::chrono::steady_clock::now();
+            std::vector<std::shared_ptr<PooledRecognizer>> reconnect;
+            std::vector<std::shared_ptr<PooledRecognizer>> evicted;
+
+            for (auto it = m_idle.begin(); it != m_idle.end();)
+            {
+                auto entry = *it;
+                if (now - entry->m_lastUsed > m_idleTimeout)
+                {
+                    // The service drops idle connections anyway, replaces the recognizer with a fresh one.
+                    evicted.push_back(entry);
+                    it = m_idle.erase(it);
+                }
+                else
+                {
+                    if (!entry->m_connected)
+                    {
+                        reconnect.push_back(entry);
+                    }
+                    ++it;
+                }
+            }
+            auto missing = m_size > m_idle.size() ? m_size - m_idle.size() : 0;
+
+            // Creates, opens and closes connections without holding the lock.
+            lock.unlock();
+            for (auto& entry : evicted)
+            {
+                entry->Connection->Close();
+            }
+            for (auto& entry : reconnect)
+            {
+                entry->Connection->Open(false);
+            }
+            std::vector<std::shared_ptr<PooledRecognizer>> created;
+            for (size_t i = 0; i < missing; i++)
+            {
+                try
+                {
+                    created.push_back(CreateEntry());
+                }
+                catch (const std::exception&)
+                {
+                    // Retries on the next check, e.g. after a transient network error.
+                    break;
+                }
+            }
+            lock.lock();
+
+            for (auto& entry : created)
+            {
+                if (m_idle.size() < m_size)
+                {
+                    m_idle.push_back(entry);
+                }
+            }
+            m_maintenance.wait_for(lock, checkInterval);
+        }
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> m_format;
+    const size_t m_size;
+    const std::chrono::seconds m_idleTimeout;
+    const RecognizerCreated m_onCreated;
+
+    std::vector<std::shared_ptr<PooledRecognizer>> m_idle;
+    std::atomic<uint64_t> m_warmHits{ 0 };
+    std::atomic<uint64_t> m_coldMisses{ 0 };
+    bool m_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_maintenance;
+    std::thread m_maintenanceThread;
+};
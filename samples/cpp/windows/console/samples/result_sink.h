@@ -0,0 +1,234 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Defines the kinds of events recorded in a result sink.
+enum class ResultRecordKind
+{
+    Recognizing,
+    Recognized,
+    Translation,
+    NoMatch,
+    Canceled
+};
+
+// A fixed-size result record, so that pushing a record never allocates.
+// Text longer than the record holds is truncated, and counted by the sink.
+struct ResultRecord
+{
+    // Defines the maximum lengths of the text, language and session id in a record.
+    static constexpr size_t maxTextLength = 1024;
+    static constexpr size_t maxLanguageLength = 16;
+    static constexpr size_t maxSessionIdLength = 64;
+
+    ResultRecordKind Kind;
+    uint64_t Offset;                        // audio offset in ticks of 100 nanoseconds.
+    uint64_t Duration;                      // audio duration in ticks of 100 nanoseconds.
+    uint32_t TextLength;
+    int32_t Reason;                         // the ResultReason of a Recognized record, the CancellationReason of a Canceled one.
+    int32_t ErrorCode;                      // the CancellationErrorCode of a Canceled record.
+    char Language[maxLanguageLength + 1];   // target language of a translation, empty otherwise.
+    char SessionId[maxSessionIdLength + 1]; // of the session the result is from, if the handler gave it.
+    char Text[maxTextLength + 1];
+};
+
+// A bounded ring buffer of result records that the SDK event handlers push into without locking or allocation,
+// and that worker threads drain for persisting and fan-out, so that no handler ever blocks the SDK dispatch thread.
+// It is meant for a single producer, the event handlers of one recognizer, and any number of consumers.
+// When the buffer is full, records are dropped rather than waited for, and the overflow is counted.
+class ResultSink final
+{
+public:
+    // Constructor that preallocates 'capacity' records, rounded up to a power of two.
+    ResultSink(size_t capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("Capacity must be positive");
+        }
+
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++)
+        {
+            m_slots[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ResultSink(const ResultSink&) = delete;
+    ResultSink& operator=(const ResultSink&) = delete;
+
+    // Pushes a record, copying the text, language and session id into the preallocated slot.
+    // It returns false, and counts an overflow, if the buffer is full.
+    bool TryPush(ResultRecordKind kind, const std::string& text, uint64_t offset = 0, uint64_t duration = 0, const std::string& language = std::string(),
+        const std::string& sessionId = std::string(), int32_t reason = 0, int32_t errorCode = 0)
+    {
+        auto pos = m_head.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true)
+        {
+            slot = &m_slots[pos & m_mask];
+            auto sequence = slot->Sequence.load(std::memory_order_acquire);
+            auto diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                m_overflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        auto& record = slot->Record;
+        record.Kind = kind;
+        record.Offset = offset;
+        record.Duration = duration;
+        record.Reason = reason;
+        record.ErrorCode = errorCode;
+        record.TextLength = (uint32_t)CopyTruncated(record.Text, ResultRecord::maxTextLength, text);
+        CopyTruncated(record.Language, ResultRecord::maxLanguageLength, language);
+        CopyTruncated(record.SessionId, ResultRecord::maxSessionIdLength, sessionId);
+        if (text.size() > ResultRecord::maxTextLength)
+        {
+            m_truncations.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        slot->Sequence.store(pos + 1, std::memory_order_release);
+        m_pushed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Pops the oldest record into 'record'. It returns false if the buffer is empty.
+    bool TryPop(ResultRecord& record)
+    {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true)
+        {
+            slot = &m_slots[pos & m_mask];
+            auto sequence = slot->Sequence.load(std::memory_order_acquire);
+            auto diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        record = slot->Record;
+        slot->Sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pops the oldest record, waiting for one with a short back-off while the buffer is empty.
+    // It returns false once the sink is closed and all the records have been drained.
+    bool Pop(ResultRecord& record)
+    {
+        // Defines how long a consumer sleeps between polls of an empty buffer.
+        constexpr auto pollInterval = std::chrono::milliseconds(1);
+
+        uint32_t spins = 0;
+        while (!TryPop(record))
+        {
+            if (m_closed.load(std::memory_order_acquire))
+            {
+                // A record may have been pushed just before the sink was closed.
+                return TryPop(record);
+            }
+            if (++spins < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(pollInterval);
+            }
+        }
+        return true;
+    }
+
+    // Closes the sink after the last push, so that consumers return from Pop() once it is drained.
+    void Close()
+    {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    // Gets the number of records pushed.
+    uint64_t GetPushed() const
+    {
+        return m_pushed.load(std::memory_order_relaxed);
+    }
+
+    // Gets the number of records dropped because the buffer was full.
+    uint64_t GetOverflows() const
+    {
+        return m_overflows.load(std::memory_order_relaxed);
+    }
+
+    // Gets the number of records whose text was truncated.
+    uint64_t GetTruncations() const
+    {
+        return m_truncations.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> Sequence;
+        ResultRecord Record;
+    };
+
+    static size_t CopyTruncated(char* destination, size_t maxLength, const std::string& source)
+    {
+        auto length = source.size() < maxLength ? source.size() : maxLength;
+        memcpy(destination, source.data(), length);
+        destination[length] = '\0';
+        return length;
+    }
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+
+    // Keeps the producer and consumer positions on separate cache lines.
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    alignas(64) std::atomic<uint64_t> m_pushed{ 0 };
+    std::atomic<uint64_t> m_overflows{ 0 };
+    std::atomic<uint64_t> m_truncations{ 0 };
+    std::atomic<bool> m_closed{ false };
+};
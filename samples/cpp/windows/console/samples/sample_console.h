@@ -0,0 +1,123 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// The console input and the input files of the samples, which the non-interactive runner of main.cpp provides
+// instead of the user: each thread that runs a sample reads its own copy of the scripted lines, and the input files
+// the samples name can be substituted with others. The runs of a sample running concurrently write their output
+// files under names of their own.
+namespace SampleConsole
+{
+    struct Script
+    {
+        bool Active = false;
+        std::vector<std::string> Lines;
+        size_t Next = 0;
+        std::string OutputSuffix;       // added to the names of the output files, before their extension.
+    };
+
+    inline Script& CurrentScript()
+    {
+        static thread_local Script script;
+        return script;
+    }
+
+    // Substituted file names, set up before any sample runs and only read while they run.
+    inline std::map<std::string, std::string>& FileSubstitutes()
+    {
+        static std::map<std::string, std::string> substitutes;
+        return substitutes;
+    }
+
+    // Makes the calling thread read 'lines' instead of the console, then empty lines once they are used up, and write
+    // its output files with 'outputSuffix' in their names, e.g. ".3" for "outputaudio.3.wav".
+    inline void SetScript(const std::vector<std::string>& lines, const std::string& outputSuffix = std::string())
+    {
+        auto& script = CurrentScript();
+        script.Active = true;
+        script.Lines = lines;
+        script.Next = 0;
+        script.OutputSuffix = outputSuffix;
+    }
+
+    inline void ClearScript()
+    {
+        CurrentScript() = Script();
+    }
+
+    inline void SubstituteFile(const std::string& name, const std::string& path)
+    {
+        FileSubstitutes()[name] = path;
+    }
+}
+
+// Reads a line of console input, or the next scripted line when the runner provides them.
+// An exhausted script gives empty lines, with which the samples that loop on input stop.
+inline bool ReadSampleLine(std::string& line)
+{
+    auto& script = SampleConsole::CurrentScript();
+    if (!script.Active)
+    {
+        return (bool)std::getline(std::cin, line);
+    }
+    line = script.Next < script.Lines.size() ? script.Lines[script.Next++] : std::string();
+    return true;
+}
+
+// Reads a positive number from a line of input, or takes 'defaultValue' for an empty line. It returns false after
+// telling the user, for anything else, e.g. "abc", "0" or "-1".
+inline bool ReadSampleCount(uint32_t defaultValue, uint32_t& value)
+{
+    std::string line;
+    ReadSampleLine(line);
+    if (line.empty())
+    {
+        value = defaultValue;
+        return true;
+    }
+    char* end = nullptr;
+    errno = 0;
+    auto number = strtoul(line.c_str(), &end, 10);
+    if (line[0] == '-' || *end != '\0' || errno != 0 || number == 0 || number > UINT32_MAX)
+    {
+        std::cout << "Expected a positive number, got " << line << std::endl;
+        return false;
+    }
+    value = (uint32_t)number;
+    return true;
+}
+
+// Gets the path of an input file of the samples, the one substituted for it if any.
+inline std::string SampleFile(const std::string& name)
+{
+    const auto& substitutes = SampleConsole::FileSubstitutes();
+    auto it = substitutes.find(name);
+    return it != substitutes.end() ? it->second : name;
+}
+
+// Gets the name of an output file of the samples, made unique to the run when the runner runs a sample concurrently.
+inline std::string SampleOutputFile(const std::string& name)
+{
+    const auto& suffix = SampleConsole::CurrentScript().OutputSuffix;
+    if (suffix.empty())
+    {
+        return name;
+    }
+    auto dot = name.find_last_of('.');
+    auto slash = name.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return name + suffix;
+    }
+    return name.substr(0, dot) + suffix + name.substr(dot);
+}
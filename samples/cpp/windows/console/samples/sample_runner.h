@@ -0,0 +1,479 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "latency_histogram.h"
+#include "sample_console.h"
+
+// A sample the runner can run, by its menu path (e.g. "1.3" for the third speech recognition sample) or by its name.
+struct SampleScenario
+{
+    const char* Id;
+    const char* Name;
+    void (*Run)();
+};
+
+// How the runner runs the scenarios, from the command line and an optional configuration file.
+struct SampleRunnerOptions
+{
+    bool List = false;
+    std::vector<std::string> Scenarios;
+    int Iterations = 1;
+    int Concurrency = 1;
+
+    // The console input of each run, and the input files substituted for those the samples name.
+    std::vector<std::string> Lines;
+    std::vector<std::pair<std::string, std::string>> Files;
+
+    // Where the results go, one JSON object per line appended to it, instead of the standard output.
+    std::string ResultsFile;
+};
+
+// Passes the output of the samples on to a stream buffer, and counts the errors they report in it: the samples catch
+// their exceptions and print them, and print the errors of canceled sessions, rather than throwing. It is thread safe,
+// as samples print from the threads of the SDK events too.
+class ErrorMarkerStreamBuffer final : public std::streambuf
+{
+public:
+    explicit ErrorMarkerStreamBuffer(std::streambuf* target)
+        : m_target(target)
+    {
+    }
+
+    uint64_t GetErrorCount() const
+    {
+        return m_errors.load();
+    }
+
+    std::streambuf* GetTarget() const
+    {
+        return m_target;
+    }
+
+protected:
+    int overflow(int c) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return c == traits_type::eof() ? traits_type::not_eof(c) : m_target->sputc((char)c);
+    }
+
+    // The markers are string literals of the samples, which come in one call.
+    std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::string text(data, (size_t)size);
+        for (auto marker : { "CANCELED: ErrorCode=", "Exit due to exception" })
+        {
+            for (auto found = text.find(marker); found != std::string::npos; found = text.find(marker, found + 1))
+            {
+                m_errors++;
+            }
+        }
+        return m_target->sputn(data, size);
+    }
+
+    int sync() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_target->pubsync();
+    }
+
+private:
+    std::streambuf* const m_target;
+    std::mutex m_mutex;
+    std::atomic<uint64_t> m_errors{ 0 };
+};
+
+// Runs samples without the menus, for automated and load testing, e.g.
+//     samples --scenario SpeechContinuousRecognitionWithFile --iterations 20 --concurrency 4 --file whatstheweatherlike.wav=long.wav
+// Each scenario runs its iterations on 'concurrency' threads, and one JSON line reports its latencies. A run fails if it
+// throws or prints an error; as the samples print from other threads, with concurrency a run counts the errors printed
+// while it ran, so that "errors" is exact and "failed" is an upper bound. Concurrent runs write their output files
+// under names of their own, e.g. outputaudio.3.wav for the third run.
+class SampleRunner final
+{
+public:
+    SampleRunner(const SampleScenario* scenarios, size_t count)
+        : m_scenarios(scenarios), m_count(count)
+    {
+    }
+
+    // Parses the command line (without the program name). The options of the --config file come first, so that those
+    // of the command line override them; a list given on the command line replaces the one of the file.
+    static SampleRunnerOptions ParseArguments(const std::vector<std::string>& arguments)
+    {
+        std::vector<std::pair<std::string, std::string>> settings;
+        std::string configFile;
+        for (size_t i = 0; i < arguments.size(); i++)
+        {
+            const auto& argument = arguments[i];
+            if (argument.compare(0, 2, "--") != 0)
+            {
+                throw std::invalid_argument("Unexpected argument: " + argument);
+            }
+
+            auto key = argument.substr(2);
+            if (key == "list")
+            {
+                settings.emplace_back(key, "true");
+                continue;
+            }
+            if (i + 1 >= arguments.size())
+            {
+                throw std::invalid_argument("Missing value of " + argument);
+            }
+            if (key == "config")
+            {
+                configFile = arguments[++i];
+            }
+            else
+            {
+                settings.emplace_back(key, arguments[++i]);
+            }
+        }
+
+        SampleRunnerOptions options;
+        if (!configFile.empty())
+        {
+            for (const auto& setting : ReadConfigFile(configFile))
+            {
+                bool overridden = IsList(setting.first) && Contains(settings, setting.first);
+                if (!overridden)
+                {
+                    Apply(options, setting.first, setting.second);
+                }
+            }
+        }
+        for (const auto& setting : settings)
+        {
+            Apply(options, setting.first, setting.second);
+        }
+        return options;
+    }
+
+    // Runs the scenarios of 'options', or lists them all. Returns the process exit code, 1 if any run failed.
+    int Run(const SampleRunnerOptions& options)
+    {
+        if (options.List)
+        {
+            for (size_t i = 0; i < m_count; i++)
+            {
+                std::cout << m_scenarios[i].Id << "\t" << m_scenarios[i].Name << "\n";
+            }
+            return 0;
+        }
+
+        std::vector<const SampleScenario*> selected;
+        for (const auto& name : options.Scenarios)
+        {
+            Select(name, selected);
+        }
+        if (selected.empty())
+        {
+            throw std::invalid_argument("No scenario to run, see --list");
+        }
+
+        // Substituted files are set before any sample runs, the runs only read them.
+        for (const auto& file : options.Files)
+        {
+            SampleConsole::SubstituteFile(file.first, file.second);
+        }
+
+        std::ofstream resultsFile;
+        if (!options.ResultsFile.empty())
+        {
+            resultsFile.open(options.ResultsFile, std::ios::app);
+            if (!resultsFile)
+            {
+                throw std::runtime_error("Cannot open " + options.ResultsFile);
+            }
+        }
+        std::ostream& results = resultsFile.is_open() ? resultsFile : std::cout;
+
+        // The output of the samples is watched for errors while they run, the results are written after.
+        bool failed = false;
+        for (auto scenario : selected)
+        {
+            ErrorMarkerStreamBuffer output(std::cout.rdbuf());
+            std::cout.rdbuf(&output);
+            ScenarioResult result;
+            try
+            {
+                result = RunScenario(*scenario, options, output);
+            }
+            catch (...)
+            {
+                std::cout.rdbuf(output.GetTarget());
+                throw;
+            }
+            std::cout.rdbuf(output.GetTarget());
+            failed = failed || result.Failed > 0;
+            Report(results, *scenario, options, result);
+        }
+        return failed ? 1 : 0;
+    }
+
+private:
+    struct ScenarioResult
+    {
+        LatencyHistogram Latencies;
+        double TotalMilliseconds = 0;
+        int Failed = 0;
+        uint64_t Errors = 0;
+        double WallSeconds = 0;
+    };
+
+    static std::vector<std::pair<std::string, std::string>> ReadConfigFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            throw std::invalid_argument("Cannot open the configuration file " + path);
+        }
+
+        // key=value lines, '#' starts a comment line.
+        std::vector<std::pair<std::string, std::string>> settings;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            auto start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line[start] == '#')
+            {
+                continue;
+            }
+            auto separator = line.find('=', start);
+            if (separator == std::string::npos)
+            {
+                throw std::invalid_argument("Expected key=value in " + path + ": " + line);
+            }
+            settings.emplace_back(Trim(line.substr(start, separator - start)), line.substr(separator + 1));
+        }
+        return settings;
+    }
+
+    static void Apply(SampleRunnerOptions& options, const std::string& key, const std::string& value)
+    {
+        if (key == "list")
+        {
+            options.List = value == "true" || value == "1";
+        }
+        else if (key == "scenario")
+        {
+            // A comma separated list, or one scenario per repeated option.
+            std::istringstream names(value);
+            std::string name;
+            while (std::getline(names, name, ','))
+            {
+                if (!Trim(name).empty())
+                {
+                    options.Scenarios.push_back(Trim(name));
+                }
+            }
+        }
+        else if (key == "iterations")
+        {
+            options.Iterations = ParsePositive(key, value);
+        }
+        else if (key == "concurrency")
+        {
+            options.Concurrency = ParsePositive(key, value);
+        }
+        else if (key == "line")
+        {
+            options.Lines.push_back(value);
+        }
+        else if (key == "file")
+        {
+            auto separator = value.find('=');
+            if (separator == 0 || separator == std::string::npos)
+            {
+                throw std::invalid_argument("Expected --file name=path, got " + value);
+            }
+            options.Files.emplace_back(value.substr(0, separator), value.substr(separator + 1));
+        }
+        else if (key == "results")
+        {
+            options.ResultsFile = value;
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown option: " + key);
+        }
+    }
+
+    static bool IsList(const std::string& key)
+    {
+        return key == "scenario" || key == "line" || key == "file";
+    }
+
+    static bool Contains(const std::vector<std::pair<std::string, std::string>>& settings, const std::string& key)
+    {
+        for (const auto& setting : settings)
+        {
+            if (setting.first == key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static int ParsePositive(const std::string& key, const std::string& value)
+    {
+        size_t end = 0;
+        int number = 0;
+        try
+        {
+            number = std::stoi(value, &end);
+        }
+        catch (const std::exception&)
+        {
+            end = 0;
+        }
+        if (end == 0 || end != value.size() || number <= 0)
+        {
+            throw std::invalid_argument("Expected a positive number of " + key + ", got " + value);
+        }
+        return number;
+    }
+
+    static std::string Trim(const std::string& text)
+    {
+        auto start = text.find_first_not_of(" \t");
+        auto end = text.find_last_not_of(" \t");
+        return start == std::string::npos ? std::string() : text.substr(start, end - start + 1);
+    }
+
+    // Selects a scenario by name or by menu path, or all of them with "all".
+    void Select(const std::string& name, std::vector<const SampleScenario*>& selected) const
+    {
+        bool found = false;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            const auto& scenario = m_scenarios[i];
+            if (name == "all" || name == scenario.Name || EqualsIgnoringCase(name, scenario.Id))
+            {
+                selected.push_back(&scenario);
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            throw std::invalid_argument("Unknown scenario: " + name + ", see --list");
+        }
+    }
+
+    static bool EqualsIgnoringCase(const std::string& left, const std::string& right)
+    {
+        if (left.size() != right.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < left.size(); i++)
+        {
+            if (std::tolower((unsigned char)left[i]) != std::tolower((unsigned char)right[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ScenarioResult RunScenario(const SampleScenario& scenario, const SampleRunnerOptions& options, const ErrorMarkerStreamBuffer& output)
+    {
+        ScenarioResult result;
+        std::mutex resultMutex;
+        std::atomic<int> remaining{ options.Iterations };
+        std::atomic<int> runs{ 0 };
+        auto concurrent = (std::min)(options.Concurrency, options.Iterations) > 1;
+        auto errorsBefore = output.GetErrorCount();
+
+        auto worker = [&]()
+        {
+            // Each thread reads its own copy of the script, the samples never wait for the console.
+            while (remaining.fetch_sub(1) > 0)
+            {
+                auto run = ++runs;
+                SampleConsole::SetScript(options.Lines, concurrent ? "." + std::to_string(run) : std::string());
+                bool succeeded = true;
+                auto errors = output.GetErrorCount();
+                auto start = std::chrono::steady_clock::now();
+                try
+                {
+                    scenario.Run();
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << scenario.Name << " failed: " << e.what() << std::endl;
+                    succeeded = false;
+                }
+                auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                succeeded = succeeded && output.GetErrorCount() == errors;
+
+                std::lock_guard<std::mutex> lock(resultMutex);
+                result.Latencies.Add(milliseconds);
+                result.TotalMilliseconds += milliseconds;
+                result.Failed += succeeded ? 0 : 1;
+            }
+            SampleConsole::ClearScript();
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 1; i < (std::min)(options.Concurrency, options.Iterations); i++)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        result.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.Errors = output.GetErrorCount() - errorsBefore;
+        return result;
+    }
+
+    static void Report(std::ostream& out, const SampleScenario& scenario, const SampleRunnerOptions& options, const ScenarioResult& result)
+    {
+        const auto& latencies = result.Latencies;
+        auto runs = latencies.Count();
+        out << "{\"scenario\":\"" << scenario.Name << "\""
+            << ",\"id\":\"" << scenario.Id << "\""
+            << ",\"runs\":" << runs
+            << ",\"failed\":" << result.Failed
+            << ",\"errors\":" << result.Errors
+            << ",\"concurrency\":" << (std::min)(options.Concurrency, options.Iterations)
+            << ",\"wallSeconds\":" << result.WallSeconds
+            << ",\"minMs\":" << latencies.Percentile(0)
+            << ",\"meanMs\":" << (runs > 0 ? result.TotalMilliseconds / runs : 0)
+            << ",\"p50Ms\":" << latencies.Percentile(50)
+            << ",\"p95Ms\":" << latencies.Percentile(95)
+            << ",\"maxMs\":" << latencies.Max()
+            << "}" << std::endl;
+    }
+
+    const SampleScenario* m_scenarios;
+    const size_t m_count;
+};
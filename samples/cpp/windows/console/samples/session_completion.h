@@ -0,0 +1,181 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Defines how a recognition session ended.
+enum class SessionOutcome : uint8_t
+{
+    Pending,
+    Stopped,        // SessionStopped, e.g. at the end of the audio.
+    Canceled        // a Canceled error, after which the session may not stop on its own.
+};
+
+// Gets which session completed, and how.
+struct SessionCompletionEvent
+{
+    uint64_t SessionId;
+    SessionOutcome Outcome;
+};
+
+// The completions of many sessions, drained by one thread instead of one blocked waiter per session.
+class CompletionQueue final
+{
+public:
+    void Post(uint64_t sessionId, SessionOutcome outcome)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_completions.push_back({ sessionId, outcome });
+        }
+        m_available.notify_one();
+    }
+
+    // Waits up to 'timeout' for a completion, then hands all those queued to 'handler', in the order they came.
+    // The handler runs without the lock, so it may stop and release the recognizer of the session.
+    // Returns the number of completions handled.
+    size_t Drain(const std::function<void(const SessionCompletionEvent&)>& handler, std::chrono::milliseconds timeout)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_available.wait_for(lock, timeout, [this]() { return !m_completions.empty(); }))
+            {
+                return 0;
+            }
+            m_draining.swap(m_completions);
+        }
+        for (const auto& completion : m_draining)
+        {
+            handler(completion);
+        }
+        auto count = m_draining.size();
+        m_draining.clear();
+        return count;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_available;
+    std::vector<SessionCompletionEvent> m_completions;
+
+    // Used by the draining thread only, swapped with the queue so that both keep their capacity.
+    std::vector<SessionCompletionEvent> m_draining;
+};
+
+// The one-shot completion of a recognition session, for the SessionStopped and Canceled handlers that both may end it.
+// The first Complete() wins and the later ones are ignored, from any thread and without throwing, unlike a second
+// std::promise::set_value(). Once complete, it wakes the threads that wait on it, if any, and posts the completion
+// to its queue, if it has one. It is not allocated per session like a promise and its future, and can be a member
+// or a local; the owner destroys it after Wait() returned, or after its completion came out of the queue.
+class SessionCompletion final
+{
+public:
+    SessionCompletion() = default;
+
+    // Constructor that posts the completion of session 'sessionId' to 'queue'.
+    SessionCompletion(std::shared_ptr<CompletionQueue> queue, uint64_t sessionId)
+        : m_queue(std::move(queue)), m_sessionId(sessionId)
+    {
+    }
+
+    SessionCompletion(const SessionCompletion&) = delete;
+    SessionCompletion& operator=(const SessionCompletion&) = delete;
+
+    // Creates a completion that the recognizer's SessionStopped event or Canceled error completes.
+    // The handlers share its ownership, so it stays valid for any late event.
+    template <class Recognizer>
+    static std::shared_ptr<SessionCompletion> Watch(Recognizer& recognizer, std::shared_ptr<CompletionQueue> queue = nullptr, uint64_t sessionId = 0)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto completion = std::make_shared<SessionCompletion>(std::move(queue), sessionId);
+        recognizer.SessionStopped.Connect([completion](const SessionEventArgs&)
+        {
+            completion->Complete(SessionOutcome::Stopped);
+        });
+        recognizer.Canceled.Connect([completion](const auto& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                completion->Complete(SessionOutcome::Canceled);
+            }
+        });
+        return completion;
+    }
+
+    // Completes the session with 'outcome'. Returns false, doing nothing, if it was already complete.
+    bool Complete(SessionOutcome outcome)
+    {
+        std::shared_ptr<CompletionQueue> queue;
+        uint64_t sessionId;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (outcome == SessionOutcome::Pending || m_outcome != SessionOutcome::Pending)
+            {
+                return false;
+            }
+            m_outcome = outcome;
+            queue = m_queue;
+            sessionId = m_sessionId;
+            m_completed.notify_all();
+        }
+
+        // A waiter may destroy this object as soon as the lock is released, from here on only copies are used.
+        if (queue != nullptr)
+        {
+            queue->Post(sessionId, outcome);
+        }
+        return true;
+    }
+
+    // Gets whether the session is complete, without waiting, e.g. for polling.
+    bool IsComplete() const
+    {
+        return GetOutcome() != SessionOutcome::Pending;
+    }
+
+    SessionOutcome GetOutcome() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_outcome;
+    }
+
+    uint64_t GetSessionId() const
+    {
+        return m_sessionId;
+    }
+
+    // Blocks until the session is complete, and returns how it ended.
+    // It always takes the lock, so that once it returns Complete() is done with this object, which may be destroyed.
+    SessionOutcome Wait() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_completed.wait(lock, [this]() { return m_outcome != SessionOutcome::Pending; });
+        return m_outcome;
+    }
+
+    // Blocks until the session is complete or 'timeout' elapsed. Returns whether it is complete.
+    bool WaitFor(std::chrono::milliseconds timeout) const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_completed.wait_for(lock, timeout, [this]() { return m_outcome != SessionOutcome::Pending; });
+    }
+
+private:
+    SessionOutcome m_outcome = SessionOutcome::Pending;
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_completed;
+
+    const std::shared_ptr<CompletionQueue> m_queue;
+    const uint64_t m_sessionId = 0;
+};
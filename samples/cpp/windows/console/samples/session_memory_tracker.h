@@ -0,0 +1,388 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include "latency_histogram.h"
+
+// Per-session memory accounting, an instrumentation mode of the samples to find where the memory of long-running
+// recognizers goes. Built with SESSION_MEMORY_TRACKING defined, the operator new and delete of the program count
+// the allocations made while a SessionMemoryTracker::Scope is active on the thread, e.g. in the event handlers, and
+// charge their frees to the same session from whatever thread they come. The memory the SDK library allocates from
+// its own heap is not seen (on Windows, all of it), only what the program and the header-only C++ API allocate.
+// Without SESSION_MEMORY_TRACKING, only the lifetimes of the retained results are tracked.
+namespace SessionMemory
+{
+#if defined(SESSION_MEMORY_TRACKING)
+    constexpr bool AllocationTracking = true;
+#else
+    constexpr bool AllocationTracking = false;
+#endif
+
+    // The counters of one tracker. It lives until its tracker and the allocations charged to it are gone,
+    // and is itself allocated with malloc(), out of the accounting.
+    struct Account
+    {
+        std::atomic<uint64_t> Allocations{ 0 };
+        std::atomic<uint64_t> Frees{ 0 };
+        std::atomic<uint64_t> AllocatedBytes{ 0 };
+        std::atomic<int64_t> LiveBytes{ 0 };
+        std::atomic<int64_t> PeakBytes{ 0 };
+
+        // The tracker, the active scopes and the live allocations.
+        std::atomic<int64_t> References{ 1 };
+    };
+
+    inline Account* CreateAccount()
+    {
+        void* memory = std::malloc(sizeof(Account));
+        if (memory == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return new (memory) Account();
+    }
+
+    inline void AddReference(Account* account) noexcept
+    {
+        account->References.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void Release(Account* account) noexcept
+    {
+        if (account->References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            account->~Account();
+            std::free(account);
+        }
+    }
+
+    // The account the allocations of the calling thread are charged to, none outside of a scope.
+    inline Account*& CurrentAccount() noexcept
+    {
+        static thread_local Account* account = nullptr;
+        return account;
+    }
+
+    inline void RecordAllocation(Account* account, size_t size) noexcept
+    {
+        AddReference(account);
+        account->Allocations.fetch_add(1, std::memory_order_relaxed);
+        account->AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        auto live = account->LiveBytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+        auto peak = account->PeakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !account->PeakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    inline void RecordFree(Account* account, size_t size) noexcept
+    {
+        account->Frees.fetch_add(1, std::memory_order_relaxed);
+        account->LiveBytes.fetch_sub((int64_t)size, std::memory_order_relaxed);
+        Release(account);
+    }
+}
+
+// Tracks the memory of the sessions of one recognizer, and reports each at its SessionStopped: the allocations, the
+// peak of live bytes, the bytes still live (leak candidates, unless the program keeps them on purpose; negative when
+// the session freed those of earlier ones), and how long the results retained with Retain() lived, listing those still alive.
+class SessionMemoryTracker final
+{
+public:
+    // Charges the allocations of the thread to the tracker while it exists, and restores the previous scope after.
+    class Scope final
+    {
+    public:
+        explicit Scope(SessionMemory::Account* account) noexcept
+            : m_account(account), m_previous(SessionMemory::CurrentAccount())
+        {
+            SessionMemory::AddReference(m_account);
+            SessionMemory::CurrentAccount() = m_account;
+        }
+
+        Scope(Scope&& other) noexcept
+            : m_account(other.m_account), m_previous(other.m_previous)
+        {
+            other.m_account = nullptr;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        Scope& operator=(Scope&&) = delete;
+
+        ~Scope()
+        {
+            if (m_account != nullptr)
+            {
+                SessionMemory::CurrentAccount() = m_previous;
+                SessionMemory::Release(m_account);
+            }
+        }
+
+    private:
+        SessionMemory::Account* m_account;
+        SessionMemory::Account* m_previous;
+    };
+
+    // Creates a tracker that reports each session of 'recognizer' to 'out' when it stops.
+    // Attach it before connecting other handlers, so that its report comes before theirs.
+    template <class Recognizer>
+    static std::shared_ptr<SessionMemoryTracker> Attach(Recognizer& recognizer, std::ostream& out)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto tracker = std::shared_ptr<SessionMemoryTracker>(new SessionMemoryTracker(out));
+        std::weak_ptr<SessionMemoryTracker> weak = tracker;
+        recognizer.SessionStarted.Connect([weak](const SessionEventArgs&)
+        {
+            if (auto tracker = weak.lock())
+            {
+                tracker->Start();
+            }
+        });
+        recognizer.SessionStopped.Connect([weak](const SessionEventArgs& e)
+        {
+            if (auto tracker = weak.lock())
+            {
+                tracker->Report(e.SessionId);
+            }
+        });
+        return tracker;
+    }
+
+    ~SessionMemoryTracker()
+    {
+        SessionMemory::Release(m_account);
+    }
+
+    SessionMemoryTracker(const SessionMemoryTracker&) = delete;
+    SessionMemoryTracker& operator=(const SessionMemoryTracker&) = delete;
+
+    // Charges the allocations of the calling thread to the session until the scope ends, e.g. at the top of a handler:
+    //     auto scope = tracker->Enter();
+    Scope Enter() const
+    {
+        return Scope(m_account);
+    }
+
+    // Gets a copy of 'result' whose lifetime is tracked, for the handlers that keep results: it lives until the last
+    // copy of what is returned is released.
+    template <class T>
+    std::shared_ptr<T> Retain(std::shared_ptr<T> result, const std::string& resultId)
+    {
+        if (result == nullptr)
+        {
+            return result;
+        }
+
+        auto holder = std::make_shared<RetainedHolder>();
+        holder->Result = result;
+        holder->Results = m_results;
+        {
+            std::lock_guard<std::mutex> lock(m_results->Mutex);
+            holder->Key = m_results->NextKey++;
+            m_results->Alive[holder->Key] = { resultId, std::chrono::steady_clock::now() };
+            m_results->Retained++;
+        }
+
+        // Shares the ownership of the holder, which records the lifetime when the last copy goes away.
+        return std::shared_ptr<T>(holder, result.get());
+    }
+
+private:
+    struct RetainedResult
+    {
+        std::string ResultId;
+        std::chrono::steady_clock::time_point Since;
+    };
+
+    struct ResultLifetimes
+    {
+        std::mutex Mutex;
+        uint64_t NextKey = 0;
+        std::map<uint64_t, RetainedResult> Alive;
+        uint64_t Retained = 0;
+        LatencyHistogram Lifetimes;
+    };
+
+    struct RetainedHolder
+    {
+        std::shared_ptr<void> Result;
+        std::weak_ptr<ResultLifetimes> Results;
+        uint64_t Key = 0;
+
+        ~RetainedHolder()
+        {
+            auto results = Results.lock();
+            if (results == nullptr)
+            {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(results->Mutex);
+            auto it = results->Alive.find(Key);
+            if (it != results->Alive.end())
+            {
+                results->Lifetimes.Add(ElapsedMilliseconds(it->second.Since));
+                results->Alive.erase(it);
+            }
+        }
+    };
+
+    // The counters at the start of the session, the report gives what changed since.
+    struct Baseline
+    {
+        uint64_t Allocations = 0;
+        uint64_t Frees = 0;
+        uint64_t AllocatedBytes = 0;
+        int64_t LiveBytes = 0;
+    };
+
+    explicit SessionMemoryTracker(std::ostream& out)
+        : m_out(out), m_account(SessionMemory::CreateAccount()), m_results(std::make_shared<ResultLifetimes>())
+    {
+    }
+
+    void Start()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_baseline.Allocations = m_account->Allocations.load();
+        m_baseline.Frees = m_account->Frees.load();
+        m_baseline.AllocatedBytes = m_account->AllocatedBytes.load();
+        m_baseline.LiveBytes = m_account->LiveBytes.load();
+        m_account->PeakBytes.store(m_baseline.LiveBytes);
+
+        std::lock_guard<std::mutex> resultsLock(m_results->Mutex);
+        m_results->Retained = 0;
+        m_results->Lifetimes = LatencyHistogram();
+    }
+
+    void Report(const std::string& sessionId)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_out << "Session " << sessionId << " memory:";
+        if (SessionMemory::AllocationTracking)
+        {
+            m_out << " allocations=" << m_account->Allocations.load() - m_baseline.Allocations
+                  << ", frees=" << m_account->Frees.load() - m_baseline.Frees
+                  << ", allocated=" << m_account->AllocatedBytes.load() - m_baseline.AllocatedBytes << "B"
+                  << ", peak=" << m_account->PeakBytes.load() - m_baseline.LiveBytes << "B"
+                  << ", live since start=" << m_account->LiveBytes.load() - m_baseline.LiveBytes << "B\n";
+        }
+        else
+        {
+            m_out << " allocations not tracked, build with SESSION_MEMORY_TRACKING to count them\n";
+        }
+
+        std::lock_guard<std::mutex> resultsLock(m_results->Mutex);
+        m_out << "Session " << sessionId << " results: retained=" << m_results->Retained
+              << ", alive=" << m_results->Alive.size() << ", ";
+        m_results->Lifetimes.Print(m_out, "lifetimes of the released");
+
+        // The results kept beyond their session, the oldest first.
+        for (const auto& alive : m_results->Alive)
+        {
+            m_out << "  Leak candidate: result " << alive.second.ResultId
+                  << " retained for " << ElapsedMilliseconds(alive.second.Since) << "ms\n";
+        }
+        m_out.flush();
+    }
+
+    static double ElapsedMilliseconds(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    std::ostream& m_out;
+    SessionMemory::Account* const m_account;
+    const std::shared_ptr<ResultLifetimes> m_results;
+
+    std::mutex m_mutex;
+    Baseline m_baseline;
+};
+
+// The replacement operator new and delete, defined by the one source file that defines SESSION_MEMORY_TRACKER_OPERATORS;
+// they exist only in the instrumentation mode. Each allocation has a header with the account it is charged to and its size.
+#if defined(SESSION_MEMORY_TRACKING) && defined(SESSION_MEMORY_TRACKER_OPERATORS)
+
+namespace SessionMemory
+{
+    struct alignas(std::max_align_t) AllocationHeader
+    {
+        Account* Owner;
+        size_t Size;
+    };
+
+    inline void* Allocate(size_t size) noexcept
+    {
+        auto header = static_cast<AllocationHeader*>(std::malloc(sizeof(AllocationHeader) + size));
+        if (header == nullptr)
+        {
+            return nullptr;
+        }
+        header->Owner = CurrentAccount();
+        header->Size = size;
+        if (header->Owner != nullptr)
+        {
+            RecordAllocation(header->Owner, size);
+        }
+        return header + 1;
+    }
+
+    inline void* AllocateOrThrow(size_t size)
+    {
+        while (true)
+        {
+            if (auto memory = Allocate(size == 0 ? 1 : size))
+            {
+                return memory;
+            }
+            auto handler = std::get_new_handler();
+            if (handler == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+
+    inline void Free(void* memory) noexcept
+    {
+        if (memory == nullptr)
+        {
+            return;
+        }
+        auto header = static_cast<AllocationHeader*>(memory) - 1;
+        if (header->Owner != nullptr)
+        {
+            RecordFree(header->Owner, header->Size);
+        }
+        std::free(header);
+    }
+}
+
+void* operator new(size_t size) { return SessionMemory::AllocateOrThrow(size); }
+void* operator new[](size_t size) { return SessionMemory::AllocateOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return SessionMemory::Allocate(size == 0 ? 1 : size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return SessionMemory::Allocate(size == 0 ? 1 : size); }
+void operator delete(void* memory) noexcept { SessionMemory::Free(memory); }
+void operator delete[](void* memory) noexcept { SessionMemory::Free(memory); }
+void operator delete(void* memory, size_t) noexcept { SessionMemory::Free(memory); }
+void operator delete[](void* memory, size_t) noexcept { SessionMemory::Free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { SessionMemory::Free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { SessionMemory::Free(memory); }
+
+#endif
@@ -0,0 +1,354 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+
+// Defines the kinds of SDK events a session recording holds.
+enum class RecordedEventKind : uint8_t
+{
+    SessionStarted,
+    SpeechStartDetected,
+    Recognizing,
+    Recognized,
+    NoMatch,
+    Canceled,
+    SessionStopped,
+    SynthesisStarted,
+    Synthesizing,
+    SynthesisCompleted,
+    SynthesisCanceled
+};
+
+// An event of a recorded session, with the payload the handlers of the samples use.
+struct RecordedEvent
+{
+    RecordedEventKind Kind = RecordedEventKind::SessionStarted;
+    uint64_t TimeMicroseconds = 0;      // since the recording started.
+    std::string SessionId;              // of a recognition event, or the result id of a synthesis event.
+    std::string Text;                   // of a result, or the error details of a cancellation.
+    uint64_t Offset = 0;                // in ticks of 100 nanoseconds.
+    uint64_t Duration = 0;              // in ticks of 100 nanoseconds.
+    int32_t Reason = 0;                 // the CancellationReason of a cancellation.
+    int32_t ErrorCode = 0;              // the CancellationErrorCode of a cancellation.
+    std::vector<uint8_t> Audio;         // of a Synthesizing chunk.
+};
+
+// The events of recorded sessions, in the order they were raised, and their file format: a magic, then one record per
+// event, with its kind, time, offset, duration, reason and error code, then its session id, text and audio, each
+// behind its length. All the integers are little endian.
+class SessionRecording final
+{
+public:
+    void Add(RecordedEvent&& event)
+    {
+        m_events.push_back(std::move(event));
+    }
+
+    const std::vector<RecordedEvent>& GetEvents() const
+    {
+        return m_events;
+    }
+
+    // Gets the time of the last event.
+    uint64_t GetDurationMicroseconds() const
+    {
+        return m_events.empty() ? 0 : m_events.back().TimeMicroseconds;
+    }
+
+    void Save(const std::string& fileName) const
+    {
+        std::string data(fileMagic, fileMagicSize);
+        for (const auto& event : m_events)
+        {
+            data += (char)event.Kind;
+            Put(data, event.TimeMicroseconds, 8);
+            Put(data, event.Offset, 8);
+            Put(data, event.Duration, 8);
+            Put(data, (uint32_t)event.Reason, 4);
+            Put(data, (uint32_t)event.ErrorCode, 4);
+            PutBytes(data, event.SessionId.data(), event.SessionId.size());
+            PutBytes(data, event.Text.data(), event.Text.size());
+            PutBytes(data, event.Audio.data(), event.Audio.size());
+        }
+
+        std::ofstream file(fileName, std::ios::binary);
+        file.write(data.data(), data.size());
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write " + fileName);
+        }
+    }
+
+    static SessionRecording Load(const std::string& fileName)
+    {
+        std::ifstream file(fileName, std::ios::binary);
+        if (!file.good())
+        {
+            throw std::invalid_argument("Failed to open " + fileName);
+        }
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.size() < fileMagicSize || memcmp(data.data(), fileMagic, fileMagicSize) != 0)
+        {
+            throw std::runtime_error(fileName + " is not a session recording");
+        }
+
+        SessionRecording recording;
+        size_t position = fileMagicSize;
+        while (position < data.size())
+        {
+            RecordedEvent event;
+            auto kind = (uint8_t)data[position++];
+            if (kind > (uint8_t)RecordedEventKind::SynthesisCanceled)
+            {
+                throw std::runtime_error("Unknown event kind in " + fileName);
+            }
+            event.Kind = (RecordedEventKind)kind;
+            event.TimeMicroseconds = Get(data, position, 8, fileName);
+            event.Offset = Get(data, position, 8, fileName);
+            event.Duration = Get(data, position, 8, fileName);
+            event.Reason = (int32_t)(uint32_t)Get(data, position, 4, fileName);
+            event.ErrorCode = (int32_t)(uint32_t)Get(data, position, 4, fileName);
+            event.SessionId = GetBytes(data, position, fileName);
+            event.Text = GetBytes(data, position, fileName);
+            auto audio = GetBytes(data, position, fileName);
+            event.Audio.assign(audio.begin(), audio.end());
+            recording.Add(std::move(event));
+        }
+        return recording;
+    }
+
+private:
+    // Defines the magic bytes at the start of a recording.
+    static constexpr const char* fileMagic = "SPXREC01";
+    static constexpr size_t fileMagicSize = 8;
+
+    static void Put(std::string& data, uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+        {
+            data += (char)(uint8_t)(value >> (8 * i));
+        }
+    }
+
+    static void PutBytes(std::string& data, const void* bytes, size_t size)
+    {
+        Put(data, (uint32_t)size, 4);
+        data.append((const char*)bytes, size);
+    }
+
+    static uint64_t Get(const std::string& data, size_t& position, int bytes, const std::string& fileName)
+    {
+        if (data.size() - position < (size_t)bytes)
+        {
+            throw std::runtime_error(fileName + " is truncated");
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+        {
+            value |= (uint64_t)(uint8_t)data[position++] << (8 * i);
+        }
+        return value;
+    }
+
+    static std::string GetBytes(const std::string& data, size_t& position, const std::string& fileName)
+    {
+        auto size = (size_t)Get(data, position, 4, fileName);
+        if (data.size() - position < size)
+        {
+            throw std::runtime_error(fileName + " is truncated");
+        }
+        position += size;
+        return data.substr(position - size, size);
+    }
+
+    std::vector<RecordedEvent> m_events;
+};
+
+// Records the events of live recognizers and synthesizers, with their timing, so that the sessions can be replayed
+// offline by a SessionReplayer. The handlers only copy the payload under a lock.
+class SessionRecorder final
+{
+public:
+    SessionRecorder()
+        : m_state(std::make_shared<State>())
+    {
+    }
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    void Attach(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer> recognizer)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto state = m_state;
+        recognizer->SessionStarted.Connect([state](const SessionEventArgs& e)
+        {
+            state->Add(RecordedEventKind::SessionStarted, e.SessionId);
+        });
+        recognizer->SpeechStartDetected.Connect([state](const RecognitionEventArgs& e)
+        {
+            state->Add(RecordedEventKind::SpeechStartDetected, e.SessionId, std::string(), e.Offset);
+        });
+        recognizer->Recognizing.Connect([state](const SpeechRecognitionEventArgs& e)
+        {
+            state->Add(RecordedEventKind::Recognizing, e.SessionId, e.Result->Text, e.Result->Offset(), e.Result->Duration());
+        });
+        recognizer->Recognized.Connect([state](const SpeechRecognitionEventArgs& e)
+        {
+            auto kind = e.Result->Reason == ResultReason::RecognizedSpeech ? RecordedEventKind::Recognized : RecordedEventKind::NoMatch;
+            state->Add(kind, e.SessionId, e.Result->Text, e.Result->Offset(), e.Result->Duration());
+        });
+        recognizer->Canceled.Connect([state](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            state->Add(RecordedEventKind::Canceled, e.SessionId, e.ErrorDetails, 0, 0, (int32_t)e.Reason, (int32_t)e.ErrorCode);
+        });
+        recognizer->SessionStopped.Connect([state](const SessionEventArgs& e)
+        {
+            state->Add(RecordedEventKind::SessionStopped, e.SessionId);
+        });
+    }
+
+    void Attach(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> synthesizer)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto state = m_state;
+        synthesizer->SynthesisStarted.Connect([state](const SpeechSynthesisEventArgs& e)
+        {
+            state->Add(RecordedEventKind::SynthesisStarted, e.Result->ResultId);
+        });
+        synthesizer->Synthesizing.Connect([state](const SpeechSynthesisEventArgs& e)
+        {
+            state->Add(RecordedEventKind::Synthesizing, e.Result->ResultId, std::string(), 0, 0, 0, 0, e.Result->GetAudioData());
+        });
+        synthesizer->SynthesisCompleted.Connect([state](const SpeechSynthesisEventArgs& e)
+        {
+            state->Add(RecordedEventKind::SynthesisCompleted, e.Result->ResultId);
+        });
+        synthesizer->SynthesisCanceled.Connect([state](const SpeechSynthesisEventArgs& e)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(e.Result);
+            state->Add(RecordedEventKind::SynthesisCanceled, e.Result->ResultId, cancellation->ErrorDetails, 0, 0,
+                (int32_t)cancellation->Reason, (int32_t)cancellation->ErrorCode);
+        });
+    }
+
+    // Gets a copy of the events recorded so far.
+    SessionRecording GetRecording() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->Mutex);
+        return m_state->Recording;
+    }
+
+private:
+    // Shared with the event handlers, which may still run on SDK threads after the recorder is gone.
+    struct State
+    {
+        std::mutex Mutex;
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        SessionRecording Recording;
+
+        void Add(RecordedEventKind kind, const std::string& sessionId, const std::string& text = std::string(), uint64_t offset = 0,
+            uint64_t duration = 0, int32_t reason = 0, int32_t errorCode = 0, std::shared_ptr<std::vector<uint8_t>> audio = nullptr)
+        {
+            RecordedEvent event;
+            event.Kind = kind;
+            event.SessionId = sessionId;
+            event.Text = text;
+            event.Offset = offset;
+            event.Duration = duration;
+            event.Reason = reason;
+            event.ErrorCode = errorCode;
+            if (audio != nullptr)
+            {
+                event.Audio = *audio;
+            }
+
+            std::lock_guard<std::mutex> lock(Mutex);
+            event.TimeMicroseconds = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count();
+            Recording.Add(std::move(event));
+        }
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+// The outcome of a replay.
+struct ReplayStatistics
+{
+    uint64_t Events = 0;
+    uint64_t AudioBytes = 0;            // of the Synthesizing chunks replayed.
+    double WallSeconds = 0;
+    double RecordedSeconds = 0;         // of all the iterations, at the recorded pace.
+    LatencyHistogram HandlerLatency;    // in microseconds per event.
+};
+
+// Replays the events of a recording to a handler, in recorded order, on the calling thread, the way the SDK calls its
+// handlers from one dispatch thread. Without pacing, the events follow each other back to back, so that runs are
+// repeatable and measure only the client-side code the handler drives: sinks, buffers, caches. With pacing, each event
+// is delivered at its recorded time, scaled by the speed.
+class SessionReplayer final
+{
+public:
+    using Handler = std::function<void(const RecordedEvent& event)>;
+
+    // Defines the speed that delivers the events as fast as the handler takes them.
+    static constexpr double unpaced = 0;
+
+    SessionReplayer(const SessionRecording& recording, double speed = unpaced)
+        : m_recording(recording), m_speed(speed)
+    {
+        if (speed < 0)
+        {
+            throw std::invalid_argument("Speed can't be negative");
+        }
+    }
+
+    // Replays the recording 'iterations' times.
+    ReplayStatistics Replay(const Handler& handler, uint32_t iterations = 1) const
+    {
+        ReplayStatistics statistics;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            auto iterationStart = std::chrono::steady_clock::now();
+            for (const auto& event : m_recording.GetEvents())
+            {
+                if (m_speed > 0)
+                {
+                    std::this_thread::sleep_until(iterationStart + std::chrono::microseconds((uint64_t)(event.TimeMicroseconds / m_speed)));
+                }
+
+                auto handlerStart = std::chrono::steady_clock::now();
+                handler(event);
+                statistics.HandlerLatency.Add(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - handlerStart).count());
+                statistics.Events++;
+                statistics.AudioBytes += event.Audio.size();
+            }
+        }
+        statistics.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        statistics.RecordedSeconds = m_recording.GetDurationMicroseconds() / 1e6 * iterations;
+        return statistics;
+    }
+
+private:
+    const SessionRecording m_recording;
+    const double m_speed;
+};
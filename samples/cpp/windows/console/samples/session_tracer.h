@@ -0,0 +1,726 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chunked_http_audio_stream.h"
+
+// An attribute of a span or of a span event, either a string or an integer.
+struct TraceAttribute
+{
+    std::string Key;
+    std::string StringValue;
+    int64_t IntValue = 0;
+    bool IsInt = false;
+
+    static TraceAttribute String(const std::string& key, const std::string& value)
+    {
+        TraceAttribute attribute;
+        attribute.Key = key;
+        attribute.StringValue = value;
+        return attribute;
+    }
+
+    static TraceAttribute Int(const std::string& key, int64_t value)
+    {
+        TraceAttribute attribute;
+        attribute.Key = key;
+        attribute.IntValue = value;
+        attribute.IsInt = true;
+        return attribute;
+    }
+};
+
+struct TraceEvent
+{
+    std::string Name;
+    uint64_t TimeUnixNano = 0;
+    std::vector<TraceAttribute> Attributes;
+};
+
+// A span as OpenTelemetry defines it, with what the tracer records.
+struct TraceSpan
+{
+    std::string TraceId;            // 32 hex digits.
+    std::string SpanId;             // 16 hex digits.
+    std::string ParentSpanId;       // empty for the root span of a trace.
+    std::string Name;
+    uint64_t StartUnixNano = 0;
+    uint64_t EndUnixNano = 0;
+    std::vector<TraceAttribute> Attributes;
+    std::vector<TraceEvent> Events;
+    uint32_t DroppedEvents = 0;
+    bool Failed = false;
+    std::string StatusMessage;
+};
+
+// Encodes spans as an OTLP ExportTraceServiceRequest, in the JSON encoding of OTLP/HTTP.
+class OtlpJsonEncoder final
+{
+public:
+    static std::string Encode(const std::vector<TraceSpan>& spans, const std::string& serviceName)
+    {
+        std::string json = "{\"resourceSpans\":[{\"resource\":{\"attributes\":[";
+        AppendAttribute(json, TraceAttribute::String("service.name", serviceName));
+        json += "]},\"scopeSpans\":[{\"scope\":{\"name\":\"speech-sdk-samples\"},\"spans\":[";
+        for (size_t i = 0; i < spans.size(); i++)
+        {
+            const auto& span = spans[i];
+            json += i > 0 ? ",{" : "{";
+            json += "\"traceId\":\"" + span.TraceId + "\",\"spanId\":\"" + span.SpanId + "\"";
+            if (!span.ParentSpanId.empty())
+            {
+                json += ",\"parentSpanId\":\"" + span.ParentSpanId + "\"";
+            }
+            json += ",\"name\":";
+            AppendString(json, span.Name);
+            json += ",\"kind\":3,\"startTimeUnixNano\":\"" + std::to_string(span.StartUnixNano)
+                + "\",\"endTimeUnixNano\":\"" + std::to_string(span.EndUnixNano) + "\",\"attributes\":";
+            AppendAttributes(json, span.Attributes);
+            json += ",\"events\":[";
+            for (size_t j = 0; j < span.Events.size(); j++)
+            {
+                const auto& event = span.Events[j];
+                json += j > 0 ? ",{" : "{";
+                json += "\"timeUnixNano\":\"" + std::to_string(event.TimeUnixNano) + "\",\"name\":";
+                AppendString(json, event.Name);
+                json += ",\"attributes\":";
+                AppendAttributes(json, event.Attributes);
+                json += "}";
+            }
+            json += "],\"droppedEventsCount\":" + std::to_string(span.DroppedEvents);
+
+            // The status codes are 1 for ok, and 2 for error.
+            json += ",\"status\":{\"code\":" + std::string(span.Failed ? "2" : "1");
+            if (!span.StatusMessage.empty())
+            {
+                json += ",\"message\":";
+                AppendString(json, span.StatusMessage);
+            }
+            json += "}}";
+        }
+        json += "]}]}]}";
+        return json;
+    }
+
+private:
+    static void AppendAttributes(std::string& json, const std::vector<TraceAttribute>& attributes)
+    {
+        json += "[";
+        for (size_t i = 0; i < attributes.size(); i++)
+        {
+            if (i > 0)
+            {
+                json += ",";
+            }
+            AppendAttribute(json, attributes[i]);
+        }
+        json += "]";
+    }
+
+    // 64-bit integers are strings in the JSON encoding.
+    static void AppendAttribute(std::string& json, const TraceAttribute& attribute)
+    {
+        json += "{\"key\":";
+        AppendString(json, attribute.Key);
+        if (attribute.IsInt)
+        {
+            json += ",\"value\":{\"intValue\":\"" + std::to_string(attribute.IntValue) + "\"}}";
+        }
+        else
+        {
+            json += ",\"value\":{\"stringValue\":";
+            AppendString(json, attribute.StringValue);
+            json += "}}";
+        }
+    }
+
+    static void AppendString(std::string& json, const std::string& value)
+    {
+        json += '"';
+        for (auto c : value)
+        {
+            switch (c)
+            {
+            case '"': json += "\\\""; break;
+            case '\\': json += "\\\\"; break;
+            case '\n': json += "\\n"; break;
+            case '\r': json += "\\r"; break;
+            case '\t': json += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20)
+                {
+                    char escaped[7];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+                    json += escaped;
+                }
+                else
+                {
+                    json += c;
+                }
+            }
+        }
+        json += '"';
+    }
+};
+
+// A destination of the batches of finished spans.
+class SpanExporter
+{
+public:
+    virtual ~SpanExporter() = default;
+
+    // Exports a batch. It returns false if the batch was not accepted.
+    virtual bool Export(const std::vector<TraceSpan>& spans) = 0;
+};
+
+// Posts each batch to the OTLP/HTTP traces endpoint of a collector, e.g. an OpenTelemetry Collector on port 4318.
+// A collector that does not accept the connection, or answer, within 'timeout' fails the export, so that it never
+// holds up the processor for longer.
+class OtlpHttpSpanExporter final : public SpanExporter
+{
+public:
+    OtlpHttpSpanExporter(const std::string& host, uint16_t port = 4318, const std::string& serviceName = "speech-client",
+        const std::string& path = "/v1/traces", std::chrono::milliseconds timeout = std::chrono::milliseconds(5000))
+        : m_host(host), m_port(port), m_serviceName(serviceName), m_path(path), m_timeout(timeout)
+    {
+    }
+
+    bool Export(const std::vector<TraceSpan>& spans) override
+    {
+        auto body = OtlpJsonEncoder::Encode(spans, m_serviceName);
+        auto connection = HttpConnection::Connect(m_host, m_port, m_timeout);
+        auto request = "POST " + m_path + " HTTP/1.1\r\nHost: " + m_host + ":" + std::to_string(m_port)
+            + "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        if (!connection->SendAll(request) || !connection->SendAll(body))
+        {
+            return false;
+        }
+
+        // Only the status line matters: "HTTP/1.1 200 OK".
+        auto head = connection->ReadRequestHead();
+        return head.size() > 9 && head[9] == '2';
+    }
+
+private:
+    const std::string m_host;
+    const uint16_t m_port;
+    const std::string m_serviceName;
+    const std::string m_path;
+    const std::chrono::milliseconds m_timeout;
+};
+
+// Appends each batch to a file as one line of OTLP JSON, the format the otlpjsonfile receiver of the collector reads.
+class OtlpFileSpanExporter final : public SpanExporter
+{
+public:
+    OtlpFileSpanExporter(const std::string& fileName, const std::string& serviceName = "speech-client")
+        : m_file(fileName, std::ios::binary | std::ios::app), m_serviceName(serviceName)
+    {
+        if (!m_file.good())
+        {
+            throw std::invalid_argument("Failed to open " + fileName);
+        }
+    }
+
+    bool Export(const std::vector<TraceSpan>& spans) override
+    {
+        m_file << OtlpJsonEncoder::Encode(spans, m_serviceName) << '\n';
+        m_file.flush();
+        return m_file.good();
+    }
+
+private:
+    std::ofstream m_file;
+    const std::string m_serviceName;
+};
+
+struct BatchSpanProcessorOptions
+{
+    size_t MaxQueueSize = 2048;                         // spans beyond it are dropped, rather than slowing the SDK down.
+    size_t MaxExportBatchSize = 512;
+    std::chrono::milliseconds ScheduleDelay{ 5000 };    // between exports of a batch that is not full.
+};
+
+struct BatchSpanProcessorStatistics
+{
+    uint64_t Exported = 0;
+    uint64_t Dropped = 0;
+    uint64_t FailedExports = 0;
+    double ExportSeconds = 0;       // time spent encoding and sending on the export thread.
+};
+
+// Queues finished spans and exports them in batches on a background thread, as the OpenTelemetry batch span processor
+// does: the SDK threads that end spans only take a lock and move the span, all the encoding and I/O happen off them.
+class BatchSpanProcessor final
+{
+public:
+    BatchSpanProcessor(std::shared_ptr<SpanExporter> exporter, const BatchSpanProcessorOptions& options = BatchSpanProcessorOptions())
+        : m_exporter(exporter), m_options(options)
+    {
+        if (exporter == nullptr || options.MaxQueueSize == 0 || options.MaxExportBatchSize == 0)
+        {
+            throw std::invalid_argument("An exporter, a positive queue size and a positive batch size are required");
+        }
+        m_thread = std::thread([this]() { ExportLoop(); });
+    }
+
+    ~BatchSpanProcessor()
+    {
+        Shutdown();
+    }
+
+    BatchSpanProcessor(const BatchSpanProcessor&) = delete;
+    BatchSpanProcessor& operator=(const BatchSpanProcessor&) = delete;
+
+    // Queues a finished span. It is dropped, and counted, if the queue is full.
+    void OnEnd(TraceSpan&& span)
+    {
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.size() >= m_options.MaxQueueSize || m_stopped)
+            {
+                m_statistics.Dropped++;
+                return;
+            }
+            m_queue.push_back(std::move(span));
+            full = m_queue.size() >= m_options.MaxExportBatchSize;
+        }
+        if (full)
+        {
+            m_wakeUp.notify_one();
+        }
+    }
+
+    // Exports the spans queued so far, and waits for it.
+    void ForceFlush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto target = ++m_flushRequested;
+        m_wakeUp.notify_one();
+        m_flushed.wait(lock, [this, target]() { return m_flushCompleted >= target || m_stopped; });
+    }
+
+    // Exports the spans left, and stops the export thread.
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopped)
+            {
+                return;
+            }
+            m_stopped = true;
+        }
+        m_wakeUp.notify_one();
+        m_thread.join();
+        m_flushed.notify_all();
+    }
+
+    BatchSpanProcessorStatistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+
+private:
+    void ExportLoop()
+    {
+        std::vector<TraceSpan> batch;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_wakeUp.wait_for(lock, m_options.ScheduleDelay, [this]()
+            {
+                return m_stopped || m_flushRequested > m_flushCompleted || m_queue.size() >= m_options.MaxExportBatchSize;
+            });
+            auto flush = m_flushRequested;
+
+            // Exports in batches until the queue is drained, so that a flush or the shutdown does not leave spans behind.
+            while (!m_queue.empty())
+            {
+                auto count = (std::min)(m_queue.size(), m_options.MaxExportBatchSize);
+                batch.assign(std::make_move_iterator(m_queue.begin()), std::make_move_iterator(m_queue.begin() + count));
+                m_queue.erase(m_queue.begin(), m_queue.begin() + count);
+                lock.unlock();
+
+                auto start = std::chrono::steady_clock::now();
+                bool exported = false;
+                try
+                {
+                    exported = m_exporter->Export(batch);
+                }
+                catch (const std::exception&)
+                {
+                }
+                auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                lock.lock();
+                m_statistics.ExportSeconds += seconds;
+                if (exported)
+                {
+                    m_statistics.Exported += batch.size();
+                }
+                else
+                {
+                    m_statistics.FailedExports++;
+                    m_statistics.Dropped += batch.size();
+                }
+            }
+
+            m_flushCompleted = flush;
+            m_flushed.notify_all();
+            if (m_stopped)
+            {
+                return;
+            }
+        }
+    }
+
+    const std::shared_ptr<SpanExporter> m_exporter;
+    const BatchSpanProcessorOptions m_options;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_flushed;
+    std::deque<TraceSpan> m_queue;
+    uint64_t m_flushRequested = 0;
+    uint64_t m_flushCompleted = 0;
+    bool m_stopped = false;
+    BatchSpanProcessorStatistics m_statistics;
+    std::thread m_thread;
+};
+
+// Traces recognition and synthesis sessions, from the events of the recognizers and synthesizers attached to it.
+// A recognition session is a root span keyed by the session id, from SessionStarted to SessionStopped, with an event
+// per connection open and close, NoMatch and cancellation, and a child span per utterance, from SpeechStartDetected to
+// its final Recognized result. A synthesis is a root span keyed by the result id, with an event per Synthesizing chunk.
+// The offsets and durations are attributes in ticks of 100 nanoseconds, the byte counts in bytes.
+class SessionTracer final
+{
+public:
+    // Defines the most events kept in a span; the others are only counted, so a long synthesis does not grow its span forever.
+    static constexpr size_t maxEventsPerSpan = 128;
+
+    SessionTracer(std::shared_ptr<BatchSpanProcessor> processor)
+        : m_state(std::make_shared<State>())
+    {
+        if (processor == nullptr)
+        {
+            throw std::invalid_argument("A span processor is required");
+        }
+        m_state->Processor = processor;
+    }
+
+    SessionTracer(const SessionTracer&) = delete;
+    SessionTracer& operator=(const SessionTracer&) = delete;
+
+    // Traces the sessions of a recognizer. The tracer must stay alive while it recognizes, for the connection events.
+    void Attach(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer> recognizer)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto state = m_state;
+        recognizer->SessionStarted.Connect([state](const SessionEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            state->GetSession(e.SessionId);
+        });
+
+        recognizer->SpeechStartDetected.Connect([state](const RecognitionEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto& session = state->GetSession(e.SessionId);
+            auto now = Now();
+            if (session.InUtterance)
+            {
+                state->End(session.Utterance, now);
+            }
+            session.Utterance = state->StartSpan("speech.utterance", &session.Span, now);
+            session.Utterance.Attributes.push_back(TraceAttribute::Int("speech.offset", (int64_t)e.Offset));
+            AddEvent(session.Utterance, "speech.start_detected", now, { TraceAttribute::Int("speech.offset", (int64_t)e.Offset) });
+            session.InUtterance = true;
+        });
+
+        recognizer->Recognized.Connect([state](const SpeechRecognitionEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto& session = state->GetSession(e.SessionId);
+            auto now = Now();
+            if (e.Result->Reason != ResultReason::RecognizedSpeech)
+            {
+                AddEvent(session.Span, "speech.no_match", now, { TraceAttribute::Int("speech.offset", (int64_t)e.Result->Offset()) });
+                return;
+            }
+
+            // A result without a detected start, e.g. of a single-shot recognition, gets a span of its own of no length.
+            if (!session.InUtterance)
+            {
+                session.Utterance = state->StartSpan("speech.utterance", &session.Span, now);
+            }
+            auto& utterance = session.Utterance;
+            utterance.Attributes.push_back(TraceAttribute::String("speech.result_id", e.Result->ResultId));
+            utterance.Attributes.push_back(TraceAttribute::Int("speech.result.offset", (int64_t)e.Result->Offset()));
+            utterance.Attributes.push_back(TraceAttribute::Int("speech.result.duration", (int64_t)e.Result->Duration()));
+            utterance.Attributes.push_back(TraceAttribute::Int("speech.result.text_length", (int64_t)e.Result->Text.size()));
+            AddEvent(utterance, "speech.recognized", now, { TraceAttribute::Int("speech.offset", (int64_t)e.Result->Offset()) });
+            state->End(utterance, now);
+            session.InUtterance = false;
+            session.Recognized++;
+        });
+
+        recognizer->Canceled.Connect([state](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto& session = state->GetSession(e.SessionId);
+            auto now = Now();
+            std::vector<TraceAttribute> attributes = { TraceAttribute::Int("speech.cancellation.reason", (int64_t)e.Reason) };
+            if (e.Reason == CancellationReason::Error)
+            {
+                attributes.push_back(TraceAttribute::Int("speech.cancellation.error_code", (int64_t)e.ErrorCode));
+                session.Span.Failed = true;
+                session.Span.StatusMessage = e.ErrorDetails;
+            }
+            AddEvent(session.Span, "speech.canceled", now, attributes);
+            if (session.InUtterance)
+            {
+                session.Utterance.Failed = session.Span.Failed;
+                state->End(session.Utterance, now);
+                session.InUtterance = false;
+            }
+        });
+
+        recognizer->SessionStopped.Connect([state](const SessionEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto found = state->Sessions.find(e.SessionId);
+            if (found == state->Sessions.end())
+            {
+                return;
+            }
+            auto& session = found->second;
+            auto now = Now();
+            if (session.InUtterance)
+            {
+                state->End(session.Utterance, now);
+            }
+            session.Span.Attributes.push_back(TraceAttribute::Int("speech.recognized_count", (int64_t)session.Recognized));
+            state->End(session.Span, now);
+            state->Sessions.erase(found);
+        });
+
+        auto connection = Connection::FromRecognizer(recognizer);
+        connection->Connected.Connect([state](const ConnectionEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            AddEvent(state->GetSession(e.SessionId).Span, "connection.opened", Now(), {});
+        });
+        connection->Disconnected.Connect([state](const ConnectionEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto found = state->Sessions.find(e.SessionId);
+            if (found != state->Sessions.end())
+            {
+                AddEvent(found->second.Span, "connection.closed", Now(), {});
+            }
+        });
+
+        // The connection is kept here rather than in the handlers, which would keep the recognizer alive forever.
+        m_connections.push_back(connection);
+    }
+
+    // Traces the syntheses of a synthesizer.
+    void Attach(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> synthesizer)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto state = m_state;
+        synthesizer->SynthesisStarted.Connect([state](const SpeechSynthesisEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto& synthesis = state->Syntheses[e.Result->ResultId];
+            synthesis.Span = state->StartSpan("speech.synthesis", nullptr, Now());
+            synthesis.Span.Attributes.push_back(TraceAttribute::String("speech.result_id", e.Result->ResultId));
+
+            // The synthesizer connects before its first synthesis starts, so the event is moved to the synthesis it was for.
+            if (state->SynthesisConnectedAt != 0)
+            {
+                AddEvent(synthesis.Span, "connection.opened", state->SynthesisConnectedAt, {});
+                state->SynthesisConnectedAt = 0;
+            }
+        });
+
+        synthesizer->Synthesizing.Connect([state](const SpeechSynthesisEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto found = state->Syntheses.find(e.Result->ResultId);
+            if (found == state->Syntheses.end())
+            {
+                return;
+            }
+            auto& synthesis = found->second;
+            auto now = Now();
+            if (synthesis.Chunks == 0)
+            {
+                synthesis.Span.Attributes.push_back(TraceAttribute::Int("synthesis.first_chunk_latency_ms",
+                    (int64_t)((now - synthesis.Span.StartUnixNano) / 1000000)));
+            }
+            synthesis.Chunks++;
+            synthesis.Bytes += e.Result->AudioLength;
+            AddEvent(synthesis.Span, "synthesis.chunk", now,
+                { TraceAttribute::Int("audio.bytes", (int64_t)e.Result->AudioLength), TraceAttribute::Int("audio.offset_bytes", (int64_t)(synthesis.Bytes - e.Result->AudioLength)) });
+        });
+
+        auto end = [state](const SpeechSynthesisEventArgs& e, bool canceled)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            auto found = state->Syntheses.find(e.Result->ResultId);
+            if (found == state->Syntheses.end())
+            {
+                return;
+            }
+            auto& synthesis = found->second;
+            auto now = Now();
+            synthesis.Span.Attributes.push_back(TraceAttribute::Int("synthesis.chunk_count", (int64_t)synthesis.Chunks));
+            synthesis.Span.Attributes.push_back(TraceAttribute::Int("audio.bytes", (int64_t)synthesis.Bytes));
+            if (canceled)
+            {
+                auto cancellation = SpeechSynthesisCancellationDetails::FromResult(e.Result);
+                AddEvent(synthesis.Span, "synthesis.canceled", now, { TraceAttribute::Int("speech.cancellation.error_code", (int64_t)cancellation->ErrorCode) });
+                synthesis.Span.Failed = true;
+                synthesis.Span.StatusMessage = cancellation->ErrorDetails;
+            }
+            state->End(synthesis.Span, now);
+            state->Syntheses.erase(found);
+        };
+        synthesizer->SynthesisCompleted.Connect([end](const SpeechSynthesisEventArgs& e) { end(e, false); });
+        synthesizer->SynthesisCanceled.Connect([end](const SpeechSynthesisEventArgs& e) { end(e, true); });
+
+        auto connection = Connection::FromSpeechSynthesizer(synthesizer);
+        connection->Connected.Connect([state](const ConnectionEventArgs&)
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            state->SynthesisConnectedAt = Now();
+        });
+        m_connections.push_back(connection);
+    }
+
+private:
+    struct Session
+    {
+        TraceSpan Span;
+        TraceSpan Utterance;
+        bool InUtterance = false;
+        uint64_t Recognized = 0;
+    };
+
+    struct Synthesis
+    {
+        TraceSpan Span;
+        uint64_t Chunks = 0;
+        uint64_t Bytes = 0;
+    };
+
+    // Shared with the event handlers, which may still run on SDK threads after the tracer is gone.
+    struct State
+    {
+        std::mutex Mutex;
+        std::shared_ptr<BatchSpanProcessor> Processor;
+        std::map<std::string, Session> Sessions;
+        std::map<std::string, Synthesis> Syntheses;
+        uint64_t SynthesisConnectedAt = 0;
+        std::mt19937_64 Random{ std::random_device()() };
+
+        // Gets the session of a session id, starting its span on the first event of the session. Called with the lock held.
+        Session& GetSession(const std::string& sessionId)
+        {
+            auto found = Sessions.find(sessionId);
+            if (found != Sessions.end())
+            {
+                return found->second;
+            }
+            auto& session = Sessions[sessionId];
+            session.Span = StartSpan("speech.recognition.session", nullptr, Now());
+            session.Span.Attributes.push_back(TraceAttribute::String("speech.session_id", sessionId));
+            return session;
+        }
+
+        TraceSpan StartSpan(const std::string& name, const TraceSpan* parent, uint64_t now)
+        {
+            TraceSpan span;
+            span.Name = name;
+            span.StartUnixNano = now;
+            span.SpanId = NewId(1);
+            if (parent != nullptr)
+            {
+                span.TraceId = parent->TraceId;
+                span.ParentSpanId = parent->SpanId;
+            }
+            else
+            {
+                span.TraceId = NewId(2);
+            }
+            return span;
+        }
+
+        void End(TraceSpan& span, uint64_t now)
+        {
+            span.EndUnixNano = now;
+            Processor->OnEnd(std::move(span));
+            span = TraceSpan();
+        }
+
+        // Makes a random id of 'words' 64-bit words, in hex.
+        std::string NewId(int words)
+        {
+            std::string id;
+            char word[17];
+            for (int i = 0; i < words; i++)
+            {
+                snprintf(word, sizeof(word), "%016llx", (unsigned long long)Random());
+                id += word;
+            }
+            return id;
+        }
+    };
+
+    static uint64_t Now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static void AddEvent(TraceSpan& span, const char* name, uint64_t time, std::vector<TraceAttribute> attributes)
+    {
+        if (span.Events.size() >= maxEventsPerSpan)
+        {
+            span.DroppedEvents++;
+            return;
+        }
+        TraceEvent event;
+        event.Name = name;
+        event.TimeUnixNano = time;
+        event.Attributes = std::move(attributes);
+        span.Events.push_back(std::move(event));
+    }
+
+    std::shared_ptr<State> m_state;
+    std::vector<std::shared_ptr<Microsoft::CognitiveServices::Speech::Connection>> m_connections;
+};
@@ -0,0 +1,204 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "latency_histogram.h"
+#include "buffered_audio.h"
+
+// The best match of one shard of an identification.
+struct SpeakerShardResult
+{
+    size_t Shard = 0;
+    size_t ProfileCount = 0;
+    std::string ProfileId;              // empty if the shard had no match.
+    float Score = 0;
+    double LatencySeconds = 0;          // wall time from starting recognition of the shard to its result.
+    bool Succeeded = false;
+    std::string ErrorDetails;
+};
+
+// The outcome of identifying a speaker across all the shards.
+struct ShardedIdentificationResult
+{
+    std::vector<SpeakerShardResult> Matches;    // the matches of all the shards, best first.
+    std::vector<SpeakerShardResult> Shards;     // the results of all the shards, in shard order.
+    double WallSeconds = 0;
+
+    // Gets the overall best match, or nullptr if no shard matched.
+    const SpeakerShardResult* Best() const
+    {
+        return Matches.empty() ? nullptr : &Matches.front();
+    }
+};
+
+// Identifies a speaker among more profiles than one identification model can hold.
+// The profiles are partitioned into shards of at most 'maxProfilesPerShard', with one model per shard built up front.
+// An identification runs the shards concurrently, up to 'maxConcurrency' at a time, all reading from the same
+// buffered copy of the audio, and merges the best match of each shard by score.
+class ShardedSpeakerIdentifier final
+{
+public:
+    // Defines the default shard size, the number of profiles the service accepts in one identification.
+    static constexpr size_t defaultMaxProfilesPerShard = 50;
+
+    ShardedSpeakerIdentifier(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config,
+        const std::vector<std::shared_ptr<Microsoft::CognitiveServices::Speech::VoiceProfile>>& profiles,
+        uint32_t maxConcurrency, size_t maxProfilesPerShard = defaultMaxProfilesPerShard)
+        : m_config(config), m_maxConcurrency(maxConcurrency)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (config == nullptr || profiles.empty() || maxConcurrency == 0 || maxProfilesPerShard == 0)
+        {
+            throw std::invalid_argument("A speech config, profiles, a positive concurrency and a positive shard size are required");
+        }
+
+        for (size_t first = 0; first < profiles.size(); first += maxProfilesPerShard)
+        {
+            auto last = profiles.size() - first > maxProfilesPerShard ? first + maxProfilesPerShard : profiles.size();
+            std::vector<std::shared_ptr<VoiceProfile>> shard(profiles.begin() + first, profiles.begin() + last);
+            m_models.push_back(SpeakerIdentificationModel::FromProfiles(shard));
+            m_shardSizes.push_back(shard.size());
+        }
+    }
+
+    // Gets the number of shards.
+    size_t GetShardCount() const
+    {
+        return m_models.size();
+    }
+
+    // Identifies the speaker of 'audio' across all the shards.
+    ShardedIdentificationResult Identify(std::shared_ptr<const BufferedAudio> audio)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        ShardedIdentificationResult result;
+        result.Shards.resize(m_models.size());
+        auto start = std::chrono::steady_clock::now();
+
+        std::deque<Request> pending;
+        for (size_t i = 0; i < m_models.size(); i++)
+        {
+            if (pending.size() >= m_maxConcurrency)
+            {
+                Complete(pending.front(), result.Shards);
+                pending.pop_front();
+            }
+
+            auto format = AudioStreamFormat::GetWaveFormatPCM(audio->Format.SamplesPerSec, (uint8_t)audio->Format.BitsPerSample, (uint8_t)audio->Format.Channels);
+            auto stream = AudioInputStream::CreatePullStream(format, std::make_shared<BufferedAudioPullCallback>(audio));
+
+            Request request;
+            request.Shard = i;
+            request.Recognizer = SpeakerRecognizer::FromConfig(m_config, AudioConfig::FromStreamInput(stream));
+            request.Started = std::chrono::steady_clock::now();
+            request.Result = request.Recognizer->RecognizeOnceAsync(m_models[i]);
+            pending.push_back(std::move(request));
+        }
+        while (!pending.empty())
+        {
+            Complete(pending.front(), result.Shards);
+            pending.pop_front();
+        }
+
+        for (const auto& shard : result.Shards)
+        {
+            if (shard.Succeeded && !shard.ProfileId.empty())
+            {
+                result.Matches.push_back(shard);
+            }
+        }
+        std::sort(result.Matches.begin(), result.Matches.end(),
+            [](const SpeakerShardResult& a, const SpeakerShardResult& b) { return a.Score > b.Score; });
+
+        result.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    // Prints the best matches and the latencies of the shards of an identification.
+    static void PrintSummary(std::ostream& out, const ShardedIdentificationResult& result, size_t topCount = 3)
+    {
+        LatencyHistogram latency;
+        size_t failed = 0;
+        for (const auto& shard : result.Shards)
+        {
+            latency.Add(shard.LatencySeconds);
+            if (!shard.Succeeded)
+            {
+                failed++;
+                out << "Shard " << shard.Shard << " failed: " << shard.ErrorDetails << "\n";
+            }
+        }
+
+        for (size_t i = 0; i < result.Matches.size() && i < topCount; i++)
+        {
+            const auto& match = result.Matches[i];
+            out << "Match " << i + 1 << ": profile " << match.ProfileId << " with score " << match.Score
+                << " (shard " << match.Shard << ", " << match.LatencySeconds << "s)\n";
+        }
+        out << "Shards: " << result.Shards.size() << ", failed: " << failed << ", wall time: " << result.WallSeconds << "s\n";
+        latency.Print(out, "Shard latency", "s");
+        out.flush();
+    }
+
+private:
+    struct Request
+    {
+        size_t Shard;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeakerRecognizer> Recognizer;
+        std::chrono::steady_clock::time_point Started;
+        std::future<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeakerRecognitionResult>> Result;
+    };
+
+    void Complete(Request& request, std::vector<SpeakerShardResult>& shards)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto& shard = shards[request.Shard];
+        shard.Shard = request.Shard;
+        shard.ProfileCount = m_shardSizes[request.Shard];
+        try
+        {
+            auto recognitionResult = request.Result.get();
+            shard.LatencySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - request.Started).count();
+            if (recognitionResult->Reason == ResultReason::RecognizedSpeakers)
+            {
+                shard.ProfileId = recognitionResult->ProfileId;
+                shard.Score = recognitionResult->GetScore();
+                shard.Succeeded = true;
+            }
+            else if (recognitionResult->Reason == ResultReason::Canceled)
+            {
+                shard.ErrorDetails = SpeakerRecognitionCancellationDetails::FromResult(recognitionResult)->ErrorDetails;
+            }
+            else
+            {
+                // No profile of the shard matched.
+                shard.Succeeded = true;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            shard.ErrorDetails = e.what();
+        }
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    const uint32_t m_maxConcurrency;
+    std::vector<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeakerIdentificationModel>> m_models;
+    std::vector<size_t> m_shardSizes;
+};
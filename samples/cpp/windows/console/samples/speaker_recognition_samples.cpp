@@ -7,9 +7,15 @@
 
 // <toplevel>
 #include <string>
+#include <thread>
 #include <vector>
 #include <speechapi_cxx.h>
+#include "audio_broadcast.h"
+#include "bulk_enrollment_driver.h"
 #include "wav_file_reader.h"
+#include "push_audio_feeder.h"
+#include "sharded_speaker_identifier.h"
+#include "sample_console.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -128,7 +134,7 @@ void SpeakerVerificationWithPushStream()
     cout << "Created a text dependent verification profile " << profile->GetId() << endl;
 
     // The source of the push streams is three recorded audio files.
-    vector<string> trainingFilenames { audioDirName+"myVoiceIsMyPassportVerifyMe01.wav", audioDirName+"myVoiceIsMyPassportVerifyMe02.wav", audioDirName + "myVoiceIsMyPassportVerifyMe03.wav" };
+    vector<string> trainingFilenames { SampleFile(audioDirName+"myVoiceIsMyPassportVerifyMe01.wav"), SampleFile(audioDirName+"myVoiceIsMyPassportVerifyMe02.wav"), SampleFile(audioDirName + "myVoiceIsMyPassportVerifyMe03.wav") };
     bool enrolled = false;
 
     // for each audio file, create a push stream and feed it to the voice profile client.
@@ -192,8 +198,8 @@ void SpeakerIdentificationWithPullStream()
     auto client = VoiceProfileClient::FromConfig(config);
 
     // Creates and train two voice profiles.
-    auto profile1 = VoiceProfileEnrollmentWithPullStream(client, audioDirName + "aboutSpeechSdk.wav");
-    auto profile2 = VoiceProfileEnrollmentWithPullStream(client, audioDirName + "speechService.wav");
+    auto profile1 = VoiceProfileEnrollmentWithPullStream(client, SampleFile(audioDirName + "aboutSpeechSdk.wav"));
+    auto profile2 = VoiceProfileEnrollmentWithPullStream(client, SampleFile(audioDirName + "speechService.wav"));
 
     if (!profile1->GetId().empty() && !profile2->GetId().empty())
     {
@@ -215,7 +221,7 @@ void SpeakerIdentificationWithMicrophone()
 
     // Creates and train two voice profiles.
     auto profile1 = VoiceProfileEnrollmentWithMicrophone(client);
-    auto profile2 = VoiceProfileEnrollmentWithPullStream(client, audioDirName + "speechService.wav");
+    auto profile2 = VoiceProfileEnrollmentWithPullStream(client, SampleFile(audioDirName + "speechService.wav"));
 
     if (!profile1->GetId().empty() && !profile2->GetId().empty())
     {
@@ -224,6 +230,154 @@ void SpeakerIdentificationWithMicrophone()
     }
 }
 
+// Speaker identification among profiles partitioned into shards, which are identified concurrently.
+void SpeakerIdentificationWithShardedProfiles()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Creates a VoiceProfileClient to create voice profiles and train voice profiles.
+    auto client = VoiceProfileClient::FromConfig(config);
+
+    // Creates and train two voice profiles. Replace with your own, possibly tens of thousands of enrolled profiles.
+    vector<shared_ptr<VoiceProfile>> profiles;
+    profiles.push_back(VoiceProfileEnrollmentWithPullStream(client, SampleFile(audioDirName + "aboutSpeechSdk.wav")));
+    profiles.push_back(VoiceProfileEnrollmentWithPullStream(client, SampleFile(audioDirName + "speechService.wav")));
+
+    // Puts each profile in its own shard to show the merge, use the default shard size for real profile sets.
+    ShardedSpeakerIdentifier identifier(config, profiles, 8, 1);
+
+    // Reads the audio once, every shard reads it from memory through its own pull stream.
+    auto audio = BufferedAudio::FromWavFile(SampleFile(audioDirName + "wikipediaOcelot.wav"));
+    auto result = identifier.Identify(audio);
+
+    if (result.Best() != nullptr)
+    {
+        cout << "The most similar voice profile is " << result.Best()->ProfileId << " with similarity score " << result.Best()->Score << endl;
+    }
+    ShardedSpeakerIdentifier::PrintSummary(cout, result);
+}
+
+// Speaker identification and speech recognition of the same audio, which is read from the file only once.
+void SpeakerIdentificationWithSpeechRecognition()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Creates a VoiceProfileClient to create voice profiles and train voice profiles.
+    auto client = VoiceProfileClient::FromConfig(config);
+
+    // Creates and train two voice profiles.
+    auto profile1 = VoiceProfileEnrollmentWithPullStream(client, SampleFile(audioDirName + "aboutSpeechSdk.wav"));
+    auto profile2 = VoiceProfileEnrollmentWithPullStream(client, SampleFile(audioDirName + "speechService.wav"));
+    if (profile1->GetId().empty() || profile2->GetId().empty())
+    {
+        return;
+    }
+
+    // The file is read once into a window of shared blocks, which both recognizers read at their own speed.
+    WavFileReader reader(SampleFile(audioDirName + "wikipediaOcelot.wav"));
+    AudioBroadcast broadcast;
+
+    // The speaker recognizer pulls its audio from the broadcast.
+    auto speakerRecognizer = SpeakerRecognizer::FromConfig(config, AudioConfig::FromStreamInput(broadcast.CreatePullStream(reader.GetFormat())));
+
+    // The speech recognizer gets its audio pushed from the broadcast.
+    auto pushStream = AudioInputStream::CreatePushStream(AudioStreamFormat::GetWaveFormatPCM(
+        reader.GetFormat().SamplesPerSec, (uint8_t)reader.GetFormat().BitsPerSample, (uint8_t)reader.GetFormat().Channels));
+    auto feeder = broadcast.FeedPushStream(pushStream);
+    auto speechRecognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pushStream));
+
+    auto model = SpeakerIdentificationModel::FromProfiles({ profile1, profile2 });
+    auto speakerResult = speakerRecognizer->RecognizeOnceAsync(model);
+    auto speechResult = speechRecognizer->RecognizeOnceAsync();
+
+    // Reads the file while the recognizers consume it.
+    thread producer([&broadcast, &reader]() { broadcast.Run(reader); });
+
+    auto speaker = speakerResult.get();
+    if (speaker->Reason == ResultReason::RecognizedSpeakers)
+    {
+        cout << "The most similar voice profile is " << speaker->ProfileId << " with similarity score " << speaker->GetScore() << endl;
+    }
+    else if (speaker->Reason == ResultReason::Canceled)
+    {
+        auto cancellation = SpeakerRecognitionCancellationDetails::FromResult(speaker);
+        cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+        cout << "CANCELED: ErrorDetails=" << cancellation->ErrorDetails << std::endl;
+    }
+
+    auto speech = speechResult.get();
+    if (speech->Reason == ResultReason::RecognizedSpeech)
+    {
+        cout << "RECOGNIZED: Text=" << speech->Text << std::endl;
+    }
+    else
+    {
+        cout << "Speech was not recognized, reason " << (int)speech->Reason << std::endl;
+    }
+
+    // The recognizers stop reading after the first utterance, stopping the broadcast releases the producer.
+    broadcast.Stop();
+    producer.join();
+    feeder.join();
+}
+
+// Bulk enrollment of the voice profiles of the users listed in a manifest file.
+void SpeakerBulkEnrollment()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    cout << "Enter a manifest file with one <user><TAB><audio file>[<TAB><audio file>...] entry per line." << std::endl;
+    cout << "> ";
+    string path;
+    ReadSampleLine(path);
+
+    cout << "Enter the file that keeps the profile ids of the users, a restarted enrollment continues from it (empty for profiles.txt)." << std::endl;
+    cout << "> ";
+    string storeFile;
+    ReadSampleLine(storeFile);
+    if (storeFile.empty())
+    {
+        storeFile = "profiles.txt";
+    }
+
+    cout << "Enter the number of users to enroll at once (empty for 8)." << std::endl;
+    cout << "> ";
+    uint32_t maxConcurrency;
+    if (!ReadSampleCount(8, maxConcurrency))
+    {
+        return;
+    }
+
+    try
+    {
+        auto jobs = ReadEnrollmentManifest(path);
+        EnrollmentStore store(storeFile);
+
+        // Adapts the concurrency to the throttling of the service, up to the maximum entered.
+        AdaptiveConcurrencyOptions limits;
+        limits.Max = maxConcurrency;
+        limits.Initial = (std::min)(limits.Initial, limits.Max);
+        auto limiter = make_shared<AdaptiveConcurrencyLimiter>(limits);
+        BulkEnrollmentDriver driver(config, store, maxConcurrency, VoiceProfileType::TextIndependentIdentification, "en-us", limiter);
+        auto summary = driver.Run(jobs, cout);
+        cout << "Enrolled: " << summary.Enrolled << ", already enrolled: " << summary.Skipped << ", failed: " << summary.Failed
+             << ", wall time: " << summary.WallSeconds << "s" << endl;
+        auto concurrency = limiter->GetStatistics();
+        cout << "Concurrency limit: " << concurrency.Limit << ", peak in flight: " << concurrency.PeakInFlight
+             << ", throttled: " << concurrency.Throttled << std::endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
+
 // helper function for speaker verification.
 void VerifyVoiceProfileFromMicrophone(const shared_ptr<SpeechConfig>& config, const shared_ptr<VoiceProfile>& profile)
 {
@@ -264,14 +418,9 @@ int PushData(const string& filename, shared_ptr<PushAudioInputStream>& pushStrea
     {
         WavFileReader reader(filename);
 
-        vector<uint8_t> buffer(1000);
-        // Read data and push them into the stream
-        int readSamples = 0;
-        while ((readSamples = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
-        {
-            // Push a buffer into the stream
-            pushStream->Write(buffer.data(), readSamples);
-        }
+        // Read data and push them into the stream, 100 ms of audio per write as sized from the file format.
+        PushAudioFeeder feeder(pushStream, reader.GetFormat());
+        feeder.Feed(reader);
 
         // Close the push stream.
         pushStream->Close();
@@ -300,7 +449,7 @@ void VerifyVoiceProfileWithPushStream(const shared_ptr<SpeechConfig>& config, co
     // Creates a speaker recognizer using microphone as audio input.
     auto recognizer = SpeakerRecognizer::FromConfig(config, audioInput);
 
-    auto error = PushData(audioDirName + "myVoiceIsMyPassportVerifyMe04.wav", pushStream);
+    auto error = PushData(SampleFile(audioDirName + "myVoiceIsMyPassportVerifyMe04.wav"), pushStream);
     if (error)
     {
         return;
@@ -373,7 +522,7 @@ shared_ptr<VoiceProfile> VoiceProfileEnrollmentWithPullStream (const shared_ptr<
 void VoiceProfileIdentificationWithPullStream(const shared_ptr<SpeechConfig>& config, const vector<shared_ptr<VoiceProfile>>& profiles)
 {
     // Create a callback that will be called by the Speech SDK during identification, aka SpeakerRecognizer::RecognizeOnceAsync.
-    auto callback = make_shared<AudioInputFromFileCallback>(audioDirName + "wikipediaOcelot.wav");
+    auto callback = make_shared<AudioInputFromFileCallback>(SampleFile(audioDirName + "wikipediaOcelot.wav"));
     auto pullStream = AudioInputStream::CreatePullStream(callback);
 
     // Creates an audio config object from stream input;
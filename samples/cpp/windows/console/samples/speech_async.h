@@ -0,0 +1,335 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// C++20 coroutine support, used when the compiler has it; everything else works in C++14.
+#if defined(__has_include)
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#define SPEECH_ASYNC_COROUTINES 1
+#include <coroutine>
+#include <exception>
+#endif
+#endif
+
+// Gets a task to run on an executor, e.g. a WorkerPool, instead of on the thread that completed the operation.
+using SpeechAsyncPost = std::function<void(std::function<void()>)>;
+
+// Watches the futures of many asynchronous operations, e.g. RecognizeOnceAsync(), StartContinuousRecognitionAsync() or
+// SpeakTextAsync(), on one thread, and posts the continuation of each to an executor once its future is ready.
+// So that thousands of sessions do not need one blocked thread each for their .get().
+// The destructor waits for the futures being watched, so it comes after the sessions ended.
+class FuturePoller final
+{
+public:
+    FuturePoller(SpeechAsyncPost post, std::chrono::milliseconds interval = std::chrono::milliseconds(2))
+        : m_post(std::move(post)), m_interval(interval)
+    {
+        if (!m_post || interval.count() <= 0)
+        {
+            throw std::invalid_argument("An executor and a positive polling interval are required");
+        }
+        m_thread = std::thread([this]() { Loop(); });
+    }
+
+    ~FuturePoller()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_one();
+        m_thread.join();
+    }
+
+    FuturePoller(const FuturePoller&) = delete;
+    FuturePoller& operator=(const FuturePoller&) = delete;
+
+    // Posts 'continuation' with the ready future, from which it gets the value or the exception.
+    template <class T>
+    void Then(std::future<T> future, std::function<void(std::future<T>)> continuation)
+    {
+        if (!future.valid() || !continuation)
+        {
+            throw std::invalid_argument("A valid future and a continuation are required");
+        }
+
+        auto shared = std::make_shared<std::future<T>>(std::move(future));
+        Entry entry;
+        entry.Ready = [shared]() { return shared->wait_for(std::chrono::seconds(0)) == std::future_status::ready; };
+        entry.Complete = [shared, continuation]() { continuation(std::move(*shared)); };
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_incoming.push_back(std::move(entry));
+            m_pending++;
+        }
+        m_changed.notify_one();
+    }
+
+    // Gets the number of futures being watched.
+    size_t GetPending() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pending;
+    }
+
+private:
+    struct Entry
+    {
+        std::function<bool()> Ready;
+        std::function<void()> Complete;
+    };
+
+    void Loop()
+    {
+        // Owned by this thread, the futures are checked without the lock.
+        std::vector<Entry> watched;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (watched.empty())
+                {
+                    m_changed.wait(lock, [this]() { return m_stopping || !m_incoming.empty(); });
+                }
+                else
+                {
+                    m_changed.wait_for(lock, m_interval, [this]() { return !m_incoming.empty(); });
+                }
+                if (m_stopping && watched.empty() && m_incoming.empty())
+                {
+                    return;
+                }
+                for (auto& entry : m_incoming)
+                {
+                    watched.push_back(std::move(entry));
+                }
+                m_incoming.clear();
+            }
+
+            size_t completed = 0;
+            for (size_t i = 0; i < watched.size();)
+            {
+                if (watched[i].Ready())
+                {
+                    m_post(std::move(watched[i].Complete));
+                    watched[i] = std::move(watched.back());
+                    watched.pop_back();
+                    completed++;
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            if (completed > 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_pending -= completed;
+            }
+        }
+    }
+
+    SpeechAsyncPost m_post;
+    const std::chrono::milliseconds m_interval;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<Entry> m_incoming;
+    size_t m_pending = 0;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+// Notifies the end of a recognition session, on SessionStopped or on a Canceled error, whichever comes first,
+// by posting the callback to an executor rather than running it on the SDK's event thread, which must not be blocked.
+// Works with any recognizer that has the SessionStopped and Canceled events.
+class SessionEnd final
+{
+public:
+    template <class Recognizer>
+    static std::shared_ptr<SessionEnd> Watch(Recognizer& recognizer, SpeechAsyncPost post)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (!post)
+        {
+            throw std::invalid_argument("An executor is required");
+        }
+        auto end = std::shared_ptr<SessionEnd>(new SessionEnd(std::move(post)));
+
+        // The handlers hold the state weakly, so that it goes away with its last owner.
+        std::weak_ptr<SessionEnd> weak = end;
+        recognizer.SessionStopped.Connect([weak](const SessionEventArgs&)
+        {
+            if (auto end = weak.lock())
+            {
+                end->Signal();
+            }
+        });
+        recognizer.Canceled.Connect([weak](const auto& e)
+        {
+            auto end = weak.lock();
+            if (end != nullptr && e.Reason == CancellationReason::Error)
+            {
+                end->Signal();
+            }
+        });
+        return end;
+    }
+
+    // Posts 'callback' once the session ends, right away if it already has. Only one callback is kept.
+    void OnEnd(std::function<void()> callback)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_ended)
+        {
+            m_callback = std::move(callback);
+            return;
+        }
+        lock.unlock();
+        m_post(std::move(callback));
+    }
+
+    bool HasEnded() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ended;
+    }
+
+private:
+    explicit SessionEnd(SpeechAsyncPost post)
+        : m_post(std::move(post))
+    {
+    }
+
+    void Signal()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_ended)
+        {
+            return;
+        }
+        m_ended = true;
+        auto callback = std::move(m_callback);
+        lock.unlock();
+        if (callback)
+        {
+            m_post(std::move(callback));
+        }
+    }
+
+    SpeechAsyncPost m_post;
+    mutable std::mutex m_mutex;
+    bool m_ended = false;
+    std::function<void()> m_callback;
+};
+
+#if defined(SPEECH_ASYNC_COROUTINES)
+
+// A coroutine that starts right away and is not awaited, e.g. the flow of one session:
+//     SpeechTask Recognize(FuturePoller& poller, std::shared_ptr<SpeechRecognizer> recognizer)
+//     {
+//         auto result = co_await Await(poller, recognizer->RecognizeOnceAsync());
+//         ...
+//     }
+// After each co_await it continues on the executor of the poller or of the session end.
+struct SpeechTask
+{
+    struct promise_type
+    {
+        SpeechTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+
+        // Nothing awaits the task, so an exception has nowhere to go; its flow catches what it expects.
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+// Awaits the future of an asynchronous operation without blocking a thread, and resumes with its value.
+template <class T>
+class FutureAwaiter final
+{
+public:
+    FutureAwaiter(FuturePoller& poller, std::future<T> future)
+        : m_poller(poller), m_future(std::move(future))
+    {
+    }
+
+    bool await_ready() const
+    {
+        return m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // The awaiter lives in the suspended coroutine's frame until it resumes, and is not touched after Then().
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_poller.Then<T>(std::move(m_future), [this, handle](std::future<T> ready)
+        {
+            m_future = std::move(ready);
+            handle.resume();
+        });
+    }
+
+    T await_resume()
+    {
+        return m_future.get();
+    }
+
+private:
+    FuturePoller& m_poller;
+    std::future<T> m_future;
+};
+
+template <class T>
+FutureAwaiter<T> Await(FuturePoller& poller, std::future<T>&& future)
+{
+    return FutureAwaiter<T>(poller, std::move(future));
+}
+
+// Awaits the end of a session.
+class SessionEndAwaiter final
+{
+public:
+    explicit SessionEndAwaiter(std::shared_ptr<SessionEnd> end)
+        : m_end(std::move(end))
+    {
+    }
+
+    bool await_ready() const
+    {
+        return m_end->HasEnded();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_end->OnEnd([handle]() { handle.resume(); });
+    }
+
+    void await_resume() const
+    {
+    }
+
+private:
+    std::shared_ptr<SessionEnd> m_end;
+};
+
+inline SessionEndAwaiter Await(std::shared_ptr<SessionEnd> end)
+{
+    return SessionEndAwaiter(std::move(end));
+}
+
+#endif
@@ -7,8 +7,40 @@
 
 // <toplevel>
 #include <speechapi_cxx.h>
+#include <condition_variable>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include "session_tracer.h"
 #include "wav_file_reader.h"
+#include "mapped_wav_file_reader.h"
+#include "push_audio_feeder.h"
+#include "recognizer_pool.h"
+#include "keyed_recognizer_pool.h"
+#include "worker_pool.h"
+#include "result_sink.h"
+#include "recognition_latency_monitor.h"
+#include "detailed_result_extractor.h"
+#include "language_pinning_recognizer.h"
+#include "keyword_gate.h"
+#include "voice_activity_trimmer.h"
+#include "pcm_format_converter.h"
+#include "speech_async.h"
+#include "session_completion.h"
+#include "sample_console.h"
+#include "session_memory_tracker.h"
+#include "partial_result_arena.h"
+#include "partial_coalescer.h"
+#include "authorization_token_cache.h"
+#include "checkpointed_recognizer.h"
+#include "split_file_recognizer.h"
+#include "keyword_model_registry.h"
+#include "alsa_capture_source.h"
+#include "audio_stream_tee.h"
+#include "transcript_log.h"
+#include "chunked_audio_buffer.h"
+#include "synthesis_cache.h"
+#include "session_recording.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -59,6 +91,60 @@ void SpeechRecognitionWithMicrophone()
     // </SpeechRecognitionWithMicrophone>
 }
 
+// Speech recognition using an ALSA capture device directly, with small periods for a low latency, on Linux.
+void SpeechRecognitionWithAlsaCapture()
+{
+#ifdef ALSA_CAPTURE_SOURCE_AVAILABLE
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Periods of 10 ms in a buffer of 40 ms; replace "default" with e.g. "hw:1,0" to bypass the sound server.
+    AlsaCaptureOptions options;
+    options.Device = "default";
+    options.PeriodFrames = 160;
+    options.Periods = 4;
+
+    try
+    {
+        AlsaCaptureSource capture(options);
+        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(capture.GetStream()));
+        capture.Start();
+        cout << "Say something...\n";
+
+        auto result = recognizer->RecognizeOnceAsync().get();
+        capture.Stop();
+
+        if (result->Reason == ResultReason::RecognizedSpeech)
+        {
+            cout << "RECOGNIZED: Text=" << result->Text << std::endl;
+        }
+        else if (result->Reason == ResultReason::NoMatch)
+        {
+            cout << "NOMATCH: Speech could not be recognized." << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = CancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+        }
+
+        auto statistics = capture.GetStatistics();
+        cout << "Period: " << statistics.PeriodFrames << " frames, buffer: " << statistics.BufferFrames << " frames, real-time: "
+             << (statistics.RealTime ? "yes" : "no") << std::endl
+             << "Captured: " << statistics.CapturedBytes << " bytes, pushed: " << statistics.PushedBytes << " bytes, overruns: "
+             << statistics.Overruns << ", ring overflows: " << statistics.RingOverflows << std::endl;
+        statistics.LatencyMilliseconds.Print(cout, "Capture to push latency");
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+#else
+    cout << "ALSA capture needs Linux and the ALSA headers, e.g. of the libasound2-dev package." << std::endl;
+#endif
+}
+
 
 // Speech recognition in the specified language, using microphone, and requesting detailed output format.
 void SpeechRecognitionWithLanguageAndUsingDetailedOutputFormat()
@@ -67,8 +153,9 @@ void SpeechRecognitionWithLanguageAndUsingDetailedOutputFormat()
     // Replace with your own subscription key and service region (e.g., "westus").
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    // Request detailed output format.
+    // Request detailed output format, with the offset and duration of each word.
     config->SetOutputFormat(OutputFormat::Detailed);
+    config->RequestWordLevelTimestamps();
 
     // Creates a speech recognizer in the specified language using microphone as audio input.
     // Replace the language with your language in BCP-47 format, e.g. en-US.
@@ -87,9 +174,28 @@ void SpeechRecognitionWithLanguageAndUsingDetailedOutputFormat()
     // Checks result.
     if (result->Reason == ResultReason::RecognizedSpeech)
     {
-        cout << "RECOGNIZED: Text=" << result->Text << std::endl
-             << "  Speech Service JSON: " << result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult)
-             << std::endl;
+        cout << "RECOGNIZED: Text=" << result->Text << std::endl;
+
+        // Extracts the alternatives and their words from the JSON, without parsing it into a document.
+        // The texts are spans of 'json', so it must stay alive while they are used.
+        auto json = result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult);
+        auto& extractor = DetailedResultExtractor::ForThisThread();
+        if (extractor.Extract(json))
+        {
+            for (const auto& entry : extractor.Entries())
+            {
+                cout << "  NBest: Confidence=" << entry.Confidence << ", Display=" << entry.Display.ToString() << std::endl;
+                for (size_t i = entry.FirstWord; i < entry.FirstWord + entry.WordCount; i++)
+                {
+                    const auto& word = extractor.Words()[i];
+                    cout << "    Word=" << word.Word.ToString() << ", Offset=" << word.Offset << ", Duration=" << word.Duration << std::endl;
+                }
+            }
+        }
+        else
+        {
+            cout << "  Speech Service JSON: " << json << std::endl;
+        }
     }
     else if (result->Reason == ResultReason::NoMatch)
     {
@@ -118,11 +224,10 @@ void SpeechContinuousRecognitionWithFile()
 
     // Creates a speech recognizer using file as audio input.
     // Replace with your own audio file name.
-    auto audioInput = AudioConfig::FromWavFileInput("whatstheweatherlike.wav");
+    auto audioInput = AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav"));
     auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
 
-    // promise for synchronization of recognition end.
-    promise<void> recognitionEnd;
+    SessionCompletion recognitionEnd;
 
     // Subscribes to events.
     recognizer->Recognizing.Connect([] (const SpeechRecognitionEventArgs& e)
@@ -154,21 +259,21 @@ void SpeechContinuousRecognitionWithFile()
                  << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
                  << "CANCELED: Did you update the subscription info?" << std::endl;
 
-            recognitionEnd.set_value(); // Notify to stop recognition.
+            recognitionEnd.Complete(SessionOutcome::Canceled); // Notify to stop recognition.
         }
     });
 
     recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
     {
         cout << "Session stopped.";
-        recognitionEnd.set_value(); // Notify to stop recognition.
+        recognitionEnd.Complete(SessionOutcome::Stopped); // Notify to stop recognition.
     });
 
     // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
     recognizer->StartContinuousRecognitionAsync().get();
 
     // Waits for recognition end.
-    recognitionEnd.get_future().get();
+    recognitionEnd.Wait();
 
     // Stops recognition.
     recognizer->StopContinuousRecognitionAsync().get();
@@ -254,6 +359,12 @@ void SpeechContinuousRecognitionWithPullStream()
             m_reader.Close();
         }
 
+        // Gets the audio format parsed from the wav file header.
+        const WavFormat& GetFormat() const
+        {
+            return m_reader.GetFormat();
+        }
+
     private:
         WavFileReader m_reader;
     };
@@ -263,17 +374,30 @@ void SpeechContinuousRecognitionWithPullStream()
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
     // Creates a callback that will read audio data from a WAV file.
-    // Currently, the only supported WAV format is mono(single channel), 16 kHZ sample rate, 16 bits per sample.
-    // Replace with your own audio file name.
-    auto callback = make_shared<AudioInputFromFileCallback>("whatstheweatherlike.wav");
-    auto pullStream = AudioInputStream::CreatePullStream(callback);
+    shared_ptr<AudioInputFromFileCallback> callback;
+    shared_ptr<AudioStreamFormat> format;
+    try
+    {
+        // Replace with your own audio file name.
+        callback = make_shared<AudioInputFromFileCallback>(SampleFile("whatstheweatherlike.wav"));
+
+        // Takes the stream format from the WAV file header, and validates it before any audio is sent to the service.
+        format = CreateAudioStreamFormat(callback->GetFormat());
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+
+    // Creates a pull stream in the PCM format of the WAV file, so that e.g. 8 kHz files stream at their native rate.
+    auto pullStream = AudioInputStream::CreatePullStream(format, callback);
 
     // Creates a speech recognizer from stream input;
     auto audioInput = AudioConfig::FromStreamInput(pullStream);
     auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
 
-    // promise for synchronization of recognition end.
-    promise<void> recognitionEnd;
+    SessionCompletion recognitionEnd;
 
     // Subscribes to events.
     recognizer->Recognizing.Connect([](const SpeechRecognitionEventArgs& e)
@@ -306,7 +430,7 @@ void SpeechContinuousRecognitionWithPullStream()
         case CancellationReason::Error:
             cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
             cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
-            recognitionEnd.set_value();
+            recognitionEnd.Complete(SessionOutcome::Canceled);
             break;
 
         default:
@@ -317,14 +441,14 @@ void SpeechContinuousRecognitionWithPullStream()
     recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
     {
         cout << "Session stopped.";
-        recognitionEnd.set_value(); // Notify to stop recognition.
+        recognitionEnd.Complete(SessionOutcome::Stopped); // Notify to stop recognition.
     });
 
     // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
     recognizer->StartContinuousRecognitionAsync().wait();
 
     // Waits for recognition end.
-    recognitionEnd.get_future().wait();
+    recognitionEnd.Wait();
 
     // Stops recognition.
     recognizer->StopContinuousRecognitionAsync().wait();
@@ -336,15 +460,34 @@ void SpeechContinuousRecognitionWithPushStream()
     // Replace with your own subscription key and service region (e.g., "westus").
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    // Creates a push stream
-    auto pushStream = AudioInputStream::CreatePushStream();
+    // Maps the audio file into memory, so that slices of the audio data can be pushed
+    // into the stream directly, without copying them into an intermediate buffer first.
+    unique_ptr<MappedWavFileReader> reader;
+    shared_ptr<AudioStreamFormat> format;
+    try
+    {
+        reader.reset(new MappedWavFileReader(SampleFile("whatstheweatherlike.wav")));
+
+        // Takes the stream format from the WAV file header, and validates it before any audio is sent to the service.
+        format = CreateAudioStreamFormat(reader->GetFormat());
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+
+    // Creates a push stream in the PCM format of the WAV file.
+    auto pushStream = AudioInputStream::CreatePushStream(format);
 
     // Creates a speech recognizer from stream input;
     auto audioInput = AudioConfig::FromStreamInput(pushStream);
     auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
 
-    // promise for synchronization of recognition end.
-    promise<void> recognitionEnd;
+    // Timestamps the recognition events, to report how far the results lag behind the audio.
+    RecognitionLatencyMonitor monitor(recognizer);
+
+    SessionCompletion recognitionEnd;
 
     // Subscribes to events.
     recognizer->Recognizing.Connect([](const SpeechRecognitionEventArgs& e)
@@ -377,7 +520,7 @@ void SpeechContinuousRecognitionWithPushStream()
         case CancellationReason::Error:
             cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
             cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
-            recognitionEnd.set_value();
+            recognitionEnd.Complete(SessionOutcome::Canceled);
             break;
 
         default:
@@ -389,67 +532,171 @@ void SpeechContinuousRecognitionWithPushStream()
     recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
     {
         cout << "Session stopped.";
-        recognitionEnd.set_value(); // Notify to stop recognition.
+        recognitionEnd.Complete(SessionOutcome::Stopped); // Notify to stop recognition.
     });
 
-    WavFileReader reader("whatstheweatherlike.wav");
-
-    vector<uint8_t> buffer(1000);
-
     // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
     recognizer->StartContinuousRecognitionAsync().wait();
 
-    // Read data and push them into the stream
-    int readSamples = 0;
-    while((readSamples = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
-    {
-        // Push a buffer into the stream
-        pushStream->Write(buffer.data(), readSamples);
-    }
+    // Pushes slices of the mapped file into the stream, 100 ms of audio per write as sized from the stream format.
+    PushAudioFeeder feeder(pushStream, reader->GetFormat());
+    feeder.Feed(*reader);
+    cout << "Pushed " << feeder.GetBytesWritten() << " bytes in " << feeder.GetWriteCount() << " writes." << std::endl;
 
     // Close the push stream.
+    monitor.MarkEndOfAudio();
     pushStream->Close();
 
     // Waits for recognition end.
-    recognitionEnd.get_future().get();
+    recognitionEnd.Wait();
 
     // Stops recognition.
     recognizer->StopContinuousRecognitionAsync().get();
+
+    cout << std::endl;
+    monitor.Print(cout);
 }
 
-// Keyword-triggered speech recognition using microphone.
-void KeywordTriggeredSpeechRecognitionWithMicrophone()
+// Speech recognition from a push stream, with the long silences of the file dropped before they are pushed.
+void SpeechContinuousRecognitionWithSilenceTrimming()
 {
     // Creates an instance of a speech config with specified subscription key and service region.
     // Replace with your own subscription key and service region (e.g., "westus").
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    // Creates a speech recognizer using microphone as audio input. The default language is "en-us".
-    auto recognizer = SpeechRecognizer::FromConfig(config);
+    unique_ptr<WavFileReader> reader;
+    shared_ptr<AudioStreamFormat> format;
+    try
+    {
+        // Replace with your own audio file name.
+        reader.reset(new WavFileReader(SampleFile("whatstheweatherlike.wav")));
 
-    // Promise for synchronization of recognition end.
-    promise<void> recognitionEnd;
+        // Takes the stream format from the WAV file header, and validates it before any audio is sent to the service.
+        format = CreateAudioStreamFormat(reader->GetFormat());
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+    auto pushStream = AudioInputStream::CreatePushStream(format);
 
-    // Subscribes to events.
-    recognizer->Recognizing.Connect([] (const SpeechRecognitionEventArgs& e)
+    // Passes the speech and the short pauses to the push stream, and keeps track of the silences it cuts.
+    VoiceActivityTrimmer trimmer(pushStream, reader->GetFormat());
+
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pushStream));
+
+    SessionCompletion recognitionEnd;
+
+    recognizer->Recognized.Connect([&trimmer](const SpeechRecognitionEventArgs& e)
     {
-        if (e.Result->Reason == ResultReason::RecognizingSpeech)
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
         {
-            cout << "RECOGNIZING: Text=" << e.Result->Text << std::endl;
+            // The offsets of the results are in the trimmed audio, translates them back to the file.
+            cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl
+                << "  Offset in file=" << trimmer.ToOriginalOffset(e.Result->Offset()) << std::endl
+                << "  Duration=" << e.Result->Duration() << std::endl;
         }
-        else if (e.Result->Reason == ResultReason::RecognizingKeyword)
+        else if (e.Result->Reason == ResultReason::NoMatch)
         {
-            cout << "RECOGNIZING KEYWORD: Text=" << e.Result->Text << std::endl;
+            cout << "NOMATCH: Speech could not be recognized." << std::endl;
         }
     });
 
-    recognizer->Recognized.Connect([] (const SpeechRecognitionEventArgs& e)
+    recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
     {
-        if (e.Result->Reason == ResultReason::RecognizedKeyword)
+        if (e.Reason == CancellationReason::Error)
         {
-            cout << "RECOGNIZED KEYWORD: Text=" << e.Result->Text << std::endl;
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
+            cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
+            recognitionEnd.Complete(SessionOutcome::Canceled);
         }
-        else if (e.Result->Reason == ResultReason::RecognizedSpeech)
+    });
+
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
+    {
+        recognitionEnd.Complete(SessionOutcome::Stopped);
+    });
+
+    recognizer->StartContinuousRecognitionAsync().get();
+
+    // Reads the file 100 ms at a time through the trimmer, which closes the push stream at the end.
+    vector<uint8_t> buffer(reader->GetFormat().AvgBytesPerSec / 10);
+    int readBytes;
+    while ((readBytes = reader->Read(buffer.data(), (uint32_t)buffer.size())) > 0)
+    {
+        trimmer.Write(buffer.data(), (uint32_t)readBytes);
+    }
+    trimmer.Close();
+
+    recognitionEnd.Wait();
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    auto original = trimmer.GetOriginalBytes();
+    cout << "Pushed " << trimmer.GetTrimmedBytes() << " of " << original << " bytes ("
+        << (original > 0 ? 100.0 * trimmer.GetTrimmedBytes() / original : 0) << "%), " << trimmer.GetCutCount() << " silences cut." << std::endl;
+}
+
+// Continuous recognition from a file in any PCM or float format, rate and channel count, converted to 16 kHz 16-bit mono.
+void SpeechContinuousRecognitionWithConvertedAudio()
+{
+    // Reads the audio of a pull stream from a wav file, converting it as it goes.
+    class ConvertedAudioCallback final : public PullAudioInputStreamCallback
+    {
+    public:
+        ConvertedAudioCallback(const string& audioFileName)
+            : m_reader(audioFileName)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            return m_reader.Read(dataBuffer, size);
+        }
+
+        void Close() override
+        {
+            m_reader.Close();
+        }
+
+        const ConvertingWavReader& GetReader() const
+        {
+            return m_reader;
+        }
+
+    private:
+        ConvertingWavReader m_reader;
+    };
+
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    shared_ptr<ConvertedAudioCallback> callback;
+    shared_ptr<AudioStreamFormat> format;
+    try
+    {
+        // Replace with your own audio file name, e.g. a 48 kHz stereo float recording.
+        callback = make_shared<ConvertedAudioCallback>(SampleFile("whatstheweatherlike.wav"));
+        format = CreateAudioStreamFormat(callback->GetReader().GetFormat());
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+    auto& input = callback->GetReader().GetInputFormat();
+    cout << "Converting " << input.SamplesPerSec << " Hz, " << input.BitsPerSample << "-bit, " << input.Channels
+        << " channel(s) to 16000 Hz, 16-bit mono." << std::endl;
+
+    auto pullStream = AudioInputStream::CreatePullStream(format, callback);
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pullStream));
+
+    SessionCompletion recognitionEnd;
+
+    recognizer->Recognized.Connect([](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
         {
             cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
         }
@@ -461,122 +708,1107 @@ void KeywordTriggeredSpeechRecognitionWithMicrophone()
 
     recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
     {
-        cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
-
         if (e.Reason == CancellationReason::Error)
         {
-            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
-                 << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
-                 << "CANCELED: Did you update the subscription info?" << std::endl;
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
+            cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
+            recognitionEnd.Complete(SessionOutcome::Canceled);
         }
     });
 
-    recognizer->SessionStarted.Connect([&recognitionEnd](const SessionEventArgs& e)
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
     {
-        cout << "SESSIONSTARTED: SessionId=" << e.SessionId << std::endl;
+        recognitionEnd.Complete(SessionOutcome::Stopped);
     });
 
-    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+    recognizer->StartContinuousRecognitionAsync().get();
+    recognitionEnd.Wait();
+    recognizer->StopContinuousRecognitionAsync().get();
+}
+
+#if defined(SPEECH_ASYNC_COROUTINES)
+// One session of continuous recognition from a file as a coroutine, which holds no thread while it waits.
+static SpeechTask RecognizeFileWithoutBlocking(FuturePoller& poller, SpeechAsyncPost post, shared_ptr<SpeechConfig> config, int session, function<void()> onDone)
+{
+    try
     {
-        cout << "SESSIONSTOPPED: SessionId=" << e.SessionId << std::endl;
+        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav")));
+        recognizer->Recognized.Connect([session](const SpeechRecognitionEventArgs& e)
+        {
+            cout << "Session " << session << " RECOGNIZED: Text=" << e.Result->Text << std::endl;
+        });
+        auto end = SessionEnd::Watch(*recognizer, post);
 
-        recognitionEnd.set_value(); // Notify to stop recognition.
+        co_await Await(poller, recognizer->StartContinuousRecognitionAsync());
+        co_await Await(end);
+        co_await Await(poller, recognizer->StopContinuousRecognitionAsync());
+    }
+    catch (const exception& e)
+    {
+        cout << "Session " << session << " failed: " << e.what() << std::endl;
+    }
+    onDone();
+}
+#else
+// One session of continuous recognition from a file as a chain of continuations, which holds no thread while it waits.
+static void RecognizeFileWithoutBlocking(FuturePoller& poller, SpeechAsyncPost post, shared_ptr<SpeechConfig> config, int session, function<void()> onDone)
+{
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav")));
+    recognizer->Recognized.Connect([session](const SpeechRecognitionEventArgs& e)
+    {
+        cout << "Session " << session << " RECOGNIZED: Text=" << e.Result->Text << std::endl;
     });
+    auto end = SessionEnd::Watch(*recognizer, post);
 
-    // Creates an instance of a keyword recognition model. Update this to
-    // point to the location of your keyword recognition model.
-    auto model = KeywordRecognitionModel::FromFile("YourKeywordRecognitionModelFile.table");
+    poller.Then<void>(recognizer->StartContinuousRecognitionAsync(), [&poller, recognizer, end, session, onDone](future<void> started)
+    {
+        try
+        {
+            started.get();
+        }
+        catch (const exception& e)
+        {
+            cout << "Session " << session << " failed: " << e.what() << std::endl;
+            onDone();
+            return;
+        }
 
-    // The phrase your keyword recognition model triggers on.
-    auto keyword = "YourKeyword";
+        // The callback keeps the session end alive until it runs.
+        end->OnEnd([&poller, recognizer, end, onDone]()
+        {
+            poller.Then<void>(recognizer->StopContinuousRecognitionAsync(), [recognizer, onDone](future<void>)
+            {
+                onDone();
+            });
+        });
+    });
+}
+#endif
 
-    // Starts continuous recognition. Use StopContinuousRecognitionAsync() to stop recognition.
-    recognizer->StartKeywordRecognitionAsync(model).get();
+// Continuous recognition of several sessions at once, none of which blocks a thread while it waits: the futures of the
+// SDK are watched by one poller thread, and each session continues on a small executor once its future is ready.
+// With a C++20 compiler each session is a coroutine, else a chain of callbacks.
+void SpeechContinuousRecognitionWithoutBlockingThreads()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    cout << "Say something starting with '" << keyword
-         << "' followed by whatever you want..." << std::endl;
+    const int sessions = 8;
+    WorkerPool executor(2, 64);
+    SpeechAsyncPost post = [&executor](function<void()> task) { executor.Submit(std::move(task)); };
 
-    // Waits for a single successful keyword-triggered speech recognition (or error).
-    recognitionEnd.get_future().get();
+    mutex doneMutex;
+    condition_variable allDone;
+    int remaining = sessions;
+    {
+        FuturePoller poller(post);
+        for (int session = 0; session < sessions; session++)
+        {
+            RecognizeFileWithoutBlocking(poller, post, config, session, [&doneMutex, &allDone, &remaining]()
+            {
+                lock_guard<mutex> lock(doneMutex);
+                if (--remaining == 0)
+                {
+                    allDone.notify_one();
+                }
+            });
+        }
 
-    // Stops recognition.
-    recognizer->StopKeywordRecognitionAsync().get();
+        // Only this console thread waits, for the sample to end.
+        unique_lock<mutex> lock(doneMutex);
+        allDone.wait(lock, [&remaining]() { return remaining == 0; });
+    }
+    executor.WaitIdle();
+    cout << sessions << " sessions ran on " << executor.GetThreadCount() << " executor threads and one poller thread." << std::endl;
 }
 
-// Speech recognition with auto detection for source language
-void SpeechRecognitionWithSourceLanguageAutoDetection()
+// Continuous recognition of several sessions at once, whose completions go to one queue drained by this thread,
+// instead of a promise and a blocked waiter per session.
+void SpeechContinuousRecognitionWithCompletionQueue()
 {
     // Creates an instance of a speech config with specified subscription key and service region.
     // Replace with your own subscription key and service region (e.g., "westus").
-    auto speechConfig = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
-
-     // Currently this feature only supports 2 different language candidates
-     // Replace the languages with your languages in BCP-47 format, e.g. fr-FR.
-     // Please see https://docs.microsoft.com/azure/cognitive-services/speech-service/language-support for all supported languages
-     auto autoDetectSourceLanguageConfig = AutoDetectSourceLanguageConfig::FromLanguages({ "en-US", "de-DE" });
-
-     // The recognizer uses microphone,  to use file or stream as audio input, just construct the audioInput and pass to FromConfig API as the 3rd parameter.
-     // Ex: auto recognizer = SpeechRecognizer::FromConfig(speechConfig, autoDetectSourceLanguageConfig, audioInput);
-     auto recognizer = SpeechRecognizer::FromConfig(speechConfig, autoDetectSourceLanguageConfig);
-     cout << "Say something in either English or German...\n";
-
-    // Starts speech recognition, and returns after a single utterance is recognized. The end of a
-    // single utterance is determined by listening for silence at the end or until a maximum of 15
-    // seconds of audio is processed.  The task returns the recognition text as result.
-    // Note: Since RecognizeOnceAsync() returns only a single utterance, it is suitable only for single
-    // shot recognition like command or query.
-    // For long-running multi-utterance recognition, use StartContinuousRecognitionAsync() instead.
-    auto result = recognizer->RecognizeOnceAsync().get();
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    // Checks result.
-    auto autoDetectSourceLanguageResult = AutoDetectSourceLanguageResult::FromResult(result);
-    auto language = autoDetectSourceLanguageResult->Language;
-    if (result->Reason == ResultReason::RecognizedSpeech)
-    {
-        cout << "RECOGNIZED: Text=" << result->Text << std::endl;
-        cout << "RECOGNIZED: Language=" << language << std::endl;
-    }
-    else if (result->Reason == ResultReason::NoMatch)
+    const uint64_t sessions = 8;
+    auto queue = make_shared<CompletionQueue>();
+    map<uint64_t, shared_ptr<SpeechRecognizer>> running;
+    for (uint64_t session = 0; session < sessions; session++)
     {
-        if (language.empty())
+        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav")));
+        recognizer->Recognized.Connect([session](const SpeechRecognitionEventArgs& e)
         {
-            // serivce cannot detect the source language
-            cout << "NOMATCH: Service cannot detect the source language." << std::endl;
-        }
-        else
-        {
-            // serivce can detect the source language but cannot recongize the speech content
-            cout << "NOMATCH: Service can recognize the speech." << std::endl;
-        }
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                cout << "Session " << session << " RECOGNIZED: Text=" << e.Result->Text << std::endl;
+            }
+        });
+
+        // The completion is owned by the event handlers, it posts to the queue once, however many events end the session.
+        SessionCompletion::Watch(*recognizer, queue, session);
+        recognizer->StartContinuousRecognitionAsync().get();
+        running[session] = recognizer;
     }
-    else if (result->Reason == ResultReason::Canceled)
-    {
-        auto cancellation = CancellationDetails::FromResult(result);
-        cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
 
-        if (cancellation->Reason == CancellationReason::Error)
+    // Stops and releases each recognizer as its session completes.
+    while (!running.empty())
+    {
+        queue->Drain([&running](const SessionCompletionEvent& completion)
         {
-            cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
-            cout << "CANCELED: ErrorDetails=" << cancellation->ErrorDetails << std::endl;
-            cout << "CANCELED: Did you update the subscription info?" << std::endl;
-        }
+            cout << "Session " << completion.SessionId << (completion.Outcome == SessionOutcome::Stopped ? " stopped." : " canceled.") << std::endl;
+            auto it = running.find(completion.SessionId);
+            if (it != running.end())
+            {
+                it->second->StopContinuousRecognitionAsync().get();
+                running.erase(it);
+            }
+        }, chrono::seconds(1));
     }
 }
 
-// Speech recognition with auto detection for source language and using customized model
-void SpeechRecognitionWithSourceLanguageAutoDetectionUsingCustomizedModel()
+// Speech continuous recognition from a file, reporting the memory of each session when it stops.
+// Build with SESSION_MEMORY_TRACKING defined to count the allocations of the handlers; else only the result lifetimes are tracked.
+void SpeechContinuousRecognitionWithMemoryAccounting()
 {
     // Creates an instance of a speech config with specified subscription key and service region.
     // Replace with your own subscription key and service region (e.g., "westus").
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
-    std::vector<std::shared_ptr<SourceLanguageConfig>> sourceLanguageConfigs;
-    // Replace the languages with your languages in BCP-47 format, e.g. zh-CN.
-    sourceLanguageConfigs.push_back(SourceLanguageConfig::FromLanguage("en-US"));
-    // Replace the languages with your languages in BCP-47 format, e.g. zh-CN.
-    // Please see https://docs.microsoft.com/azure/cognitive-services/speech-service/language-support for all supported languages
-    // Set the endpoint ID of your customized mode that will be used for fr-FR,  Replace with your own CRIS endpoint ID.
-    sourceLanguageConfigs.push_back(SourceLanguageConfig::FromLanguage("fr-FR", "The Endpoint Id for custom model of fr-FR"));
+    // Replace with your own audio file name.
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav")));
+
+    // Attached first, so that it reports before the session completes.
+    auto tracker = SessionMemoryTracker::Attach(*recognizer, cout);
+    auto recognitionEnd = SessionCompletion::Watch(*recognizer);
+
+    // The final results are kept for the transcript; held beyond the session, they show as leak candidates in its report.
+    mutex transcriptMutex;
+    vector<shared_ptr<SpeechRecognitionResult>> transcript;
+    weak_ptr<SessionMemoryTracker> weakTracker = tracker;
+    recognizer->Recognized.Connect([weakTracker, &transcriptMutex, &transcript](const SpeechRecognitionEventArgs& e)
+    {
+        auto tracker = weakTracker.lock();
+        if (tracker == nullptr || e.Result->Reason != ResultReason::RecognizedSpeech)
+        {
+            return;
+        }
+
+        // What the handler allocates is charged to the session.
+        auto scope = tracker->Enter();
+        cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+        lock_guard<mutex> lock(transcriptMutex);
+        transcript.push_back(tracker->Retain(e.Result, e.Result->ResultId));
+    });
+
+    recognizer->StartContinuousRecognitionAsync().get();
+    recognitionEnd->Wait();
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    lock_guard<mutex> lock(transcriptMutex);
+    cout << "Kept " << transcript.size() << " results." << std::endl;
+}
+
+// Speech continuous recognition of several streams, the partial results of each handled as deltas from the previous one.
+void SpeechContinuousRecognitionWithPartialDeltas()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    const int streams = 4;
+    vector<shared_ptr<SpeechRecognizer>> recognizers;
+    vector<shared_ptr<SessionCompletion>> completions;
+    for (int stream = 0; stream < streams; stream++)
+    {
+        // Replace with your own audio file name.
+        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav")));
+
+        // One tracker per stream, its arena is only used by the stream's event handlers.
+        auto partials = make_shared<PartialResultTracker>();
+        recognizer->Recognizing.Connect([stream, partials](const SpeechRecognitionEventArgs& e)
+        {
+            auto delta = partials->OnRecognizing(e.Result->Text);
+            if (delta.Removed > 0 || delta.Appended.Size > 0)
+            {
+                cout << "Stream " << stream << " RECOGNIZING: -" << delta.Removed << " +\"";
+                cout.write(delta.Appended.Data, delta.Appended.Size);
+                cout << "\"" << std::endl;
+            }
+        });
+        recognizer->Recognized.Connect([stream, partials](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                auto delta = partials->OnRecognized(e.Result->Text);
+                cout << "Stream " << stream << " RECOGNIZED: -" << delta.Removed << " +\"";
+                cout.write(delta.Appended.Data, delta.Appended.Size);
+                cout << "\" Text=" << e.Result->Text << " (arena of " << partials->GetArenaCapacity() << " bytes)" << std::endl;
+            }
+        });
+
+        completions.push_back(SessionCompletion::Watch(*recognizer));
+        recognizer->StartContinuousRecognitionAsync().get();
+        recognizers.push_back(recognizer);
+    }
+
+    for (int stream = 0; stream < streams; stream++)
+    {
+        completions[stream]->Wait();
+        recognizers[stream]->StopContinuousRecognitionAsync().get();
+    }
+}
+
+// Speech continuous recognition with file input, the partial results coalesced to at most 5 a second, e.g. for a UI.
+void SpeechContinuousRecognitionWithCoalescedPartials()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Replace with your own audio file name.
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav")));
+    auto recognitionEnd = SessionCompletion::Watch(*recognizer);
+
+    // A partial every 200 ms at most, or sooner once 20 characters changed; the final results always go through.
+    PartialCoalescerOptions options;
+    options.MinInterval = chrono::milliseconds(200);
+    options.MinNewCharacters = 20;
+    auto coalescer = PartialCoalescer::Attach(*recognizer, options, [](const string& text, bool isFinal)
+    {
+        cout << (isFinal ? "RECOGNIZED: Text=" : "Recognizing:") << text << std::endl;
+    });
+
+    recognizer->StartContinuousRecognitionAsync().get();
+    recognitionEnd->Wait();
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    auto statistics = coalescer->GetStatistics();
+    cout << "Partials: received=" << statistics.Received << ", emitted=" << statistics.Emitted
+         << ", suppressed=" << statistics.Suppressed << "; final results=" << statistics.Finals << std::endl;
+}
+
+// Short command recognition with recognizers taken from a pool of pre-warmed recognizers.
+void SpeechRecognitionWithRecognizerPool()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Replace with your own audio file name.
+    auto fileName = SampleFile("whatstheweatherlike.wav");
+    shared_ptr<AudioStreamFormat> format;
+    try
+    {
+        MappedWavFileReader reader(fileName);
+        format = CreateAudioStreamFormat(reader.GetFormat());
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+
+    // Creates a pool that keeps two recognizers with open connections ready, so that the TLS and WebSocket setup
+    // is not paid for when a request comes in.
+    RecognizerPool pool(config, format, 2);
+
+    // Gives the pool a moment to open its connections.
+    this_thread::sleep_for(chrono::seconds(2));
+
+    for (int i = 0; i < 3; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        auto lease = pool.Acquire();
+
+        // Starts recognizing a single utterance, then pushes its audio into the pooled stream.
+        auto recognition = lease->Recognizer->RecognizeOnceAsync();
+        MappedWavFileReader reader(fileName);
+        PushAudioFeeder feeder(lease->Stream, reader.GetFormat());
+        feeder.Feed(reader);
+        auto result = recognition.get();
+
+        auto latency = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+        // Checks result.
+        if (result->Reason == ResultReason::RecognizedSpeech)
+        {
+            cout << "RECOGNIZED: Text=" << result->Text << " (" << latency.count() << "ms)" << std::endl;
+        }
+        else if (result->Reason == ResultReason::NoMatch)
+        {
+            cout << "NOMATCH: Speech could not be recognized." << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = CancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=" << cancellation->ErrorDetails << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+
+        // Returns the recognizer to the pool, which connects a fresh one in its place.
+        pool.Release(lease);
+    }
+
+    cout << "Warm hits: " << pool.GetWarmHits() << ", cold misses: " << pool.GetColdMisses() << std::endl;
+}
+
+// Short command recognition with recognizers pooled per Custom Speech endpoint, language and output format.
+void SpeechRecognitionWithEndpointPools()
+{
+    // Replace with your own audio file name.
+    auto fileName = SampleFile("whatstheweatherlike.wav");
+    shared_ptr<AudioStreamFormat> format;
+    try
+    {
+        MappedWavFileReader reader(fileName);
+        format = CreateAudioStreamFormat(reader.GetFormat());
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+
+    // Each key gets its own config, set up once for its endpoint, language and output format.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto createConfig = []() { return SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion"); };
+
+    // Keeps two recognizers warm per key, and the two keys used most recently, so that the third request for the
+    // least used key pays for a new pool.
+    KeyedRecognizerPoolOptions options;
+    options.WarmPerKey = 2;
+    options.MaxKeys = 2;
+    KeyedRecognizerPool pool(createConfig, format, options);
+
+    // Replace with the ids of your own Custom Speech endpoints; an empty id is the base model.
+    vector<RecognizerPoolKey> keys =
+    {
+        { "YourEndpointId", "en-US", OutputFormat::Detailed },
+        { "", "en-US", OutputFormat::Simple },
+        { "YourOtherEndpointId", "en-US", OutputFormat::Simple },
+    };
+    const size_t requests[] = { 0, 1, 0, 1, 0, 2, 0, 1 };
+
+    try
+    {
+        for (auto index : requests)
+        {
+            const auto& key = keys[index];
+            auto start = chrono::steady_clock::now();
+            auto lease = pool.Acquire(key);
+
+            // Starts recognizing a single utterance, then pushes its audio into the pooled stream.
+            auto recognition = lease->Recognizer->RecognizeOnceAsync();
+            MappedWavFileReader reader(fileName);
+            PushAudioFeeder feeder(lease->Stream, reader.GetFormat());
+            feeder.Feed(reader);
+            auto result = recognition.get();
+
+            auto latency = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+            auto endpoint = key.EndpointId.empty() ? string("base model") : key.EndpointId;
+            if (result->Reason == ResultReason::RecognizedSpeech)
+            {
+                cout << "RECOGNIZED (" << endpoint << "): Text=" << result->Text << " (" << latency.count() << "ms)" << std::endl;
+            }
+            else if (result->Reason == ResultReason::NoMatch)
+            {
+                cout << "NOMATCH (" << endpoint << "): Speech could not be recognized." << std::endl;
+            }
+            else if (result->Reason == ResultReason::Canceled)
+            {
+                auto cancellation = CancellationDetails::FromResult(result);
+                cout << "CANCELED (" << endpoint << "): Reason=" << (int)cancellation->Reason << std::endl;
+
+                if (cancellation->Reason == CancellationReason::Error)
+                {
+                    cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                    cout << "CANCELED: ErrorDetails=" << cancellation->ErrorDetails << std::endl;
+                    cout << "CANCELED: Did you update the subscription info and the endpoint ids?" << std::endl;
+                }
+            }
+
+            pool.Release(key, lease);
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+
+    KeyedRecognizerPool::PrintStatistics(cout, pool.GetStatistics());
+    cout << "Pools evicted: " << pool.GetEvictions() << std::endl;
+}
+
+// Short command recognition with pooled recognizers that use an authorization token, refreshed in the background.
+void SpeechRecognitionWithTokenCache()
+{
+    // Replace with a call to your own token service, which gets a token for your subscription key from
+    // https://YourServiceRegion.api.cognitive.microsoft.com/sts/v1.0/issueToken, without exposing the key to this process.
+    auto issuer = []()
+    {
+        IssuedToken issued;
+        issued.Token = "YourAuthorizationToken";
+        issued.ValidFor = chrono::minutes(10);
+        return issued;
+    };
+
+    // One cache for the process, it gets the first token now and the next ones before they expire.
+    shared_ptr<AuthorizationTokenCache> tokens;
+    try
+    {
+        tokens = make_shared<AuthorizationTokenCache>(issuer, "YourServiceRegion");
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+
+    // Replace with your own audio file name.
+    auto fileName = SampleFile("whatstheweatherlike.wav");
+    shared_ptr<AudioStreamFormat> format;
+    try
+    {
+        MappedWavFileReader reader(fileName);
+        format = CreateAudioStreamFormat(reader.GetFormat());
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+
+    // The pooled recognizers get each new token, as they do not see it through their config.
+    RecognizerPool pool(tokens->CreateSpeechConfig(), format, 2, chrono::seconds(60),
+        [tokens](const shared_ptr<SpeechRecognizer>& recognizer) { tokens->Track(recognizer); });
+
+    // Requests on several threads, none of which waits on the token service.
+    vector<thread> requests;
+    mutex outputMutex;
+    for (int i = 0; i < 3; i++)
+    {
+        requests.emplace_back([&pool, &fileName, &outputMutex, i]()
+        {
+            auto lease = pool.Acquire();
+            auto recognition = lease->Recognizer->RecognizeOnceAsync();
+            MappedWavFileReader reader(fileName);
+            PushAudioFeeder feeder(lease->Stream, reader.GetFormat());
+            feeder.Feed(reader);
+            auto result = recognition.get();
+
+            lock_guard<mutex> lock(outputMutex);
+            cout << "Request " << i << (result->Reason == ResultReason::RecognizedSpeech ? " RECOGNIZED: Text=" + result->Text : string(" got no text.")) << std::endl;
+            pool.Release(lease);
+        });
+    }
+    for (auto& request : requests)
+    {
+        request.join();
+    }
+
+    auto statistics = tokens->GetStatistics();
+    cout << "Token refreshes: " << statistics.Refreshes << ", failures: " << statistics.Failures
+         << ", client failures: " << statistics.ClientFailures << ", tracked clients: " << statistics.Tracked << std::endl;
+}
+
+// Continuous speech recognition of a long file, which resumes from the last result after a network error, or after
+// the sample is run again, instead of sending the whole file again.
+void SpeechContinuousRecognitionWithCheckpoints()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Replace with your own audio file name. The checkpoint is saved next to it.
+    CheckpointedRecognitionOptions options;
+    auto fileName = SampleFile("whatstheweatherlike.wav");
+    options.CheckpointFile = fileName + ".checkpoint";
+
+    try
+    {
+        CheckpointedRecognition recognition(config, fileName, options);
+        if (recognition.GetCheckpoint() > 0)
+        {
+            cout << "Resuming at " << recognition.GetCheckpoint() / 10000 << " ms." << std::endl;
+        }
+
+        mutex outputMutex;
+        auto complete = recognition.Run([&outputMutex](const CheckpointedResult& result)
+        {
+            lock_guard<mutex> lock(outputMutex);
+            cout << "RECOGNIZED: Text=" << result.Text << " Offset=" << result.Offset << " Duration=" << result.Duration
+                 << " Session=" << result.Session << std::endl;
+        });
+
+        cout << (complete ? "Recognized the whole file" : "Stopped after repeated errors") << ", resumed "
+             << recognition.GetResumes() << " times." << std::endl;
+        if (complete)
+        {
+            remove(options.CheckpointFile.c_str());
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
+
+// Speech recognition of a long file in parallel, cut at silences into segments recognized concurrently and merged back.
+void SpeechRecognitionWithSplitFile()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Segments of 10 seconds, to split even the short sample file; use minutes for recordings of hours.
+    SplitRecognitionOptions options;
+    options.SegmentLength = chrono::seconds(10);
+    options.SearchWindow = chrono::seconds(3);
+    options.MaxInFlight = 4;
+
+    // Replace with your own audio file name, of 16-bit PCM audio.
+    SplitFileRecognizer recognizer(config, options, make_shared<AdaptiveConcurrencyLimiter>());
+    auto result = recognizer.Run(SampleFile("whatstheweatherlike.wav"));
+    for (const auto& entry : result.Entries)
+    {
+        cout << "RECOGNIZED: Text=" << entry.Text << " Offset=" << entry.Offset << " Duration=" << entry.Duration
+             << " Segment=" << entry.Segment << std::endl;
+    }
+
+    size_t silenceCuts = 0;
+    for (const auto& segment : result.Segments)
+    {
+        silenceCuts += segment.SilenceCut ? 1 : 0;
+    }
+    cout << "Segments: " << result.Segments.size() << " (" << silenceCuts << " cut at silences), failed: " << result.FailedSegments
+         << ", duplicates dropped: " << result.Duplicates << std::endl
+         << "Audio: " << result.AudioSeconds << " s, wall time: " << result.WallSeconds << " s" << std::endl;
+    if (!result.ErrorDetails.empty())
+    {
+        cout << "First error: " << result.ErrorDetails << std::endl;
+    }
+}
+
+// Continuous speech recognition from a pull stream, archiving the exact audio sent for recognition to a wav file.
+void SpeechContinuousRecognitionWithAudioArchive()
+{
+    // Reads the audio data of a wav file.
+    class WavPullCallback final : public PullAudioInputStreamCallback
+    {
+    public:
+        WavPullCallback(const string& fileName)
+            : m_reader(fileName)
+        {
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            return m_reader.Read(dataBuffer, size);
+        }
+
+        void Close() override
+        {
+            m_reader.Close();
+        }
+
+        const WavFormat& GetFormat() const
+        {
+            return m_reader.GetFormat();
+        }
+
+    private:
+        WavFileReader m_reader;
+    };
+
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    try
+    {
+        // Replace with your own audio file name, and the name of the archive.
+        auto source = make_shared<WavPullCallback>(SampleFile("whatstheweatherlike.wav"));
+        const auto& format = source->GetFormat();
+        auto archiveFile = SampleOutputFile("archived_audio.wav");
+        auto archive = make_shared<FileAudioSink>(archiveFile, format.SamplesPerSec, format.BitsPerSample, format.Channels);
+
+        // The recognizer reads through the tee, which hands each chunk to the archive's writer thread.
+        auto tee = make_shared<TeePullAudioInputCallback>(source, archive);
+        auto recognizer = SpeechRecognizer::FromConfig(config,
+            AudioConfig::FromStreamInput(AudioInputStream::CreatePullStream(CreateAudioStreamFormat(format), tee)));
+        auto recognitionEnd = SessionCompletion::Watch(*recognizer);
+
+        recognizer->Recognized.Connect([](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+            }
+        });
+
+        recognizer->StartContinuousRecognitionAsync().get();
+        recognitionEnd->Wait();
+        recognizer->StopContinuousRecognitionAsync().get();
+
+        // Waits for the archive to be written, and fills in the lengths of its header.
+        archive->Close();
+        cout << "Archived the audio sent for recognition to " << archiveFile << "." << std::endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
+
+// Continuous speech recognition from file, with the event handlers handing results off to a worker thread
+// through a result sink instead of writing them out on the SDK's callback thread. The worker appends the final
+// results to a transcript log, which is then looked up by session and offset.
+void SpeechContinuousRecognitionWithResultSink()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // The sink and the completion outlive the recognizer, so that no late event handler can touch them after destruction.
+    ResultSink sink(256);
+    SessionCompletion recognitionEnd;
+
+    try
+    {
+        // Creates a speech recognizer using file as audio input.
+        // Replace with your own audio file name.
+        auto audioInput = AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav"));
+
+        // The transcript log the consumer writes the results to.
+        const std::string logFileName = SampleOutputFile("transcript.stlg");
+        TranscriptLogWriter log(logFileName);
+        std::string lastSessionId;
+        uint64_t lastOffset = 0;
+
+        // The consumer starts once the recognizer is built. Until it is joined, an exception must not leave this block.
+        thread consumer;
+        try
+        {
+            auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+
+            // Subscribes to events. The handlers only copy the results into the sink, they never block.
+            recognizer->Recognizing.Connect([&sink](const SpeechRecognitionEventArgs& e)
+            {
+                sink.TryPush(ResultRecordKind::Recognizing, e.Result->Text, e.Result->Offset(), e.Result->Duration());
+            });
+
+            recognizer->Recognized.Connect([&sink](const SpeechRecognitionEventArgs& e)
+            {
+                if (e.Result->Reason == ResultReason::RecognizedSpeech)
+                {
+                    sink.TryPush(ResultRecordKind::Recognized, e.Result->Text, e.Result->Offset(), e.Result->Duration(), std::string(), e.SessionId);
+                }
+                else if (e.Result->Reason == ResultReason::NoMatch)
+                {
+                    sink.TryPush(ResultRecordKind::NoMatch, std::string(), e.Result->Offset(), e.Result->Duration());
+                }
+            });
+
+            recognizer->Canceled.Connect([&sink, &recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+            {
+                if (e.Reason == CancellationReason::Error)
+                {
+                    sink.TryPush(ResultRecordKind::Canceled, e.ErrorDetails);
+                    recognitionEnd.Complete(SessionOutcome::Canceled);
+                }
+            });
+
+            recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
+            {
+                recognitionEnd.Complete(SessionOutcome::Stopped);
+            });
+
+            // Drains the sink, persisting the final results. A service would also fan them out to its clients here.
+            consumer = thread([&sink, &log, &lastSessionId, &lastOffset]()
+            {
+                ResultRecord record;
+                while (sink.Pop(record))
+                {
+                    log.Append(record);
+                    switch (record.Kind)
+                    {
+                    case ResultRecordKind::Recognizing:
+                        cout << "Recognizing:" << record.Text << std::endl;
+                        break;
+                    case ResultRecordKind::Recognized:
+                        cout << "RECOGNIZED: Text=" << record.Text << "\n"
+                             << "  Offset=" << record.Offset << "\n"
+                             << "  Duration=" << record.Duration << std::endl;
+                        lastSessionId = record.SessionId;
+                        lastOffset = record.Offset + record.Duration / 2;
+                        break;
+                    case ResultRecordKind::NoMatch:
+                        cout << "NOMATCH: Speech could not be recognized." << std::endl;
+                        break;
+                    case ResultRecordKind::Canceled:
+                        cout << "CANCELED: ErrorDetails=" << record.Text << "\n"
+                             << "CANCELED: Did you update the subscription info?" << std::endl;
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                log.Close();
+            });
+
+            // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+            recognizer->StartContinuousRecognitionAsync().get();
+
+            // Waits for recognition end.
+            recognitionEnd.Wait();
+
+            // Stops recognition.
+            recognizer->StopContinuousRecognitionAsync().get();
+        }
+        catch (...)
+        {
+            sink.Close();
+            if (consumer.joinable())
+            {
+                consumer.join();
+            }
+            throw;
+        }
+
+        // Lets the consumer drain what is left, then stop.
+        sink.Close();
+        consumer.join();
+
+        cout << "Results pushed: " << sink.GetPushed() << ", dropped on overflow: " << sink.GetOverflows()
+             << ", truncated: " << sink.GetTruncations() << ", logged: " << log.GetRecordCount() << std::endl;
+
+        // Looks up what was said in the middle of the last result, through the index of the log.
+        if (!lastSessionId.empty())
+        {
+            TranscriptLogReader reader(logFileName);
+            TranscriptEntry entry;
+            if (reader.Find(lastSessionId, lastOffset, entry))
+            {
+                cout << "Transcript at offset " << lastOffset << " of session " << lastSessionId << ": " << entry.Text << std::endl;
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
+
+// Keyword-triggered speech recognition using microphone.
+void KeywordTriggeredSpeechRecognitionWithMicrophone()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Creates a speech recognizer using microphone as audio input. The default language is "en-us".
+    auto recognizer = SpeechRecognizer::FromConfig(config);
+
+    // Promise for synchronization of recognition end.
+    SessionCompletion recognitionEnd;
+
+    // Subscribes to events.
+    recognizer->Recognizing.Connect([] (const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizingSpeech)
+        {
+            cout << "RECOGNIZING: Text=" << e.Result->Text << std::endl;
+        }
+        else if (e.Result->Reason == ResultReason::RecognizingKeyword)
+        {
+            cout << "RECOGNIZING KEYWORD: Text=" << e.Result->Text << std::endl;
+        }
+    });
+
+    recognizer->Recognized.Connect([] (const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizedKeyword)
+        {
+            cout << "RECOGNIZED KEYWORD: Text=" << e.Result->Text << std::endl;
+        }
+        else if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+        }
+        else if (e.Result->Reason == ResultReason::NoMatch)
+        {
+            cout << "NOMATCH: Speech could not be recognized." << std::endl;
+        }
+    });
+
+    recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
+
+        if (e.Reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                 << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                 << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+    });
+
+    recognizer->SessionStarted.Connect([&recognitionEnd](const SessionEventArgs& e)
+    {
+        cout << "SESSIONSTARTED: SessionId=" << e.SessionId << std::endl;
+    });
+
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+    {
+        cout << "SESSIONSTOPPED: SessionId=" << e.SessionId << std::endl;
+
+        recognitionEnd.Complete(SessionOutcome::Stopped); // Notify to stop recognition.
+    });
+
+    // Gets the keyword recognition model, loaded once for the process. Update this to
+    // point to the location of your keyword recognition model.
+    auto model = KeywordModelRegistry::Default().Get("YourKeywordRecognitionModelFile.table");
+
+    // The phrase your keyword recognition model triggers on.
+    auto keyword = "YourKeyword";
+
+    // Starts continuous recognition. Use StopContinuousRecognitionAsync() to stop recognition.
+    recognizer->StartKeywordRecognitionAsync(model).get();
+
+    cout << "Say something starting with '" << keyword
+         << "' followed by whatever you want..." << std::endl;
+
+    // Waits for a single successful keyword-triggered speech recognition (or error).
+    recognitionEnd.Wait();
+
+    // Stops recognition.
+    recognizer->StopKeywordRecognitionAsync().get();
+}
+
+// Keyword-gated speech recognition of many always-on audio feeds, streamed to the cloud only after their keyword.
+void KeywordGatedSpeechRecognitionWithFeeds()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Replace with your own audio file, starting with your keyword, and the keyword recognition model.
+    MappedWavFileReader reader(SampleFile("YourKeywordAudioFile.wav"));
+    auto model = KeywordModelRegistry::Default().Get("YourKeywordRecognitionModelFile.table");
+
+    // Streams at most four feeds to the cloud at a time, with recognizers from a pool of two warm ones.
+    WorkerPool workers(4, 64);
+    RecognizerPool recognizers(config, CreateAudioStreamFormat(reader.GetFormat()), 2);
+
+    mutex outputMutex;
+    KeywordGate gate(model, recognizers, workers, reader.GetFormat(),
+        [&outputMutex](size_t feed, shared_ptr<SpeechRecognitionResult> result)
+        {
+            lock_guard<mutex> lock(outputMutex);
+            if (result->Reason == ResultReason::RecognizedSpeech)
+            {
+                cout << "RECOGNIZED: Feed=" << feed << " Text=" << result->Text << std::endl;
+            }
+            else if (result->Reason == ResultReason::NoMatch)
+            {
+                cout << "NOMATCH: Feed=" << feed << " Speech could not be recognized." << std::endl;
+            }
+            else if (result->Reason == ResultReason::Canceled)
+            {
+                auto cancellation = CancellationDetails::FromResult(result);
+                cout << "CANCELED: Feed=" << feed << " Reason=" << (int)cancellation->Reason << std::endl;
+            }
+        });
+
+    // Simulates eight feeds playing the same file, 100 ms of audio at a time, in real time.
+    constexpr size_t feedCount = 8;
+    for (size_t i = 0; i < feedCount; i++)
+    {
+        gate.AddFeed();
+    }
+    auto chunkSize = reader.GetFormat().AvgBytesPerSec / 10 / reader.GetFormat().BlockAlign * reader.GetFormat().BlockAlign;
+    for (uint32_t offset = 0; offset < reader.Size(); offset += chunkSize)
+    {
+        auto size = reader.Size() - offset < chunkSize ? reader.Size() - offset : chunkSize;
+        for (size_t i = 0; i < feedCount; i++)
+        {
+            gate.Write(i, reader.Data() + offset, size);
+        }
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+
+    // Waits for the feeds being streamed to be recognized.
+    gate.Close();
+    gate.PrintStatistics(cout);
+}
+
+// Measures the startup of many keyword feeds, each loading its own copy of the keyword model, then sharing one from the registry.
+void KeywordRecognitionWithSharedModel()
+{
+    // Replace with your own keyword recognition model; the feeds listen on push streams of 16 kHz 16-bit mono audio.
+    const string modelFile = "YourKeywordRecognitionModelFile.table";
+    constexpr size_t feedCount = 50;
+
+    // Starts listening on each feed, with the model 'getModel' gives, and measures the time and the memory it takes.
+    auto measure = [](const char* label, const function<shared_ptr<KeywordRecognitionModel>()>& getModel)
+    {
+        vector<shared_ptr<PushAudioInputStream>> streams;
+        vector<shared_ptr<KeywordRecognizer>> recognizers;
+        vector<future<shared_ptr<KeywordRecognitionResult>>> recognitions;
+        auto memoryBefore = GetProcessMemoryBytes();
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < feedCount; i++)
+        {
+            streams.push_back(AudioInputStream::CreatePushStream());
+            recognizers.push_back(KeywordRecognizer::FromConfig(AudioConfig::FromStreamInput(streams.back())));
+            recognitions.push_back(recognizers.back()->RecognizeOnceAsync(getModel()));
+        }
+        auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        auto memoryAfter = GetProcessMemoryBytes();
+
+        cout << label << ": " << seconds * 1000 / feedCount << " ms per feed, "
+             << (memoryAfter > memoryBefore ? (memoryAfter - memoryBefore) / feedCount / 1024 : 0) << " KB per feed." << std::endl;
+
+        for (size_t i = 0; i < feedCount; i++)
+        {
+            recognizers[i]->StopRecognitionAsync().get();
+            streams[i]->Close();
+            recognitions[i].wait();
+        }
+    };
+
+    try
+    {
+        measure("A model loaded per feed", [&modelFile]() { return KeywordRecognitionModel::FromFile(modelFile); });
+
+        KeywordModelRegistry registry;
+        measure("A model shared from the registry", [&registry, &modelFile]() { return registry.Get(modelFile); });
+
+        auto statistics = registry.GetStatistics();
+        cout << "Registry loads: " << statistics.Loads << " (" << statistics.LoadSeconds * 1000 << " ms), hits: " << statistics.Hits << std::endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
+
+// Speech recognition with auto detection for source language
+void SpeechRecognitionWithSourceLanguageAutoDetection()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto speechConfig = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+     // Currently this feature only supports 2 different language candidates
+     // Replace the languages with your languages in BCP-47 format, e.g. fr-FR.
+     // Please see https://docs.microsoft.com/azure/cognitive-services/speech-service/language-support for all supported languages
+     auto autoDetectSourceLanguageConfig = AutoDetectSourceLanguageConfig::FromLanguages({ "en-US", "de-DE" });
+
+     // The recognizer uses microphone,  to use file or stream as audio input, just construct the audioInput and pass to FromConfig API as the 3rd parameter.
+     // Ex: auto recognizer = SpeechRecognizer::FromConfig(speechConfig, autoDetectSourceLanguageConfig, audioInput);
+     auto recognizer = SpeechRecognizer::FromConfig(speechConfig, autoDetectSourceLanguageConfig);
+     cout << "Say something in either English or German...\n";
+
+    // Starts speech recognition, and returns after a single utterance is recognized. The end of a
+    // single utterance is determined by listening for silence at the end or until a maximum of 15
+    // seconds of audio is processed.  The task returns the recognition text as result.
+    // Note: Since RecognizeOnceAsync() returns only a single utterance, it is suitable only for single
+    // shot recognition like command or query.
+    // For long-running multi-utterance recognition, use StartContinuousRecognitionAsync() instead.
+    auto result = recognizer->RecognizeOnceAsync().get();
+
+    // Checks result.
+    auto autoDetectSourceLanguageResult = AutoDetectSourceLanguageResult::FromResult(result);
+    auto language = autoDetectSourceLanguageResult->Language;
+    if (result->Reason == ResultReason::RecognizedSpeech)
+    {
+        cout << "RECOGNIZED: Text=" << result->Text << std::endl;
+        cout << "RECOGNIZED: Language=" << language << std::endl;
+    }
+    else if (result->Reason == ResultReason::NoMatch)
+    {
+        if (language.empty())
+        {
+            // serivce cannot detect the source language
+            cout << "NOMATCH: Service cannot detect the source language." << std::endl;
+        }
+        else
+        {
+            // serivce can detect the source language but cannot recongize the speech content
+            cout << "NOMATCH: Service can recognize the speech." << std::endl;
+        }
+    }
+    else if (result->Reason == ResultReason::Canceled)
+    {
+        auto cancellation = CancellationDetails::FromResult(result);
+        cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+        if (cancellation->Reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+            cout << "CANCELED: ErrorDetails=" << cancellation->ErrorDetails << std::endl;
+            cout << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+    }
+}
+
+// Continuous speech recognition of a long file with auto detection of the source language, pinned once stable.
+void SpeechContinuousRecognitionWithLanguagePinning()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto speechConfig = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    MappedWavFileReader reader(SampleFile("whatstheweatherlike.wav"));
+
+    // Detects the language among the candidates until two utterances in a row are recognized in the same one, then
+    // recognizes in that language without detection, until two no-matches in a row suggest the language changed.
+    mutex outputMutex;
+    LanguagePinningRecognizer recognizer(speechConfig, { "en-US", "de-DE" }, reader.GetFormat(),
+        [&outputMutex](const string& text, const string& language, bool pinned, uint64_t offset, uint64_t duration)
+        {
+            lock_guard<mutex> lock(outputMutex);
+            cout << "RECOGNIZED: Language=" << language << (pinned ? " (pinned)" : " (detected)") << " Offset=" << offset
+                 << " Duration=" << duration << " Text=" << text << std::endl;
+        });
+    recognizer.Start();
+
+    // Writes 100 ms of audio at a time, the recognizers are switched between writes.
+    auto chunkSize = reader.GetFormat().AvgBytesPerSec / 10;
+    uint8_t* data;
+    uint32_t size;
+    while ((size = reader.ReadSpan(&data, chunkSize)) > 0)
+    {
+        recognizer.Write(data, size);
+    }
+
+    // Waits for the last utterances to be recognized.
+    recognizer.Close();
+    recognizer.PrintStatistics(cout);
+}
+
+// Speech recognition with auto detection for source language and using customized model
+void SpeechRecognitionWithSourceLanguageAutoDetectionUsingCustomizedModel()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    std::vector<std::shared_ptr<SourceLanguageConfig>> sourceLanguageConfigs;
+    // Replace the languages with your languages in BCP-47 format, e.g. zh-CN.
+    sourceLanguageConfigs.push_back(SourceLanguageConfig::FromLanguage("en-US"));
+    // Replace the languages with your languages in BCP-47 format, e.g. zh-CN.
+    // Please see https://docs.microsoft.com/azure/cognitive-services/speech-service/language-support for all supported languages
+    // Set the endpoint ID of your customized mode that will be used for fr-FR,  Replace with your own CRIS endpoint ID.
+    sourceLanguageConfigs.push_back(SourceLanguageConfig::FromLanguage("fr-FR", "The Endpoint Id for custom model of fr-FR"));
     // Construct AutoDetectSourceLanguageConfig with the 2 source language configurations
     // Currently this feature only supports 2 different language candidates
     auto autoDetectSourceLanguageConfig = AutoDetectSourceLanguageConfig::FromSourceLanguageConfigs(sourceLanguageConfigs);
@@ -653,7 +1885,7 @@ void PronunciationAssessmentWithMicrophone()
         // Receives reference text from console input.
         cout << "Enter reference text that you want to assess, or enter empty text to exit." << std::endl;
         cout << "> ";
-        getline(cin, referenceText);
+        ReadSampleLine(referenceText);
         if (referenceText.empty())
         {
             break;
@@ -698,3 +1930,246 @@ void PronunciationAssessmentWithMicrophone()
         }
     }
 }
+
+// Continuous speech recognition from a file, then synthesis of the transcript, traced as OpenTelemetry spans.
+void SpeechRecognitionWithTracing()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    cout << "Enter the host of an OpenTelemetry collector with OTLP/HTTP on port 4318 (empty to write traces.jsonl instead)." << std::endl;
+    cout << "> ";
+    string host;
+    ReadSampleLine(host);
+
+    try
+    {
+        shared_ptr<SpanExporter> exporter;
+        if (host.empty())
+        {
+            exporter = make_shared<OtlpFileSpanExporter>(SampleOutputFile("traces.jsonl"));
+        }
+        else
+        {
+            exporter = make_shared<OtlpHttpSpanExporter>(host);
+        }
+        auto processor = make_shared<BatchSpanProcessor>(exporter);
+        SessionTracer tracer(processor);
+        auto start = chrono::steady_clock::now();
+
+        // Creates a speech recognizer using file as audio input.
+        // Replace with your own audio file name.
+        auto audioInput = AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav"));
+        auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+        tracer.Attach(recognizer);
+
+        SessionCompletion recognitionEnd;
+        mutex transcriptMutex;
+        string transcript;
+        recognizer->Recognized.Connect([&transcriptMutex, &transcript](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
+                lock_guard<mutex> lock(transcriptMutex);
+                transcript += (transcript.empty() ? "" : " ") + e.Result->Text;
+            }
+        });
+        recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                     << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                     << "CANCELED: Did you update the subscription info?" << std::endl;
+                recognitionEnd.Complete(SessionOutcome::Canceled);
+            }
+        });
+        recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
+        {
+            recognitionEnd.Complete(SessionOutcome::Stopped);
+        });
+
+        recognizer->StartContinuousRecognitionAsync().get();
+        recognitionEnd.Wait();
+        recognizer->StopContinuousRecognitionAsync().get();
+
+        // Reads the transcript back, traced as a synthesis span with an event per audio chunk.
+        if (!transcript.empty())
+        {
+            auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+            tracer.Attach(synthesizer);
+            auto result = synthesizer->SpeakTextAsync(transcript).get();
+            cout << "Synthesized the transcript: " << (result->Reason == ResultReason::SynthesizingAudioCompleted ? "completed" : "canceled") << std::endl;
+        }
+
+        // Exports the spans still queued, and shows how much time the export took next to the whole run.
+        processor->ForceFlush();
+        auto statistics = processor->GetStatistics();
+        auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Spans exported: " << statistics.Exported << ", dropped: " << statistics.Dropped << ", failed exports: " << statistics.FailedExports
+             << ", export time: " << statistics.ExportSeconds * 1000 << " ms (" << 100 * statistics.ExportSeconds / seconds << "% of the run)" << std::endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
+
+// Records a recognition and synthesis session once against the service, then replays it offline, as many times as asked,
+// through the client-side pipeline of the samples: a result sink and its consumer, a chunked audio buffer and a synthesis
+// cache. Replays need neither a subscription nor a network, e.g. to benchmark in CI with
+//     samples --scenario SpeechRecognitionRecordAndReplay --line session.sprec --line 1000
+void SpeechRecognitionRecordAndReplay()
+{
+    cout << "Enter the recording file. If it does not exist, a live session is recorded to it; otherwise it is replayed." << std::endl;
+    cout << "> ";
+    string fileName;
+    ReadSampleLine(fileName);
+    cout << "Enter the number of replays (empty for 1)." << std::endl;
+    cout << "> ";
+    uint32_t count;
+    if (!ReadSampleCount(1, count))
+    {
+        return;
+    }
+
+    try
+    {
+        if (!ifstream(fileName).good())
+        {
+            // Creates an instance of a speech config with specified subscription key and service region.
+            // Replace with your own subscription key and service region (e.g., "westus").
+            auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+            SessionRecorder recorder;
+            SessionCompletion recognitionEnd;
+            mutex transcriptMutex;
+            string transcript;
+            {
+                // Replace with your own audio file name.
+                auto audioInput = AudioConfig::FromWavFileInput(SampleFile("whatstheweatherlike.wav"));
+                auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+                recorder.Attach(recognizer);
+                recognizer->Recognized.Connect([&transcriptMutex, &transcript](const SpeechRecognitionEventArgs& e)
+                {
+                    if (e.Result->Reason == ResultReason::RecognizedSpeech)
+                    {
+                        lock_guard<mutex> lock(transcriptMutex);
+                        transcript += (transcript.empty() ? "" : " ") + e.Result->Text;
+                    }
+                });
+                recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+                {
+                    if (e.Reason == CancellationReason::Error)
+                    {
+                        cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                             << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                             << "CANCELED: Did you update the subscription info?" << std::endl;
+                        recognitionEnd.Complete(SessionOutcome::Canceled);
+                    }
+                });
+                recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
+                {
+                    recognitionEnd.Complete(SessionOutcome::Stopped);
+                });
+
+                recognizer->StartContinuousRecognitionAsync().get();
+                recognitionEnd.Wait();
+                recognizer->StopContinuousRecognitionAsync().get();
+            }
+
+            // Records the Synthesizing chunks of reading the transcript back too.
+            if (!transcript.empty())
+            {
+                auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+                recorder.Attach(synthesizer);
+                synthesizer->SpeakTextAsync(transcript).get();
+            }
+
+            auto recording = recorder.GetRecording();
+            recording.Save(fileName);
+            cout << "Recorded " << recording.GetEvents().size() << " events over " << recording.GetDurationMicroseconds() / 1000 << " ms to [" << fileName << "]" << std::endl;
+            return;
+        }
+
+        auto recording = SessionRecording::Load(fileName);
+
+        // The same pipeline as SpeechContinuousRecognitionWithResultSink and SpeechSynthesisWithCache, driven by the recording.
+        ResultSink sink(256);
+        uint64_t consumed = 0;
+        thread consumer([&sink, &consumed]()
+        {
+            ResultRecord record;
+            while (sink.Pop(record))
+            {
+                consumed++;
+            }
+        });
+
+        ChunkedAudioBuffer audio;
+        SynthesisCache cache(16 * 1024 * 1024);
+        auto handler = [&sink, &audio, &cache](const RecordedEvent& event)
+        {
+            switch (event.Kind)
+            {
+            case RecordedEventKind::Recognizing:
+                sink.TryPush(ResultRecordKind::Recognizing, event.Text, event.Offset, event.Duration);
+                break;
+            case RecordedEventKind::Recognized:
+                sink.TryPush(ResultRecordKind::Recognized, event.Text, event.Offset, event.Duration, std::string(), event.SessionId);
+                break;
+            case RecordedEventKind::NoMatch:
+                sink.TryPush(ResultRecordKind::NoMatch, std::string(), event.Offset, event.Duration);
+                break;
+            case RecordedEventKind::Canceled:
+                sink.TryPush(ResultRecordKind::Canceled, event.Text);
+                break;
+            case RecordedEventKind::SynthesisStarted:
+                audio.Clear();
+                break;
+            case RecordedEventKind::Synthesizing:
+                audio.Append(event.Audio.data(), event.Audio.size());
+                break;
+            case RecordedEventKind::SynthesisCompleted:
+            {
+                auto key = SynthesisCache::MakeKey(std::string(), std::string(), std::string(), event.SessionId, false);
+                if (cache.Find(key) == nullptr)
+                {
+                    cache.Add(key, make_shared<const vector<uint8_t>>(audio.Flatten()));
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        };
+
+        ReplayStatistics statistics;
+        try
+        {
+            SessionReplayer replayer(recording);
+            statistics = replayer.Replay(handler, count);
+        }
+        catch (...)
+        {
+            // Stops the consumer before the exception leaves, a joinable thread would terminate the process.
+            sink.Close();
+            consumer.join();
+            throw;
+        }
+        sink.Close();
+        consumer.join();
+
+        cout << "Replayed " << statistics.Events << " events and " << statistics.AudioBytes << " bytes of audio in " << statistics.WallSeconds
+             << " s, " << statistics.RecordedSeconds << " s at the recorded pace (" << statistics.Events / (std::max)(statistics.WallSeconds, 1e-9) << " events/s)" << std::endl;
+        statistics.HandlerLatency.Print(cout, "Handler latency", "us");
+        cout << "Results consumed: " << consumed << ", dropped on overflow: " << sink.GetOverflows() << std::endl;
+        cache.PrintStatistics(cout);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
@@ -6,7 +6,20 @@
 #include "stdafx.h"
 
 #include <speechapi_cxx.h>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include "audio_stream_tee.h"
+#include "batch_synthesis_driver.h"
+#include "chunked_audio_buffer.h"
+#include "chunked_http_audio_stream.h"
+#include "long_form_synthesizer.h"
+#include "ssml_template.h"
+#include "synthesis_cache.h"
+#include "word_boundary_collector.h"
+#include "sample_console.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -28,7 +41,7 @@ void SpeechSynthesisToSpeaker()
         cout << "Enter some text that you want to speak, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -78,7 +91,7 @@ void SpeechSynthesisWithLanguage()
         cout << "Enter some text that you want to speak, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -129,7 +142,7 @@ void SpeechSynthesisWithVoice()
         cout << "Enter some text that you want to speak, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -166,7 +179,7 @@ void SpeechSynthesisToWaveFile()
 
     // Creates a speech synthesizer using file as audio output.
     // Replace with your own audio file name.
-    auto fileName = "outputaudio.wav";
+    auto fileName = SampleOutputFile("outputaudio.wav");
     auto fileOutput = AudioConfig::FromWavFileOutput(fileName);
     auto synthesizer = SpeechSynthesizer::FromConfig(config, fileOutput);
 
@@ -176,7 +189,7 @@ void SpeechSynthesisToWaveFile()
         cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -218,7 +231,7 @@ void SpeechSynthesisToMp3File()
 
     // Creates a speech synthesizer using file as audio output.
     // Replace with your own audio file name.
-    auto fileName = "outputaudio.mp3";
+    auto fileName = SampleOutputFile("outputaudio.mp3");
     auto fileOutput = AudioConfig::FromWavFileOutput(fileName);
     auto synthesizer = SpeechSynthesizer::FromConfig(config, fileOutput);
 
@@ -228,7 +241,7 @@ void SpeechSynthesisToMp3File()
         cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -257,6 +270,7 @@ void SpeechSynthesisToMp3File()
 }
 
 // Speech synthesis to pull audio output stream.
+// The audio is read from the stream on a separate thread while it is being synthesized, as a player would do.
 void SpeechSynthesisToPullAudioOutputStream()
 {
     // Creates an instance of a speech config with specified subscription key and service region.
@@ -266,55 +280,97 @@ void SpeechSynthesisToPullAudioOutputStream()
     // Creates an audio out stream.
     auto stream = AudioOutputStream::CreatePullStream();
 
-    // Creates a speech synthesizer using audio stream output.
-    auto streamConfig = AudioConfig::FromStreamOutput(stream);
-    auto synthesizer = SpeechSynthesizer::FromConfig(config, streamConfig);
-
-    while (true)
+    // Reads(pulls) data from the stream as soon as the synthesizer exists, rather than after the synthesis.
+    // Read() blocks until audio is available, and returns 0 once the synthesizer is destroyed.
+    // Replace the byte count with your audio sink, e.g. a playback device.
+    atomic<uint64_t> totalSize{ 0 };
+    thread reader;
+    try
     {
-        // Receives a text from console input and synthesize it to pull audio output stream.
-        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
-        cout << "> ";
-        std::string text;
-        getline(cin, text);
-        if (text.empty())
+        // Records when the first audio chunk of a request is available, which is when playback can start.
+        // These outlive the synthesizer, so that no late event handler can touch them after destruction.
+        mutex timingMutex;
+        chrono::steady_clock::time_point requestStart;
+        chrono::steady_clock::time_point firstAudio;
+        bool firstAudioSeen = false;
+
+        // Creates a speech synthesizer using audio stream output.
+        auto streamConfig = AudioConfig::FromStreamOutput(stream);
+        auto synthesizer = SpeechSynthesizer::FromConfig(config, streamConfig);
+        synthesizer->Synthesizing += [&](const SpeechSynthesisEventArgs&)
         {
-            break;
-        }
-
-        auto result = synthesizer->SpeakTextAsync(text).get();
+            lock_guard<mutex> lock(timingMutex);
+            if (!firstAudioSeen)
+            {
+                firstAudio = chrono::steady_clock::now();
+                firstAudioSeen = true;
+            }
+        };
 
-        // Checks result.
-        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
-        {
-            cout << "Speech synthesized for text [" << text << "], and the audio was written to output stream." << std::endl;
-        }
-        else if (result->Reason == ResultReason::Canceled)
+        reader = thread([stream, &totalSize]()
         {
-            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
-            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+            uint8_t buffer[3200];
+            uint32_t filledSize = 0;
+            while ((filledSize = stream->Read(buffer, sizeof(buffer))) > 0)
+            {
+                totalSize += filledSize;
+            }
+        });
 
-            if (cancellation->Reason == CancellationReason::Error)
+        while (true)
+        {
+            // Receives a text from console input and synthesize it to pull audio output stream.
+            cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+            cout << "> ";
+            std::string text;
+            ReadSampleLine(text);
+            if (text.empty())
             {
-                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
-                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
-                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+                break;
             }
-        }
-    }
 
-    // Destroys the synthesizer so that the while statement below won't infinitely wait for data from the stream.
-    synthesizer = nullptr;
+            {
+                lock_guard<mutex> lock(timingMutex);
+                requestStart = chrono::steady_clock::now();
+                firstAudioSeen = false;
+            }
+            auto result = synthesizer->SpeakTextAsync(text).get();
+            auto completed = chrono::steady_clock::now();
 
-    // Reads(pulls) data from the stream
-    uint8_t buffer[32000];
-    uint32_t totalSize = 0;
-    uint32_t filledSize = 0;
+            // Checks result.
+            if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+            {
+                lock_guard<mutex> lock(timingMutex);
+                cout << "Speech synthesized for text [" << text << "], and the audio was written to output stream." << std::endl;
+                if (firstAudioSeen)
+                {
+                    cout << "First audio after " << chrono::duration_cast<chrono::milliseconds>(firstAudio - requestStart).count() << " ms, ";
+                }
+                cout << "synthesis completed after " << chrono::duration_cast<chrono::milliseconds>(completed - requestStart).count() << " ms." << std::endl;
+            }
+            else if (result->Reason == ResultReason::Canceled)
+            {
+                auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+                cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+                if (cancellation->Reason == CancellationReason::Error)
+                {
+                    cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                    cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                    cout << "CANCELED: Did you update the subscription info?" << std::endl;
+                }
+            }
+        }
 
-    while ((filledSize = stream->Read(buffer, sizeof(buffer))) > 0)
+        // Destroys the synthesizer at the end of this scope, also when it throws, so that the reader sees the end of the stream.
+    }
+    catch (const exception& e)
     {
-        cout << filledSize << " bytes received." << endl;
-        totalSize += filledSize;
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+    if (reader.joinable())
+    {
+        reader.join();
     }
 
     cout << "Totally " << totalSize << " bytes received." << endl;
@@ -332,20 +388,19 @@ void SpeechSynthesisToPushAudioOutputStream()
     public:
         PushAudioOutputStreamSampleCallback()
         {
-            m_audioData = std::make_shared<std::vector<uint8_t>>();
+            m_audioData = std::make_shared<ChunkedAudioBuffer>();
         }
 
         /// <summary>
         /// The callback function which is invoked when the synthesizer has a output audio chunk to write out.
+        /// The chunk is appended to the tail block of a chunked buffer, so that earlier audio is never reallocated or copied.
         /// </summary>
         /// <param name="dataBuffer">The output audio chunk sent by synthesizer.</param>
         /// <param name="size">Size of the output audio chunk in bytes.</param>
         /// <returns>Tell synthesizer how many bytes are received.</returns>
         int Write(uint8_t* dataBuffer, uint32_t size) override
         {
-            auto oldSize = m_audioData->size();
-            m_audioData->resize(oldSize + size);
-            memcpy(m_audioData->data() + oldSize, dataBuffer, size);
+            m_audioData->Append(dataBuffer, size);
 
             cout << size << " bytes received." << endl;
 
@@ -360,26 +415,35 @@ void SpeechSynthesisToPushAudioOutputStream()
             cout << "Push audio output stream closed." << endl;
         }
 
+        /// <summary>
+        /// Reserves room for the audio of a text before it is synthesized, from the length of the text.
+        /// </summary>
+        /// <param name="text">The text about to be synthesized.</param>
+        void ReserveFor(const std::string& text)
+        {
+            m_audioData->Reserve(ChunkedAudioBuffer::EstimateSynthesizedBytes(text.size()));
+        }
+
         /// <summary>
         /// Gets the received audio data size
         /// </summary>
         /// <returns>The received audio data size</returns>
         size_t GetAudioSize()
         {
-            return m_audioData->size();
+            return m_audioData->Size();
         }
 
         /// <summary>
         /// Gets the received audio data
         /// </summary>
-        /// <returns>The received audio data in byte vector</returns>
-        std::shared_ptr<std::vector<uint8_t>> GetAudioData()
+        /// <returns>The received audio data in a chunked buffer, which is read as a list of segments</returns>
+        std::shared_ptr<ChunkedAudioBuffer> GetAudioData()
         {
             return m_audioData;
         }
 
     private:
-        std::shared_ptr<std::vector<uint8_t>> m_audioData;
+        std::shared_ptr<ChunkedAudioBuffer> m_audioData;
     };
 
     // Creates an instance of a speech config with specified subscription key and service region.
@@ -402,12 +466,13 @@ void SpeechSynthesisToPushAudioOutputStream()
         cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
         }
 
+        callback->ReserveFor(text);
         auto result = synthesizer->SpeakTextAsync(text).get();
 
         // Checks result.
@@ -429,7 +494,8 @@ void SpeechSynthesisToPushAudioOutputStream()
         }
     }
 
-    cout << "Totally " << callback->GetAudioSize() << " bytes received." << endl;
+    cout << "Totally " << callback->GetAudioSize() << " bytes received in "
+         << callback->GetAudioData()->GetSegments().size() << " segments." << endl;
 }
 
 // Gets synthesized audio data from result.
@@ -450,7 +516,7 @@ void SpeechSynthesisToResult()
         cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -498,7 +564,7 @@ void SpeechSynthesisToAudioDataStream()
         cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -512,25 +578,21 @@ void SpeechSynthesisToAudioDataStream()
             cout << "Speech synthesized for text [" << text << "]" << std::endl;
             auto audioDataStream = AudioDataStream::FromResult(result);
 
-            // You can save all the data in the audio data stream to a file
+            // You can save the data in the audio data stream to a file and process it in memory at the same time,
+            // reading the stream only once. Each chunk read goes to all the sinks.
+            // The file gets a wav header for the output format of the synthesizer.
             stringstream fileName;
-            fileName << "outputaudio.wav";
-            audioDataStream->SaveToWavFile(fileName.str());
+            fileName << SampleOutputFile("outputaudio.wav");
+            auto memory = make_shared<MemoryAudioSink>();
+            auto hash = make_shared<HashAudioSink>();
+            AudioStreamTee tee(16000);
+            tee.AddSink(FileAudioSink::FromSynthesisOutputFormat(fileName.str(), config->GetSpeechSynthesisOutputFormat()));
+            tee.AddSink(memory);
+            tee.AddSink(hash);
+
+            auto totalSize = tee.Run(*audioDataStream);
             cout << "Audio data for text [" << text << "] was saved to [" << fileName.str() << "]" << endl;
-
-            // You can also read data from audio data stream and process it in memory
-            // Reset the stream position to the beginnging since saving to file puts the postion to end.
-            audioDataStream->SetPosition(0);
-
-            uint8_t buffer[16000];
-            uint32_t totalSize = 0;
-            uint32_t filledSize = 0;
-
-            while ((filledSize = audioDataStream->ReadData(buffer, sizeof(buffer))) > 0)
-            {
-                cout << filledSize << " bytes received." << endl;
-                totalSize += filledSize;
-            }
+            cout << memory->GetBuffer()->Size() << " bytes kept in memory, with hash " << hex << hash->GetHash() << dec << endl;
 
             cout << "Totally " << totalSize << " bytes received for text [" << text << "]" << endl;
         }
@@ -585,7 +647,7 @@ void SpeechSynthesisEvents()
         cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -644,7 +706,7 @@ void SpeechSynthesisWordBoundaryEvent()
         cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
         cout << "> ";
         std::string text;
-        getline(cin, text);
+        ReadSampleLine(text);
         if (text.empty())
         {
             break;
@@ -716,3 +778,388 @@ void SpeechSynthesisWithSourceLanguageAutoDetection()
         }
     }
 }
+
+// Batch speech synthesis of all the texts listed in a manifest file, each to its own output file.
+void SpeechSynthesisBatchToFiles()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    // The config is shared by all the synthesizers of the batch.
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    cout << "Enter a manifest file with one <output file><TAB><text or SSML> entry per line." << std::endl;
+    cout << "> ";
+    string path;
+    ReadSampleLine(path);
+
+    cout << "Enter the number of synthesizers (empty for 2)." << std::endl;
+    cout << "> ";
+    uint32_t synthesizerCount;
+    if (!ReadSampleCount(2, synthesizerCount))
+    {
+        return;
+    }
+
+    cout << "Enter the maximum number of requests in flight (empty for 8)." << std::endl;
+    cout << "> ";
+    uint32_t maxInFlight;
+    if (!ReadSampleCount(8, maxInFlight))
+    {
+        return;
+    }
+
+    vector<BatchSynthesisJob> jobs;
+    try
+    {
+        jobs = ReadSynthesisManifest(path);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+        return;
+    }
+    cout << "Synthesizing " << jobs.size() << " texts with " << synthesizerCount << " synthesizers and up to "
+         << maxInFlight << " requests in flight..." << std::endl;
+
+    // Adapts the concurrency to the throttling of the service, up to the maximum entered.
+    AdaptiveConcurrencyOptions limits;
+    limits.Max = maxInFlight;
+    limits.Initial = (std::min)(limits.Initial, limits.Max);
+    auto limiter = make_shared<AdaptiveConcurrencyLimiter>(limits);
+
+    // Keeps several requests outstanding, and saves each result to its output file as soon as it completes.
+    BatchSynthesisDriver driver(config, synthesizerCount, maxInFlight, limiter);
+    auto results = driver.Run(jobs);
+
+    for (const auto& result : results)
+    {
+        if (result.Succeeded)
+        {
+            cout << "SYNTHESIZED: File=" << result.OutputPath << ", FirstByte=" << result.FirstByteSeconds << "s"
+                 << ", Latency=" << result.LatencySeconds << "s" << std::endl;
+        }
+        else
+        {
+            cout << "FAILED: File=" << result.OutputPath << ", ErrorDetails=[" << result.ErrorDetails << "]" << std::endl;
+        }
+    }
+
+    BatchSynthesisDriver::PrintSummary(cout, results, driver.GetWallSeconds());
+    auto concurrency = limiter->GetStatistics();
+    cout << "Concurrency limit: " << concurrency.Limit << ", peak in flight: " << concurrency.PeakInFlight
+         << ", throttled: " << concurrency.Throttled << std::endl;
+}
+
+// Speech synthesis of repeated prompts, answered from a cache after the first time.
+void SpeechSynthesisWithCache()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    cout << "Enter an existing directory to keep the cached audio in across runs (empty to cache in memory only)." << std::endl;
+    cout << "> ";
+    string directory;
+    ReadSampleLine(directory);
+
+    // Keeps up to 64 MB of audio in memory, and everything in the directory.
+    auto cache = make_shared<SynthesisCache>(64 * 1024 * 1024, directory);
+    CachingSpeechSynthesizer synthesizer(config, cache);
+
+    while (true)
+    {
+        // Receives a text from console input and synthesize it, or take it from the cache if it was synthesized before.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        ReadSampleLine(text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        try
+        {
+            auto start = chrono::steady_clock::now();
+            auto audio = synthesizer.SpeakText(text);
+            auto latency = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+            // Replace with your own audio file name.
+            auto fileName = SampleOutputFile("outputaudio.wav");
+            audio->SaveToFile(fileName);
+            cout << "Audio for text [" << text << "] available after " << latency.count() << " ms, and saved to [" << fileName << "]" << std::endl;
+        }
+        catch (const exception& e)
+        {
+            cout << "CANCELED: " << e.what() << std::endl;
+            cout << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+
+        cache->PrintStatistics(cout);
+    }
+}
+
+// Speech synthesis of a long document, split into segments that are synthesized in parallel and stitched into one file.
+void SpeechSynthesisLongDocument()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    cout << "Enter a text file with the document to synthesize." << std::endl;
+    cout << "> ";
+    string path;
+    ReadSampleLine(path);
+
+    ifstream document(path, ios::binary);
+    if (!document.good())
+    {
+        cout << "Exit due to failing to open the specified document file." << std::endl;
+        return;
+    }
+    string text((istreambuf_iterator<char>(document)), istreambuf_iterator<char>());
+
+    cout << "Enter the output file, ending in .wav or .mp3 (empty for outputaudio.wav)." << std::endl;
+    cout << "> ";
+    string fileName;
+    ReadSampleLine(fileName);
+    if (fileName.empty())
+    {
+        fileName = "outputaudio.wav";
+    }
+    fileName = SampleOutputFile(fileName);
+    auto container = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".mp3") == 0
+        ? LongFormSynthesizer::OutputContainer::Mp3
+        : LongFormSynthesizer::OutputContainer::Wav;
+
+    cout << "Enter the number of segments to synthesize in parallel (empty for 4)." << std::endl;
+    cout << "> ";
+    uint32_t maxConcurrency;
+    if (!ReadSampleCount(4, maxConcurrency))
+    {
+        return;
+    }
+
+    LongFormSynthesizer synthesizer(config, container, maxConcurrency);
+    auto result = synthesizer.SynthesizeToFile(text, fileName);
+
+    if (result.Succeeded)
+    {
+        cout << "Speech synthesized to [" << fileName << "] from " << result.SegmentCount << " segments, "
+             << result.AudioBytes << " bytes of audio and " << result.WordBoundaries.size() << " word boundaries." << std::endl;
+        cout << "First segment ready after " << result.FirstSegmentSeconds << "s, document completed after " << result.TotalSeconds << "s." << std::endl;
+    }
+    else
+    {
+        cout << "CANCELED: ErrorDetails=[" << result.ErrorDetails << "]" << std::endl;
+        cout << "CANCELED: Did you update the subscription info?" << std::endl;
+    }
+}
+
+// Speech synthesis with captions, from word boundaries collected without slowing the synthesis down.
+void SpeechSynthesisWordBoundaryCaptions()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Creates a speech synthesizer with a null output stream, the audio is taken from the result.
+    auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+
+    // Only appends the boundaries to preallocated arrays on the callback thread, the captions are written afterward.
+    auto collector = make_shared<WordBoundaryCollector>();
+    synthesizer->WordBoundary += [collector](const SpeechSynthesisWordBoundaryEventArgs& e)
+    {
+        collector->Append(e.AudioOffset, e.TextOffset, e.WordLength);
+    };
+
+    while (true)
+    {
+        // Receives a text from console input and synthesize it to result.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        ReadSampleLine(text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        collector->Clear();
+        auto result = synthesizer->SpeakTextAsync(text).get();
+
+        // Checks result.
+        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+        {
+            // Replace with your own file names.
+            auto audioFile = SampleOutputFile("outputaudio.wav");
+            auto captionsFile = SampleOutputFile("outputaudio.vtt");
+            auto boundariesFile = SampleOutputFile("outputaudio.wordboundaries");
+            AudioDataStream::FromResult(result)->SaveToWavFile(audioFile);
+            collector->SaveToWebVttFile(captionsFile, text);
+            collector->SaveToBinaryFile(boundariesFile);
+            cout << "Speech synthesized to [" << audioFile << "], with captions for " << collector->Size()
+                 << " words in [" << captionsFile << "] and [" << boundariesFile << "]" << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+    }
+}
+
+// Speech synthesis of SSML prompts filled from a template, whose static segments are synthesized once and cached.
+void SpeechSynthesisWithSsmlTemplate()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    try
+    {
+        // Parses the prompt once. The greeting is the same for every caller, so it is synthesized only the first time,
+        // while the second segment is synthesized for each new name and balance.
+        SsmlTemplate prompt("en-US-JennyNeural", "en-US",
+            "<prosody rate='-5%'>Thank you for calling Contoso.</prosody>"
+            "{{segment}}"
+            "Hello {{name}}, your balance is <say-as interpret-as='currency'>{{balance}}</say-as>.");
+        auto nameSlot = prompt.GetSlotIndex("name");
+        auto balanceSlot = prompt.GetSlotIndex("balance");
+
+        auto cache = make_shared<SynthesisCache>(64 * 1024 * 1024);
+        SsmlTemplateSynthesizer synthesizer(config, cache);
+
+        // Replace with the callers of your own IVR.
+        const char* callers[][2] = { { "Ana", "$12.50" }, { "Bob & Co", "$3.00" }, { "Ana", "$12.50" }, { "Chen", "$0.99" } };
+        vector<string> values(prompt.GetSlotNames().size());
+        int call = 0;
+        for (const auto& caller : callers)
+        {
+            values[nameSlot] = caller[0];
+            values[balanceSlot] = caller[1];
+
+            auto start = chrono::steady_clock::now();
+            auto audio = synthesizer.Speak(prompt, values);
+            auto latency = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+            // Replace with your own audio file name.
+            auto fileName = SampleOutputFile("outputaudio" + to_string(++call) + ".wav");
+            audio->SaveToFile(fileName);
+            cout << "Prompt for [" << caller[0] << "] available after " << latency.count() << " ms, and saved to [" << fileName << "]" << std::endl;
+        }
+
+        cout << "Segments synthesized: " << synthesizer.GetSynthesizedSegments() << std::endl;
+        cache->PrintStatistics(cout);
+    }
+    catch (const exception& e)
+    {
+        cout << "CANCELED: " << e.what() << std::endl;
+        cout << "CANCELED: Did you update the subscription info?" << std::endl;
+    }
+}
+
+// Speech synthesis streamed to HTTP clients as MP3, chunk by chunk as it is synthesized, e.g. to an audio element of a web page.
+void SpeechSynthesisToHttpStream()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // MP3 frames can be played as they arrive, unlike a WAV file whose header needs the total length.
+    config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Audio24Khz48KBitRateMonoMp3);
+
+    cout << "Enter the port to listen on (empty for 8080)." << std::endl;
+    cout << "> ";
+    uint32_t port;
+    if (!ReadSampleCount(8080, port))
+    {
+        return;
+    }
+    if (port > UINT16_MAX)
+    {
+        cout << "Expected a port up to " << UINT16_MAX << ", got " << port << std::endl;
+        return;
+    }
+    cout << "Enter the number of requests to serve (empty for 1)." << std::endl;
+    cout << "> ";
+    uint32_t count;
+    if (!ReadSampleCount(1, count))
+    {
+        return;
+    }
+
+    try
+    {
+        HttpListener listener((uint16_t)port);
+        auto pool = make_shared<AudioChunkPool>();
+        cout << "Open http://localhost:" << port << "/speak?text=Hello%20world in a browser." << std::endl;
+
+        for (uint32_t served = 0; served < count;)
+        {
+            auto connection = listener.Accept();
+            string text;
+            try
+            {
+                auto target = HttpConnection::GetRequestTarget(connection->ReadRequestHead());
+                if (target.compare(0, 6, "/speak") != 0)
+                {
+                    connection->SendStatus("404 Not Found");
+                    continue;
+                }
+                text = HttpConnection::GetQueryParameter(target, "text");
+            }
+            catch (const exception& e)
+            {
+                cout << "Bad request: " << e.what() << std::endl;
+                continue;
+            }
+            if (text.empty())
+            {
+                connection->SendStatus("400 Bad Request");
+                continue;
+            }
+            served++;
+
+            // The response starts as soon as the request is read, and each chunk of audio is sent as it is written.
+            auto callback = make_shared<ChunkedHttpAudioOutputCallback>(connection, pool, "audio/mpeg");
+            auto stream = AudioOutputStream::CreatePushStream(callback);
+            auto synthesizer = SpeechSynthesizer::FromConfig(config, AudioConfig::FromStreamOutput(stream));
+            auto result = synthesizer->SpeakTextAsync(text).get();
+
+            if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+            {
+                callback->Close();
+            }
+            else
+            {
+                auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+                cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+                if (cancellation->Reason == CancellationReason::Error)
+                {
+                    cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                    cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                    cout << "CANCELED: Did you update the subscription info?" << std::endl;
+                }
+                callback->Abort();
+            }
+
+            auto statistics = callback->GetStatistics();
+            cout << "Streamed [" << text << "]: " << statistics.Bytes << " bytes in " << statistics.Chunks << " chunks, "
+                 << "time to first byte " << statistics.TimeToFirstByteMilliseconds << " ms, stalled " << statistics.StallMilliseconds << " ms"
+                 << (statistics.Disconnected ? ", client disconnected" : "") << std::endl;
+        }
+        cout << "Audio buffers allocated: " << pool->GetAllocated() << std::endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exit due to exception: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,402 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "adaptive_concurrency_limiter.h"
+#include "session_completion.h"
+#include "voice_activity_trimmer.h"
+#include "wav_file_reader.h"
+#include "worker_pool.h"
+
+struct SplitRecognitionOptions
+{
+    // The length the segments aim for, and how far from it a cut is looked for.
+    std::chrono::seconds SegmentLength{ 60 };
+    std::chrono::seconds SearchWindow{ 10 };
+
+    // A cut goes in the middle of the longest silence of the window at least this long, else at the target length.
+    std::chrono::milliseconds MinSilence{ 300 };
+
+    // How far each segment reaches into its neighbors, so that an utterance cut in two is recognized whole by one of them.
+    std::chrono::milliseconds Overlap{ 1000 };
+
+    uint32_t MaxInFlight = 8;
+    VoiceActivityOptions VoiceActivity;
+};
+
+// A segment of the audio data, in bytes: it owns [Start, End), and is recognized over [AudioStart, AudioEnd), with the overlap.
+struct AudioSegment
+{
+    uint64_t Start = 0;
+    uint64_t End = 0;
+    uint64_t AudioStart = 0;
+    uint64_t AudioEnd = 0;
+    bool SilenceCut = false;    // whether it ends in a silence, rather than at the target length or the end of the file.
+};
+
+// A final result, its offset from the start of the file in ticks of 100 ns.
+struct SplitTranscriptEntry
+{
+    std::string Text;
+    uint64_t Offset = 0;
+    uint64_t Duration = 0;
+    size_t Segment = 0;
+};
+
+struct SplitRecognitionResult
+{
+    std::vector<SplitTranscriptEntry> Entries;      // in offset order, without the duplicates of the overlaps.
+    std::vector<AudioSegment> Segments;
+    size_t FailedSegments = 0;
+    size_t Duplicates = 0;                          // results dropped as recognized by the neighbor too.
+    std::string ErrorDetails;                       // of the first segment that failed.
+    double AudioSeconds = 0;
+    double WallSeconds = 0;
+};
+
+// Recognizes one long wav file in parallel: cuts it into segments at silences found by a VoiceActivityDetector,
+// recognizes the segments concurrently on separate recognizers, each reading its part of the file, and merges the
+// results in offset order. So the turnaround of a file of hours is that of a segment times the segments per recognizer
+// in flight, rather than the length of the file.
+// The segments overlap, and a result of an overlap is kept from the segment that owns its middle; of two results of
+// neighbors that still overlap, the one further from the edges of its segment, which is less likely cut, is kept.
+class SplitFileRecognizer final
+{
+public:
+    SplitFileRecognizer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config,
+        SplitRecognitionOptions options = SplitRecognitionOptions(), std::shared_ptr<AdaptiveConcurrencyLimiter> limiter = nullptr)
+        : m_config(config), m_options(options), m_limiter(limiter)
+    {
+        if (m_config == nullptr || options.MaxInFlight == 0 || options.SegmentLength <= options.SearchWindow
+            || options.Overlap.count() < 0 || options.MinSilence.count() <= 0)
+        {
+            throw std::invalid_argument("A speech config, a positive in-flight limit, and a segment longer than its search window are required");
+        }
+    }
+
+    SplitFileRecognizer(const SplitFileRecognizer&) = delete;
+    SplitFileRecognizer& operator=(const SplitFileRecognizer&) = delete;
+
+    // Cuts the audio of a 16-bit PCM wav file into segments, reading it once.
+    std::vector<AudioSegment> PlanSegments(const std::string& fileName) const
+    {
+        WavFileReader reader(fileName);
+        const auto format = reader.GetFormat();
+        VoiceActivityDetector detector(format, m_options.VoiceActivity);
+        auto frameBytes = detector.GetFrameBytes();
+
+        // Classifies the whole frames; a trailing partial frame belongs to the last segment.
+        std::vector<bool> speech;
+        std::vector<uint8_t> buffer(frameBytes * 100);
+        uint64_t dataBytes = 0;
+        int read;
+        size_t fill = 0;
+        while ((read = reader.Read(buffer.data() + fill, (uint32_t)(buffer.size() - fill))) > 0)
+        {
+            dataBytes += read;
+            fill += read;
+            size_t frames = fill / frameBytes;
+            for (size_t i = 0; i < frames; i++)
+            {
+                speech.push_back(detector.IsSpeech(buffer.data() + i * frameBytes));
+            }
+            std::copy(buffer.begin() + frames * frameBytes, buffer.begin() + fill, buffer.begin());
+            fill -= frames * frameBytes;
+        }
+
+        auto toFrames = [&detector](std::chrono::milliseconds duration) { return (size_t)detector.FramesFromMilliseconds((uint32_t)duration.count()); };
+        auto targetFrames = toFrames(m_options.SegmentLength);
+        auto windowFrames = toFrames(m_options.SearchWindow);
+        auto minSilenceFrames = toFrames(m_options.MinSilence);
+        auto overlapBytes = AudioTicksToBytes(m_options.Overlap.count() * 10000, format);
+
+        std::vector<AudioSegment> segments;
+        size_t start = 0;
+        while (start < speech.size() || segments.empty())
+        {
+            AudioSegment segment;
+            segment.Start = (uint64_t)start * frameBytes;
+            size_t end = speech.size();
+            if (speech.size() - start > targetFrames + windowFrames)
+            {
+                end = start + targetFrames;
+                auto cut = FindSilence(speech, end - windowFrames, end + windowFrames, minSilenceFrames);
+                if (cut > start)
+                {
+                    end = cut;
+                    segment.SilenceCut = true;
+                }
+            }
+            segment.End = end == speech.size() ? dataBytes : (uint64_t)end * frameBytes;
+            segment.AudioStart = segment.Start > overlapBytes ? segment.Start - overlapBytes : 0;
+            segment.AudioEnd = (std::min)(segment.End + overlapBytes, dataBytes);
+            segments.push_back(segment);
+            start = end;
+        }
+        return segments;
+    }
+
+    // Recognizes the file, and returns its transcript.
+    SplitRecognitionResult Run(const std::string& fileName)
+    {
+        SplitRecognitionResult result;
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            result.Segments = PlanSegments(fileName);
+            WavFileReader reader(fileName);
+            const auto format = reader.GetFormat();
+            result.AudioSeconds = (double)result.Segments.back().End / format.AvgBytesPerSec;
+
+            // Each segment has its own slot, written by the worker that recognizes it.
+            std::vector<SegmentResult> segmentResults(result.Segments.size());
+            {
+                WorkerPool pool(m_options.MaxInFlight, m_options.MaxInFlight * 2);
+                for (size_t i = 0; i < result.Segments.size(); i++)
+                {
+                    pool.Submit([this, &fileName, &format, &result, &segmentResults, i]()
+                    {
+                        segmentResults[i] = m_limiter != nullptr
+                            ? RecognizeSegmentWithinLimit(fileName, format, result.Segments[i], i)
+                            : RecognizeSegment(fileName, format, result.Segments[i], i);
+                    });
+                }
+                pool.WaitIdle();
+            }
+            Merge(format, segmentResults, result);
+        }
+        catch (const std::exception& e)
+        {
+            result.FailedSegments = (std::max)(result.FailedSegments, (size_t)1);
+            result.ErrorDetails = e.what();
+        }
+        result.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    // Defines how many times a segment is recognized while the service throttles it.
+    static constexpr int maxThrottledAttempts = 3;
+
+    struct SegmentResult
+    {
+        std::vector<SplitTranscriptEntry> Entries;
+        bool Succeeded = false;
+        bool Throttled = false;
+        std::string ErrorDetails;
+    };
+
+    // Reads the audio data of a segment from the file.
+    class SegmentCallback final : public Microsoft::CognitiveServices::Speech::Audio::PullAudioInputStreamCallback
+    {
+    public:
+        SegmentCallback(const std::string& fileName, uint64_t start, uint64_t end)
+            : m_reader(fileName)
+        {
+            m_remaining = end - m_reader.SeekAudio(start);
+        }
+
+        int Read(uint8_t* dataBuffer, uint32_t size) override
+        {
+            auto read = m_reader.Read(dataBuffer, (uint32_t)(std::min)((uint64_t)size, m_remaining));
+            m_remaining -= read;
+            return read;
+        }
+
+        void Close() override
+        {
+            m_reader.Close();
+        }
+
+    private:
+        WavFileReader m_reader;
+        uint64_t m_remaining = 0;
+    };
+
+    // Gets the middle frame of the longest silence of at least 'minFrames' that overlaps [from, to), or 0 if there is none.
+    static size_t FindSilence(const std::vector<bool>& speech, size_t from, size_t to, size_t minFrames)
+    {
+        // Starts at the beginning of a silence that runs into the window, so that its length is right.
+        while (from > 0 && !speech[from - 1])
+        {
+            from--;
+        }
+
+        size_t best = 0;
+        size_t bestLength = 0;
+        size_t i = from;
+        while (i < to && i < speech.size())
+        {
+            if (speech[i])
+            {
+                i++;
+                continue;
+            }
+            auto runStart = i;
+            while (i < speech.size() && !speech[i])
+            {
+                i++;
+            }
+            if (i - runStart >= minFrames && i - runStart > bestLength)
+            {
+                bestLength = i - runStart;
+                best = runStart + bestLength / 2;
+            }
+        }
+        return best;
+    }
+
+    SegmentResult RecognizeSegmentWithinLimit(const std::string& fileName, const WavFormat& format, const AudioSegment& segment, size_t index)
+    {
+        SegmentResult result;
+        for (int attempt = 1; attempt <= maxThrottledAttempts; attempt++)
+        {
+            auto permit = m_limiter->Acquire();
+            result = RecognizeSegment(fileName, format, segment, index);
+            permit.Release(result.Succeeded ? ConcurrencyOutcome::Succeeded
+                : result.Throttled ? ConcurrencyOutcome::Throttled : ConcurrencyOutcome::Failed);
+            if (!result.Throttled)
+            {
+                break;
+            }
+        }
+        return result;
+    }
+
+    SegmentResult RecognizeSegment(const std::string& fileName, const WavFormat& format, const AudioSegment& segment, size_t index)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        SegmentResult result;
+        try
+        {
+            auto callback = std::make_shared<SegmentCallback>(fileName, segment.AudioStart, segment.AudioEnd);
+            auto audioConfig = AudioConfig::FromStreamInput(AudioInputStream::CreatePullStream(CreateAudioStreamFormat(format), callback));
+            auto base = AudioBytesToTicks(segment.AudioStart, format);
+
+            // These outlive the recognizer, so that no late event handler can touch them after destruction.
+            std::mutex resultMutex;
+            SessionCompletion recognitionEnd;
+
+            auto recognizer = SpeechRecognizer::FromConfig(m_config, audioConfig);
+            recognizer->Recognized.Connect([&result, &resultMutex, base, index](const SpeechRecognitionEventArgs& e)
+            {
+                if (e.Result->Reason == ResultReason::RecognizedSpeech)
+                {
+                    std::lock_guard<std::mutex> lock(resultMutex);
+                    result.Entries.push_back({ e.Result->Text, base + e.Result->Offset(), e.Result->Duration(), index });
+                }
+            });
+            recognizer->Canceled.Connect([&result, &resultMutex, &recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+            {
+                if (e.Reason == CancellationReason::Error)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(resultMutex);
+                        result.ErrorDetails = e.ErrorDetails;
+                        result.Throttled = AdaptiveConcurrencyLimiter::IsThrottling(e.ErrorCode);
+                    }
+                    recognitionEnd.Complete(SessionOutcome::Canceled);
+                }
+            });
+            recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs&)
+            {
+                recognitionEnd.Complete(SessionOutcome::Stopped);
+            });
+
+            recognizer->StartContinuousRecognitionAsync().get();
+            recognitionEnd.Wait();
+            recognizer->StopContinuousRecognitionAsync().get();
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            result.Succeeded = result.ErrorDetails.empty();
+        }
+        catch (const std::exception& e)
+        {
+            result.ErrorDetails = e.what();
+        }
+        return result;
+    }
+
+    static void Merge(const WavFormat& format, std::vector<SegmentResult>& segmentResults, SplitRecognitionResult& result)
+    {
+        // How far a result is from the audio edges of its segment; a result at an edge may have been cut.
+        auto margin = [&format, &result](const SplitTranscriptEntry& entry)
+        {
+            const auto& segment = result.Segments[entry.Segment];
+            auto audioStart = AudioBytesToTicks(segment.AudioStart, format);
+            auto audioEnd = AudioBytesToTicks(segment.AudioEnd, format);
+            auto end = entry.Offset + entry.Duration;
+            return (std::min)(entry.Offset > audioStart ? entry.Offset - audioStart : 0, audioEnd > end ? audioEnd - end : 0);
+        };
+
+        std::vector<SplitTranscriptEntry> entries;
+        for (size_t i = 0; i < segmentResults.size(); i++)
+        {
+            auto& segmentResult = segmentResults[i];
+            if (!segmentResult.Succeeded)
+            {
+                if (result.FailedSegments++ == 0)
+                {
+                    result.ErrorDetails = segmentResult.ErrorDetails;
+                }
+            }
+
+            // Keeps the results whose middle is in the part the segment owns, the others are its neighbors'.
+            auto start = AudioBytesToTicks(result.Segments[i].Start, format);
+            auto end = AudioBytesToTicks(result.Segments[i].End, format);
+            for (auto& entry : segmentResult.Entries)
+            {
+                auto middle = entry.Offset + entry.Duration / 2;
+                if (middle >= start && (middle < end || i + 1 == segmentResults.size()))
+                {
+                    entries.push_back(std::move(entry));
+                }
+                else
+                {
+                    result.Duplicates++;
+                }
+            }
+        }
+
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const SplitTranscriptEntry& a, const SplitTranscriptEntry& b) { return a.Offset < b.Offset; });
+
+        // Of the results of neighbors that overlap still, e.g. across a cut in speech, keeps the one further from its edges.
+        for (auto& entry : entries)
+        {
+            if (!result.Entries.empty())
+            {
+                auto& last = result.Entries.back();
+                if (last.Segment != entry.Segment && entry.Offset < last.Offset + last.Duration)
+                {
+                    result.Duplicates++;
+                    auto lastMargin = margin(last);
+                    auto entryMargin = margin(entry);
+                    if (entryMargin > lastMargin || (entryMargin == lastMargin && entry.Duration > last.Duration))
+                    {
+                        last = std::move(entry);
+                    }
+                    continue;
+                }
+            }
+            result.Entries.push_back(std::move(entry));
+        }
+    }
+
+    const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> m_config;
+    const SplitRecognitionOptions m_options;
+    const std::shared_ptr<AdaptiveConcurrencyLimiter> m_limiter;
+};
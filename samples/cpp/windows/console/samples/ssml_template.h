@@ -0,0 +1,367 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "synthesis_cache.h"
+
+// An SSML prompt parsed once, and filled per request. The body is an SSML fragment with {{name}} slots, which are
+// filled with escaped text, and {{segment}} markers that split it into segments synthesized and cached separately:
+// a segment without slots is synthesized once for all requests, whatever the slots of the other segments.
+// Each segment is wrapped in the speak and voice elements of the template, so it must be well-formed on its own.
+class SsmlTemplate final
+{
+public:
+    SsmlTemplate(const std::string& voice, const std::string& language, const std::string& body)
+    {
+        m_prologue = "<speak version='1.0' xmlns='http://www.w3.org/2001/10/synthesis' xml:lang='";
+        AppendEscaped(m_prologue, language);
+        m_prologue += "'><voice name='";
+        AppendEscaped(m_prologue, voice);
+        m_prologue += "'>";
+
+        m_segments.emplace_back();
+        size_t position = 0;
+        while (position < body.size())
+        {
+            auto open = body.find("{{", position);
+            if (open == std::string::npos)
+            {
+                AddText(body.substr(position));
+                break;
+            }
+            auto close = body.find("}}", open + 2);
+            if (close == std::string::npos)
+            {
+                throw std::invalid_argument("Unterminated slot at offset " + std::to_string(open));
+            }
+            AddText(body.substr(position, open - position));
+
+            auto name = body.substr(open + 2, close - open - 2);
+            if (name == "segment")
+            {
+                m_segments.emplace_back();
+            }
+            else if (name.empty() || name.find_first_of("{}<>&'\" \t\r\n") != std::string::npos)
+            {
+                throw std::invalid_argument("Invalid slot name at offset " + std::to_string(open));
+            }
+            else
+            {
+                Token token;
+                token.Slot = GetOrAddSlot(name);
+                m_segments.back().Tokens.push_back(token);
+                m_segments.back().Slots.push_back(token.Slot);
+            }
+            position = close + 2;
+        }
+
+        // A segment's hash covers its static text and where its slots go, not the slot names, so that the same
+        // segment in two templates shares its cached audio.
+        for (auto& segment : m_segments)
+        {
+            uint64_t hash = Hash(14695981039346656037ULL, m_prologue);
+            for (const auto& token : segment.Tokens)
+            {
+                hash = token.Slot == noSlot ? Hash(hash, token.Text) : Hash(hash, std::string(1, '\0'));
+            }
+            segment.Hash = hash;
+        }
+    }
+
+    size_t GetSegmentCount() const
+    {
+        return m_segments.size();
+    }
+
+    // Whether a segment has no slots, so that it is the same for all requests.
+    bool IsStatic(size_t segment) const
+    {
+        return m_segments.at(segment).Slots.empty();
+    }
+
+    // Gets the slot names, in the order of the values that Fill() takes.
+    const std::vector<std::string>& GetSlotNames() const
+    {
+        return m_slotNames;
+    }
+
+    // Gets the index of a slot in the values. It throws if the template has no such slot.
+    size_t GetSlotIndex(const std::string& name) const
+    {
+        auto found = m_slotIndexes.find(name);
+        if (found == m_slotIndexes.end())
+        {
+            throw std::invalid_argument("The template has no slot " + name);
+        }
+        return found->second;
+    }
+
+    // Orders named values as Fill() takes them. It throws if a slot has no value.
+    std::vector<std::string> Bind(const std::map<std::string, std::string>& values) const
+    {
+        std::vector<std::string> ordered;
+        for (const auto& name : m_slotNames)
+        {
+            auto found = values.find(name);
+            if (found == values.end())
+            {
+                throw std::invalid_argument("No value for slot " + name);
+            }
+            ordered.push_back(found->second);
+        }
+        return ordered;
+    }
+
+    // Writes the SSML document of a segment to 'buffer', with the values escaped. The buffer is cleared first,
+    // but keeps its capacity, so that a buffer reused across requests stops allocating once it has grown.
+    void Fill(size_t segment, const std::vector<std::string>& values, std::string& buffer) const
+    {
+        CheckValues(values);
+        buffer.clear();
+        buffer += m_prologue;
+        AppendTokens(m_segments.at(segment), values, buffer);
+        buffer += epilogue;
+    }
+
+    // Writes the SSML document of all segments at once, for a request that is not cached per segment.
+    void FillDocument(const std::vector<std::string>& values, std::string& buffer) const
+    {
+        CheckValues(values);
+        buffer.clear();
+        buffer += m_prologue;
+        for (const auto& segment : m_segments)
+        {
+            AppendTokens(segment, values, buffer);
+        }
+        buffer += epilogue;
+    }
+
+    // Gets the text to build the cache key of a segment from: the hash of the segment and the values of its slots only.
+    // It is the same for every request with those values, however the SSML is formatted, and never starts with '<',
+    // so it does not collide with the key of an SSML document.
+    std::string GetCacheText(size_t segment, const std::vector<std::string>& values) const
+    {
+        CheckValues(values);
+        const auto& tokens = m_segments.at(segment);
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)tokens.Hash);
+        std::string text = std::string("template ") + hash;
+        for (auto slot : tokens.Slots)
+        {
+            text += '\x1f';
+            text += values[slot];
+        }
+        return text;
+    }
+
+    // Escapes the XML special characters of 'value' while appending it to 'buffer'.
+    static void AppendEscaped(std::string& buffer, const std::string& value)
+    {
+        size_t position = 0;
+        while (true)
+        {
+            auto special = value.find_first_of("&<>'\"", position);
+            if (special == std::string::npos)
+            {
+                buffer.append(value, position, std::string::npos);
+                return;
+            }
+            buffer.append(value, position, special - position);
+            switch (value[special])
+            {
+            case '&': buffer += "&amp;"; break;
+            case '<': buffer += "&lt;"; break;
+            case '>': buffer += "&gt;"; break;
+            case '\'': buffer += "&apos;"; break;
+            default: buffer += "&quot;"; break;
+            }
+            position = special + 1;
+        }
+    }
+
+private:
+    static constexpr size_t noSlot = SIZE_MAX;
+    static constexpr const char* epilogue = "</voice></speak>";
+
+    struct Token
+    {
+        std::string Text;       // static SSML, as is, if Slot is noSlot.
+        size_t Slot = noSlot;
+    };
+
+    struct Segment
+    {
+        std::vector<Token> Tokens;
+        std::vector<size_t> Slots;      // the slots of the segment, in order of appearance.
+        uint64_t Hash = 0;
+    };
+
+    void AddText(const std::string& text)
+    {
+        if (!text.empty())
+        {
+            Token token;
+            token.Text = text;
+            m_segments.back().Tokens.push_back(token);
+        }
+    }
+
+    size_t GetOrAddSlot(const std::string& name)
+    {
+        auto found = m_slotIndexes.find(name);
+        if (found != m_slotIndexes.end())
+        {
+            return found->second;
+        }
+        m_slotNames.push_back(name);
+        return m_slotIndexes[name] = m_slotNames.size() - 1;
+    }
+
+    void CheckValues(const std::vector<std::string>& values) const
+    {
+        if (values.size() != m_slotNames.size())
+        {
+            throw std::invalid_argument("Expected " + std::to_string(m_slotNames.size()) + " slot values, got " + std::to_string(values.size()));
+        }
+    }
+
+    static void AppendTokens(const Segment& segment, const std::vector<std::string>& values, std::string& buffer)
+    {
+        for (const auto& token : segment.Tokens)
+        {
+            if (token.Slot == noSlot)
+            {
+                buffer += token.Text;
+            }
+            else
+            {
+                AppendEscaped(buffer, values[token.Slot]);
+            }
+        }
+    }
+
+    // 64-bit FNV-1a, continued from 'hash'.
+    static uint64_t Hash(uint64_t hash, const std::string& text)
+    {
+        for (auto c : text)
+        {
+            hash ^= (uint8_t)c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    std::string m_prologue;
+    std::vector<Segment> m_segments;
+    std::vector<std::string> m_slotNames;
+    std::map<std::string, size_t> m_slotIndexes;
+};
+
+// A speech synthesizer for SSML templates, that synthesizes each segment on its own and answers it from a synthesis
+// cache when it was synthesized before, then stitches the segments into one WAV file. It reuses one SSML buffer,
+// so it is not thread safe: use one per thread, sharing the cache.
+class SsmlTemplateSynthesizer final
+{
+public:
+    // Constructor that sets the output format of 'config' to raw PCM, whose segments can be concatenated.
+    SsmlTemplateSynthesizer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, std::shared_ptr<SynthesisCache> cache)
+        : m_cache(cache)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (config == nullptr || cache == nullptr)
+        {
+            throw std::invalid_argument("A speech config and a cache are required");
+        }
+
+        config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw24Khz16BitMonoPcm);
+        m_outputFormat = config->GetSpeechSynthesisOutputFormat();
+        m_synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+    }
+
+    // Synthesizes a template filled with 'values', or takes its segments from the cache. It throws if a synthesis is canceled.
+    std::shared_ptr<CachedAudioStream> Speak(const SsmlTemplate& ssmlTemplate, const std::vector<std::string>& values)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        std::vector<std::shared_ptr<const std::vector<uint8_t>>> segments;
+        size_t dataSize = 0;
+        for (size_t i = 0; i < ssmlTemplate.GetSegmentCount(); i++)
+        {
+            // The voice and language are in the template, and so in the segment hash.
+            auto key = SynthesisCache::MakeKey(std::string(), std::string(), m_outputFormat, ssmlTemplate.GetCacheText(i, values), true);
+            auto audio = m_cache->Find(key);
+            if (audio == nullptr)
+            {
+                ssmlTemplate.Fill(i, values, m_ssml);
+                auto result = m_synthesizer->SpeakSsmlAsync(m_ssml).get();
+                if (result->Reason != ResultReason::SynthesizingAudioCompleted)
+                {
+                    auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+                    throw std::runtime_error("Synthesis of segment " + std::to_string(i) + " canceled: " + cancellation->ErrorDetails);
+                }
+                audio = result->GetAudioData();
+                m_cache->Add(key, audio);
+                m_synthesized++;
+            }
+            dataSize += audio->size();
+            segments.push_back(audio);
+        }
+
+        auto file = std::make_shared<std::vector<uint8_t>>();
+        file->reserve(44 + dataSize);
+        AppendWavHeader(*file, (uint32_t)dataSize);
+        for (const auto& audio : segments)
+        {
+            file->insert(file->end(), audio->begin(), audio->end());
+        }
+        return std::make_shared<CachedAudioStream>(file);
+    }
+
+    // Gets the number of segments that went to the service, rather than the cache.
+    uint64_t GetSynthesizedSegments() const
+    {
+        return m_synthesized;
+    }
+
+private:
+    // Defines the sample rate of the output format.
+    static constexpr uint32_t sampleRate = 24000;
+
+    static void AppendWavHeader(std::vector<uint8_t>& file, uint32_t dataSize)
+    {
+        auto write = [&file](const char* bytes, size_t count) { file.insert(file.end(), bytes, bytes + count); };
+        auto write32 = [&file](uint32_t value) { for (int i = 0; i < 4; i++) file.push_back((uint8_t)(value >> (8 * i))); };
+        auto write16 = [&file](uint16_t value) { file.push_back((uint8_t)value); file.push_back((uint8_t)(value >> 8)); };
+
+        write("RIFF", 4);
+        write32(36 + dataSize);
+        write("WAVE", 4);
+        write("fmt ", 4);
+        write32(16);
+        write16(1);                 // PCM
+        write16(1);                 // mono
+        write32(sampleRate);
+        write32(sampleRate * 2);    // bytes per second
+        write16(2);                 // block align
+        write16(16);                // bits per sample
+        write("data", 4);
+        write32(dataSize);
+    }
+
+    std::shared_ptr<SynthesisCache> m_cache;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> m_synthesizer;
+    std::string m_outputFormat;
+    std::string m_ssml;
+    uint64_t m_synthesized = 0;
+};
@@ -0,0 +1,383 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Synthesized audio served from a cache. It reads like an AudioDataStream, so that code playing or saving
+// audio can take either one.
+class CachedAudioStream final
+{
+public:
+    CachedAudioStream(std::shared_ptr<const std::vector<uint8_t>> audioData)
+        : m_audioData(audioData)
+    {
+    }
+
+    // Copies the audio from the current position to 'buffer', and advances the position.
+    // It returns the number of bytes copied, or 0 at the end of the audio.
+    uint32_t ReadData(uint8_t* buffer, uint32_t bufferSize)
+    {
+        auto count = ReadData(m_position, buffer, bufferSize);
+        m_position += count;
+        return count;
+    }
+
+    // Copies the audio from 'position' to 'buffer', without changing the current position.
+    uint32_t ReadData(uint32_t position, uint8_t* buffer, uint32_t bufferSize) const
+    {
+        if (position >= m_audioData->size())
+        {
+            return 0;
+        }
+        auto available = (uint32_t)(m_audioData->size() - position);
+        auto count = bufferSize < available ? bufferSize : available;
+        memcpy(buffer, m_audioData->data() + position, count);
+        return count;
+    }
+
+    void SetPosition(uint32_t position)
+    {
+        m_position = position;
+    }
+
+    uint32_t GetPosition() const
+    {
+        return m_position;
+    }
+
+    // Gets the audio data, in the output format it was synthesized in (a WAV file for the Riff formats).
+    std::shared_ptr<const std::vector<uint8_t>> GetAudioData() const
+    {
+        return m_audioData;
+    }
+
+    // Saves the audio data to a file as is.
+    void SaveToFile(const std::string& fileName) const
+    {
+        std::ofstream file(fileName, std::ios::binary);
+        file.write((const char*)m_audioData->data(), m_audioData->size());
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write " + fileName);
+        }
+    }
+
+private:
+    std::shared_ptr<const std::vector<uint8_t>> m_audioData;
+    uint32_t m_position = 0;
+};
+
+// A two-tier cache of synthesized audio: an in-memory LRU bounded by size in bytes, backed by an optional
+// content-addressed store on disk that survives restarts.
+// Keys are built by MakeKey() from everything that changes the audio. It is thread safe.
+class SynthesisCache final
+{
+public:
+    // Constructor with the memory budget in bytes, and the directory of the disk store (empty for none).
+    // The directory must exist. Disk entries are never evicted, clean the directory up to bound its size.
+    SynthesisCache(size_t memoryCapacity, const std::string& directory = std::string())
+        : m_memoryCapacity(memoryCapacity), m_directory(directory)
+    {
+        if (!m_directory.empty() && m_directory.back() != '/' && m_directory.back() != '\\')
+        {
+            m_directory += '/';
+        }
+    }
+
+    SynthesisCache(const SynthesisCache&) = delete;
+    SynthesisCache& operator=(const SynthesisCache&) = delete;
+
+    // Builds the cache key of a request from the voice, the language, the output format and the text or SSML.
+    // Whitespace runs in the text are collapsed, so that formatting differences of the same prompt share an entry.
+    static std::string MakeKey(const std::string& voice, const std::string& language, const std::string& outputFormat,
+        const std::string& text, bool isSsml)
+    {
+        std::string key = voice + '\n' + language + '\n' + outputFormat + '\n' + (isSsml ? "ssml\n" : "text\n");
+        bool space = false;
+        for (auto c : text)
+        {
+            if (isspace((unsigned char)c))
+            {
+                space = true;
+                continue;
+            }
+            if (space && key.back() != '\n')
+            {
+                key += ' ';
+            }
+            space = false;
+            key += c;
+        }
+        return key;
+    }
+
+    // Looks up an entry, first in memory, then on disk. It returns nullptr on a miss.
+    std::shared_ptr<const std::vector<uint8_t>> Find(const std::string& key)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_index.find(key);
+            if (it != m_index.end())
+            {
+                // Moves the entry to the front of the LRU list.
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                m_memoryHits++;
+                return it->second->Audio;
+            }
+        }
+
+        auto audio = ReadFromDisk(key);
+        if (audio != nullptr)
+        {
+            m_diskHits++;
+            AddToMemory(key, audio);
+            return audio;
+        }
+
+        m_misses++;
+        return nullptr;
+    }
+
+    // Adds an entry to memory and to the disk store.
+    void Add(const std::string& key, std::shared_ptr<const std::vector<uint8_t>> audio)
+    {
+        AddToMemory(key, audio);
+        WriteToDisk(key, *audio);
+    }
+
+    uint64_t GetMemoryHits() const { return m_memoryHits; }
+    uint64_t GetDiskHits() const { return m_diskHits; }
+    uint64_t GetMisses() const { return m_misses; }
+    uint64_t GetEvictions() const { return m_evictions; }
+
+    // Gets the number of bytes of audio held in memory.
+    size_t GetMemoryBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_memoryBytes;
+    }
+
+    // Prints the hit rate, the memory usage and the number of evictions.
+    void PrintStatistics(std::ostream& out) const
+    {
+        auto lookups = m_memoryHits + m_diskHits + m_misses;
+        out << "Cache lookups: " << lookups
+            << ", memory hits: " << m_memoryHits << ", disk hits: " << m_diskHits << ", misses: " << m_misses
+            << ", hit rate: " << (lookups > 0 ? 100.0 * (m_memoryHits + m_diskHits) / lookups : 0) << "%"
+            << ", bytes in memory: " << GetMemoryBytes() << ", evictions: " << m_evictions << std::endl;
+    }
+
+private:
+    struct Entry
+    {
+        std::string Key;
+        std::shared_ptr<const std::vector<uint8_t>> Audio;
+    };
+
+    // Defines the magic bytes in front of every file of the disk store.
+    static constexpr const char* fileMagic = "SPXCACHE";
+
+    // 64-bit FNV-1a, used to name the files of the disk store. The full key is kept in the file to rule out collisions.
+    static uint64_t Hash(const std::string& key)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (auto c : key)
+        {
+            hash ^= (uint8_t)c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    std::string GetPath(const std::string& key) const
+    {
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)Hash(key));
+        return m_directory + name + ".audio";
+    }
+
+    void AddToMemory(const std::string& key, std::shared_ptr<const std::vector<uint8_t>> audio)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (audio->size() > m_memoryCapacity || m_index.find(key) != m_index.end())
+        {
+            return;
+        }
+
+        m_entries.push_front(Entry{ key, audio });
+        m_index[key] = m_entries.begin();
+        m_memoryBytes += audio->size();
+
+        while (m_memoryBytes > m_memoryCapacity)
+        {
+            auto& last = m_entries.back();
+            m_memoryBytes -= last.Audio->size();
+            m_index.erase(last.Key);
+            m_entries.pop_back();
+            m_evictions++;
+        }
+    }
+
+    // A file holds the magic, the key length, the key and the audio.
+    std::shared_ptr<const std::vector<uint8_t>> ReadFromDisk(const std::string& key) const
+    {
+        if (m_directory.empty())
+        {
+            return nullptr;
+        }
+
+        std::ifstream file(GetPath(key), std::ios::binary);
+        if (!file.good())
+        {
+            return nullptr;
+        }
+
+        char magic[8];
+        uint32_t keyLength = 0;
+        file.read(magic, sizeof(magic));
+        file.read((char*)&keyLength, sizeof(keyLength));
+        if (!file.good() || memcmp(magic, fileMagic, sizeof(magic)) != 0 || keyLength != key.size())
+        {
+            return nullptr;
+        }
+        std::string storedKey(keyLength, '\0');
+        file.read(&storedKey[0], keyLength);
+        if (!file.good() || storedKey != key)
+        {
+            return nullptr;
+        }
+
+        auto audio = std::make_shared<std::vector<uint8_t>>();
+        uint8_t buffer[64 * 1024];
+        while (file.read((char*)buffer, sizeof(buffer)) || file.gcount() > 0)
+        {
+            audio->insert(audio->end(), buffer, buffer + file.gcount());
+        }
+        return audio;
+    }
+
+    void WriteToDisk(const std::string& key, const std::vector<uint8_t>& audio) const
+    {
+        if (m_directory.empty())
+        {
+            return;
+        }
+
+        // Writes to a temporary file first, so that a concurrent reader never sees a partial entry.
+        auto path = GetPath(key);
+        auto temporaryPath = path + ".tmp" + std::to_string(m_temporaryCounter++);
+        {
+            std::ofstream file(temporaryPath, std::ios::binary);
+            uint32_t keyLength = (uint32_t)key.size();
+            file.write(fileMagic, 8);
+            file.write((const char*)&keyLength, sizeof(keyLength));
+            file.write(key.data(), key.size());
+            file.write((const char*)audio.data(), audio.size());
+            if (!file.good())
+            {
+                // The disk store is only an optimization, the entry is still cached in memory.
+                file.close();
+                std::remove(temporaryPath.c_str());
+                return;
+            }
+        }
+        std::remove(path.c_str());
+        if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporaryPath.c_str());
+        }
+    }
+
+    const size_t m_memoryCapacity;
+    std::string m_directory;
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t m_memoryBytes = 0;
+    mutable std::atomic<uint64_t> m_temporaryCounter{ 0 };
+
+    std::atomic<uint64_t> m_memoryHits{ 0 };
+    std::atomic<uint64_t> m_diskHits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+    std::atomic<uint64_t> m_evictions{ 0 };
+};
+
+// A speech synthesizer that answers repeated requests from a synthesis cache, and only goes to the service on a miss.
+class CachingSpeechSynthesizer final
+{
+public:
+    CachingSpeechSynthesizer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, std::shared_ptr<SynthesisCache> cache)
+        : m_cache(cache)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (config == nullptr || cache == nullptr)
+        {
+            throw std::invalid_argument("A speech config and a cache are required");
+        }
+
+        m_voice = config->GetSpeechSynthesisVoiceName();
+        m_language = config->GetSpeechSynthesisLanguage();
+        m_outputFormat = config->GetSpeechSynthesisOutputFormat();
+
+        // The audio only goes to the results, which are cached.
+        m_synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+    }
+
+    // Synthesizes a text, or returns its cached audio. It throws if the synthesis is canceled.
+    std::shared_ptr<CachedAudioStream> SpeakText(const std::string& text)
+    {
+        return Speak(text, false);
+    }
+
+    // Synthesizes an SSML document, or returns its cached audio. It throws if the synthesis is canceled.
+    std::shared_ptr<CachedAudioStream> SpeakSsml(const std::string& ssml)
+    {
+        return Speak(ssml, true);
+    }
+
+private:
+    std::shared_ptr<CachedAudioStream> Speak(const std::string& text, bool isSsml)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto key = SynthesisCache::MakeKey(m_voice, m_language, m_outputFormat, text, isSsml);
+        auto audio = m_cache->Find(key);
+        if (audio == nullptr)
+        {
+            auto result = isSsml ? m_synthesizer->SpeakSsmlAsync(text).get() : m_synthesizer->SpeakTextAsync(text).get();
+            if (result->Reason != ResultReason::SynthesizingAudioCompleted)
+            {
+                auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+                throw std::runtime_error("Synthesis canceled: " + cancellation->ErrorDetails);
+            }
+            audio = result->GetAudioData();
+            m_cache->Add(key, audio);
+        }
+        return std::make_shared<CachedAudioStream>(audio);
+    }
+
+    std::shared_ptr<SynthesisCache> m_cache;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> m_synthesizer;
+    std::string m_voice;
+    std::string m_language;
+    std::string m_outputFormat;
+};
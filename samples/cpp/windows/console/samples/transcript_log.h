@@ -0,0 +1,626 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "result_sink.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The layout of a transcript log, little endian. The log starts with "STLG" and the version, followed by records:
+//   uint32 length of the rest of the record
+//   uint64 offset, uint64 duration, in ticks of 100 ns
+//   uint64 position in the log of the previous record of the same session, or noPosition
+//   uint16 length of the session id, uint32 length of the text, then the session id and the text, in UTF-8.
+// Its index, the log's name with ".idx", starts with "STLI" and the version, followed by entries of 32 bytes:
+//   uint64 hash of the session id, uint64 offset of the record, uint64 its position in the log, uint32 flags, uint32 0.
+// The index is sparse: it has an entry for every IndexStride-th record of each session, and one for the last,
+// flagged lastOfSession, when the writer is closed. Both files are only ever appended to.
+namespace TranscriptLogFormat
+{
+    constexpr uint32_t version = 1;
+    constexpr size_t fileHeaderSize = 8;
+    constexpr size_t recordHeaderSize = 4 + 8 + 8 + 8 + 2 + 4;
+    constexpr size_t indexEntrySize = 32;
+    constexpr uint64_t noPosition = UINT64_MAX;
+    constexpr uint32_t lastOfSession = 1;
+
+    inline void Put(std::vector<uint8_t>& out, uint64_t value, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; i++)
+        {
+            out.push_back((uint8_t)(value >> (8 * i)));
+        }
+    }
+
+    inline uint64_t Get(const uint8_t* data, size_t bytes)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; i++)
+        {
+            value |= (uint64_t)data[i] << (8 * i);
+        }
+        return value;
+    }
+
+    // Gets the 64-bit FNV-1a hash of a session id, the key of the index.
+    inline uint64_t HashSessionId(const char* sessionId, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (uint8_t)sessionId[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+}
+
+// A result read from a transcript log.
+struct TranscriptEntry
+{
+    std::string SessionId;
+    std::string Text;
+    uint64_t Offset = 0;                    // in ticks of 100 ns from the start of the session's audio.
+    uint64_t Duration = 0;
+    uint64_t Position = 0;                  // of the record in the log.
+};
+
+// Appends the final results of recognizers to a transcript log, e.g. on the thread that drains a ResultSink. Writes are
+// sequential and buffered, a record and, now and then, an index entry, so that a log can take the results of many
+// sessions. An existing log is appended to, after its last whole record. Not thread safe: use one writer per log, on one thread.
+class TranscriptLogWriter final
+{
+public:
+    TranscriptLogWriter(const std::string& fileName, uint32_t indexStride = 16)
+        : m_fileName(fileName), m_indexStride(indexStride)
+    {
+        if (fileName.empty() || indexStride == 0)
+        {
+            throw std::invalid_argument("A file name and a positive index stride are required");
+        }
+        // A writer that was not closed may have left a record or an index entry half written. Both are cut off,
+        // so that the records appended from now on follow the last whole one, and no index entry points past it.
+        auto logSize = Open(m_log, fileName, "STLG");
+        m_position = FindLogEnd(m_log, logSize);
+        if (m_position != logSize)
+        {
+            Truncate(m_log, fileName, "STLG", m_position);
+        }
+        auto indexSize = Open(m_index, fileName + ".idx", "STLI");
+        auto indexEnd = FindIndexEnd(m_index, indexSize, m_position);
+        if (indexEnd != indexSize)
+        {
+            Truncate(m_index, fileName + ".idx", "STLI", indexEnd);
+        }
+    }
+
+    ~TranscriptLogWriter()
+    {
+        try
+        {
+            Close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    TranscriptLogWriter(const TranscriptLogWriter&) = delete;
+    TranscriptLogWriter& operator=(const TranscriptLogWriter&) = delete;
+
+    void Append(const std::string& sessionId, uint64_t offset, uint64_t duration, const std::string& text)
+    {
+        Append(sessionId.data(), sessionId.size(), offset, duration, text.data(), text.size());
+    }
+
+    // Appends a Recognized record of a result sink; records of other kinds are not transcripts, and are skipped.
+    void Append(const ResultRecord& record)
+    {
+        if (record.Kind == ResultRecordKind::Recognized)
+        {
+            Append(record.SessionId, strlen(record.SessionId), record.Offset, record.Duration, record.Text, record.TextLength);
+        }
+    }
+
+    // Writes the records buffered, so that readers opened from now on see them.
+    void Flush()
+    {
+        m_log.flush();
+        m_index.flush();
+        if (m_log.fail() || m_index.fail())
+        {
+            throw std::runtime_error("Failed to write " + m_fileName);
+        }
+    }
+
+    // Indexes the last record of each session, so that lookups past it need no scan, and closes the files.
+    void Close()
+    {
+        if (!m_log.is_open())
+        {
+            return;
+        }
+        for (const auto& session : m_sessions)
+        {
+            WriteIndexEntry(session.second.Hash, session.second.LastOffset, session.second.LastPosition, TranscriptLogFormat::lastOfSession);
+        }
+        m_sessions.clear();
+        Flush();
+        m_log.close();
+        m_index.close();
+    }
+
+    // Gets the number of records appended by this writer.
+    uint64_t GetRecordCount() const
+    {
+        return m_records;
+    }
+
+private:
+    struct SessionState
+    {
+        uint64_t Hash;
+        uint64_t LastPosition;
+        uint64_t LastOffset;
+        uint32_t SinceIndexed;
+    };
+
+    // Opens a file to append to, writing its header if it is new. Returns its size.
+    static uint64_t Open(std::fstream& file, const std::string& fileName, const char* magic)
+    {
+        file.open(fileName, std::ios::binary | std::ios::in | std::ios::out | std::ios::app);
+        if (!file.is_open())
+        {
+            // It does not exist yet: std::ios::in refuses to create it.
+            std::ofstream(fileName, std::ios::binary).close();
+            file.open(fileName, std::ios::binary | std::ios::in | std::ios::out | std::ios::app);
+        }
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open " + fileName);
+        }
+
+        file.seekg(0, std::ios::end);
+        auto size = (uint64_t)file.tellg();
+        if (size == 0)
+        {
+            std::vector<uint8_t> header(magic, magic + 4);
+            TranscriptLogFormat::Put(header, TranscriptLogFormat::version, 4);
+            file.write((const char*)header.data(), header.size());
+            return header.size();
+        }
+
+        char header[TranscriptLogFormat::fileHeaderSize];
+        file.seekg(0);
+        if (!file.read(header, sizeof(header)) || memcmp(header, magic, 4) != 0
+            || TranscriptLogFormat::Get((const uint8_t*)header + 4, 4) != TranscriptLogFormat::version)
+        {
+            throw std::runtime_error(fileName + " is not a transcript log of this version");
+        }
+        file.clear();
+        return size;
+    }
+
+    // Walks the records of the log from its header, and returns the end of the last whole one.
+    static uint64_t FindLogEnd(std::fstream& file, uint64_t size)
+    {
+        using namespace TranscriptLogFormat;
+
+        uint64_t position = fileHeaderSize;
+        uint8_t header[recordHeaderSize];
+        while (size - position >= recordHeaderSize)
+        {
+            file.seekg((std::streamoff)position);
+            if (!file.read((char*)header, sizeof(header)))
+            {
+                break;
+            }
+            auto length = Get(header, 4);
+            if (length != recordHeaderSize - 4 + Get(header + 28, 2) + Get(header + 30, 4) || size - position < 4 + length)
+            {
+                break;
+            }
+            position += 4 + length;
+        }
+        file.clear();
+        return position;
+    }
+
+    // Returns the end of the whole index entries that point at records before 'logEnd'. Its entries are in the order
+    // the records were written, but for those of a Close(), so that the entries of records cut off are at its end.
+    static uint64_t FindIndexEnd(std::fstream& file, uint64_t size, uint64_t logEnd)
+    {
+        using namespace TranscriptLogFormat;
+
+        auto end = fileHeaderSize + (size - fileHeaderSize) / indexEntrySize * indexEntrySize;
+        uint8_t position[8];
+        while (end > fileHeaderSize)
+        {
+            file.seekg((std::streamoff)(end - indexEntrySize + 16));
+            if (!file.read((char*)position, sizeof(position)) || Get(position, 8) < logEnd)
+            {
+                break;
+            }
+            end -= indexEntrySize;
+        }
+        file.clear();
+        return end;
+    }
+
+    // Cuts a file opened by Open() down to 'size', and opens it again to append to.
+    static void Truncate(std::fstream& file, const std::string& fileName, const char* magic, uint64_t size)
+    {
+        file.close();
+#ifdef _WIN32
+        HANDLE handle = CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER distance;
+        distance.QuadPart = (LONGLONG)size;
+        bool truncated = handle != INVALID_HANDLE_VALUE && SetFilePointerEx(handle, distance, nullptr, FILE_BEGIN) && SetEndOfFile(handle);
+        if (handle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(handle);
+        }
+#else
+        bool truncated = truncate(fileName.c_str(), (off_t)size) == 0;
+#endif
+        if (!truncated)
+        {
+            throw std::runtime_error("Failed to truncate " + fileName);
+        }
+        Open(file, fileName, magic);
+    }
+
+    void Append(const char* sessionId, size_t sessionIdLength, uint64_t offset, uint64_t duration, const char* text, size_t textLength)
+    {
+        using namespace TranscriptLogFormat;
+
+        sessionIdLength = (std::min)(sessionIdLength, (size_t)UINT16_MAX);
+        auto found = m_sessions.find(std::string(sessionId, sessionIdLength));
+        if (found == m_sessions.end())
+        {
+            SessionState state{ HashSessionId(sessionId, sessionIdLength), noPosition, 0, m_indexStride };
+            found = m_sessions.emplace(std::string(sessionId, sessionIdLength), state).first;
+        }
+        auto& session = found->second;
+
+        m_record.clear();
+        Put(m_record, recordHeaderSize - 4 + sessionIdLength + textLength, 4);
+        Put(m_record, offset, 8);
+        Put(m_record, duration, 8);
+        Put(m_record, session.LastPosition, 8);
+        Put(m_record, sessionIdLength, 2);
+        Put(m_record, textLength, 4);
+        m_record.insert(m_record.end(), sessionId, sessionId + sessionIdLength);
+        m_record.insert(m_record.end(), text, text + textLength);
+        m_log.write((const char*)m_record.data(), m_record.size());
+
+        // The first record of a session is indexed, then every IndexStride-th.
+        if (session.SinceIndexed >= m_indexStride)
+        {
+            WriteIndexEntry(session.Hash, offset, m_position, 0);
+            session.SinceIndexed = 0;
+        }
+        session.SinceIndexed++;
+        session.LastPosition = m_position;
+        session.LastOffset = offset;
+        m_position += m_record.size();
+        m_records++;
+    }
+
+    void WriteIndexEntry(uint64_t hash, uint64_t offset, uint64_t position, uint32_t flags)
+    {
+        std::vector<uint8_t> entry;
+        TranscriptLogFormat::Put(entry, hash, 8);
+        TranscriptLogFormat::Put(entry, offset, 8);
+        TranscriptLogFormat::Put(entry, position, 8);
+        TranscriptLogFormat::Put(entry, flags, 4);
+        TranscriptLogFormat::Put(entry, 0, 4);
+        m_index.write((const char*)entry.data(), entry.size());
+    }
+
+    const std::string m_fileName;
+    const uint32_t m_indexStride;
+    std::fstream m_log;
+    std::fstream m_index;
+    uint64_t m_position = 0;
+    uint64_t m_records = 0;
+    std::map<std::string, SessionState> m_sessions;
+    std::vector<uint8_t> m_record;          // reused for each record.
+};
+
+// Reads a transcript log through a read-only memory-mapped view, as it was when it was opened. Find() gets what was
+// said at an offset of a session with a binary search of the index and a walk back of at most IndexStride records of
+// the session, instead of a scan of the log. The records written after the last index entry, by a writer that is still
+// open or was not closed, are indexed when the reader opens, and a torn record at the end is ignored.
+class TranscriptLogReader final
+{
+public:
+    explicit TranscriptLogReader(const std::string& fileName)
+    {
+        Map(fileName);
+        try
+        {
+            if (m_size < TranscriptLogFormat::fileHeaderSize || memcmp(m_view, "STLG", 4) != 0
+                || TranscriptLogFormat::Get(m_view + 4, 4) != TranscriptLogFormat::version)
+            {
+                throw std::runtime_error(fileName + " is not a transcript log of this version");
+            }
+            LoadIndex(fileName + ".idx");
+        }
+        catch (...)
+        {
+            Unmap();
+            throw;
+        }
+    }
+
+    ~TranscriptLogReader()
+    {
+        Unmap();
+    }
+
+    TranscriptLogReader(const TranscriptLogReader&) = delete;
+    TranscriptLogReader& operator=(const TranscriptLogReader&) = delete;
+
+    // Gets the last result of a session that starts at or before 'offset', which is what was said then if it lasts
+    // past it. Returns false if the session has none.
+    bool Find(const std::string& sessionId, uint64_t offset, TranscriptEntry& entry) const
+    {
+        auto hash = TranscriptLogFormat::HashSessionId(sessionId.data(), sessionId.size());
+        auto range = std::equal_range(m_entries.begin(), m_entries.end(), IndexEntry{ hash, 0, 0, 0 },
+            [](const IndexEntry& a, const IndexEntry& b) { return a.Hash < b.Hash; });
+        if (range.first == range.second)
+        {
+            return false;
+        }
+
+        auto after = std::upper_bound(range.first, range.second, offset,
+            [](uint64_t value, const IndexEntry& e) { return value < e.Offset; });
+        Record record;
+        if (after != range.second)
+        {
+            // Walks back from the first indexed record after the offset, through the session's records.
+            auto position = after->Position;
+            while (position != TranscriptLogFormat::noPosition && ReadRecord(position, record))
+            {
+                if (record.Offset <= offset)
+                {
+                    return Matches(record, sessionId) && ToEntry(record, position, entry);
+                }
+                position = record.Previous;
+            }
+        }
+        if (after == range.first)
+        {
+            return false;
+        }
+
+        // The offset is at or after the last indexed record of the session; it is the session's last if so flagged.
+        auto last = std::prev(after);
+        if (after == range.second && (last->Flags & TranscriptLogFormat::lastOfSession))
+        {
+            return ReadRecord(last->Position, record) && Matches(record, sessionId) && ToEntry(record, last->Position, entry);
+        }
+
+        // Else the writer was not closed, or the walk back reached the first record of the session a writer appended:
+        // scans on from the last indexed record before the offset, up to the next.
+        auto end = after != range.second ? after->Position : m_size;
+        bool found = false;
+        for (auto position = last->Position; position < end && ReadRecord(position, record); position += record.Size)
+        {
+            if (record.Offset <= offset && Matches(record, sessionId))
+            {
+                found = ToEntry(record, position, entry);
+            }
+        }
+        return found;
+    }
+
+    // Calls 'callback' with each record of the log, in the order they were written, until it returns false.
+    template <class Callback>
+    void ForEach(Callback callback) const
+    {
+        Record record;
+        TranscriptEntry entry;
+        for (uint64_t position = TranscriptLogFormat::fileHeaderSize; ReadRecord(position, record); position += record.Size)
+        {
+            ToEntry(record, position, entry);
+            if (!callback(entry))
+            {
+                return;
+            }
+        }
+    }
+
+    // Gets the number of index entries, those of the index file and those of the records after it.
+    size_t GetIndexSize() const
+    {
+        return m_entries.size();
+    }
+
+private:
+    struct IndexEntry
+    {
+        uint64_t Hash;
+        uint64_t Offset;
+        uint64_t Position;
+        uint32_t Flags;
+    };
+
+    // A record, its session id and text still in the view.
+    struct Record
+    {
+        uint64_t Size;
+        uint64_t Offset;
+        uint64_t Duration;
+        uint64_t Previous;
+        const char* SessionId;
+        size_t SessionIdLength;
+        const char* Text;
+        size_t TextLength;
+    };
+
+    // Reads the record at 'position'. Returns false at the end of the log, or at a record cut short.
+    bool ReadRecord(uint64_t position, Record& record) const
+    {
+        using namespace TranscriptLogFormat;
+
+        if (position < fileHeaderSize || position > m_size || m_size - position < recordHeaderSize)
+        {
+            return false;
+        }
+        auto data = m_view + position;
+        auto length = Get(data, 4);
+        auto sessionIdLength = (size_t)Get(data + 28, 2);
+        auto textLength = (size_t)Get(data + 30, 4);
+        if (length != recordHeaderSize - 4 + sessionIdLength + textLength || m_size - position < 4 + length)
+        {
+            return false;
+        }
+
+        record.Size = 4 + length;
+        record.Offset = Get(data + 4, 8);
+        record.Duration = Get(data + 12, 8);
+        record.Previous = Get(data + 20, 8);
+        record.SessionId = (const char*)data + recordHeaderSize;
+        record.SessionIdLength = sessionIdLength;
+        record.Text = record.SessionId + sessionIdLength;
+        record.TextLength = textLength;
+        return true;
+    }
+
+    static bool Matches(const Record& record, const std::string& sessionId)
+    {
+        return record.SessionIdLength == sessionId.size() && memcmp(record.SessionId, sessionId.data(), sessionId.size()) == 0;
+    }
+
+    static bool ToEntry(const Record& record, uint64_t position, TranscriptEntry& entry)
+    {
+        entry.SessionId.assign(record.SessionId, record.SessionIdLength);
+        entry.Text.assign(record.Text, record.TextLength);
+        entry.Offset = record.Offset;
+        entry.Duration = record.Duration;
+        entry.Position = position;
+        return true;
+    }
+
+    void LoadIndex(const std::string& indexFileName)
+    {
+        using namespace TranscriptLogFormat;
+
+        // The index is small, a fraction of the log; it is read whole, and sorted by session and offset.
+        uint64_t indexed = fileHeaderSize;
+        std::ifstream index(indexFileName, std::ios::binary);
+        char header[fileHeaderSize];
+        if (index.read(header, sizeof(header)) && memcmp(header, "STLI", 4) == 0 && Get((const uint8_t*)header + 4, 4) == version)
+        {
+            uint8_t data[indexEntrySize];
+            while (index.read((char*)data, sizeof(data)))
+            {
+                IndexEntry entry{ Get(data, 8), Get(data + 8, 8), Get(data + 16, 8), (uint32_t)Get(data + 24, 4) };
+                if (entry.Position < m_size)
+                {
+                    m_entries.push_back(entry);
+                    indexed = (std::max)(indexed, entry.Position);
+                }
+            }
+        }
+
+        // Indexes the records after the last one indexed, the tail a writer had not indexed yet.
+        Record record;
+        for (auto position = indexed; ReadRecord(position, record); position += record.Size)
+        {
+            m_entries.push_back({ HashSessionId(record.SessionId, record.SessionIdLength), record.Offset, position, 0 });
+        }
+
+        std::sort(m_entries.begin(), m_entries.end(), [](const IndexEntry& a, const IndexEntry& b)
+        {
+            return a.Hash != b.Hash ? a.Hash < b.Hash : a.Offset != b.Offset ? a.Offset < b.Offset : a.Position < b.Position;
+        });
+    }
+
+    void Map(const std::string& fileName)
+    {
+#ifdef _WIN32
+        // Shared for writing too, so that a log can be read while it is being written.
+        HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::invalid_argument("Failed to open " + fileName);
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            throw std::runtime_error(fileName + " is empty");
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+        {
+            throw std::runtime_error("Failed to map " + fileName);
+        }
+        m_view = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        m_size = (uint64_t)fileSize.QuadPart;
+#else
+        int file = open(fileName.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            throw std::invalid_argument("Failed to open " + fileName);
+        }
+        struct stat fileStat;
+        if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            close(file);
+            throw std::runtime_error(fileName + " is empty");
+        }
+        auto view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, file, 0);
+        close(file);
+        m_view = view != MAP_FAILED ? (const uint8_t*)view : nullptr;
+        m_size = (uint64_t)fileStat.st_size;
+#endif
+        if (m_view == nullptr)
+        {
+            m_size = 0;
+            throw std::runtime_error("Failed to map " + fileName);
+        }
+    }
+
+    void Unmap()
+    {
+        if (m_view != nullptr)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_view);
+#else
+            munmap((void*)m_view, (size_t)m_size);
+#endif
+            m_view = nullptr;
+        }
+        m_size = 0;
+    }
+
+    const uint8_t* m_view = nullptr;
+    uint64_t m_size = 0;
+    std::vector<IndexEntry> m_entries;
+};
@@ -0,0 +1,78 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+// Transcript log reader.
+// It lists the records of a transcript log written by TranscriptLogWriter, or looks up what was said at an offset of
+// a session, through the log's index, and prints how long the lookup took.
+//
+// Usage: transcript_log_reader <log> [<session id> <offset in seconds>]
+
+#include "stdafx.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "transcript_log.h"
+
+using namespace std;
+
+static double TicksToSeconds(uint64_t ticks)
+{
+    return ticks / 1e7;
+}
+
+static void PrintEntry(const TranscriptEntry& entry)
+{
+    cout << fixed << setprecision(2) << TicksToSeconds(entry.Offset) << "s +" << TicksToSeconds(entry.Duration) << "s "
+         << entry.SessionId << " @" << entry.Position << ": " << entry.Text << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2 && argc != 4)
+    {
+        cerr << "Usage: transcript_log_reader <log> [<session id> <offset in seconds>]" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        TranscriptLogReader reader(argv[1]);
+        if (argc == 2)
+        {
+            uint64_t records = 0;
+            reader.ForEach([&records](const TranscriptEntry& entry)
+            {
+                PrintEntry(entry);
+                records++;
+                return true;
+            });
+            cout << records << " records, " << reader.GetIndexSize() << " index entries." << std::endl;
+            return 0;
+        }
+
+        auto offset = (uint64_t)(stod(argv[3]) * 1e7);
+        TranscriptEntry entry;
+        auto start = chrono::steady_clock::now();
+        auto found = reader.Find(argv[2], offset, entry);
+        auto elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        if (!found)
+        {
+            cout << "Nothing found for session " << argv[2] << " at " << argv[3] << "s, in " << elapsed << " us." << std::endl;
+            return 2;
+        }
+        PrintEntry(entry);
+        cout << "Found in " << elapsed << " us." << std::endl;
+    }
+    catch (const exception& e)
+    {
+        cerr << "Exit due to exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
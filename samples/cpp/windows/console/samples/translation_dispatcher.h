@@ -0,0 +1,143 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// The text of one target language of a translation result, as handed to the consumer of that language.
+struct TranslationUpdate
+{
+    std::string Text;
+    bool IsFinal = false;               // true for a Recognized result, false for a partial one.
+    uint64_t Offset = 0;                // audio offset in ticks of 100 nanoseconds.
+    uint64_t Duration = 0;              // audio duration in ticks of 100 nanoseconds.
+};
+
+// Routes the translations of each result to the consumer registered for their target language, instead of
+// copying the whole translation map per event. The text of a language is copied once, into a buffer owned by
+// its lane, and moved to the consumer. A consumer that doesn't move the text out leaves the buffer's capacity
+// to the next update, so that steady partials don't allocate.
+// Partial results of a language are coalesced: one arriving less than the minimum interval after the last
+// delivered partial of that language is held back, and replaced by the next one, so that a consumer sees at most
+// one partial per interval. A final result is always delivered, and drops the partial held back before it.
+// It is meant for the event handlers of one recognizer, which the SDK calls one at a time. Consumers are
+// registered before recognition starts, and run on the SDK's callback thread, so they must not block.
+class TranslationDispatcher final
+{
+public:
+    using Consumer = std::function<void(TranslationUpdate&&)>;
+
+    // Constructor with the minimum interval between two partials of the same language, zero to deliver all.
+    TranslationDispatcher(std::chrono::milliseconds minPartialInterval = std::chrono::milliseconds(0))
+        : m_minPartialInterval(minPartialInterval)
+    {
+    }
+
+    TranslationDispatcher(const TranslationDispatcher&) = delete;
+    TranslationDispatcher& operator=(const TranslationDispatcher&) = delete;
+
+    // Registers the consumer of a target language, replacing any earlier one.
+    void Register(const std::string& language, Consumer consumer)
+    {
+        if (!consumer)
+        {
+            throw std::invalid_argument("A consumer is required for " + language);
+        }
+        m_lanes[language].Deliver = std::move(consumer);
+    }
+
+    // Dispatches the translations of a Recognizing result.
+    void OnRecognizing(const Microsoft::CognitiveServices::Speech::Translation::TranslationRecognitionResult& result)
+    {
+        Dispatch(result, false);
+    }
+
+    // Dispatches the translations of a Recognized result.
+    void OnRecognized(const Microsoft::CognitiveServices::Speech::Translation::TranslationRecognitionResult& result)
+    {
+        Dispatch(result, true);
+    }
+
+    // Gets the number of updates delivered to consumers.
+    uint64_t GetDelivered() const
+    {
+        return m_delivered.load(std::memory_order_relaxed);
+    }
+
+    // Gets the number of partials that were held back and then replaced, or dropped by a final result.
+    uint64_t GetCoalesced() const
+    {
+        return m_coalesced.load(std::memory_order_relaxed);
+    }
+
+    // Gets the number of translations into languages without a consumer.
+    uint64_t GetUnrouted() const
+    {
+        return m_unrouted.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Lane
+    {
+        Consumer Deliver;
+        TranslationUpdate Update;
+        bool Pending = false;           // a partial is held back in Update.
+        std::chrono::steady_clock::time_point LastPartial;
+    };
+
+    void Dispatch(const Microsoft::CognitiveServices::Speech::Translation::TranslationRecognitionResult& result, bool isFinal)
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& translation : result.Translations)
+        {
+            auto it = m_lanes.find(translation.first);
+            if (it == m_lanes.end())
+            {
+                m_unrouted.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            auto& lane = it->second;
+            if (lane.Pending)
+            {
+                // The partial held back is superseded by this result.
+                m_coalesced.fetch_add(1, std::memory_order_relaxed);
+                lane.Pending = false;
+            }
+
+            // Reuses the capacity of the lane's buffer.
+            lane.Update.Text.assign(translation.second);
+            lane.Update.IsFinal = isFinal;
+            lane.Update.Offset = result.Offset();
+            lane.Update.Duration = result.Duration();
+
+            if (!isFinal && now - lane.LastPartial < m_minPartialInterval)
+            {
+                lane.Pending = true;
+                continue;
+            }
+            if (!isFinal)
+            {
+                lane.LastPartial = now;
+            }
+            lane.Deliver(std::move(lane.Update));
+            m_delivered.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    const std::chrono::steady_clock::duration m_minPartialInterval;
+    std::map<std::string, Lane> m_lanes;
+    std::atomic<uint64_t> m_delivered{ 0 };
+    std::atomic<uint64_t> m_coalesced{ 0 };
+    std::atomic<uint64_t> m_unrouted{ 0 };
+};
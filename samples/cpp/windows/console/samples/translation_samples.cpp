@@ -9,6 +9,12 @@
 #include <string>
 #include <vector>
 #include <speechapi_cxx.h>
+#include <thread>
+#include <chrono>
+#include "result_sink.h"
+#include "translation_dispatcher.h"
+#include "translation_synthesis_player.h"
+#include "sample_console.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -90,67 +96,131 @@ void TranslationContinuousRecognition()
     config->AddTargetLanguage("de");
     config->AddTargetLanguage("fr");
 
-    // Creates a translation recognizer using microphone as audio input.
-    auto recognizer = TranslationRecognizer::FromConfig(config);
+    // Sets the voice that speaks the German translation, so that the Synthesizing events deliver its audio.
+    config->SetVoiceName("de-DE-Hedda");
+
+    // The event handlers only copy the results into a sink, and a worker thread writes them out,
+    // so that writing to the console never blocks the SDK's callback thread.
+    // The sink outlives the recognizer, so that no late event handler can touch it after destruction.
+    ResultSink sink(1024);
 
-    // Subscribes to events.
-    recognizer->Recognizing.Connect([](const TranslationRecognitionEventArgs& e)
+    // Routes the translations of each target language to its own consumer, here the sink, with at most
+    // one partial translation per language every 200 ms.
+    TranslationDispatcher dispatcher(chrono::milliseconds(200));
+    for (const auto& language : config->GetTargetLanguages())
     {
-        cout << "Recognizing:" << e.Result->Text << std::endl;
-        for (const auto& it : e.Result->Translations)
+        dispatcher.Register(language, [&sink, language](TranslationUpdate&& update)
         {
-            cout << "  Translated into '" << it.first.c_str() << "': " << it.second.c_str() << std::endl;
-        }
-    });
+            sink.TryPush(ResultRecordKind::Translation, update.Text, update.Offset, update.Duration, language);
+        });
+    }
+
+    // Streams the translated speech to a file as it arrives. It outlives the recognizer like the sink.
+    TranslationSynthesisPlayer player(make_shared<FileAudioSink>(SampleOutputFile("translation_synthesis.audio")));
 
-    recognizer->Recognized.Connect([](const TranslationRecognitionEventArgs& e)
+    // The consumer starts once the recognizer is built. Until it is joined, an exception must not leave this function.
+    thread consumer;
+    try
     {
-        if (e.Result->Reason == ResultReason::TranslatedSpeech)
+        // Creates a translation recognizer using microphone as audio input.
+        auto recognizer = TranslationRecognizer::FromConfig(config);
+
+        // Subscribes to events.
+        recognizer->Recognizing.Connect([&sink, &dispatcher](const TranslationRecognitionEventArgs& e)
         {
-            cout << "RECOGNIZED: Text=" << e.Result->Text << std::endl;
-        }
-        else if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            sink.TryPush(ResultRecordKind::Recognizing, e.Result->Text, e.Result->Offset(), e.Result->Duration());
+            dispatcher.OnRecognizing(*e.Result);
+        });
+
+        recognizer->Recognized.Connect([&sink, &dispatcher, &player](const TranslationRecognitionEventArgs& e)
         {
-            cout << "RECOGNIZED: Text=" << e.Result->Text << " (text could not be translated)" << std::endl;
-        }
-        else if (e.Result->Reason == ResultReason::NoMatch)
+            if (e.Result->Reason == ResultReason::TranslatedSpeech || e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                sink.TryPush(ResultRecordKind::Recognized, e.Result->Text, e.Result->Offset(), e.Result->Duration(), std::string(), std::string(),
+                    (int32_t)e.Result->Reason);
+            }
+            else if (e.Result->Reason == ResultReason::NoMatch)
+            {
+                sink.TryPush(ResultRecordKind::NoMatch, std::string(), e.Result->Offset(), e.Result->Duration());
+            }
+            if (e.Result->Reason == ResultReason::TranslatedSpeech)
+            {
+                player.OnRecognized();
+            }
+            dispatcher.OnRecognized(*e.Result);
+        });
+
+        recognizer->Canceled.Connect([&sink](const TranslationRecognitionCanceledEventArgs& e)
         {
-            cout << "NOMATCH: Speech could not be recognized." << std::endl;
-        }
+            sink.TryPush(ResultRecordKind::Canceled, e.ErrorDetails, 0, 0, std::string(), std::string(), (int32_t)e.Reason, (int32_t)e.ErrorCode);
+        });
 
-        for (const auto& it : e.Result->Translations)
+        recognizer->Synthesizing.Connect([&player](const TranslationSynthesisEventArgs& e)
         {
-            cout << "  Translated into '" << it.first.c_str() << "': " << it.second.c_str() << std::endl;
-        }
-    });
+            player.OnSynthesizing(e);
+        });
 
-    recognizer->Canceled.Connect([](const TranslationRecognitionCanceledEventArgs& e)
+        consumer = thread([&sink]()
+        {
+            ResultRecord record;
+            while (sink.Pop(record))
+            {
+                switch (record.Kind)
+                {
+                case ResultRecordKind::Recognizing:
+                    cout << "Recognizing:" << record.Text << std::endl;
+                    break;
+                case ResultRecordKind::Recognized:
+                    cout << "RECOGNIZED: Text=" << record.Text
+                         << (record.Reason == (int)ResultReason::RecognizedSpeech ? " (text could not be translated)" : "") << std::endl;
+                    break;
+                case ResultRecordKind::Translation:
+                    cout << "  Translated into '" << record.Language << "': " << record.Text << std::endl;
+                    break;
+                case ResultRecordKind::NoMatch:
+                    cout << "NOMATCH: Speech could not be recognized." << std::endl;
+                    break;
+                case ResultRecordKind::Canceled:
+                    cout << "CANCELED: Reason=" << record.Reason << std::endl;
+                    if (record.Reason == (int)CancellationReason::Error)
+                    {
+                        cout << "CANCELED: ErrorCode=" << record.ErrorCode << std::endl;
+                        cout << "CANCELED: ErrorDetails=" << record.Text << std::endl;
+                        cout << "CANCELED: Did you update the subscription info?" << std::endl;
+                    }
+                    break;
+                }
+            }
+        });
+
+        cout << "Say something...\n";
+
+        // Starts continuos recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+        recognizer->StartContinuousRecognitionAsync().get();
+
+        cout << "Press any key to stop\n";
+        string s;
+        ReadSampleLine(s);
+
+        // Stops recognition.
+        recognizer->StopContinuousRecognitionAsync().get();
+    }
+    catch (...)
     {
-        cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
-        if (e.Reason == CancellationReason::Error)
+        sink.Close();
+        if (consumer.joinable())
         {
-            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << std::endl;
-            cout << "CANCELED: ErrorDetails=" << e.ErrorDetails << std::endl;
-            cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            consumer.join();
         }
-    });
-
-    recognizer->Synthesizing.Connect([](const TranslationSynthesisEventArgs& e)
-    {
-        auto size = e.Result->Audio.size();
-        cout << "Translation synthesis result: size of audio data: " << size
-             << (size == 0 ? "(END)" : "");
-    });
-
-    cout << "Say something...\n";
-
-    // Starts continuos recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
-    recognizer->StartContinuousRecognitionAsync().get();
+        throw;
+    }
 
-    cout << "Press any key to stop\n";
-    string s;
-    getline(cin, s);
+    // Lets the consumer drain what is left, then stop.
+    sink.Close();
+    consumer.join();
+    player.Close();
 
-    // Stops recognition.
-    recognizer->StopContinuousRecognitionAsync().get();
+    cout << "Results pushed: " << sink.GetPushed() << ", dropped on overflow: " << sink.GetOverflows() << std::endl;
+    cout << "Translations delivered: " << dispatcher.GetDelivered() << ", partials coalesced: " << dispatcher.GetCoalesced() << std::endl;
+    player.PrintStatistics(cout);
 }
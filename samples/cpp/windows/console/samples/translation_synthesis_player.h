@@ -0,0 +1,185 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "audio_stream_tee.h"
+#include "latency_histogram.h"
+
+// Streams the translated speech of a translation recognizer to an audio sink, e.g. one that plays it or sends it on,
+// as the Synthesizing events deliver it. Each chunk is copied into a buffer from a pool, whose capacity is reserved
+// up front and kept across chunks, and queued for a writer thread. So the SDK's callback thread never waits for the
+// sink, and steady streaming doesn't allocate. A zero-length chunk marks the end of the audio of an utterance.
+// It also measures the latency from the Recognized event of an utterance to its first chunk of translated audio.
+class TranslationSynthesisPlayer final
+{
+public:
+    // Defines the default capacity of a pooled buffer, larger than the chunks of the service.
+    static constexpr size_t defaultBufferCapacity = 32 * 1024;
+
+    // Constructor that preallocates 'poolSize' buffers of 'bufferCapacity' bytes.
+    TranslationSynthesisPlayer(std::shared_ptr<AudioSink> sink, size_t poolSize = 16, size_t bufferCapacity = defaultBufferCapacity)
+        : m_sink(sink)
+    {
+        if (sink == nullptr)
+        {
+            throw std::invalid_argument("A sink is required");
+        }
+
+        m_free.resize(poolSize);
+        for (auto& buffer : m_free)
+        {
+            buffer.reserve(bufferCapacity);
+        }
+        m_writer = std::thread([this]() { WriterLoop(); });
+    }
+
+    ~TranslationSynthesisPlayer()
+    {
+        try
+        {
+            Close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    TranslationSynthesisPlayer(const TranslationSynthesisPlayer&) = delete;
+    TranslationSynthesisPlayer& operator=(const TranslationSynthesisPlayer&) = delete;
+
+    // Called from the Recognized handler for a translated utterance, whose audio then follows.
+    void OnRecognized()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_recognizedTimes.push_back(std::chrono::steady_clock::now());
+    }
+
+    // Called from the Synthesizing handler.
+    void OnSynthesizing(const Microsoft::CognitiveServices::Speech::Translation::TranslationSynthesisEventArgs& e)
+    {
+        auto now = std::chrono::steady_clock::now();
+        const auto& audio = e.Result->Audio;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (audio.empty())
+        {
+            // The END marker of an utterance.
+            if (!m_inUtterance && !m_recognizedTimes.empty())
+            {
+                // An utterance without audio, e.g. an empty translation.
+                m_recognizedTimes.pop_front();
+            }
+            m_inUtterance = false;
+            m_utterances++;
+            return;
+        }
+
+        if (!m_inUtterance)
+        {
+            m_inUtterance = true;
+            if (!m_recognizedTimes.empty())
+            {
+                m_firstAudioLatency.Add(std::chrono::duration<double, std::milli>(now - m_recognizedTimes.front()).count());
+                m_recognizedTimes.pop_front();
+            }
+        }
+
+        std::vector<uint8_t> buffer;
+        if (!m_free.empty())
+        {
+            buffer.swap(m_free.back());
+            m_free.pop_back();
+        }
+        else
+        {
+            m_poolMisses++;
+        }
+        lock.unlock();
+
+        buffer.assign(audio.begin(), audio.end());
+
+        lock.lock();
+        m_queue.push_back(std::move(buffer));
+        m_bytes += audio.size();
+        lock.unlock();
+        m_available.notify_one();
+    }
+
+    // Waits for the queued audio to be written, and closes the sink.
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed)
+            {
+                return;
+            }
+            m_closed = true;
+        }
+        m_available.notify_one();
+        m_writer.join();
+        m_sink->Close();
+    }
+
+    // Prints the number of utterances and bytes, the buffers allocated beyond the pool, and the first audio latency.
+    void PrintStatistics(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        out << "Translated utterances: " << m_utterances << ", audio bytes: " << m_bytes
+            << ", buffers allocated beyond the pool: " << m_poolMisses << std::endl;
+        m_firstAudioLatency.Print(out, "Recognized to first translated audio", "ms");
+    }
+
+private:
+    void WriterLoop()
+    {
+        while (true)
+        {
+            std::vector<uint8_t> buffer;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_available.wait(lock, [this]() { return m_closed || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                buffer.swap(m_queue.front());
+                m_queue.pop_front();
+            }
+
+            m_sink->Write(buffer.data(), buffer.size());
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(std::move(buffer));
+        }
+    }
+
+    std::shared_ptr<AudioSink> m_sink;
+    std::mutex m_mutex;
+    std::condition_variable m_available;
+    std::deque<std::vector<uint8_t>> m_queue;
+    std::vector<std::vector<uint8_t>> m_free;
+    bool m_closed = false;
+
+    std::deque<std::chrono::steady_clock::time_point> m_recognizedTimes;
+    bool m_inUtterance = false;
+    uint64_t m_utterances = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_poolMisses = 0;
+    LatencyHistogram m_firstAudioLatency;
+
+    std::thread m_writer;
+};
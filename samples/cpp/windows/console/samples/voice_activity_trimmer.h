@@ -0,0 +1,360 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "wav_file_reader.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VOICE_ACTIVITY_TRIMMER_SSE2
+#endif
+
+// The thresholds of VoiceActivityTrimmer.
+struct VoiceActivityOptions
+{
+    double EnergyThresholdDb = -45;             // frames louder than this, in dBFS RMS, are speech.
+    double FricativeThresholdDb = -55;          // quieter frames are speech too if they cross zero often, like "s" and "f".
+    double FricativeZeroCrossingRate = 0.35;    // crossings per sample pair of a channel.
+    uint32_t HangoverMilliseconds = 300;        // silence kept after speech, so that word endings aren't clipped.
+    uint32_t LeadInMilliseconds = 200;          // silence kept before speech, for the onset.
+    uint32_t MinSilenceMilliseconds = 1000;     // shorter pauses are kept whole.
+};
+
+// Classifies 10 ms frames of 16-bit PCM audio as speech or silence by their energy and zero-crossing rate, with SSE2
+// where available. It keeps no state between frames, so one can be shared by threads.
+class VoiceActivityDetector final
+{
+public:
+    VoiceActivityDetector(const WavFormat& format, const VoiceActivityOptions& options = VoiceActivityOptions())
+        : m_format(format)
+    {
+        if (format.BitsPerSample != 16 || format.Channels == 0 || format.BlockAlign != 2 * format.Channels || format.AvgBytesPerSec == 0)
+        {
+            throw std::invalid_argument("Voice activity detection supports 16-bit PCM audio only");
+        }
+
+        m_frameBytes = format.AvgBytesPerSec / 100 / format.BlockAlign * format.BlockAlign;
+        if (m_frameBytes == 0)
+        {
+            m_frameBytes = format.BlockAlign;
+        }
+
+        // Compares the mean square of the samples against the thresholds, without a logarithm per frame.
+        m_energyThreshold = MeanSquareFromDb(options.EnergyThresholdDb);
+        m_fricativeThreshold = MeanSquareFromDb(options.FricativeThresholdDb);
+        m_fricativeZeroCrossingRate = options.FricativeZeroCrossingRate;
+    }
+
+    // Gets the size of a frame in bytes, whole sample frames of all channels.
+    uint32_t GetFrameBytes() const
+    {
+        return m_frameBytes;
+    }
+
+    // Gets the number of frames that last at least 'milliseconds'.
+    uint32_t FramesFromMilliseconds(uint32_t milliseconds) const
+    {
+        auto frameMilliseconds = (double)m_frameBytes * 1000 / m_format.AvgBytesPerSec;
+        return (uint32_t)ceil(milliseconds / frameMilliseconds);
+    }
+
+    // Gets whether a frame of GetFrameBytes() bytes is speech.
+    bool IsSpeech(const uint8_t* frame) const
+    {
+        uint64_t sumOfSquares;
+        uint32_t crossings;
+        auto samples = m_frameBytes / 2;
+        Measure(reinterpret_cast<const int16_t*>(frame), samples, m_format.Channels, sumOfSquares, crossings);
+
+        auto meanSquare = (double)sumOfSquares / samples;
+        auto pairs = samples > m_format.Channels ? samples - m_format.Channels : 1;
+        return meanSquare >= m_energyThreshold
+            || (meanSquare >= m_fricativeThreshold && (double)crossings / pairs >= m_fricativeZeroCrossingRate);
+    }
+
+private:
+    static double MeanSquareFromDb(double db)
+    {
+        return 32768.0 * 32768.0 * pow(10.0, db / 10);
+    }
+
+    // Sums the squares of the samples, and counts the sign changes between consecutive samples of each channel.
+    static void Measure(const int16_t* samples, size_t count, size_t channels, uint64_t& sumOfSquares, uint32_t& crossings)
+    {
+        sumOfSquares = 0;
+        crossings = 0;
+        size_t i = 0;
+
+#ifdef VOICE_ACTIVITY_TRIMMER_SSE2
+        // The sum of two squares fits in 32 bits unsigned, and is widened to 64 bits before it's accumulated.
+        const __m128i zero = _mm_setzero_si128();
+        auto sums = _mm_setzero_si128();
+        auto counts = _mm_setzero_si128();
+        for (; i + 8 + channels <= count; i += 8)
+        {
+            auto current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+            auto next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i + channels));
+            auto squares = _mm_madd_epi16(current, current);
+            sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(squares, zero));
+            sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(squares, zero));
+
+            // The sign bit of the xor is set where the signs differ; the shift makes it -1, subtracted to count it.
+            counts = _mm_sub_epi16(counts, _mm_srai_epi16(_mm_xor_si128(current, next), 15));
+        }
+        uint64_t sumLanes[2];
+        uint16_t countLanes[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sumLanes), sums);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(countLanes), counts);
+        sumOfSquares = sumLanes[0] + sumLanes[1];
+        for (auto lane : countLanes)
+        {
+            crossings += lane;
+        }
+#endif
+
+        for (; i < count; i++)
+        {
+            sumOfSquares += (uint64_t)((int32_t)samples[i] * samples[i]);
+            if (i + channels < count && (samples[i] ^ samples[i + channels]) < 0)
+            {
+                crossings++;
+            }
+        }
+    }
+
+    const WavFormat m_format;
+    uint32_t m_frameBytes;
+    double m_energyThreshold;
+    double m_fricativeThreshold;
+    double m_fricativeZeroCrossingRate;
+};
+
+// Drops the long silent regions of 16-bit PCM audio on its way to a push stream, so that they cost neither
+// bandwidth nor service time. Each 10 ms frame is classified by a VoiceActivityDetector. A silence longer than
+// MinSilenceMilliseconds is cut down to its first HangoverMilliseconds and its last LeadInMilliseconds; leading and
+// trailing silences alike.
+// The trimmer keeps a map of the cuts, to translate the offsets of the results, which are relative to the trimmed
+// audio, back to the original recording with ToOriginalOffset(), from any thread.
+class VoiceActivityTrimmer final
+{
+public:
+    VoiceActivityTrimmer(std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> pushStream,
+        const WavFormat& format, const VoiceActivityOptions& options = VoiceActivityOptions())
+        : m_pushStream(pushStream), m_format(format), m_detector(format, options)
+    {
+        if (m_pushStream == nullptr)
+        {
+            throw std::invalid_argument("Push stream is null");
+        }
+        if (options.MinSilenceMilliseconds < options.HangoverMilliseconds + options.LeadInMilliseconds)
+        {
+            throw std::invalid_argument("The minimum silence must cover the hangover and the lead-in");
+        }
+
+        m_frameBytes = m_detector.GetFrameBytes();
+        m_frame.resize(m_frameBytes);
+        m_hangoverFrames = m_detector.FramesFromMilliseconds(options.HangoverMilliseconds);
+        m_leadInFrames = m_detector.FramesFromMilliseconds(options.LeadInMilliseconds);
+        m_pauseFrames = m_detector.FramesFromMilliseconds(options.MinSilenceMilliseconds) - m_hangoverFrames;
+
+        // The audio starts like a silence whose hangover is over, so a long leading silence is dropped too.
+        m_silentFrames = m_hangoverFrames;
+        m_segments.push_back(Segment{ 0, 0 });
+    }
+
+    VoiceActivityTrimmer(const VoiceActivityTrimmer&) = delete;
+    VoiceActivityTrimmer& operator=(const VoiceActivityTrimmer&) = delete;
+
+    // Classifies the audio frame by frame, and writes what is kept to the push stream.
+    void Write(const uint8_t* data, uint32_t size)
+    {
+        while (size > 0)
+        {
+            auto copied = m_frameBytes - m_frameFill < size ? m_frameBytes - m_frameFill : size;
+            memcpy(m_frame.data() + m_frameFill, data, copied);
+            m_frameFill += copied;
+            data += copied;
+            size -= copied;
+            if (m_frameFill == m_frameBytes)
+            {
+                ProcessFrame();
+                m_frameFill = 0;
+            }
+        }
+        FlushOutput();
+    }
+
+    // Writes the kept tail of the audio, and closes the push stream.
+    void Close()
+    {
+        // A trailing partial frame is kept, unless the audio ends in a silence being dropped.
+        if (!m_dropping)
+        {
+            m_output.insert(m_output.end(), m_pending.begin(), m_pending.end());
+            m_output.insert(m_output.end(), m_frame.begin(), m_frame.begin() + m_frameFill);
+        }
+        m_pending.clear();
+        m_frameFill = 0;
+        FlushOutput();
+        m_pushStream->Close();
+    }
+
+    // Translates an offset in the trimmed audio, in ticks of 100 nanoseconds, to the original audio.
+    uint64_t ToOriginalOffset(uint64_t trimmedTicks) const
+    {
+        auto trimmedBytes = trimmedTicks * m_format.AvgBytesPerSec / ticksPerSecond;
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Finds the last segment starting at or before the offset.
+        size_t low = 0;
+        size_t high = m_segments.size();
+        while (high - low > 1)
+        {
+            auto middle = (low + high) / 2;
+            if (m_segments[middle].TrimmedByte <= trimmedBytes)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        const auto& segment = m_segments[low];
+        return trimmedTicks + (segment.OriginalByte - segment.TrimmedByte) * ticksPerSecond / m_format.AvgBytesPerSec;
+    }
+
+    // Gets the number of bytes of audio classified, the whole frames written to the trimmer.
+    uint64_t GetOriginalBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_originalBytes;
+    }
+
+    // Gets the number of bytes of audio written to the push stream.
+    uint64_t GetTrimmedBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_trimmedBytes;
+    }
+
+    // Gets the number of silences that were cut.
+    size_t GetCutCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_cuts;
+    }
+
+private:
+    // Defines the ticks of 100 nanoseconds per second used by the offsets of the results.
+    static constexpr uint64_t ticksPerSecond = 10000000;
+
+    // A run of kept audio: the byte at TrimmedByte of the trimmed audio is the byte at OriginalByte of the original.
+    struct Segment
+    {
+        uint64_t TrimmedByte;
+        uint64_t OriginalByte;
+    };
+
+    void ProcessFrame()
+    {
+        if (m_detector.IsSpeech(m_frame.data()))
+        {
+            if (m_dropping)
+            {
+                // Resumes after a cut: the kept lead-in starts a new segment.
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto segment = Segment{ m_trimmedBytes + m_output.size(), m_originalBytes - m_pending.size() };
+                if (m_segments.back().TrimmedByte == segment.TrimmedByte)
+                {
+                    m_segments.back() = segment;
+                }
+                else
+                {
+                    m_segments.push_back(segment);
+                }
+            }
+            m_output.insert(m_output.end(), m_pending.begin(), m_pending.end());
+            m_pending.clear();
+            m_dropping = false;
+            m_silentFrames = 0;
+            Keep();
+        }
+        else if (m_silentFrames < m_hangoverFrames)
+        {
+            m_silentFrames++;
+            Keep();
+        }
+        else
+        {
+            // Holds the silence back until it is known to be a short pause or a long silence.
+            m_silentFrames++;
+            m_pending.insert(m_pending.end(), m_frame.begin(), m_frame.end());
+            if (!m_dropping && m_silentFrames - m_hangoverFrames > m_pauseFrames)
+            {
+                m_dropping = true;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_cuts++;
+            }
+            // Of a long silence, only the last frames are held back, for the lead-in.
+            auto leadInBytes = (size_t)m_leadInFrames * m_frameBytes;
+            if (m_dropping && m_pending.size() > leadInBytes)
+            {
+                m_pending.erase(m_pending.begin(), m_pending.end() - leadInBytes);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_originalBytes += m_frameBytes;
+    }
+
+    void Keep()
+    {
+        m_output.insert(m_output.end(), m_frame.begin(), m_frame.end());
+    }
+
+    void FlushOutput()
+    {
+        if (m_output.empty())
+        {
+            return;
+        }
+        m_pushStream->Write(m_output.data(), (uint32_t)m_output.size());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_trimmedBytes += m_output.size();
+        m_output.clear();
+    }
+
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> m_pushStream;
+    const WavFormat m_format;
+    const VoiceActivityDetector m_detector;
+    uint32_t m_frameBytes;
+    uint32_t m_hangoverFrames;
+    uint32_t m_leadInFrames;
+    uint32_t m_pauseFrames;             // silent frames after the hangover that still make a short pause.
+
+    // Used by the writing thread only.
+    std::vector<uint8_t> m_frame;
+    uint32_t m_frameFill = 0;
+    std::vector<uint8_t> m_pending;     // the silence held back after the hangover.
+    std::vector<uint8_t> m_output;      // the audio kept during one Write() call.
+    uint32_t m_silentFrames;
+    bool m_dropping = false;
+
+    mutable std::mutex m_mutex;
+    std::vector<Segment> m_segments;
+    uint64_t m_originalBytes = 0;       // of the whole frames processed.
+    uint64_t m_trimmedBytes = 0;
+    size_t m_cuts = 0;
+};
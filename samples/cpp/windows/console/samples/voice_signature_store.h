@@ -0,0 +1,207 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Keeps the voice signatures of conversation participants by user id, so that recurring attendees are only
+// enrolled through the signature REST API once. With a file name, the signatures are loaded from and appended
+// to a text file, one "<user id><TAB><signature>" line per signature, and the last line of a user wins.
+// It is thread safe.
+class VoiceSignatureStore final
+{
+public:
+    // Constructor for a store kept in memory only.
+    VoiceSignatureStore()
+    {
+    }
+
+    // Constructor that loads the signatures saved by earlier runs, and opens the file to append to it.
+    VoiceSignatureStore(const std::string& fileName)
+    {
+        std::ifstream existing(fileName);
+        std::string line;
+        while (getline(existing, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            auto tab = line.find('\t');
+            if (tab == std::string::npos || tab == 0 || tab + 1 == line.size())
+            {
+                // A line cut short by a crash while it was written.
+                continue;
+            }
+            m_signatures[line.substr(0, tab)] = line.substr(tab + 1);
+        }
+
+        m_file.open(fileName, std::ios::app);
+        if (!m_file.good())
+        {
+            throw std::invalid_argument("Failed to open " + fileName);
+        }
+    }
+
+    VoiceSignatureStore(const VoiceSignatureStore&) = delete;
+    VoiceSignatureStore& operator=(const VoiceSignatureStore&) = delete;
+
+    // Gets the signature of a user, returns false if there is none.
+    bool Find(const std::string& userId, std::string& signature) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_signatures.find(userId);
+        if (it == m_signatures.end())
+        {
+            return false;
+        }
+        signature = it->second;
+        return true;
+    }
+
+    // Adds or replaces the signature of a user, the JSON returned by the signature REST API.
+    void Add(const std::string& userId, const std::string& signature)
+    {
+        if (userId.empty() || userId.find_first_of("\t\r\n") != std::string::npos)
+        {
+            throw std::invalid_argument("Invalid user id: " + userId);
+        }
+
+        auto compact = Compact(signature);
+        if (compact.empty())
+        {
+            throw std::invalid_argument("Empty voice signature for " + userId);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_signatures[userId] = compact;
+        if (m_file.is_open())
+        {
+            m_file << userId << '\t' << compact << std::endl;
+        }
+    }
+
+    // Gets the signature of a user, or calls 'fetch' to get it, e.g. from the signature REST API, and adds it.
+    std::string GetOrFetch(const std::string& userId, const std::function<std::string()>& fetch)
+    {
+        std::string signature;
+        if (Find(userId, signature))
+        {
+            return signature;
+        }
+
+        signature = fetch();
+        Add(userId, signature);
+        return Compact(signature);
+    }
+
+    // Gets the number of signatures.
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_signatures.size();
+    }
+
+private:
+    // Collapses the line breaks and indentation of a signature onto one line. The values of a signature, its
+    // version, tag and base64 data, contain no whitespace, so only the formatting of the JSON changes.
+    static std::string Compact(const std::string& signature)
+    {
+        std::string compact;
+        bool space = false;
+        for (auto c : signature)
+        {
+            if (isspace((unsigned char)c))
+            {
+                space = true;
+                continue;
+            }
+            if (space && !compact.empty())
+            {
+                compact += ' ';
+            }
+            space = false;
+            compact += c;
+        }
+        return compact;
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::string> m_signatures;
+    std::ofstream m_file;
+};
+
+// A participant to add to a conversation.
+struct ConversationParticipant
+{
+    std::string UserId;
+    std::string PreferredLanguage;
+};
+
+// The outcome of adding the participants of a conversation.
+struct ParticipantLoadResult
+{
+    // The participants added.
+    std::vector<std::shared_ptr<Microsoft::CognitiveServices::Speech::Transcription::Participant>> Participants;
+    // One error per participant that couldn't be added.
+    std::vector<std::string> Errors;
+    double WallSeconds = 0;
+};
+
+// Adds all the participants of a conversation at once, with their voice signatures from a store. All the
+// AddParticipantAsync() requests are started before waiting for any of them, so that the startup of a conversation
+// takes about one round trip instead of one per attendee. 'fetch' is called for users without a stored signature.
+inline ParticipantLoadResult AddParticipants(std::shared_ptr<Microsoft::CognitiveServices::Speech::Transcription::Conversation> conversation,
+    const std::vector<ConversationParticipant>& participants, VoiceSignatureStore& store,
+    const std::function<std::string(const std::string& userId)>& fetch)
+{
+    using namespace Microsoft::CognitiveServices::Speech::Transcription;
+
+    ParticipantLoadResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::future<std::shared_ptr<Participant>>> pending;
+    std::vector<size_t> pendingIndices;
+    for (size_t i = 0; i < participants.size(); i++)
+    {
+        const auto& participant = participants[i];
+        try
+        {
+            auto signature = store.GetOrFetch(participant.UserId, [&fetch, &participant]() { return fetch(participant.UserId); });
+            pending.push_back(conversation->AddParticipantAsync(Participant::From(participant.UserId, participant.PreferredLanguage, signature)));
+            pendingIndices.push_back(i);
+        }
+        catch (const std::exception& e)
+        {
+            result.Errors.push_back(participant.UserId + ": " + e.what());
+        }
+    }
+
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        try
+        {
+            result.Participants.push_back(pending[i].get());
+        }
+        catch (const std::exception& e)
+        {
+            result.Errors.push_back(participants[pendingIndices[i]].UserId + ": " + e.what());
+        }
+    }
+
+    result.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
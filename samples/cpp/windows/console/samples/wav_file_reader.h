@@ -5,7 +5,72 @@
 #pragma once
 
 #include <speechapi_cxx.h>
+#include <algorithm>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
+
+// The format structure expected in wav files.
+struct WavFormat
+{
+    uint16_t FormatTag;        // format type.
+    uint16_t Channels;         // number of channels (i.e. mono, stereo...).
+    uint32_t SamplesPerSec;    // sample rate.
+    uint32_t AvgBytesPerSec;   // for buffer estimation.
+    uint16_t BlockAlign;       // block size of data.
+    uint16_t BitsPerSample;    // Number of bits per sample of mono data.
+};
+static_assert(sizeof(WavFormat) == 16, "unexpected size of WavFormat");
+
+// Creates an audio stream format that matches the PCM format parsed from a wav file header.
+// The format is validated up front, so that an unsupported file fails here instead of after a round trip to the service.
+inline std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat> CreateAudioStreamFormat(const WavFormat& format)
+{
+    // Defines the format tags of PCM data.
+    constexpr uint16_t formatTagPcm = 0x0001;
+    constexpr uint16_t formatTagExtensible = 0xFFFE;
+
+    if (format.FormatTag != formatTagPcm && format.FormatTag != formatTagExtensible)
+    {
+        throw std::invalid_argument("Unsupported wav format, only PCM audio data is supported.");
+    }
+    if (format.Channels == 0 || format.Channels > 8)
+    {
+        throw std::invalid_argument("Unsupported wav format, the number of channels must be between 1 and 8.");
+    }
+    if (format.BitsPerSample != 8 && format.BitsPerSample != 16 && format.BitsPerSample != 32)
+    {
+        throw std::invalid_argument("Unsupported wav format, bits per sample must be 8, 16 or 32.");
+    }
+    if (format.SamplesPerSec < 8000 || format.SamplesPerSec > 48000)
+    {
+        throw std::invalid_argument("Unsupported wav format, the sample rate must be between 8 kHz and 48 kHz.");
+    }
+    if (format.BlockAlign != format.Channels * format.BitsPerSample / 8)
+    {
+        throw std::invalid_argument("Invalid wav format, block align does not match channels and bits per sample.");
+    }
+
+    return Microsoft::CognitiveServices::Speech::Audio::AudioStreamFormat::GetWaveFormatPCM(
+        format.SamplesPerSec, (uint8_t)format.BitsPerSample, (uint8_t)format.Channels);
+}
+
+// Converts an offset in the audio data from bytes to ticks of 100 ns, the unit of the result offsets, and back,
+// rounded down to a whole frame. Both avoid the overflow of the product for hours of audio.
+inline uint64_t AudioBytesToTicks(uint64_t bytes, const WavFormat& format)
+{
+    constexpr uint64_t ticksPerSecond = 10000000;
+    return format.AvgBytesPerSec > 0
+        ? bytes / format.AvgBytesPerSec * ticksPerSecond + bytes % format.AvgBytesPerSec * ticksPerSecond / format.AvgBytesPerSec
+        : 0;
+}
+
+inline uint64_t AudioTicksToBytes(uint64_t ticks, const WavFormat& format)
+{
+    constexpr uint64_t ticksPerSecond = 10000000;
+    auto bytes = ticks / ticksPerSecond * format.AvgBytesPerSec + ticks % ticksPerSecond * format.AvgBytesPerSec / ticksPerSecond;
+    return format.BlockAlign > 0 ? bytes - bytes % format.BlockAlign : bytes;
+}
 
 // Helper functions
 class WavFileReader final
@@ -50,6 +115,35 @@ public:
         m_fs.close();
     }
 
+    // Gets the audio format parsed from the file header.
+    const WavFormat& GetFormat() const
+    {
+        return m_formatHeader;
+    }
+
+    // Gets the size of the audio data in bytes, as the header of its chunk gives it.
+    uint32_t GetDataSize() const
+    {
+        return m_dataSize;
+    }
+
+    // Continues reading at 'offset' bytes into the audio data, rounded down to a whole frame so that the samples
+    // of all channels stay aligned. Returns the offset it continues at.
+    uint64_t SeekAudio(uint64_t offset)
+    {
+        auto blockAlign = m_formatHeader.BlockAlign > 0 ? m_formatHeader.BlockAlign : 1;
+        auto aligned = (std::min)(offset, (uint64_t)m_dataSize);
+        aligned -= aligned % blockAlign;
+
+        m_fs.clear();
+        m_fs.seekg(m_dataStart + (std::streamoff)aligned, std::ios_base::beg);
+        if (!m_fs.good())
+        {
+            throw std::runtime_error("Failed to seek in the audio file.");
+        }
+        return aligned;
+    }
+
 private:
     // Defines common constants for WAV format.
     static constexpr uint16_t tagBufferSize = 4;
@@ -104,6 +198,8 @@ private:
                 else if (memcmp(chunkType, "data", chunkTypeBufferSize) == 0)
                 {
                     foundDataChunk = true;
+                    m_dataStart = m_fs.tellg();
+                    m_dataSize = chunkSize;
                     break;
                 }
                 else
@@ -145,18 +241,12 @@ private:
             (uint32_t)chunkSizeBuffer[0];
     }
 
-    // The format structure expected in wav files.
-    struct WAVEFORMAT
-    {
-        uint16_t FormatTag;        // format type.
-        uint16_t Channels;         // number of channels (i.e. mono, stereo...).
-        uint32_t SamplesPerSec;    // sample rate.
-        uint32_t AvgBytesPerSec;   // for buffer estimation.
-        uint16_t BlockAlign;       // block size of data.
-        uint16_t BitsPerSample;    // Number of bits per sample of mono data.
-    } m_formatHeader;
-    static_assert(sizeof(m_formatHeader) == 16, "unexpected size of m_formatHeader");
+    WavFormat m_formatHeader;
 
 private:
     std::fstream m_fs;
+
+    // Where the audio data starts in the file, and its size.
+    std::streampos m_dataStart = 0;
+    uint32_t m_dataSize = 0;
 };
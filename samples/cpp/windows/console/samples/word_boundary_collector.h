@@ -0,0 +1,176 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Collects the word boundaries of a synthesis for captioning, with as little work as possible on the SDK's callback thread.
+// The offsets and lengths are appended into preallocated parallel arrays, without locking or formatting anything.
+// The SDK raises the events of a synthesizer one at a time, so there is a single writer. The boundaries are read,
+// and written out as a binary or a WebVTT file, once the synthesis has completed.
+class WordBoundaryCollector final
+{
+public:
+    // Constructor that preallocates room for 'capacity' boundaries. More boundaries are still collected,
+    // at the cost of growing the arrays on the callback thread.
+    WordBoundaryCollector(size_t capacity = 4096)
+        : m_audioOffsets(capacity), m_textOffsets(capacity), m_wordLengths(capacity)
+    {
+    }
+
+    WordBoundaryCollector(const WordBoundaryCollector&) = delete;
+    WordBoundaryCollector& operator=(const WordBoundaryCollector&) = delete;
+
+    // Estimates the number of boundaries of 'characters' characters of text, as a capacity hint.
+    // It assumes an average of 5 characters per word, including the separator.
+    static size_t EstimateCapacity(size_t characters)
+    {
+        constexpr size_t charactersPerWord = 5;
+        return characters / charactersPerWord + 16;
+    }
+
+    // Appends a boundary. Only called by the single writer, the WordBoundary handler of one synthesizer.
+    void Append(uint64_t audioOffset, uint32_t textOffset, uint32_t wordLength)
+    {
+        auto index = m_count.load(std::memory_order_relaxed);
+        if (index == m_audioOffsets.size())
+        {
+            Grow();
+        }
+        m_audioOffsets[index] = audioOffset;
+        m_textOffsets[index] = textOffset;
+        m_wordLengths[index] = wordLength;
+
+        // Publishes the boundary after its values.
+        m_count.store(index + 1, std::memory_order_release);
+    }
+
+    // Forgets the collected boundaries, keeping the arrays for the next synthesis.
+    void Clear()
+    {
+        m_count.store(0, std::memory_order_release);
+        m_grown = 0;
+    }
+
+    // Gets the number of collected boundaries.
+    size_t Size() const
+    {
+        return m_count.load(std::memory_order_acquire);
+    }
+
+    // Gets the number of times the arrays were grown since the last Clear(), zero if the capacity was large enough.
+    uint32_t GetGrowCount() const
+    {
+        return m_grown;
+    }
+
+    // Gets the collected arrays, valid for the first Size() entries. Audio offsets are in ticks of 100 nanoseconds.
+    const uint64_t* GetAudioOffsets() const { return m_audioOffsets.data(); }
+    const uint32_t* GetTextOffsets() const { return m_textOffsets.data(); }
+    const uint32_t* GetWordLengths() const { return m_wordLengths.data(); }
+
+    // Writes the boundaries in a compact binary format: the magic "SPXWBND1", the count as a little-endian 64-bit value,
+    // then the arrays one after the other, the audio offsets as 64-bit values, the text offsets and the word lengths as 32-bit values.
+    // All the values are in the byte order of the machine, which is little-endian on all the supported platforms.
+    void SaveToBinaryFile(const std::string& fileName) const
+    {
+        std::ofstream file(fileName, std::ios::binary);
+        uint64_t count = Size();
+        file.write("SPXWBND1", 8);
+        file.write((const char*)&count, sizeof(count));
+        file.write((const char*)m_audioOffsets.data(), count * sizeof(uint64_t));
+        file.write((const char*)m_textOffsets.data(), count * sizeof(uint32_t));
+        file.write((const char*)m_wordLengths.data(), count * sizeof(uint32_t));
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write " + fileName);
+        }
+    }
+
+    // Writes the boundaries as WebVTT captions of 'text', the text that was synthesized. Words are grouped into cues
+    // of up to 'maxCueCharacters' characters, also ending a cue after a sentence. A cue lasts until the next cue starts,
+    // the last cue lasts 'lastCueTicks'.
+    void SaveToWebVttFile(const std::string& fileName, const std::string& text,
+        size_t maxCueCharacters = 42, uint64_t lastCueTicks = 20000000) const
+    {
+        std::ofstream file(fileName, std::ios::binary);
+        file << "WEBVTT\n";
+
+        auto count = Size();
+        size_t first = 0;
+        while (first < count)
+        {
+            // Extends the cue word by word, up to the end of a sentence or the character limit.
+            auto cueStart = m_textOffsets[first];
+            auto last = first;
+            while (last + 1 < count && !EndsSentence(text, last))
+            {
+                auto cueEnd = m_textOffsets[last + 1] + m_wordLengths[last + 1];
+                if (cueEnd - cueStart > maxCueCharacters)
+                {
+                    break;
+                }
+                last++;
+            }
+
+            auto start = m_audioOffsets[first];
+            auto end = last + 1 < count ? m_audioOffsets[last + 1] : m_audioOffsets[last] + lastCueTicks;
+            auto cueEnd = (size_t)m_textOffsets[last] + m_wordLengths[last];
+            file << "\n" << FormatTimestamp(start) << " --> " << FormatTimestamp(end) << "\n";
+            if (cueStart < text.size())
+            {
+                file << text.substr(cueStart, cueEnd - cueStart) << "\n";
+            }
+            first = last + 1;
+        }
+
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write " + fileName);
+        }
+    }
+
+private:
+    void Grow()
+    {
+        auto capacity = m_audioOffsets.size() * 2 + 16;
+        m_audioOffsets.resize(capacity);
+        m_textOffsets.resize(capacity);
+        m_wordLengths.resize(capacity);
+        m_grown++;
+    }
+
+    // Checks whether the word at 'index' is followed by sentence punctuation in 'text'.
+    bool EndsSentence(const std::string& text, size_t index) const
+    {
+        size_t end = (size_t)m_textOffsets[index] + m_wordLengths[index];
+        return end < text.size() && (text[end] == '.' || text[end] == '!' || text[end] == '?');
+    }
+
+    // Formats ticks of 100 nanoseconds as a WebVTT timestamp, "hh:mm:ss.ttt".
+    static std::string FormatTimestamp(uint64_t ticks)
+    {
+        auto milliseconds = ticks / 10000;
+        char timestamp[32];
+        snprintf(timestamp, sizeof(timestamp), "%02llu:%02llu:%02llu.%03llu",
+            (unsigned long long)(milliseconds / 3600000), (unsigned long long)(milliseconds / 60000 % 60),
+            (unsigned long long)(milliseconds / 1000 % 60), (unsigned long long)(milliseconds % 1000));
+        return timestamp;
+    }
+
+    std::vector<uint64_t> m_audioOffsets;
+    std::vector<uint32_t> m_textOffsets;
+    std::vector<uint32_t> m_wordLengths;
+    std::atomic<size_t> m_count{ 0 };
+    uint32_t m_grown = 0;
+};
@@ -0,0 +1,136 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run submitted tasks.
+// The number of queued tasks is bounded: Submit() blocks while the queue is full, so that a producer that
+// enumerates tens of thousands of jobs never holds more than 'queueCapacity' of them in memory.
+class WorkerPool final
+{
+public:
+    // Constructor that starts 'threadCount' workers. At most 'threadCount' tasks are in flight at any time.
+    WorkerPool(uint32_t threadCount, uint32_t queueCapacity)
+        : m_queueCapacity(queueCapacity)
+    {
+        if (threadCount == 0 || queueCapacity == 0)
+        {
+            throw std::invalid_argument("Thread count and queue capacity must be positive");
+        }
+
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            m_threads.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    // Destructor that runs the queued tasks to completion and joins the workers.
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_taskAvailable.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Queues a task, and blocks while the queue is full.
+    void Submit(std::function<void()> task)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_spaceAvailable.wait(lock, [this]() { return m_tasks.size() < m_queueCapacity; });
+        m_tasks.push_back(std::move(task));
+        lock.unlock();
+        m_taskAvailable.notify_one();
+    }
+
+    // Queues a task unless the queue is full, for producers that must not block, e.g. the threads of SDK events.
+    // Returns false if the task was not queued.
+    bool TrySubmit(std::function<void()> task)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_tasks.size() >= m_queueCapacity)
+        {
+            return false;
+        }
+        m_tasks.push_back(std::move(task));
+        lock.unlock();
+        m_taskAvailable.notify_one();
+        return true;
+    }
+
+    // Blocks until all queued and running tasks have completed.
+    void WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_tasks.empty() && m_running == 0; });
+    }
+
+    // Gets the number of worker threads.
+    uint32_t GetThreadCount() const
+    {
+        return (uint32_t)m_threads.size();
+    }
+
+private:
+    void WorkerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_taskAvailable.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+                m_running++;
+            }
+            m_spaceAvailable.notify_one();
+
+            // A failing task must not take the worker down with it, tasks report their own errors.
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_running--;
+            }
+            m_idle.notify_all();
+        }
+    }
+
+    const size_t m_queueCapacity;
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    uint32_t m_running = 0;
+    bool m_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_spaceAvailable;
+    std::condition_variable m_idle;
+};
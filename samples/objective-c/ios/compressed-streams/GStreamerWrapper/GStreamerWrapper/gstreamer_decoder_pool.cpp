@@ -0,0 +1,337 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// gstreamer_decoder_pool.cpp
+//
+
+#include "gstreamer_decoder_pool.h"
+#include "gstreamer_modules.h"
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
+#include <algorithm>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Impl {
+
+namespace {
+
+// The part of each pipeline between the source and the conversion to the PCM format of the recognizer, only using the
+// elements of the plugins registered by spx_gst_init().
+const char* DecoderElements(DecoderContainerFormat format) {
+    switch (format) {
+    case DecoderContainerFormat::OGG_OPUS: return "oggdemux ! opusparse ! opusdec";
+    case DecoderContainerFormat::MP3: return "mpegaudioparse ! mpg123audiodec";
+    case DecoderContainerFormat::FLAC: return "flacparse ! flacdec";
+    case DecoderContainerFormat::ALAW: return "wavparse ! alawdec";
+    case DecoderContainerFormat::MULAW: return "wavparse ! mulawdec";
+    }
+    throw std::invalid_argument("Unsupported container format: " + std::to_string(static_cast<int>(format)));
+}
+
+uint64_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+std::chrono::nanoseconds ThreadCpuTime() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+}
+
+} // namespace
+
+DecoderPipeline::DecoderPipeline(DecoderContainerFormat format)
+    : m_format(format) {
+    // Without queues, everything downstream of the source runs on its streaming thread, which the probes account for.
+    std::string description = std::string("appsrc name=source format=bytes block=true max-bytes=65536 ! ") + DecoderElements(format) +
+        " ! audioconvert ! audioresample ! audio/x-raw,format=S16LE,layout=interleaved,rate=16000,channels=1"
+        " ! appsink name=sink sync=false max-buffers=64";
+
+    GError* error = nullptr;
+    m_pipeline = gst_parse_launch(description.c_str(), &error);
+    if (m_pipeline == nullptr || error != nullptr) {
+        std::string message = error != nullptr ? error->message : "unknown error";
+        g_clear_error(&error);
+        if (m_pipeline != nullptr) {
+            gst_object_unref(m_pipeline);
+        }
+        throw std::runtime_error("The decoder pipeline could not be built: " + message);
+    }
+    m_source = gst_bin_get_by_name(GST_BIN(m_pipeline), "source");
+    m_sink = gst_bin_get_by_name(GST_BIN(m_pipeline), "sink");
+    m_bus = gst_element_get_bus(m_pipeline);
+
+    GstPad* sourcePad = gst_element_get_static_pad(m_source, "src");
+    gst_pad_add_probe(sourcePad, GST_PAD_PROBE_TYPE_BUFFER, &DecoderPipeline::OnStreamingProbe, this, nullptr);
+    gst_object_unref(sourcePad);
+
+    // The decoders drain on the end of the stream, so the CPU time is accounted once more when it reaches the sink.
+    GstPad* sinkPad = gst_element_get_static_pad(m_sink, "sink");
+    gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, &DecoderPipeline::OnStreamingProbe, this, nullptr);
+    gst_object_unref(sinkPad);
+
+    if (gst_element_set_state(m_pipeline, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        Release();
+        throw std::runtime_error("The decoder pipeline could not be set ready");
+    }
+}
+
+DecoderPipeline::~DecoderPipeline() {
+    Release();
+}
+
+void DecoderPipeline::Release() {
+    if (m_sample != nullptr) {
+        gst_sample_unref(m_sample);
+        m_sample = nullptr;
+    }
+    if (m_pipeline != nullptr) {
+        gst_element_set_state(m_pipeline, GST_STATE_NULL);
+        gst_object_unref(m_bus);
+        gst_object_unref(m_sink);
+        gst_object_unref(m_source);
+        gst_object_unref(m_pipeline);
+        m_pipeline = nullptr;
+    }
+}
+
+bool DecoderPipeline::Push(const uint8_t* data, size_t size) {
+    CheckBus();
+    if (m_failed) {
+        return false;
+    }
+    if (size == 0) {
+        return true;
+    }
+
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    gst_buffer_fill(buffer, 0, data, size);
+
+    // Takes the buffer, and blocks while the source holds max-bytes that are not decoded yet.
+    if (gst_app_src_push_buffer(GST_APP_SRC(m_source), buffer) != GST_FLOW_OK) {
+        m_failed = true;
+        return false;
+    }
+    m_bytesIn += size;
+    return true;
+}
+
+void DecoderPipeline::EndOfStream() {
+    gst_app_src_end_of_stream(GST_APP_SRC(m_source));
+}
+
+size_t DecoderPipeline::Read(uint8_t* buffer, size_t size) {
+    while (size > 0 && !m_ended && !m_failed) {
+        if (m_sample == nullptr) {
+            // Waits a bit at a time, so that an error, after which no sample nor end of stream comes, is noticed.
+            m_sample = gst_app_sink_try_pull_sample(GST_APP_SINK(m_sink), 100 * GST_MSECOND);
+            if (m_sample == nullptr) {
+                m_ended = gst_app_sink_is_eos(GST_APP_SINK(m_sink));
+                CheckBus();
+                continue;
+            }
+            m_sampleOffset = 0;
+        }
+
+        GstBuffer* decoded = gst_sample_get_buffer(m_sample);
+        size_t available = decoded != nullptr ? gst_buffer_get_size(decoded) - m_sampleOffset : 0;
+        size_t count = (std::min)(size, available);
+        if (count > 0) {
+            gst_buffer_extract(decoded, m_sampleOffset, buffer, count);
+            m_sampleOffset += count;
+        }
+        if (count == available) {
+            gst_sample_unref(m_sample);
+            m_sample = nullptr;
+        }
+        if (count > 0) {
+            m_bytesOut += count;
+            return count;
+        }
+    }
+    return 0;
+}
+
+void DecoderPipeline::Play() {
+    if (gst_element_set_state(m_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        m_failed = true;
+        throw std::runtime_error("The decoder pipeline could not be started");
+    }
+}
+
+void DecoderPipeline::Reset() {
+    // Going back to READY stops the streaming thread and flushes all the elements, including the end of stream of the
+    // source and the sink, and the state of the demuxers, parsers and decoders.
+    if (gst_element_set_state(m_pipeline, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE ||
+        gst_element_get_state(m_pipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_FAILURE) {
+        m_failed = true;
+    }
+    if (m_sample != nullptr) {
+        gst_sample_unref(m_sample);
+        m_sample = nullptr;
+    }
+    gst_bus_set_flushing(m_bus, TRUE);
+    gst_bus_set_flushing(m_bus, FALSE);
+
+    m_sampleOffset = 0;
+    m_ended = false;
+    m_bytesIn = 0;
+    m_bytesOut = 0;
+}
+
+void DecoderPipeline::CheckBus() {
+    GstMessage* message = gst_bus_pop_filtered(m_bus, GST_MESSAGE_ERROR);
+    if (message != nullptr) {
+        m_failed = true;
+        gst_message_unref(message);
+    }
+}
+
+GstPadProbeReturn DecoderPipeline::OnStreamingProbe(GstPad*, GstPadProbeInfo* info, gpointer self) {
+    if ((GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) != 0 &&
+        GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // Accounts the CPU time the streaming thread spent since the last buffer left the source, decoding that buffer.
+    auto pipeline = static_cast<DecoderPipeline*>(self);
+    auto now = ThreadCpuTime();
+    std::lock_guard<std::mutex> lock(pipeline->m_cpuMutex);
+    if (pipeline->m_cpuThread == std::this_thread::get_id()) {
+        pipeline->m_decodeCpu += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - pipeline->m_lastCpu).count());
+    }
+    pipeline->m_cpuThread = std::this_thread::get_id();
+    pipeline->m_lastCpu = now;
+    return GST_PAD_PROBE_OK;
+}
+
+uint64_t DecoderPipeline::TakeDecodeCpuTime() {
+    std::lock_guard<std::mutex> lock(m_cpuMutex);
+    auto decodeCpu = m_decodeCpu;
+    m_decodeCpu = 0;
+    m_cpuThread = std::thread::id();
+    return decodeCpu;
+}
+
+DecoderPipelinePool::Lease::Lease(DecoderPipelinePool* pool, std::unique_ptr<DecoderPipeline> pipeline)
+    : m_pool(pool), m_pipeline(std::move(pipeline)) {
+}
+
+DecoderPipelinePool::Lease::Lease(Lease&& other) noexcept
+    : m_pool(other.m_pool), m_pipeline(std::move(other.m_pipeline)) {
+}
+
+DecoderPipelinePool::Lease::~Lease() {
+    if (m_pipeline != nullptr) {
+        m_pool->Return(std::move(m_pipeline));
+    }
+}
+
+DecoderPipelinePool::DecoderPipelinePool(size_t maxIdlePerFormat)
+    : m_maxIdlePerFormat(maxIdlePerFormat) {
+    auto start = std::chrono::steady_clock::now();
+    if (spx_gst_init_once()) {
+        m_statistics.InitTime = MicrosecondsSince(start);
+    }
+}
+
+void DecoderPipelinePool::Prewarm(DecoderContainerFormat format, size_t count) {
+    size_t missing;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto idle = m_idle[format].size();
+        missing = count > idle ? count - idle : 0;
+    }
+
+    // Builds outside the lock, so that the streams acquiring pipelines meanwhile do not wait.
+    std::vector<std::unique_ptr<DecoderPipeline>> built;
+    for (size_t i = 0; i < missing; i++) {
+        built.push_back(Build(format));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& idle = m_idle[format];
+    for (auto& pipeline : built) {
+        idle.push_back(std::move(pipeline));
+    }
+}
+
+DecoderPipelinePool::Lease DecoderPipelinePool::Acquire(DecoderContainerFormat format) {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<DecoderPipeline> pipeline;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& idle = m_idle[format];
+        if (!idle.empty()) {
+            pipeline = std::move(idle.back());
+            idle.pop_back();
+            m_statistics.WarmAcquires++;
+        }
+        else {
+            m_statistics.ColdAcquires++;
+        }
+    }
+    if (pipeline == nullptr) {
+        pipeline = Build(format);
+    }
+
+    pipeline->Play();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_statistics.AcquireTime += MicrosecondsSince(start);
+    return Lease(this, std::move(pipeline));
+}
+
+DecoderPoolStatistics DecoderPipelinePool::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+std::unique_ptr<DecoderPipeline> DecoderPipelinePool::Build(DecoderContainerFormat format) {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<DecoderPipeline> pipeline(new DecoderPipeline(format));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_statistics.PipelinesBuilt++;
+    m_statistics.BuildTime += MicrosecondsSince(start);
+    return pipeline;
+}
+
+void DecoderPipelinePool::Return(std::unique_ptr<DecoderPipeline> pipeline) {
+    auto bytesIn = pipeline->m_bytesIn;
+    auto bytesOut = pipeline->m_bytesOut;
+
+    // Resets outside the lock, it waits for the streaming thread to stop.
+    auto start = std::chrono::steady_clock::now();
+    pipeline->Reset();
+    auto resetTime = MicrosecondsSince(start);
+
+    // Reads the CPU time after the reset, once the streaming thread has stopped accounting it.
+    auto decodeCpu = pipeline->TakeDecodeCpuTime();
+
+    std::unique_ptr<DecoderPipeline> discarded;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_statistics.BytesIn += bytesIn;
+    m_statistics.BytesOut += bytesOut;
+    m_statistics.DecodeCpuTime += decodeCpu;
+    m_statistics.ResetTime += resetTime;
+
+    // A pipeline that failed is not reused, as its elements may be left in any state.
+    auto& idle = m_idle[pipeline->GetFormat()];
+    if (!pipeline->Failed() && idle.size() < m_maxIdlePerFormat) {
+        idle.push_back(std::move(pipeline));
+    }
+    else {
+        discarded = std::move(pipeline);
+    }
+}
+
+} } } } // Microsoft::CognitiveServices::Speech::Impl
@@ -0,0 +1,152 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// gstreamer_decoder_pool.h
+//
+
+#pragma once
+
+#include <gst/gst.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Impl {
+
+// The compressed container formats, with the values of the SDK's AudioStreamContainerFormat, so that either converts to the other.
+enum class DecoderContainerFormat : int {
+    OGG_OPUS = 0x101,
+    MP3 = 0x102,
+    FLAC = 0x103,
+    ALAW = 0x104,
+    MULAW = 0x105
+};
+
+// Counters of a decoder pipeline pool, times in microseconds.
+struct DecoderPoolStatistics {
+    uint64_t InitTime = 0;          // GStreamer initialization and plugin registration, once per process.
+    uint64_t PipelinesBuilt = 0;
+    uint64_t BuildTime = 0;         // building pipelines, whether ahead of time or on demand.
+    uint64_t WarmAcquires = 0;      // streams that got a pre-built pipeline.
+    uint64_t ColdAcquires = 0;      // streams that had to wait for a pipeline to be built.
+    uint64_t AcquireTime = 0;       // from asking for a pipeline to it playing, what the streams wait for.
+    uint64_t ResetTime = 0;         // resetting pipelines between streams.
+    uint64_t DecodeCpuTime = 0;     // CPU time of the streaming threads, which parse, decode and convert.
+    uint64_t BytesIn = 0;
+    uint64_t BytesOut = 0;
+};
+
+// A pipeline that decodes one compressed stream to 16 kHz 16-bit mono PCM: its owner pushes the compressed bytes and reads the PCM.
+// It is built once and reused for many streams, reset to the READY state between them.
+class __attribute__((visibility ("default"))) DecoderPipeline final {
+public:
+    explicit DecoderPipeline(DecoderContainerFormat format);
+    ~DecoderPipeline();
+
+    DecoderPipeline(const DecoderPipeline&) = delete;
+    DecoderPipeline& operator=(const DecoderPipeline&) = delete;
+
+    // Pushes compressed bytes. Returns false if the pipeline no longer accepts data, e.g. after a decoding error.
+    bool Push(const uint8_t* data, size_t size);
+
+    // Ends the compressed stream, so that Read() returns 0 once the rest is decoded.
+    void EndOfStream();
+
+    // Copies up to 'size' bytes of decoded PCM to 'buffer', waiting for them if none is available.
+    // Returns 0 at the end of the stream or after an error.
+    size_t Read(uint8_t* buffer, size_t size);
+
+    // Gets whether the pipeline reported an error, in which case it is not reused.
+    bool Failed() const { return m_failed; }
+
+    DecoderContainerFormat GetFormat() const { return m_format; }
+
+private:
+    friend class DecoderPipelinePool;
+
+    void Play();
+    void Reset();
+    void Release();
+    void CheckBus();
+    uint64_t TakeDecodeCpuTime();
+    static GstPadProbeReturn OnStreamingProbe(GstPad* pad, GstPadProbeInfo* info, gpointer self);
+
+    const DecoderContainerFormat m_format;
+    GstElement* m_pipeline = nullptr;
+    GstElement* m_source = nullptr;
+    GstElement* m_sink = nullptr;
+    GstBus* m_bus = nullptr;
+
+    // The sample being read, and how much of it has been.
+    GstSample* m_sample = nullptr;
+    size_t m_sampleOffset = 0;
+    bool m_ended = false;
+    bool m_failed = false;
+
+    // Accounting of the stream in progress, updated by the streaming thread for the CPU time.
+    std::mutex m_cpuMutex;
+    std::thread::id m_cpuThread;
+    std::chrono::nanoseconds m_lastCpu{};
+    uint64_t m_decodeCpu = 0;
+    uint64_t m_bytesIn = 0;
+    uint64_t m_bytesOut = 0;
+};
+
+// A pool of pre-built decoder pipelines per container format.
+// GStreamer is initialized once, pipelines are built ahead of time with Prewarm() or on demand, and a stream's pipeline
+// goes back to the pool when its lease ends, so that the next stream of the same format only has to set it playing.
+class __attribute__((visibility ("default"))) DecoderPipelinePool final {
+public:
+    // A pipeline leased for one stream; it is reset and returned to the pool when the lease is destroyed.
+    class Lease final {
+    public:
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease();
+
+        DecoderPipeline* operator->() const { return m_pipeline.get(); }
+        DecoderPipeline& operator*() const { return *m_pipeline; }
+
+    private:
+        friend class DecoderPipelinePool;
+        Lease(DecoderPipelinePool* pool, std::unique_ptr<DecoderPipeline> pipeline);
+
+        DecoderPipelinePool* m_pool;
+        std::unique_ptr<DecoderPipeline> m_pipeline;
+    };
+
+    // Keeps up to 'maxIdlePerFormat' idle pipelines of each format; the pipelines returned beyond that are destroyed.
+    explicit DecoderPipelinePool(size_t maxIdlePerFormat = 2);
+
+    DecoderPipelinePool(const DecoderPipelinePool&) = delete;
+    DecoderPipelinePool& operator=(const DecoderPipelinePool&) = delete;
+
+    // Builds pipelines until 'count' of the format are idle, e.g. at startup, before the first stream needs one.
+    void Prewarm(DecoderContainerFormat format, size_t count);
+
+    // Gets a playing pipeline for a new stream, pre-built if one is idle, else built now.
+    Lease Acquire(DecoderContainerFormat format);
+
+    DecoderPoolStatistics GetStatistics() const;
+
+private:
+    std::unique_ptr<DecoderPipeline> Build(DecoderContainerFormat format);
+    void Return(std::unique_ptr<DecoderPipeline> pipeline);
+
+    const size_t m_maxIdlePerFormat;
+    mutable std::mutex m_mutex;
+    std::map<DecoderContainerFormat, std::vector<std::unique_ptr<DecoderPipeline>>> m_idle;
+    DecoderPoolStatistics m_statistics;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Impl
@@ -7,6 +7,10 @@
 
 #include "gstreamer_modules.h"
 
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
 namespace Microsoft {
 namespace CognitiveServices {
 namespace Speech {
@@ -30,4 +34,20 @@ void spx_gst_init() {
 #endif
 }
 
+bool spx_gst_init_once() {
+    static std::once_flag once;
+    bool initialized = false;
+    std::call_once(once, [&initialized]() {
+        GError* error = nullptr;
+        if (!gst_init_check(nullptr, nullptr, &error)) {
+            std::string message = error != nullptr ? error->message : "unknown error";
+            g_clear_error(&error);
+            throw std::runtime_error("GStreamer could not be initialized: " + message);
+        }
+        spx_gst_init();
+        initialized = true;
+    });
+    return initialized;
+}
+
 } } } } // Microsoft::CognitiveServices::Speech::Impl
@@ -45,4 +45,8 @@ namespace Impl {
 
 __attribute__((visibility ("default"))) void spx_gst_init();
 
+// Initializes GStreamer and registers the plugins above, on the first call only.
+// Returns true for the call that did the initialization, and throws if GStreamer cannot be initialized.
+__attribute__((visibility ("default"))) bool spx_gst_init_once();
+
 } } } } // Microsoft::CognitiveServices::Speech::Impl